@@ -0,0 +1,314 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "Bvh.h"
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+    enum BoundsArray {
+        MinX,
+        MinY,
+        MinZ,
+        MaxX,
+        MaxY,
+        MaxZ
+    };
+
+    constexpr unsigned allPlanes = 0x3fu;
+
+    // Bit i is set when point i of the four lies on the negative side of the plane.
+    unsigned below4(const float *x, const float *y, const float *z, const float *normal, float distance) {
+#ifdef __SSE2__
+        __m128 result = _mm_mul_ps(_mm_loadu_ps(x), _mm_set1_ps(normal[0]));
+        result = _mm_add_ps(result, _mm_mul_ps(_mm_loadu_ps(y), _mm_set1_ps(normal[1])));
+        result = _mm_add_ps(result, _mm_mul_ps(_mm_loadu_ps(z), _mm_set1_ps(normal[2])));
+        result = _mm_add_ps(result, _mm_set1_ps(distance));
+        return static_cast<unsigned>(_mm_movemask_ps(_mm_cmplt_ps(result, _mm_setzero_ps())));
+#else
+        unsigned mask = 0;
+        for (int i = 0; i < 4; ++i) {
+            if (x[i] * normal[0] + y[i] * normal[1] + z[i] * normal[2] + distance < 0.0f) {
+                mask |= 1u << i;
+            }
+        }
+        return mask;
+#endif
+    }
+
+    int bitCount(unsigned mask) {
+        return __builtin_popcount(mask);
+    }
+}
+
+Bvh::Bvh() :
+        mMinX(),
+        mMinY(),
+        mMinZ(),
+        mMaxX(),
+        mMaxY(),
+        mMaxZ(),
+        mOrder(),
+        mLeafBounds(),
+        mNodes(),
+        mPlanes(),
+        mStack(),
+        mLastFrame(),
+        mTotal(),
+        mFrames(0) {
+}
+
+void Bvh::resize(std::size_t count) {
+    mMinX.resize(count);
+    mMinY.resize(count);
+    mMinZ.resize(count);
+    mMaxX.resize(count);
+    mMaxY.resize(count);
+    mMaxZ.resize(count);
+}
+
+void Bvh::setBounds(std::size_t index, const QVector3D &min, const QVector3D &max) {
+    mMinX[index] = min.x();
+    mMinY[index] = min.y();
+    mMinZ[index] = min.z();
+    mMaxX[index] = max.x();
+    mMaxY[index] = max.y();
+    mMaxZ[index] = max.z();
+}
+
+void Bvh::build() {
+    const auto count = static_cast<std::uint32_t>(size());
+    mOrder.resize(count);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        mOrder[i] = i;
+    }
+    mNodes.clear();
+    if (count > 0) {
+        buildNode(0, count);
+    }
+    refit();
+}
+
+int Bvh::buildNode(std::uint32_t first, std::uint32_t count) {
+    const int index = static_cast<int>(mNodes.size());
+    mNodes.emplace_back();
+
+    const std::uint32_t half = split(first, count);
+    const std::uint32_t quarter = split(first, half);
+    const std::uint32_t threeQuarters = split(first + half, count - half);
+    const std::uint32_t firsts[width] = {first, first + quarter, first + half, first + half + threeQuarters};
+    const std::uint32_t counts[width] = {quarter, half - quarter, threeQuarters, count - half - threeQuarters};
+
+    for (int slot = 0; slot < width; ++slot) {
+        int child = -1;
+        if (counts[slot] > leafSize) {
+            child = buildNode(firsts[slot], counts[slot]);
+        }
+        Node &node = mNodes[index];
+        node.child[slot] = child;
+        node.first[slot] = firsts[slot];
+        node.count[slot] = counts[slot];
+    }
+    return index;
+}
+
+std::uint32_t Bvh::split(std::uint32_t first, std::uint32_t count) {
+    if (count < 2) {
+        return count;
+    }
+    const auto begin = mOrder.begin() + first;
+    const auto end = begin + count;
+    float min[3] = {mMinX[*begin] + mMaxX[*begin], mMinY[*begin] + mMaxY[*begin], mMinZ[*begin] + mMaxZ[*begin]};
+    float max[3] = {min[0], min[1], min[2]};
+    for (auto it = begin; it != end; ++it) {
+        const float centre[3] = {mMinX[*it] + mMaxX[*it], mMinY[*it] + mMaxY[*it], mMinZ[*it] + mMaxZ[*it]};
+        for (int axis = 0; axis < 3; ++axis) {
+            min[axis] = std::min(min[axis], centre[axis]);
+            max[axis] = std::max(max[axis], centre[axis]);
+        }
+    }
+    int axis = 0;
+    for (int candidate = 1; candidate < 3; ++candidate) {
+        if (max[candidate] - min[candidate] > max[axis] - min[axis]) {
+            axis = candidate;
+        }
+    }
+    const std::vector<float> *mins[3] = {&mMinX, &mMinY, &mMinZ};
+    const std::vector<float> *maxs[3] = {&mMaxX, &mMaxY, &mMaxZ};
+    const std::vector<float> &axisMin = *mins[axis];
+    const std::vector<float> &axisMax = *maxs[axis];
+    const std::uint32_t half = count / 2;
+    std::nth_element(begin, begin + half, end, [&axisMin, &axisMax](std::uint32_t a, std::uint32_t b) {
+        const float centreA = axisMin[a] + axisMax[a];
+        const float centreB = axisMin[b] + axisMax[b];
+        return centreA < centreB || (centreA == centreB && a < b);
+    });
+    return half;
+}
+
+void Bvh::refit() {
+    const std::size_t count = mOrder.size();
+    const std::vector<float> *sources[6] = {&mMinX, &mMinY, &mMinZ, &mMaxX, &mMaxY, &mMaxZ};
+    for (int array = 0; array < 6; ++array) {
+        // Padded so leaf tests can always load four values.
+        mLeafBounds[array].assign(count + width - 1, 0.0f);
+        for (std::size_t i = 0; i < count; ++i) {
+            mLeafBounds[array][i] = (*sources[array])[mOrder[i]];
+        }
+    }
+
+    // Children are always created after their parent, so walking backwards sees them first.
+    for (auto node = mNodes.rbegin(); node != mNodes.rend(); ++node) {
+        for (int slot = 0; slot < width; ++slot) {
+            float min[3] = {0.0f, 0.0f, 0.0f};
+            float max[3] = {0.0f, 0.0f, 0.0f};
+            if (node->count[slot] > 0) {
+                childBounds(*node, slot, min, max);
+            }
+            node->minX[slot] = min[0];
+            node->minY[slot] = min[1];
+            node->minZ[slot] = min[2];
+            node->maxX[slot] = max[0];
+            node->maxY[slot] = max[1];
+            node->maxZ[slot] = max[2];
+        }
+    }
+}
+
+void Bvh::childBounds(const Node &node, int slot, float *min, float *max) const {
+    if (node.child[slot] >= 0) {
+        const Node &child = mNodes[node.child[slot]];
+        bool first = true;
+        for (int i = 0; i < width; ++i) {
+            if (child.count[i] == 0) {
+                continue;
+            }
+            const float childMin[3] = {child.minX[i], child.minY[i], child.minZ[i]};
+            const float childMax[3] = {child.maxX[i], child.maxY[i], child.maxZ[i]};
+            for (int axis = 0; axis < 3; ++axis) {
+                min[axis] = first ? childMin[axis] : std::min(min[axis], childMin[axis]);
+                max[axis] = first ? childMax[axis] : std::max(max[axis], childMax[axis]);
+            }
+            first = false;
+        }
+        return;
+    }
+    const std::uint32_t begin = node.first[slot];
+    const std::uint32_t end = begin + node.count[slot];
+    for (int axis = 0; axis < 3; ++axis) {
+        const std::vector<float> &mins = mLeafBounds[MinX + axis];
+        const std::vector<float> &maxs = mLeafBounds[MaxX + axis];
+        min[axis] = *std::min_element(mins.cbegin() + begin, mins.cbegin() + end);
+        max[axis] = *std::max_element(maxs.cbegin() + begin, maxs.cbegin() + end);
+    }
+}
+
+void Bvh::cull(const QMatrix4x4 &projView, std::vector<std::uint32_t> &visible) {
+    visible.clear();
+    Statistics frame {};
+
+    // Gribb-Hartmann: each clip plane is the last row of the matrix plus or minus another row.
+    const float *m = projView.constData();
+    for (int i = 0; i < 6; ++i) {
+        const int row = i / 2;
+        const float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+        Plane &plane = mPlanes[i];
+        plane.normal[0] = m[3] + sign * m[row];
+        plane.normal[1] = m[7] + sign * m[4 + row];
+        plane.normal[2] = m[11] + sign * m[8 + row];
+        plane.distance = m[15] + sign * m[12 + row];
+    }
+
+    mStack.clear();
+    if (!mNodes.empty()) {
+        mStack.push_back(Entry {0, allPlanes});
+    }
+    while (!mStack.empty()) {
+        const Entry entry = mStack.back();
+        mStack.pop_back();
+        const Node &node = mNodes[entry.node];
+        ++frame.nodesVisited;
+
+        unsigned used = 0;
+        for (int slot = 0; slot < width; ++slot) {
+            used |= node.count[slot] > 0 ? 1u << slot : 0u;
+        }
+        unsigned outside = 0;
+        unsigned childPlanes[width] = {entry.planes, entry.planes, entry.planes, entry.planes};
+        for (int i = 0; i < 6; ++i) {
+            if ((entry.planes & (1u << i)) == 0) {
+                continue;
+            }
+            const Plane &plane = mPlanes[i];
+            // The corner furthest along the normal decides "outside", the nearest one "inside".
+            const bool px = plane.normal[0] >= 0.0f;
+            const bool py = plane.normal[1] >= 0.0f;
+            const bool pz = plane.normal[2] >= 0.0f;
+            outside |= below4(px ? node.maxX : node.minX, py ? node.maxY : node.minY, pz ? node.maxZ : node.minZ,
+                              plane.normal, plane.distance);
+            const unsigned crossing = below4(px ? node.minX : node.maxX, py ? node.minY : node.maxY,
+                                             pz ? node.minZ : node.maxZ, plane.normal, plane.distance);
+            for (int slot = 0; slot < width; ++slot) {
+                if ((crossing & (1u << slot)) == 0) {
+                    childPlanes[slot] &= ~(1u << i);
+                }
+            }
+            frame.boxTests += bitCount(used);
+        }
+
+        const unsigned survivors = used & ~outside;
+        for (int slot = 0; slot < width; ++slot) {
+            if ((survivors & (1u << slot)) == 0) {
+                continue;
+            }
+            if (childPlanes[slot] == 0) {
+                accept(node.first[slot], node.count[slot], visible);
+            } else if (node.child[slot] >= 0) {
+                mStack.push_back(Entry {node.child[slot], childPlanes[slot]});
+            } else {
+                frame.boxTests += static_cast<int>(node.count[slot]) * bitCount(childPlanes[slot]);
+                cullLeaf(node.first[slot], node.count[slot], childPlanes[slot], visible);
+            }
+        }
+    }
+
+    frame.visible = static_cast<int>(visible.size());
+    frame.culled = static_cast<int>(size()) - frame.visible;
+    mLastFrame = frame;
+    mTotal.nodesVisited += frame.nodesVisited;
+    mTotal.boxTests += frame.boxTests;
+    mTotal.visible += frame.visible;
+    mTotal.culled += frame.culled;
+    ++mFrames;
+}
+
+void Bvh::cullLeaf(std::uint32_t first, std::uint32_t count, unsigned planes, std::vector<std::uint32_t> &visible) {
+    for (std::uint32_t base = first; base < first + count; base += width) {
+        const std::uint32_t lanes = std::min<std::uint32_t>(width, first + count - base);
+        unsigned outside = 0;
+        for (int i = 0; i < 6; ++i) {
+            if ((planes & (1u << i)) == 0) {
+                continue;
+            }
+            const Plane &plane = mPlanes[i];
+            const BoundsArray x = plane.normal[0] >= 0.0f ? MaxX : MinX;
+            const BoundsArray y = plane.normal[1] >= 0.0f ? MaxY : MinY;
+            const BoundsArray z = plane.normal[2] >= 0.0f ? MaxZ : MinZ;
+            outside |= below4(mLeafBounds[x].data() + base, mLeafBounds[y].data() + base, mLeafBounds[z].data() + base,
+                              plane.normal, plane.distance);
+        }
+        for (std::uint32_t lane = 0; lane < lanes; ++lane) {
+            if ((outside & (1u << lane)) == 0) {
+                visible.push_back(mOrder[base + lane]);
+            }
+        }
+    }
+}
+
+void Bvh::accept(std::uint32_t first, std::uint32_t count, std::vector<std::uint32_t> &visible) const {
+    visible.insert(visible.end(), mOrder.cbegin() + first, mOrder.cbegin() + first + count);
+}
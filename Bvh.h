@@ -0,0 +1,88 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_BVH_H
+#define GLTUT2_BVH_H
+
+#include <cstdint>
+#include <vector>
+#include <QMatrix4x4>
+#include <QVector3D>
+
+// Four-wide bounding volume hierarchy over axis-aligned object bounds. Nodes keep the bounds
+// of their four children as structure of arrays, so one frustum plane is tested against all
+// four children at once; subtrees found fully inside the frustum are accepted without tests.
+// build() rebuilds the topology, refit() only recomputes bounds after objects have moved.
+class Bvh {
+public:
+    struct Statistics {
+        int nodesVisited;
+        int boxTests;
+        int visible;
+        int culled;
+    };
+
+    Bvh();
+
+    void resize(std::size_t count);
+    std::size_t size() const { return mMinX.size(); }
+    void setBounds(std::size_t index, const QVector3D &min, const QVector3D &max);
+    void build();
+    void refit();
+
+    void cull(const QMatrix4x4 &projView, std::vector<std::uint32_t> &visible);
+
+    const Statistics &lastFrame() const { return mLastFrame; }
+    const Statistics &total() const { return mTotal; }
+    int frames() const { return mFrames; }
+
+private:
+    static constexpr int width = 4;
+    static constexpr std::uint32_t leafSize = 8;
+
+    struct Node {
+        float minX[width];
+        float minY[width];
+        float minZ[width];
+        float maxX[width];
+        float maxY[width];
+        float maxZ[width];
+        int child[width];
+        std::uint32_t first[width];
+        std::uint32_t count[width];
+    };
+
+    struct Plane {
+        float normal[3];
+        float distance;
+    };
+
+    struct Entry {
+        int node;
+        unsigned planes;
+    };
+
+    int buildNode(std::uint32_t first, std::uint32_t count);
+    std::uint32_t split(std::uint32_t first, std::uint32_t count);
+    void childBounds(const Node &node, int slot, float *min, float *max) const;
+    void cullLeaf(std::uint32_t first, std::uint32_t count, unsigned planes, std::vector<std::uint32_t> &visible);
+    void accept(std::uint32_t first, std::uint32_t count, std::vector<std::uint32_t> &visible) const;
+
+    std::vector<float> mMinX;
+    std::vector<float> mMinY;
+    std::vector<float> mMinZ;
+    std::vector<float> mMaxX;
+    std::vector<float> mMaxY;
+    std::vector<float> mMaxZ;
+    std::vector<std::uint32_t> mOrder;
+    std::vector<float> mLeafBounds[6];
+    std::vector<Node> mNodes;
+    Plane mPlanes[6];
+    std::vector<Entry> mStack;
+    Statistics mLastFrame;
+    Statistics mTotal;
+    int mFrames;
+};
+
+#endif //GLTUT2_BVH_H
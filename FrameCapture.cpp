@@ -0,0 +1,377 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "FrameCapture.h"
+#include <algorithm>
+#include <functional>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QOpenGLFunctions_4_5_Core>
+#include <QThread>
+
+namespace {
+    constexpr GLbitfield storageFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    constexpr GLuint64 drainTimeoutNs = 1000000000;
+    constexpr int bytesPerPixel = 4;
+
+    class EncoderThread : public QThread {
+    public:
+        explicit EncoderThread(std::function<void()> loop) : mLoop(std::move(loop)) {}
+
+    protected:
+        void run() override { mLoop(); }
+
+    private:
+        const std::function<void()> mLoop;
+    };
+
+    // BT.601 studio range, in 8.8 fixed point.
+    uchar lumaOf(int r, int g, int b) {
+        return static_cast<uchar>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    }
+
+    uchar blueDifferenceOf(int r, int g, int b) {
+        return static_cast<uchar>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    }
+
+    uchar redDifferenceOf(int r, int g, int b) {
+        return static_cast<uchar>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+}
+
+FrameCapture::FrameCapture(int ringSize, int frameRate) :
+        mPath(),
+        mFormat(Png),
+        mFrameRate(std::max(frameRate, 1)),
+        mFunctions(nullptr),
+        mSlots(static_cast<std::size_t>(std::max(ringSize, 2))),
+        mNext(0),
+        mOldest(0),
+        mSize(),
+        mResolveFramebuffer(0),
+        mResolveRenderbuffer(0),
+        mFrames(0),
+        mCaptured(0),
+        mSkipped(0),
+        mCaptureNs(0),
+        mEncoder(nullptr),
+        mQueueMutex(),
+        mQueueCondition(),
+        mQueue(),
+        mStop(false),
+        mVideo(),
+        mVideoSize(),
+        mPlanes(),
+        mEncoded(0),
+        mDropped(0),
+        mEncodeNs(0),
+        mBytes(0) {
+    for (Slot &slot : mSlots) {
+        slot.buffer = 0;
+        slot.data = nullptr;
+        slot.fence = nullptr;
+        slot.frame = 0;
+        slot.state.store(Free, std::memory_order_relaxed);
+    }
+}
+
+FrameCapture::~FrameCapture() {
+    stopEncoder();
+}
+
+void FrameCapture::setOutput(const QString &path) {
+    mPath = path;
+    mFormat = path.endsWith(QStringLiteral(".y4m"), Qt::CaseInsensitive) ? Y4m : Png;
+}
+
+void FrameCapture::initializeGpu(QOpenGLFunctions_4_5_Core *functions) {
+    if (mFunctions != nullptr || functions == nullptr || !isEnabled()) {
+        return;
+    }
+    if (mFormat == Png && !QDir().mkpath(mPath)) {
+        qWarning() << "Cannot create the capture directory" << mPath;
+        return;
+    }
+    if (mFormat == Y4m) {
+        mVideo.setFileName(mPath);
+        if (!mVideo.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning() << "Cannot open the capture video" << mPath << mVideo.errorString();
+            return;
+        }
+        mVideoSize = QSize();
+    }
+    mFunctions = functions;
+    mFunctions->glCreateFramebuffers(1, &mResolveFramebuffer);
+    startEncoder();
+}
+
+void FrameCapture::releaseGpu() {
+    if (mFunctions == nullptr) {
+        return;
+    }
+    collect(true);
+    stopEncoder();
+    free();
+    mFunctions->glDeleteFramebuffers(1, &mResolveFramebuffer);
+    mResolveFramebuffer = 0;
+    mFunctions = nullptr;
+    if (mVideo.isOpen()) {
+        mVideo.close();
+    }
+    qDebug() << "Captured" << mCaptured << "of" << mFrames << "frames," << mSkipped << "skipped,"
+             << static_cast<double>(mCaptureNs) / std::max<qint64>(mFrames, 1) / 1e6 << "ms per frame";
+}
+
+void FrameCapture::allocate(const QSize &size) {
+    // Buffers still being read or encoded hold frames of the old size; let them finish first.
+    collect(true);
+    stopEncoder();
+    free();
+    mSize = size;
+    const auto bufferSize = static_cast<GLsizeiptr>(size.width()) * size.height() * bytesPerPixel;
+    for (Slot &slot : mSlots) {
+        mFunctions->glCreateBuffers(1, &slot.buffer);
+        mFunctions->glNamedBufferStorage(slot.buffer, bufferSize, nullptr, storageFlags | GL_CLIENT_STORAGE_BIT);
+        slot.data = static_cast<const uchar *>(mFunctions->glMapNamedBufferRange(slot.buffer, 0, bufferSize, storageFlags));
+        slot.state.store(Free, std::memory_order_relaxed);
+    }
+    mFunctions->glCreateRenderbuffers(1, &mResolveRenderbuffer);
+    mFunctions->glNamedRenderbufferStorage(mResolveRenderbuffer, GL_RGBA8, size.width(), size.height());
+    mFunctions->glNamedFramebufferRenderbuffer(mResolveFramebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER,
+                                               mResolveRenderbuffer);
+    mNext = 0;
+    mOldest = 0;
+    startEncoder();
+}
+
+void FrameCapture::free() {
+    for (Slot &slot : mSlots) {
+        if (slot.fence != nullptr) {
+            mFunctions->glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+        if (slot.buffer != 0) {
+            mFunctions->glUnmapNamedBuffer(slot.buffer);
+            mFunctions->glDeleteBuffers(1, &slot.buffer);
+            slot.buffer = 0;
+            slot.data = nullptr;
+        }
+        slot.state.store(Free, std::memory_order_relaxed);
+    }
+    if (mResolveRenderbuffer != 0) {
+        mFunctions->glDeleteRenderbuffers(1, &mResolveRenderbuffer);
+        mResolveRenderbuffer = 0;
+    }
+    mSize = QSize();
+}
+
+void FrameCapture::capture(GLuint framebuffer, const QSize &size) {
+    if (Q_UNLIKELY(mFunctions == nullptr || size.isEmpty())) {
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    const qint64 frame = mFrames++;
+    if (Q_UNLIKELY(size != mSize)) {
+        allocate(size);
+    }
+    collect(false);
+
+    Slot &slot = mSlots[mNext];
+    if (slot.state.load(std::memory_order_acquire) != Free) {
+        ++mSkipped;
+        mCaptureNs += timer.nsecsElapsed();
+        return;
+    }
+    // Reading a multisampled framebuffer is an error, so resolve it first; the blit is queued
+    // like any draw, and so is the read into the pack buffer.
+    mFunctions->glBlitNamedFramebuffer(framebuffer, mResolveFramebuffer, 0, 0, size.width(), size.height(), 0, 0,
+                                       size.width(), size.height(), GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    mFunctions->glBindFramebuffer(GL_READ_FRAMEBUFFER, mResolveFramebuffer);
+    mFunctions->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    mFunctions->glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    mFunctions->glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    mFunctions->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    mFunctions->glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    slot.fence = mFunctions->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.frame = frame;
+    slot.state.store(Reading, std::memory_order_relaxed);
+    mNext = (mNext + 1) % static_cast<int>(mSlots.size());
+    ++mCaptured;
+    mCaptureNs += timer.nsecsElapsed();
+}
+
+// Hands finished reads to the encoder oldest first, so a video keeps its frame order. Reads are
+// issued in ring order, so the ones in flight always run from mOldest up to mNext.
+void FrameCapture::collect(bool wait) {
+    const auto slotCount = static_cast<int>(mSlots.size());
+    for (int i = 0; i < slotCount; ++i) {
+        Slot &slot = mSlots[mOldest];
+        if (slot.state.load(std::memory_order_relaxed) != Reading) {
+            break;
+        }
+        const GLenum status = mFunctions->glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                                           wait ? drainTimeoutNs : 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            break;
+        }
+        mFunctions->glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+        slot.state.store(Encoding, std::memory_order_relaxed);
+        {
+            const QMutexLocker locker(&mQueueMutex);
+            mQueue.push_back(Job{mOldest, slot.frame, mSize});
+        }
+        mQueueCondition.wakeOne();
+        mOldest = (mOldest + 1) % slotCount;
+    }
+}
+
+void FrameCapture::startEncoder() {
+    if (mEncoder != nullptr) {
+        return;
+    }
+    mStop = false;
+    mEncoder = new EncoderThread([this] { encoderLoop(); });
+    mEncoder->start(QThread::LowPriority);
+}
+
+void FrameCapture::stopEncoder() {
+    if (mEncoder == nullptr) {
+        return;
+    }
+    {
+        const QMutexLocker locker(&mQueueMutex);
+        mStop = true;
+    }
+    mQueueCondition.wakeOne();
+    mEncoder->wait();
+    delete mEncoder;
+    mEncoder = nullptr;
+}
+
+// Drains the queue before honoring a stop, so every frame that was read back gets written.
+void FrameCapture::encoderLoop() {
+    for (;;) {
+        Job job;
+        {
+            const QMutexLocker locker(&mQueueMutex);
+            while (mQueue.empty() && !mStop) {
+                mQueueCondition.wait(&mQueueMutex);
+            }
+            if (mQueue.empty()) {
+                return;
+            }
+            job = mQueue.front();
+            mQueue.pop_front();
+        }
+        QElapsedTimer timer;
+        timer.start();
+        if (encode(job)) {
+            mEncoded.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        mEncodeNs.fetch_add(timer.nsecsElapsed(), std::memory_order_relaxed);
+        mSlots[job.slot].state.store(Free, std::memory_order_release);
+    }
+}
+
+bool FrameCapture::encode(const Job &job) {
+    const uchar *pixels = mSlots[job.slot].data;
+    return mFormat == Y4m ? writeY4m(job, pixels) : writePng(job, pixels);
+}
+
+bool FrameCapture::writePng(const Job &job, const uchar *pixels) {
+    // GL rows run bottom to top; mirrored() flips them into a copy the encoder owns.
+    const QImage image(pixels, job.size.width(), job.size.height(), job.size.width() * bytesPerPixel,
+                       QImage::Format_RGBA8888);
+    const QString &fileName = QStringLiteral("%1/frame-%2.png").arg(mPath).arg(job.frame, 6, 10, QLatin1Char('0'));
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || !image.mirrored().save(&file, "PNG")) {
+        qWarning() << "Cannot write captured frame" << fileName;
+        return false;
+    }
+    mBytes.fetch_add(file.size(), std::memory_order_relaxed);
+    return true;
+}
+
+// YUV4MPEG2 with 4:2:0 chroma; every frame must match the size in the stream header.
+bool FrameCapture::writeY4m(const Job &job, const uchar *pixels) {
+    const int width = job.size.width();
+    const int height = job.size.height();
+    if (!mVideoSize.isValid()) {
+        mVideoSize = job.size;
+        const QByteArray &header = QStringLiteral("YUV4MPEG2 W%1 H%2 F%3:1 Ip A1:1 C420jpeg\n")
+                .arg(width).arg(height).arg(mFrameRate).toLatin1();
+        if (mVideo.write(header) != header.size()) {
+            return false;
+        }
+        mBytes.fetch_add(header.size(), std::memory_order_relaxed);
+    } else if (job.size != mVideoSize) {
+        return false;
+    }
+
+    const int chromaWidth = (width + 1) / 2;
+    const int chromaHeight = (height + 1) / 2;
+    const std::size_t lumaSize = static_cast<std::size_t>(width) * height;
+    const std::size_t chromaSize = static_cast<std::size_t>(chromaWidth) * chromaHeight;
+    mPlanes.resize(lumaSize + 2 * chromaSize);
+    uchar *luma = mPlanes.data();
+    uchar *blue = luma + lumaSize;
+    uchar *red = blue + chromaSize;
+    for (int y = 0; y < height; ++y) {
+        const uchar *row = pixels + static_cast<std::size_t>(height - 1 - y) * width * bytesPerPixel;
+        for (int x = 0; x < width; ++x) {
+            luma[static_cast<std::size_t>(y) * width + x] = lumaOf(row[x * 4], row[x * 4 + 1], row[x * 4 + 2]);
+        }
+    }
+    // Chroma is taken from the average of each 2x2 block, clamped at odd edges.
+    for (int y = 0; y < chromaHeight; ++y) {
+        const int top = height - 1 - 2 * y;
+        const int bottom = std::max(top - 1, 0);
+        for (int x = 0; x < chromaWidth; ++x) {
+            const int left = 2 * x;
+            const int right = std::min(left + 1, width - 1);
+            int sum[3] = {0, 0, 0};
+            for (const int row : {top, bottom}) {
+                for (const int column : {left, right}) {
+                    const uchar *pixel = pixels + (static_cast<std::size_t>(row) * width + column) * bytesPerPixel;
+                    sum[0] += pixel[0];
+                    sum[1] += pixel[1];
+                    sum[2] += pixel[2];
+                }
+            }
+            const int r = (sum[0] + 2) / 4;
+            const int g = (sum[1] + 2) / 4;
+            const int b = (sum[2] + 2) / 4;
+            blue[static_cast<std::size_t>(y) * chromaWidth + x] = blueDifferenceOf(r, g, b);
+            red[static_cast<std::size_t>(y) * chromaWidth + x] = redDifferenceOf(r, g, b);
+        }
+    }
+    static const QByteArray frameHeader = QByteArrayLiteral("FRAME\n");
+    if (mVideo.write(frameHeader) != frameHeader.size()
+        || mVideo.write(reinterpret_cast<const char *>(mPlanes.data()), static_cast<qint64>(mPlanes.size()))
+           != static_cast<qint64>(mPlanes.size())) {
+        qWarning() << "Cannot write captured frame to" << mPath << mVideo.errorString();
+        return false;
+    }
+    mBytes.fetch_add(frameHeader.size() + static_cast<qint64>(mPlanes.size()), std::memory_order_relaxed);
+    return true;
+}
+
+FrameCapture::Statistics FrameCapture::statistics() const {
+    return Statistics{
+            mFrames,
+            mCaptured,
+            mSkipped,
+            mEncoded.load(std::memory_order_relaxed),
+            mDropped.load(std::memory_order_relaxed),
+            mCaptureNs,
+            mEncodeNs.load(std::memory_order_relaxed),
+            mBytes.load(std::memory_order_relaxed)
+    };
+}
@@ -0,0 +1,129 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_FRAMECAPTURE_H
+#define GLTUT2_FRAMECAPTURE_H
+
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <QFile>
+#include <QMutex>
+#include <QSize>
+#include <QString>
+#include <QWaitCondition>
+#include <QtGui/qopengl.h>
+
+class QOpenGLFunctions_4_5_Core;
+class QThread;
+
+// Records rendered frames without waiting for the GPU. capture() resolves the framebuffer into
+// a single-sample copy and starts an asynchronous glReadPixels into the next buffer of a ring of
+// persistently mapped pixel pack buffers, fenced with glFenceSync. Later calls hand every buffer
+// whose fence has signaled to an encoder thread, which reads the mapping in place and writes
+// either numbered PNG files into a directory or one raw Y4M (YUV 4:2:0) video. A buffer returns
+// to the ring once it is encoded; when the next one is still in use the frame is skipped, so a
+// slow encoder costs frames, never frame time.
+class FrameCapture {
+public:
+    enum Format {
+        Png,
+        Y4m
+    };
+
+    struct Statistics {
+        // Frames offered to capture(), and of those the ones read back, skipped for want of a
+        // free buffer, encoded and dropped by the encoder (size changes mid video, write errors).
+        qint64 frames;
+        qint64 captured;
+        qint64 skipped;
+        qint64 encoded;
+        qint64 dropped;
+        // Render thread time spent in capture(), encoder thread time and bytes written.
+        qint64 captureNs;
+        qint64 encodeNs;
+        qint64 bytes;
+    };
+
+    explicit FrameCapture(int ringSize = 4, int frameRate = 60);
+    ~FrameCapture();
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture &operator=(const FrameCapture &) = delete;
+
+    // A path ending in .y4m records a video, anything else is a directory for frame-NNNNNN.png.
+    // An empty path disables capture; set it before the context is created.
+    void setOutput(const QString &path);
+    bool isEnabled() const { return !mPath.isEmpty(); }
+    Format format() const { return mFormat; }
+
+    void initializeGpu(QOpenGLFunctions_4_5_Core *functions);
+    // Reads back and encodes every frame still in flight, then frees the buffers.
+    void releaseGpu();
+
+    // Call after the frame is rendered into framebuffer and before it is presented or released.
+    void capture(GLuint framebuffer, const QSize &size);
+
+    Statistics statistics() const;
+
+private:
+    enum SlotState {
+        Free,
+        Reading,
+        Encoding
+    };
+
+    struct Slot {
+        GLuint buffer;
+        const uchar *data;
+        GLsync fence;
+        qint64 frame;
+        std::atomic<int> state;
+    };
+
+    struct Job {
+        int slot;
+        qint64 frame;
+        QSize size;
+    };
+
+    void allocate(const QSize &size);
+    void free();
+    void collect(bool wait);
+    void startEncoder();
+    void stopEncoder();
+    void encoderLoop();
+    bool encode(const Job &job);
+    bool writePng(const Job &job, const uchar *pixels);
+    bool writeY4m(const Job &job, const uchar *pixels);
+
+    QString mPath;
+    Format mFormat;
+    const int mFrameRate;
+    QOpenGLFunctions_4_5_Core *mFunctions;
+    std::vector<Slot> mSlots;
+    int mNext;
+    int mOldest;
+    QSize mSize;
+    GLuint mResolveFramebuffer;
+    GLuint mResolveRenderbuffer;
+    qint64 mFrames;
+    qint64 mCaptured;
+    qint64 mSkipped;
+    qint64 mCaptureNs;
+
+    QThread *mEncoder;
+    QMutex mQueueMutex;
+    QWaitCondition mQueueCondition;
+    std::deque<Job> mQueue;
+    bool mStop;
+    QFile mVideo;
+    QSize mVideoSize;
+    std::vector<uchar> mPlanes;
+    std::atomic<qint64> mEncoded;
+    std::atomic<qint64> mDropped;
+    std::atomic<qint64> mEncodeNs;
+    std::atomic<qint64> mBytes;
+};
+
+#endif //GLTUT2_FRAMECAPTURE_H
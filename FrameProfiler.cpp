@@ -0,0 +1,180 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "FrameProfiler.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QOpenGLFunctions_4_5_Core>
+#include <QTextStream>
+
+FrameProfiler::FrameProfiler(std::size_t capacity) :
+        mEnabled(false),
+        mClock(),
+        mSamples(std::max<std::size_t>(capacity, 1)),
+        mNextSample(0),
+        mSampleCount(0),
+        mFrame(0),
+        mFrameHandle{-1, -1},
+        mFunctions(nullptr),
+        mFrameQueries(),
+        mCurrentQueries(nullptr),
+        mGpuToCpuOffsetNs(0) {
+    mClock.start();
+}
+
+void FrameProfiler::initializeGpu(QOpenGLFunctions_4_5_Core *functions) {
+    if (mFunctions != nullptr || functions == nullptr) {
+        return;
+    }
+    mFunctions = functions;
+    for (auto &frameQueries : mFrameQueries) {
+        for (auto &query : frameQueries.queries) {
+            mFunctions->glGenQueries(1, &query.begin);
+            mFunctions->glGenQueries(1, &query.end);
+        }
+        frameQueries.used = 0;
+    }
+    GLint64 gpuNow = 0;
+    mFunctions->glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    mGpuToCpuOffsetNs = nowNs() - gpuNow;
+}
+
+void FrameProfiler::releaseGpu() {
+    if (mFunctions == nullptr) {
+        return;
+    }
+    for (auto &frameQueries : mFrameQueries) {
+        for (auto &query : frameQueries.queries) {
+            mFunctions->glDeleteQueries(1, &query.begin);
+            mFunctions->glDeleteQueries(1, &query.end);
+        }
+        frameQueries.used = 0;
+    }
+    mFunctions = nullptr;
+    mCurrentQueries = nullptr;
+}
+
+void FrameProfiler::beginFrame() {
+    if (Q_LIKELY(!mEnabled)) {
+        return;
+    }
+    ++mFrame;
+    if (mFunctions != nullptr) {
+        mCurrentQueries = &mFrameQueries[mFrame % framesInFlight];
+        resolve(*mCurrentQueries);
+    }
+    mFrameHandle = beginScope("frame");
+}
+
+void FrameProfiler::endFrame() {
+    if (Q_UNLIKELY(mFrameHandle.sample >= 0)) {
+        endScope(mFrameHandle);
+        mFrameHandle = Handle{-1, -1};
+    }
+}
+
+FrameProfiler::Handle FrameProfiler::beginScope(const char *name) {
+    const auto sample = static_cast<int>(mNextSample);
+    mSamples[mNextSample] = Sample{name, mFrame, nowNs(), -1, -1, -1};
+    mNextSample = (mNextSample + 1) % mSamples.size();
+    mSampleCount = std::min(mSampleCount + 1, mSamples.size());
+
+    int query = -1;
+    if (mCurrentQueries != nullptr && mCurrentQueries->used < maxQueriesPerFrame) {
+        query = mCurrentQueries->used++;
+        PendingQuery &pending = mCurrentQueries->queries[query];
+        pending.sample = sample;
+        pending.frame = mFrame;
+        mFunctions->glQueryCounter(pending.begin, GL_TIMESTAMP);
+    }
+    return Handle{sample, query};
+}
+
+void FrameProfiler::endScope(const Handle &handle) {
+    Sample &sample = mSamples[handle.sample];
+    sample.cpuDurationNs = nowNs() - sample.cpuStartNs;
+    if (handle.query >= 0 && mCurrentQueries != nullptr) {
+        mFunctions->glQueryCounter(mCurrentQueries->queries[handle.query].end, GL_TIMESTAMP);
+    }
+}
+
+void FrameProfiler::resolve(FrameQueries &frameQueries) {
+    for (int i = 0; i < frameQueries.used; ++i) {
+        const PendingQuery &pending = frameQueries.queries[i];
+        GLint available = GL_FALSE;
+        mFunctions->glGetQueryObjectiv(pending.end, GL_QUERY_RESULT_AVAILABLE, &available);
+        Sample &sample = mSamples[pending.sample];
+        if (available == GL_FALSE || sample.frame != pending.frame) {
+            continue;
+        }
+        GLuint64 begin = 0;
+        GLuint64 end = 0;
+        mFunctions->glGetQueryObjectui64v(pending.begin, GL_QUERY_RESULT, &begin);
+        mFunctions->glGetQueryObjectui64v(pending.end, GL_QUERY_RESULT, &end);
+        sample.gpuStartNs = static_cast<qint64>(begin) + mGpuToCpuOffsetNs;
+        sample.gpuDurationNs = static_cast<qint64>(end - begin);
+    }
+    frameQueries.used = 0;
+}
+
+std::vector<FrameProfiler::Sample> FrameProfiler::samples() const {
+    std::vector<Sample> result;
+    result.reserve(mSampleCount);
+    const std::size_t first = (mNextSample + mSamples.size() - mSampleCount) % mSamples.size();
+    for (std::size_t i = 0; i < mSampleCount; ++i) {
+        result.push_back(mSamples[(first + i) % mSamples.size()]);
+    }
+    return result;
+}
+
+bool FrameProfiler::writeCsv(const QString &fileName) const {
+    QFile file(fileName);
+    if (Q_UNLIKELY(!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))) {
+        return false;
+    }
+    QTextStream out(&file);
+    out << "frame,phase,cpu_start_ns,cpu_ns,gpu_start_ns,gpu_ns\n";
+    for (const auto &sample : samples()) {
+        out << sample.frame << ',' << sample.name << ','
+            << sample.cpuStartNs << ',' << sample.cpuDurationNs << ','
+            << sample.gpuStartNs << ',' << sample.gpuDurationNs << '\n';
+    }
+    return out.status() == QTextStream::Ok;
+}
+
+bool FrameProfiler::writeChromeTrace(const QString &fileName) const {
+    QFile file(fileName);
+    if (Q_UNLIKELY(!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))) {
+        return false;
+    }
+    QTextStream out(&file);
+    out.setRealNumberNotation(QTextStream::FixedNotation);
+    out.setRealNumberPrecision(3);
+    out << "{\"traceEvents\":[\n"
+        << R"({"name":"thread_name","ph":"M","pid":1,"tid":1,"args":{"name":"CPU"}},)" << '\n'
+        << R"({"name":"thread_name","ph":"M","pid":1,"tid":2,"args":{"name":"GPU"}})";
+    const auto writeEvent = [&out](const Sample &sample, int tid, qint64 startNs, qint64 durationNs) {
+        out << ",\n{\"name\":\"" << sample.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+            << ",\"ts\":" << static_cast<double>(startNs) / 1e3
+            << ",\"dur\":" << static_cast<double>(durationNs) / 1e3
+            << ",\"args\":{\"frame\":" << sample.frame << "}}";
+    };
+    for (const auto &sample : samples()) {
+        if (sample.cpuDurationNs >= 0) {
+            writeEvent(sample, 1, sample.cpuStartNs, sample.cpuDurationNs);
+        }
+        if (sample.gpuDurationNs >= 0) {
+            writeEvent(sample, 2, sample.gpuStartNs, sample.gpuDurationNs);
+        }
+    }
+    out << "\n]}\n";
+    return out.status() == QTextStream::Ok;
+}
+
+bool FrameProfiler::write(const QString &fileName) const {
+    if (QFileInfo(fileName).suffix().compare(QStringLiteral("json"), Qt::CaseInsensitive) == 0) {
+        return writeChromeTrace(fileName);
+    }
+    return writeCsv(fileName);
+}
@@ -0,0 +1,103 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_FRAMEPROFILER_H
+#define GLTUT2_FRAMEPROFILER_H
+
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <QElapsedTimer>
+#include <QtGui/qopengl.h>
+
+class QOpenGLFunctions_4_5_Core;
+class QString;
+
+class FrameProfiler {
+public:
+    struct Sample {
+        const char *name;
+        quint64 frame;
+        qint64 cpuStartNs;
+        qint64 cpuDurationNs;
+        qint64 gpuStartNs;
+        qint64 gpuDurationNs;
+    };
+
+    struct Handle {
+        int sample;
+        int query;
+    };
+
+    class Scope {
+    public:
+        Scope(FrameProfiler &profiler, const char *name) : mProfiler(profiler), mHandle{-1, -1} {
+            if (Q_UNLIKELY(profiler.isEnabled())) {
+                mHandle = profiler.beginScope(name);
+            }
+        }
+        ~Scope() {
+            if (Q_UNLIKELY(mHandle.sample >= 0)) {
+                mProfiler.endScope(mHandle);
+            }
+        }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        FrameProfiler &mProfiler;
+        Handle mHandle;
+    };
+
+    explicit FrameProfiler(std::size_t capacity = 16384);
+
+    void setEnabled(bool enabled) { mEnabled = enabled; }
+    bool isEnabled() const { return mEnabled; }
+
+    void initializeGpu(QOpenGLFunctions_4_5_Core *functions);
+    void releaseGpu();
+
+    void beginFrame();
+    void endFrame();
+    Handle beginScope(const char *name);
+    void endScope(const Handle &handle);
+
+    qint64 nowNs() const { return mClock.nsecsElapsed(); }
+    std::vector<Sample> samples() const;
+    bool writeCsv(const QString &fileName) const;
+    bool writeChromeTrace(const QString &fileName) const;
+    bool write(const QString &fileName) const;
+
+private:
+    static constexpr int maxQueriesPerFrame = 64;
+    static constexpr int framesInFlight = 2;
+
+    struct PendingQuery {
+        GLuint begin;
+        GLuint end;
+        int sample;
+        quint64 frame;
+    };
+
+    struct FrameQueries {
+        std::array<PendingQuery, maxQueriesPerFrame> queries;
+        int used;
+    };
+
+    void resolve(FrameQueries &frameQueries);
+
+    bool mEnabled;
+    QElapsedTimer mClock;
+    std::vector<Sample> mSamples;
+    std::size_t mNextSample;
+    std::size_t mSampleCount;
+    quint64 mFrame;
+    Handle mFrameHandle;
+    QOpenGLFunctions_4_5_Core *mFunctions;
+    std::array<FrameQueries, framesInFlight> mFrameQueries;
+    FrameQueries *mCurrentQueries;
+    qint64 mGpuToCpuOffsetNs;
+};
+
+#endif //GLTUT2_FRAMEPROFILER_H
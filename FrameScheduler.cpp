@@ -0,0 +1,113 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "FrameScheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <QDebug>
+#include <QThread>
+
+namespace {
+    // Sleeps overshoot by up to about a millisecond, so the last stretch is spun.
+    constexpr qint64 spinNs = 1500000;
+    constexpr qint64 lateDivisor = 5;
+
+    qint64 intervalNs(double framesPerSecond) {
+        return framesPerSecond > 0.0 ? static_cast<qint64>(std::llround(1e9 / framesPerSecond)) : 0;
+    }
+}
+
+double FrameScheduler::Statistics::averageIntervalMs() const {
+    return intervals == 0 ? 0.0 : static_cast<double>(intervalNs) / intervals / 1e6;
+}
+
+double FrameScheduler::Statistics::jitterMs() const {
+    if (intervals == 0) {
+        return 0.0;
+    }
+    const double average = averageIntervalMs();
+    return std::sqrt(std::max(intervalSquaredMs / intervals - average * average, 0.0));
+}
+
+FrameScheduler::FrameScheduler() :
+        mClock(),
+        mFrameRateCap(0.0),
+        mVsync(true),
+        mRefreshRate(60.0),
+        mIntervalNs(0),
+        mDeadlineNs(intervalNs(60.0)),
+        mFrameStartNs(0),
+        mNextFrameNs(0),
+        mStatistics{0, 0, 0, 0, 0.0, 0, 0, 0} {
+    mClock.start();
+}
+
+void FrameScheduler::setFrameRateCap(double framesPerSecond) {
+    mFrameRateCap = std::max(framesPerSecond, 0.0);
+    updateDeadline();
+}
+
+void FrameScheduler::setVsync(bool vsync, double refreshRate) {
+    mVsync = vsync;
+    if (refreshRate > 0.0) {
+        mRefreshRate = refreshRate;
+    }
+    updateDeadline();
+}
+
+void FrameScheduler::updateDeadline() {
+    mIntervalNs = intervalNs(mFrameRateCap);
+    mDeadlineNs = mIntervalNs > 0 ? mIntervalNs : (mVsync ? intervalNs(mRefreshRate) : 0);
+}
+
+qint64 FrameScheduler::remainingNs() const {
+    return mIntervalNs > 0 ? std::max<qint64>(mNextFrameNs - mClock.nsecsElapsed(), 0) : 0;
+}
+
+void FrameScheduler::waitForNextFrame() {
+    if (mIntervalNs <= 0) {
+        return;
+    }
+    qint64 now = mClock.nsecsElapsed();
+    const qint64 sleepUntil = mNextFrameNs - spinNs;
+    if (now < sleepUntil) {
+        QThread::usleep(static_cast<unsigned long>((sleepUntil - now) / 1000));
+        const qint64 woken = mClock.nsecsElapsed();
+        mStatistics.sleepNs += woken - now;
+        now = woken;
+    }
+    const qint64 spinStart = now;
+    while (now < mNextFrameNs) {
+        QThread::yieldCurrentThread();
+        now = mClock.nsecsElapsed();
+    }
+    mStatistics.spinNs += now - spinStart;
+}
+
+void FrameScheduler::beginFrame() {
+    const qint64 now = mClock.nsecsElapsed();
+    if (mStatistics.frames > 0) {
+        const qint64 deltaNs = now - mFrameStartNs;
+        ++mStatistics.intervals;
+        mStatistics.intervalNs += deltaNs;
+        const double deltaMs = static_cast<double>(deltaNs) / 1e6;
+        mStatistics.intervalSquaredMs += deltaMs * deltaMs;
+        mStatistics.maxIntervalNs = std::max(mStatistics.maxIntervalNs, deltaNs);
+        if (mDeadlineNs > 0 && deltaNs > mDeadlineNs + mDeadlineNs / lateDivisor) {
+            ++mStatistics.missed;
+        }
+    }
+    ++mStatistics.frames;
+    mFrameStartNs = now;
+    mNextFrameNs += mIntervalNs;
+    if (mNextFrameNs <= now) {
+        mNextFrameNs = now + mIntervalNs;
+    }
+}
+
+void FrameScheduler::logStatistics() const {
+    qDebug() << "Frame pacing:" << mStatistics.frames << "frames," << mStatistics.averageIntervalMs()
+             << "ms average interval," << mStatistics.jitterMs() << "ms jitter," << mStatistics.missed
+             << "missed deadlines";
+}
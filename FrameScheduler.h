@@ -0,0 +1,69 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_FRAMESCHEDULER_H
+#define GLTUT2_FRAMESCHEDULER_H
+
+#include <QElapsedTimer>
+
+// Paces frames on a monotonic nanosecond clock. beginFrame() stamps the frame and measures the
+// interval since the previous one; with a frame rate cap, waitForNextFrame() sleeps until 1.5 ms
+// before the next slot and spins the rest, so capped rates idle instead of burning a core yet
+// still start on time. Slots advance by whole intervals, and a frame that starts more than an
+// interval late restarts the schedule instead of rushing to catch up.
+// The deadline is the cap interval, or one refresh with vsync; an interval more than a fifth over
+// it counts as missed. Without either, frames run as fast as they can and nothing is missed.
+class FrameScheduler {
+public:
+    struct Statistics {
+        qint64 frames;
+        qint64 missed;
+        // Intervals between the starts of consecutive frames.
+        qint64 intervals;
+        qint64 intervalNs;
+        double intervalSquaredMs;
+        qint64 maxIntervalNs;
+        qint64 sleepNs;
+        qint64 spinNs;
+
+        double averageIntervalMs() const;
+        // Standard deviation of the frame intervals.
+        double jitterMs() const;
+    };
+
+    FrameScheduler();
+
+    // 0 for no cap. Set before rendering starts, like the rest of the configuration.
+    void setFrameRateCap(double framesPerSecond);
+    void setVsync(bool vsync, double refreshRate);
+    double frameRateCap() const { return mFrameRateCap; }
+    bool vsync() const { return mVsync; }
+
+    // Sleeps and spins until the next slot of a capped frame rate; returns at once otherwise.
+    void waitForNextFrame();
+    // Time left until the next slot, for callers that would rather wait on an event loop timer.
+    qint64 remainingNs() const;
+    void beginFrame();
+
+    // Start of the current frame since the scheduler was created.
+    double frameTime() const { return static_cast<double>(mFrameStartNs) / 1e9; }
+
+    const Statistics &statistics() const { return mStatistics; }
+    void logStatistics() const;
+
+private:
+    void updateDeadline();
+
+    QElapsedTimer mClock;
+    double mFrameRateCap;
+    bool mVsync;
+    double mRefreshRate;
+    qint64 mIntervalNs;
+    qint64 mDeadlineNs;
+    qint64 mFrameStartNs;
+    qint64 mNextFrameNs;
+    Statistics mStatistics;
+};
+
+#endif //GLTUT2_FRAMESCHEDULER_H
@@ -0,0 +1,174 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "GLStateCache.h"
+#include <algorithm>
+#include <cstring>
+#include <QOpenGLFunctions_4_5_Core>
+
+namespace {
+    constexpr GLuint unknown = ~0u;
+}
+
+GLStateCache::GLStateCache(QOpenGLFunctions_4_5_Core *functions) :
+        mFunctions(functions),
+        mProgram(unknown),
+        mVertexArray(unknown),
+        mArrayBuffer(unknown),
+        mUniformBuffer(unknown),
+        mStorageBuffer(unknown),
+        mOtherBuffer(unknown),
+        mTextures(),
+        mUniforms(),
+        mProgramUniforms(nullptr),
+        mFrame{0, 0},
+        mLastFrame{0, 0},
+        mTotal{0, 0},
+        mFrames(0) {
+    mTextures.fill(unknown);
+}
+
+void GLStateCache::beginFrame() {
+    if (mFrames != 0) {
+        mLastFrame = mFrame;
+    }
+    mFrame = Statistics{0, 0};
+    ++mFrames;
+}
+
+void GLStateCache::invalidate() {
+    mProgram = unknown;
+    mVertexArray = unknown;
+    mArrayBuffer = unknown;
+    mUniformBuffer = unknown;
+    mStorageBuffer = unknown;
+    mOtherBuffer = unknown;
+    mTextures.fill(unknown);
+    mProgramUniforms = nullptr;
+}
+
+void GLStateCache::useProgram(GLuint program) {
+    const bool changed = program != mProgram;
+    count(changed);
+    if (changed) {
+        mFunctions->glUseProgram(program);
+        mProgram = program;
+    }
+    if (changed || mProgramUniforms == nullptr) {
+        mProgramUniforms = &mUniforms[program];
+    }
+}
+
+void GLStateCache::bindVertexArray(GLuint vertexArray) {
+    const bool changed = vertexArray != mVertexArray;
+    count(changed);
+    if (changed) {
+        mFunctions->glBindVertexArray(vertexArray);
+        mVertexArray = vertexArray;
+    }
+}
+
+void GLStateCache::bindTextureUnit(GLuint unit, GLuint texture) {
+    if (Q_UNLIKELY(unit >= static_cast<GLuint>(maxTextureUnits))) {
+        count(true);
+        mFunctions->glBindTextureUnit(unit, texture);
+        return;
+    }
+    const bool changed = texture != mTextures[unit];
+    count(changed);
+    if (changed) {
+        mFunctions->glBindTextureUnit(unit, texture);
+        mTextures[unit] = texture;
+    }
+}
+
+GLuint &GLStateCache::bufferSlot(GLenum target) {
+    switch (target) {
+        case GL_ARRAY_BUFFER:
+            return mArrayBuffer;
+        case GL_UNIFORM_BUFFER:
+            return mUniformBuffer;
+        case GL_SHADER_STORAGE_BUFFER:
+            return mStorageBuffer;
+        default:
+            mOtherBuffer = unknown;
+            return mOtherBuffer;
+    }
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer) {
+    GLuint &slot = bufferSlot(target);
+    const bool changed = buffer != slot;
+    count(changed);
+    if (changed) {
+        mFunctions->glBindBuffer(target, buffer);
+        slot = buffer;
+    }
+}
+
+void GLStateCache::bindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+    // Indexed bindings are not cached, but they also replace the generic binding.
+    count(true);
+    mFunctions->glBindBufferBase(target, index, buffer);
+    bufferSlot(target) = buffer;
+}
+
+void GLStateCache::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    count(true);
+    mFunctions->glBindBufferRange(target, index, buffer, offset, size);
+    bufferSlot(target) = buffer;
+}
+
+void GLStateCache::uniform(GLint location, GLint value) {
+    GLfloat bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    if (changeUniform(location, &bits, 1)) {
+        mFunctions->glUniform1i(location, value);
+    }
+}
+
+void GLStateCache::uniform(GLint location, GLfloat value) {
+    if (changeUniform(location, &value, 1)) {
+        mFunctions->glUniform1f(location, value);
+    }
+}
+
+void GLStateCache::uniformMatrix4(GLint location, const GLfloat *value) {
+    if (changeUniform(location, value, 16)) {
+        mFunctions->glUniformMatrix4fv(location, 1, GL_FALSE, value);
+    }
+}
+
+bool GLStateCache::changeUniform(GLint location, const GLfloat *data, int size) {
+    if (Q_UNLIKELY(location < 0)) {
+        return false;
+    }
+    if (Q_UNLIKELY(mProgramUniforms == nullptr)) {
+        count(true);
+        return true;
+    }
+    auto &uniforms = *mProgramUniforms;
+    if (Q_UNLIKELY(static_cast<std::size_t>(location) >= uniforms.size())) {
+        uniforms.resize(static_cast<std::size_t>(location) + 1, UniformValue{0, {}});
+    }
+    UniformValue &cached = uniforms[location];
+    const std::size_t bytes = size * sizeof(GLfloat);
+    const bool changed = cached.size != size || std::memcmp(cached.data.data(), data, bytes) != 0;
+    count(changed);
+    if (changed) {
+        cached.size = size;
+        std::memcpy(cached.data.data(), data, bytes);
+    }
+    return changed;
+}
+
+void GLStateCache::count(bool issued) {
+    if (issued) {
+        ++mFrame.issued;
+        ++mTotal.issued;
+    } else {
+        ++mFrame.skipped;
+        ++mTotal.skipped;
+    }
+}
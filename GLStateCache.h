@@ -0,0 +1,72 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_GLSTATECACHE_H
+#define GLTUT2_GLSTATECACHE_H
+
+#include <array>
+#include <unordered_map>
+#include <vector>
+#include <QtGui/qopengl.h>
+
+class QOpenGLFunctions_4_5_Core;
+
+// Remembers the bound program, VAO, texture units and uniform values and drops calls that
+// would not change anything. Call invalidate() after code that touches GL state behind its back.
+class GLStateCache {
+public:
+    struct Statistics {
+        int issued;
+        int skipped;
+    };
+
+    explicit GLStateCache(QOpenGLFunctions_4_5_Core *functions);
+
+    void beginFrame();
+    void invalidate();
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vertexArray);
+    void bindTextureUnit(GLuint unit, GLuint texture);
+    void bindBuffer(GLenum target, GLuint buffer);
+    void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+    void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    void uniform(GLint location, GLint value);
+    void uniform(GLint location, GLfloat value);
+    void uniformMatrix4(GLint location, const GLfloat *value);
+
+    const Statistics &lastFrame() const { return mLastFrame; }
+    const Statistics &total() const { return mTotal; }
+    int frames() const { return mFrames; }
+
+private:
+    static constexpr int maxTextureUnits = 32;
+    static constexpr int maxUniformFloats = 16;
+
+    struct UniformValue {
+        int size;
+        std::array<GLfloat, maxUniformFloats> data;
+    };
+
+    bool changeUniform(GLint location, const GLfloat *data, int size);
+    void count(bool issued);
+    GLuint &bufferSlot(GLenum target);
+
+    QOpenGLFunctions_4_5_Core *mFunctions;
+    GLuint mProgram;
+    GLuint mVertexArray;
+    GLuint mArrayBuffer;
+    GLuint mUniformBuffer;
+    GLuint mStorageBuffer;
+    GLuint mOtherBuffer;
+    std::array<GLuint, maxTextureUnits> mTextures;
+    std::unordered_map<GLuint, std::vector<UniformValue>> mUniforms;
+    std::vector<UniformValue> *mProgramUniforms;
+    Statistics mFrame;
+    Statistics mLastFrame;
+    Statistics mTotal;
+    int mFrames;
+};
+
+#endif //GLTUT2_GLSTATECACHE_H
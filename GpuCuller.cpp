@@ -0,0 +1,347 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "GpuCuller.h"
+#include "GLStateCache.h"
+#include "ProgramCache.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <QDebug>
+#include <QOpenGLFunctions_4_5_Core>
+#include <QOpenGLShaderProgram>
+
+namespace {
+    constexpr GLuint modelBinding = 0;
+    constexpr GLuint boundsBinding = 1;
+    constexpr GLuint visibleBinding = 2;
+    constexpr GLuint commandBinding = 3;
+    constexpr GLuint hiZUnit = 2;
+    constexpr GLuint cullGroupSize = 64;
+    constexpr GLuint hiZGroupSize = 8;
+    constexpr GLsizeiptr sphereBytes = 4 * sizeof(GLfloat);
+
+    GLuint groups(GLuint count, GLuint groupSize) {
+        return (count + groupSize - 1) / groupSize;
+    }
+
+    int mipLevels(const QSize &size) {
+        int levels = 1;
+        for (int extent = std::max(size.width(), size.height()); extent > 1; extent /= 2) {
+            ++levels;
+        }
+        return levels;
+    }
+}
+
+GpuCuller::GpuCuller(QOpenGLFunctions_4_5_Core *functions) :
+        mFunctions(functions),
+        mCullProgram(nullptr),
+        mHiZProgram(nullptr),
+        mObjectCountLocation(-1),
+        mPlanesLocation(-1),
+        mUseHiZLocation(-1),
+        mHiZProjViewLocation(-1),
+        mHiZSizeLocation(-1),
+        mHiZMaxLevelLocation(-1),
+        mSourceLevelLocation(-1),
+        mBoundsBuffer(0),
+        mVisibleBuffer(0),
+        mCommandBuffer(0),
+        mObjectCount(0),
+        mOcclusionCulling(true),
+        mDepthTexture(0),
+        mDepthFramebuffer(0),
+        mHiZTexture(0),
+        mDepthSize(),
+        mHiZSize(),
+        mHiZLevels(0),
+        mHiZValid(false),
+        mHiZProjView(),
+        mAttachedVertexArray(0),
+        mAttachedBuffer(0),
+        mReadbackBuffer(0),
+        mReadbackData(nullptr),
+        mReadbackFences(),
+        mReadbackSlot(0),
+        mLastVisible(0),
+        mVisibleTotal(0),
+        mResolvedFrames(0) {
+    mReadbackFences.fill(nullptr);
+}
+
+bool GpuCuller::initialize(ProgramCache *programCache, QObject *programParent) {
+    mCullProgram = new QOpenGLShaderProgram(programParent);
+    mHiZProgram = new QOpenGLShaderProgram(programParent);
+    const bool built = programCache->build(mCullProgram, {{QOpenGLShader::Compute, QStringLiteral(":/shaders/cull.comp")}})
+                       && programCache->build(mHiZProgram, {{QOpenGLShader::Compute, QStringLiteral(":/shaders/hiz.comp")}});
+    if (Q_UNLIKELY(!built)) {
+        qWarning() << "Failed to build the GPU culling programs";
+        return false;
+    }
+    mObjectCountLocation = mCullProgram->uniformLocation("objectCount");
+    mPlanesLocation = mCullProgram->uniformLocation("planes");
+    mUseHiZLocation = mCullProgram->uniformLocation("useHiZ");
+    mHiZProjViewLocation = mCullProgram->uniformLocation("hiZProjView");
+    mHiZSizeLocation = mCullProgram->uniformLocation("hiZSize");
+    mHiZMaxLevelLocation = mCullProgram->uniformLocation("hiZMaxLevel");
+    mSourceLevelLocation = mHiZProgram->uniformLocation("sourceLevel");
+
+    mFunctions->glCreateBuffers(1, &mCommandBuffer);
+    mFunctions->glNamedBufferStorage(mCommandBuffer, sizeof(DrawCommand), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+    const GLbitfield readbackFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    mFunctions->glCreateBuffers(1, &mReadbackBuffer);
+    mFunctions->glNamedBufferStorage(mReadbackBuffer, readbackSlots * sizeof(GLuint), nullptr, readbackFlags);
+    mReadbackData = static_cast<const GLuint *>(
+            mFunctions->glMapNamedBufferRange(mReadbackBuffer, 0, readbackSlots * sizeof(GLuint), readbackFlags));
+    return true;
+}
+
+void GpuCuller::destroy() {
+    if (mCommandBuffer == 0) {
+        return;
+    }
+    for (GLsync &fence : mReadbackFences) {
+        if (fence != nullptr) {
+            mFunctions->glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    if (mReadbackBuffer != 0) {
+        mFunctions->glUnmapNamedBuffer(mReadbackBuffer);
+        mReadbackData = nullptr;
+    }
+    releaseHiZ();
+    const GLuint buffers[] = {mBoundsBuffer, mVisibleBuffer, mCommandBuffer, mReadbackBuffer};
+    mFunctions->glDeleteBuffers(sizeof(buffers) / sizeof(buffers[0]), buffers);
+    mBoundsBuffer = 0;
+    mVisibleBuffer = 0;
+    mCommandBuffer = 0;
+    mReadbackBuffer = 0;
+    mObjectCount = 0;
+    mAttachedVertexArray = 0;
+    mAttachedBuffer = 0;
+    // The programs belong to their parent; only detach from them here.
+    mCullProgram->removeAllShaders();
+    mCullProgram = nullptr;
+    mHiZProgram->removeAllShaders();
+    mHiZProgram = nullptr;
+}
+
+void GpuCuller::setObjects(const GLfloat *spheres, std::size_t count) {
+    const GLuint buffers[] = {mBoundsBuffer, mVisibleBuffer};
+    mFunctions->glDeleteBuffers(sizeof(buffers) / sizeof(buffers[0]), buffers);
+    mObjectCount = count;
+    // Zero-sized storage is not allowed, so an empty scene still gets one element.
+    const auto elements = static_cast<GLsizeiptr>(std::max<std::size_t>(count, 1));
+    mFunctions->glCreateBuffers(1, &mBoundsBuffer);
+    mFunctions->glNamedBufferStorage(mBoundsBuffer, elements * sphereBytes, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    if (count > 0) {
+        mFunctions->glNamedBufferSubData(mBoundsBuffer, 0, static_cast<GLsizeiptr>(count) * sphereBytes, spheres);
+    }
+    mFunctions->glCreateBuffers(1, &mVisibleBuffer);
+    mFunctions->glNamedBufferStorage(mVisibleBuffer, elements * sizeof(GLuint), nullptr, 0);
+}
+
+void GpuCuller::cull(GLStateCache &state, const QMatrix4x4 &projView, const MeshArena::Mesh &mesh) {
+    resolveReadbacks();
+
+    const DrawCommand command {static_cast<GLuint>(mesh.indexCount), 0, mesh.firstIndex, mesh.baseVertex, 0};
+    mFunctions->glNamedBufferSubData(mCommandBuffer, 0, sizeof(command), &command);
+    if (mObjectCount == 0) {
+        return;
+    }
+
+    // Normalised so the shader can compare plane distances with sphere radii.
+    GLfloat planes[6][4];
+    const float *m = projView.constData();
+    for (int i = 0; i < 6; ++i) {
+        const int row = i / 2;
+        const float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+        const float a = m[3] + sign * m[row];
+        const float b = m[7] + sign * m[4 + row];
+        const float c = m[11] + sign * m[8 + row];
+        const float d = m[15] + sign * m[12 + row];
+        const float length = std::sqrt(a * a + b * b + c * c);
+        planes[i][0] = a / length;
+        planes[i][1] = b / length;
+        planes[i][2] = c / length;
+        planes[i][3] = d / length;
+    }
+
+    const GLuint program = mCullProgram->programId();
+    const bool useHiZ = mOcclusionCulling && mHiZValid;
+    mFunctions->glProgramUniform1ui(program, mObjectCountLocation, static_cast<GLuint>(mObjectCount));
+    mFunctions->glProgramUniform4fv(program, mPlanesLocation, 6, &planes[0][0]);
+    mFunctions->glProgramUniform1i(program, mUseHiZLocation, useHiZ ? 1 : 0);
+    if (useHiZ) {
+        mFunctions->glProgramUniformMatrix4fv(program, mHiZProjViewLocation, 1, GL_FALSE, mHiZProjView.constData());
+        mFunctions->glProgramUniform2f(program, mHiZSizeLocation, mHiZSize.width(), mHiZSize.height());
+        mFunctions->glProgramUniform1f(program, mHiZMaxLevelLocation, static_cast<GLfloat>(mHiZLevels - 1));
+        state.bindTextureUnit(hiZUnit, mHiZTexture);
+    }
+    state.useProgram(program);
+    state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, boundsBinding, mBoundsBuffer);
+    state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, visibleBinding, mVisibleBuffer);
+    state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, commandBinding, mCommandBuffer);
+    mFunctions->glDispatchCompute(groups(static_cast<GLuint>(mObjectCount), cullGroupSize), 1, 1);
+    mFunctions->glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    GLsync &fence = mReadbackFences[mReadbackSlot];
+    if (fence != nullptr) {
+        // Still in flight after a full lap of the ring; drop that sample rather than wait.
+        mFunctions->glDeleteSync(fence);
+    }
+    mFunctions->glCopyNamedBufferSubData(mCommandBuffer, mReadbackBuffer, offsetof(DrawCommand, instanceCount),
+                                         mReadbackSlot * static_cast<GLintptr>(sizeof(GLuint)), sizeof(GLuint));
+    fence = mFunctions->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    mReadbackSlot = (mReadbackSlot + 1) % readbackSlots;
+}
+
+void GpuCuller::draw(GLStateCache &state, GLuint vertexArray, GLuint objectLocation, GLenum indexType,
+                     const StreamBuffer::Range &models) {
+    if (vertexArray != mAttachedVertexArray || mVisibleBuffer != mAttachedBuffer) {
+        // The visible list feeds a per-instance attribute, which honours the command's base instance.
+        const GLuint binding = objectLocation;
+        mFunctions->glVertexArrayVertexBuffer(vertexArray, binding, mVisibleBuffer, 0, sizeof(GLuint));
+        mFunctions->glVertexArrayAttribIFormat(vertexArray, objectLocation, 1, GL_UNSIGNED_INT, 0);
+        mFunctions->glVertexArrayAttribBinding(vertexArray, objectLocation, binding);
+        mFunctions->glVertexArrayBindingDivisor(vertexArray, binding, 1);
+        mFunctions->glEnableVertexArrayAttrib(vertexArray, objectLocation);
+        mAttachedVertexArray = vertexArray;
+        mAttachedBuffer = mVisibleBuffer;
+    }
+    state.bindVertexArray(vertexArray);
+    if (models.size > 0) {
+        state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, modelBinding, models.buffer, models.offset, models.size);
+    }
+    state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer);
+    mFunctions->glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, nullptr, 1, 0);
+}
+
+void GpuCuller::updateHiZ(GLStateCache &state, const QSize &framebufferSize, const QMatrix4x4 &projView) {
+    if (!mOcclusionCulling || framebufferSize.isEmpty()) {
+        mHiZValid = false;
+        return;
+    }
+    GLint source = 0;
+    mFunctions->glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &source);
+    const bool resized = framebufferSize != mDepthSize;
+    if (resized && !resizeHiZ(static_cast<GLuint>(source), framebufferSize)) {
+        mOcclusionCulling = false;
+        mHiZValid = false;
+        return;
+    }
+
+    const int width = mDepthSize.width();
+    const int height = mDepthSize.height();
+    mFunctions->glBlitNamedFramebuffer(static_cast<GLuint>(source), mDepthFramebuffer, 0, 0, width, height,
+                                       0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    if (Q_UNLIKELY(resized && mFunctions->glGetError() != GL_NO_ERROR)) {
+        qWarning() << "Cannot copy the depth buffer, occlusion culling is disabled";
+        mOcclusionCulling = false;
+        mHiZValid = false;
+        return;
+    }
+
+    state.useProgram(mHiZProgram->programId());
+    QSize levelSize = mHiZSize;
+    for (int level = 0; level < mHiZLevels; ++level) {
+        mFunctions->glProgramUniform1i(mHiZProgram->programId(), mSourceLevelLocation, level == 0 ? 0 : level - 1);
+        state.bindTextureUnit(hiZUnit, level == 0 ? mDepthTexture : mHiZTexture);
+        mFunctions->glBindImageTexture(0, mHiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        mFunctions->glDispatchCompute(groups(static_cast<GLuint>(levelSize.width()), hiZGroupSize),
+                                      groups(static_cast<GLuint>(levelSize.height()), hiZGroupSize), 1);
+        mFunctions->glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        levelSize = QSize(std::max(levelSize.width() / 2, 1), std::max(levelSize.height() / 2, 1));
+    }
+    mHiZProjView = projView;
+    mHiZValid = true;
+}
+
+void GpuCuller::resolveReadbacks() {
+    // Oldest slot first, so the running "last" value really is the latest one.
+    for (int i = 0; i < readbackSlots; ++i) {
+        const int slot = (mReadbackSlot + i) % readbackSlots;
+        GLsync &fence = mReadbackFences[slot];
+        if (fence == nullptr || mFunctions->glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            continue;
+        }
+        mFunctions->glDeleteSync(fence);
+        fence = nullptr;
+        mLastVisible = static_cast<int>(mReadbackData[slot]);
+        mVisibleTotal += mLastVisible;
+        ++mResolvedFrames;
+    }
+}
+
+bool GpuCuller::resizeHiZ(GLuint sourceFramebuffer, const QSize &size) {
+    releaseHiZ();
+
+    // A depth blit needs matching formats, so mirror whatever the target framebuffer uses.
+    const GLenum depthAttachment = sourceFramebuffer == 0 ? GL_DEPTH : GL_DEPTH_ATTACHMENT;
+    const GLenum stencilAttachment = sourceFramebuffer == 0 ? GL_STENCIL : GL_STENCIL_ATTACHMENT;
+    GLint depthBits = 0;
+    GLint stencilBits = 0;
+    GLint componentType = GL_NONE;
+    mFunctions->glGetNamedFramebufferAttachmentParameteriv(sourceFramebuffer, depthAttachment,
+                                                           GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthBits);
+    mFunctions->glGetNamedFramebufferAttachmentParameteriv(sourceFramebuffer, depthAttachment,
+                                                           GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &componentType);
+    mFunctions->glGetNamedFramebufferAttachmentParameteriv(sourceFramebuffer, stencilAttachment,
+                                                           GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilBits);
+    GLenum format;
+    if (componentType == GL_FLOAT) {
+        format = stencilBits > 0 ? GL_DEPTH32F_STENCIL8 : GL_DEPTH_COMPONENT32F;
+    } else if (depthBits == 24) {
+        format = stencilBits > 0 ? GL_DEPTH24_STENCIL8 : GL_DEPTH_COMPONENT24;
+    } else if (depthBits == 16) {
+        format = GL_DEPTH_COMPONENT16;
+    } else if (depthBits == 32) {
+        format = GL_DEPTH_COMPONENT32;
+    } else {
+        qWarning() << "Unsupported depth buffer with" << depthBits << "bits, occlusion culling is disabled";
+        return false;
+    }
+
+    mDepthSize = size;
+    mFunctions->glCreateTextures(GL_TEXTURE_2D, 1, &mDepthTexture);
+    mFunctions->glTextureStorage2D(mDepthTexture, 1, format, size.width(), size.height());
+    mFunctions->glTextureParameteri(mDepthTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    mFunctions->glTextureParameteri(mDepthTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    mFunctions->glCreateFramebuffers(1, &mDepthFramebuffer);
+    mFunctions->glNamedFramebufferTexture(mDepthFramebuffer, stencilBits > 0 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT,
+                                          mDepthTexture, 0);
+    if (Q_UNLIKELY(mFunctions->glCheckNamedFramebufferStatus(mDepthFramebuffer, GL_DRAW_FRAMEBUFFER)
+                   != GL_FRAMEBUFFER_COMPLETE)) {
+        qWarning() << "Depth copy framebuffer is incomplete, occlusion culling is disabled";
+        return false;
+    }
+
+    mHiZSize = QSize(std::max(size.width() / 2, 1), std::max(size.height() / 2, 1));
+    mHiZLevels = mipLevels(mHiZSize);
+    mFunctions->glCreateTextures(GL_TEXTURE_2D, 1, &mHiZTexture);
+    mFunctions->glTextureStorage2D(mHiZTexture, mHiZLevels, GL_R32F, mHiZSize.width(), mHiZSize.height());
+    mFunctions->glTextureParameteri(mHiZTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    mFunctions->glTextureParameteri(mHiZTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    mFunctions->glTextureParameteri(mHiZTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    mFunctions->glTextureParameteri(mHiZTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return true;
+}
+
+void GpuCuller::releaseHiZ() {
+    if (mDepthFramebuffer != 0) {
+        mFunctions->glDeleteFramebuffers(1, &mDepthFramebuffer);
+        mDepthFramebuffer = 0;
+    }
+    const GLuint textures[] = {mDepthTexture, mHiZTexture};
+    mFunctions->glDeleteTextures(2, textures);
+    mDepthTexture = 0;
+    mHiZTexture = 0;
+    mDepthSize = QSize();
+    mHiZSize = QSize();
+    mHiZLevels = 0;
+    mHiZValid = false;
+}
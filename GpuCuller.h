@@ -0,0 +1,101 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_GPUCULLER_H
+#define GLTUT2_GPUCULLER_H
+
+#include "MeshArena.h"
+#include "StreamBuffer.h"
+#include <array>
+#include <QMatrix4x4>
+#include <QSize>
+#include <QtGui/qopengl.h>
+
+class GLStateCache;
+class ProgramCache;
+class QObject;
+class QOpenGLFunctions_4_5_Core;
+class QOpenGLShaderProgram;
+
+// Culls the whole scene in a compute pass and draws the survivors with one indirect call.
+// Object bounding spheres and model matrices are read as shader storage buffers; the compute pass
+// tests each sphere against the frustum and against a depth pyramid built from the previous
+// frame, appends visible object indices and bumps the instance count of the draw command.
+// Occlusion uses the previous frame's depth and matrices, so an object that has just come
+// out from behind an occluder can show up one frame late.
+// The visible count is read back through a fenced ring, so it lags a frame or two.
+class GpuCuller {
+public:
+    explicit GpuCuller(QOpenGLFunctions_4_5_Core *functions);
+
+    bool initialize(ProgramCache *programCache, QObject *programParent);
+    void destroy();
+
+    void setObjects(const GLfloat *spheres, std::size_t count);
+    std::size_t objectCount() const { return mObjectCount; }
+
+    void setOcclusionCulling(bool occlusionCulling) { mOcclusionCulling = occlusionCulling; }
+    void cull(GLStateCache &state, const QMatrix4x4 &projView, const MeshArena::Mesh &mesh);
+    void draw(GLStateCache &state, GLuint vertexArray, GLuint objectLocation, GLenum indexType,
+              const StreamBuffer::Range &models);
+    void updateHiZ(GLStateCache &state, const QSize &framebufferSize, const QMatrix4x4 &projView);
+
+    int lastVisible() const { return mLastVisible; }
+    qint64 visibleTotal() const { return mVisibleTotal; }
+    int resolvedFrames() const { return mResolvedFrames; }
+
+private:
+    static constexpr int readbackSlots = 3;
+
+    struct DrawCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    void resolveReadbacks();
+    bool resizeHiZ(GLuint sourceFramebuffer, const QSize &size);
+    void releaseHiZ();
+
+    QOpenGLFunctions_4_5_Core *mFunctions;
+    QOpenGLShaderProgram *mCullProgram;
+    QOpenGLShaderProgram *mHiZProgram;
+    GLint mObjectCountLocation;
+    GLint mPlanesLocation;
+    GLint mUseHiZLocation;
+    GLint mHiZProjViewLocation;
+    GLint mHiZSizeLocation;
+    GLint mHiZMaxLevelLocation;
+    GLint mSourceLevelLocation;
+
+    GLuint mBoundsBuffer;
+    GLuint mVisibleBuffer;
+    GLuint mCommandBuffer;
+    std::size_t mObjectCount;
+
+    bool mOcclusionCulling;
+    GLuint mDepthTexture;
+    GLuint mDepthFramebuffer;
+    GLuint mHiZTexture;
+    QSize mDepthSize;
+    QSize mHiZSize;
+    int mHiZLevels;
+    bool mHiZValid;
+    QMatrix4x4 mHiZProjView;
+
+    GLuint mAttachedVertexArray;
+    GLuint mAttachedBuffer;
+
+    GLuint mReadbackBuffer;
+    const GLuint *mReadbackData;
+    std::array<GLsync, readbackSlots> mReadbackFences;
+    int mReadbackSlot;
+    int mLastVisible;
+    qint64 mVisibleTotal;
+    int mResolvedFrames;
+};
+
+#endif //GLTUT2_GPUCULLER_H
@@ -0,0 +1,195 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "InputRecorder.h"
+#include <QDebug>
+#include <QFile>
+#include <QTextStream>
+
+namespace {
+    constexpr int formatVersion = 3;
+
+    // Nine significant digits read back into the same float.
+    QString exact(float value) {
+        return QString::number(static_cast<double>(value), 'g', 9);
+    }
+}
+
+InputRecorder::InputRecorder() :
+        mMode(Off),
+        mFileName(),
+        mTickRate(0),
+        mTickCount(0),
+        mStartPosition(),
+        mEvents(),
+        mNext(0),
+        mCurrent{0, QVector3D()},
+        mDigs(),
+        mNextDig(0) {
+}
+
+void InputRecorder::startRecording(const QString &fileName, int tickRate) {
+    mMode = Recording;
+    mFileName = fileName;
+    mTickRate = tickRate;
+    mTickCount = 0;
+    mEvents.clear();
+    mDigs.clear();
+}
+
+bool InputRecorder::startReplay(const QString &fileName) {
+    QFile file(fileName);
+    if (Q_UNLIKELY(!file.open(QIODevice::ReadOnly | QIODevice::Text))) {
+        qWarning() << "Failed to open input recording" << fileName << file.errorString();
+        return false;
+    }
+    QTextStream in(&file);
+    QString magic;
+    int version = 0;
+    QString keyword;
+    int tickRate = 0;
+    qint64 tickCount = 0;
+    float x = 0.0f;
+    float y = 0.0f;
+    float z = 0.0f;
+    in >> magic >> version >> keyword >> tickRate;
+    if (Q_UNLIKELY(magic != QLatin1String("gltut2-input") || version != formatVersion
+                   || keyword != QLatin1String("tick-rate") || tickRate <= 0)) {
+        qWarning() << "Input recording" << fileName << "is not a supported recording";
+        return false;
+    }
+    in >> keyword >> tickCount;
+    const bool counted = keyword == QLatin1String("ticks") && tickCount > 0;
+    in >> keyword >> x >> y >> z;
+    if (Q_UNLIKELY(!counted || keyword != QLatin1String("start") || in.status() != QTextStream::Ok)) {
+        qWarning() << "Input recording" << fileName << "is corrupt";
+        return false;
+    }
+
+    std::vector<Event> events;
+    std::vector<Dig> digs;
+    for (in.skipWhiteSpace(); !in.atEnd(); in.skipWhiteSpace()) {
+        qint64 tick = 0;
+        in >> keyword >> tick;
+        if (keyword == QLatin1String("input")) {
+            Event event{tick, {0, QVector3D()}};
+            float frontX = 0.0f;
+            float frontY = 0.0f;
+            float frontZ = 0.0f;
+            in >> event.input.directions >> frontX >> frontY >> frontZ;
+            event.input.cameraFront = QVector3D(frontX, frontY, frontZ);
+            if (Q_UNLIKELY(!events.empty() && tick <= events.back().tick)) {
+                qWarning() << "Input recording" << fileName << "goes back in time at tick" << tick;
+                return false;
+            }
+            events.push_back(event);
+        } else if (keyword == QLatin1String("dig")) {
+            Dig dig{tick, 0, 0, 0};
+            in >> dig.x >> dig.y >> dig.z;
+            if (Q_UNLIKELY(!digs.empty() && tick < digs.back().tick)) {
+                qWarning() << "Input recording" << fileName << "goes back in time at tick" << tick;
+                return false;
+            }
+            digs.push_back(dig);
+        } else {
+            in.setStatus(QTextStream::ReadCorruptData);
+        }
+        if (Q_UNLIKELY(in.status() != QTextStream::Ok)) {
+            qWarning() << "Input recording" << fileName << "is corrupt";
+            return false;
+        }
+        if (Q_UNLIKELY(tick < 0 || tick >= tickCount)) {
+            qWarning() << "Input recording" << fileName << "has input outside its ticks 0 to" << tickCount - 1;
+            return false;
+        }
+    }
+    if (Q_UNLIKELY(events.empty())) {
+        qWarning() << "Input recording" << fileName << "has no input";
+        return false;
+    }
+
+    mMode = Replaying;
+    mFileName = fileName;
+    mTickRate = tickRate;
+    mTickCount = tickCount;
+    mStartPosition = QVector3D(x, y, z);
+    mEvents.swap(events);
+    mNext = 0;
+    mCurrent = mEvents.front().input;
+    mDigs.swap(digs);
+    mNextDig = 0;
+    return true;
+}
+
+bool InputRecorder::finish() {
+    const Mode mode = mMode;
+    mMode = Off;
+    if (mode != Recording) {
+        return true;
+    }
+    QFile file(mFileName);
+    if (Q_UNLIKELY(!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))) {
+        qWarning() << "Failed to create input recording" << mFileName << file.errorString();
+        return false;
+    }
+    QTextStream out(&file);
+    out << "gltut2-input " << formatVersion << "\n"
+        << "tick-rate " << mTickRate << "\n"
+        << "ticks " << mTickCount << "\n"
+        << "start " << exact(mStartPosition.x()) << ' ' << exact(mStartPosition.y()) << ' '
+        << exact(mStartPosition.z()) << "\n";
+    // Both lists are in tick order; merge them so the file reads in tick order too.
+    auto dig = mDigs.cbegin();
+    const auto writeDigsUntil = [&out, &dig, this](qint64 tick) {
+        for (; dig != mDigs.cend() && dig->tick < tick; ++dig) {
+            out << "dig " << dig->tick << ' ' << dig->x << ' ' << dig->y << ' ' << dig->z << '\n';
+        }
+    };
+    for (const Event &event : mEvents) {
+        writeDigsUntil(event.tick);
+        const Input &input = event.input;
+        out << "input " << event.tick << ' ' << input.directions << ' ' << exact(input.cameraFront.x()) << ' '
+            << exact(input.cameraFront.y()) << ' ' << exact(input.cameraFront.z()) << '\n';
+    }
+    writeDigsUntil(mTickCount);
+    out.flush();
+    if (Q_UNLIKELY(out.status() != QTextStream::Ok)) {
+        qWarning() << "Failed to write input recording" << mFileName << file.errorString();
+        return false;
+    }
+    qDebug() << "Recorded" << mTickCount << "ticks," << mEvents.size() << "input changes and" << mDigs.size()
+             << "digs to" << mFileName;
+    return true;
+}
+
+void InputRecorder::record(qint64 tick, const Input &input) {
+    mTickCount = tick + 1;
+    if (mEvents.empty() || mEvents.back().input != input) {
+        mEvents.push_back(Event{tick, input});
+    }
+}
+
+const InputRecorder::Input &InputRecorder::replay(qint64 tick) {
+    while (mNext < mEvents.size() && mEvents[mNext].tick <= tick) {
+        mCurrent = mEvents[mNext].input;
+        ++mNext;
+    }
+    return mCurrent;
+}
+
+void InputRecorder::recordDig(const Dig &dig) {
+    mDigs.push_back(dig);
+}
+
+bool InputRecorder::nextDig(qint64 tick, Dig &dig) {
+    if (mNextDig == mDigs.size() || mDigs[mNextDig].tick > tick) {
+        return false;
+    }
+    dig = mDigs[mNextDig++];
+    return true;
+}
+
+bool InputRecorder::replayFinished(qint64 tick) const {
+    return mMode == Replaying && tick >= mTickCount;
+}
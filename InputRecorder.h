@@ -0,0 +1,83 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_INPUTRECORDER_H
+#define GLTUT2_INPUTRECORDER_H
+
+#include <vector>
+#include <QString>
+#include <QVector3D>
+
+// Records the input each simulation tick consumed and plays it back tick for tick. Only changes
+// are stored, stamped with the tick they took effect on, so a replay feeds the simulation exactly
+// the same values at the same ticks whatever the frame rate, and the camera path repeats bit for
+// bit. Digs are stored as the block they removed rather than as a request: what a ray hits depends
+// on which chunks the background builds have loaded, which the replay cannot reproduce. Files are
+// text: a header with the tick rate, tick count and start position, then one line per change or
+// dig. A replay ends after the recorded number of ticks.
+class InputRecorder {
+public:
+    struct Input {
+        int directions;
+        QVector3D cameraFront;
+
+        bool operator==(const Input &other) const {
+            return directions == other.directions && cameraFront == other.cameraFront;
+        }
+        bool operator!=(const Input &other) const { return !(*this == other); }
+    };
+
+    struct Dig {
+        qint64 tick;
+        int x;
+        int y;
+        int z;
+    };
+
+    enum Mode {
+        Off,
+        Recording,
+        Replaying
+    };
+
+    InputRecorder();
+
+    // Both take effect from the first tick; the recording is written by finish().
+    void startRecording(const QString &fileName, int tickRate);
+    bool startReplay(const QString &fileName);
+    bool finish();
+
+    Mode mode() const { return mMode; }
+    int tickRate() const { return mTickRate; }
+    const QVector3D &startPosition() const { return mStartPosition; }
+
+    void setStartPosition(const QVector3D &position) { mStartPosition = position; }
+    void record(qint64 tick, const Input &input);
+    void recordDig(const Dig &dig);
+    // The input in effect at tick; ticks must not go backwards.
+    const Input &replay(qint64 tick);
+    // Hands out the digs recorded up to tick, one per call.
+    bool nextDig(qint64 tick, Dig &dig);
+    // Whether every recorded tick has been replayed before tick.
+    bool replayFinished(qint64 tick) const;
+
+private:
+    struct Event {
+        qint64 tick;
+        Input input;
+    };
+
+    Mode mMode;
+    QString mFileName;
+    int mTickRate;
+    qint64 mTickCount;
+    QVector3D mStartPosition;
+    std::vector<Event> mEvents;
+    std::size_t mNext;
+    Input mCurrent;
+    std::vector<Dig> mDigs;
+    std::size_t mNextDig;
+};
+
+#endif //GLTUT2_INPUTRECORDER_H
@@ -0,0 +1,172 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "JobSystem.h"
+#include <algorithm>
+#include <deque>
+#include <QThread>
+
+namespace {
+    class WorkerThread : public QThread {
+    public:
+        explicit WorkerThread(std::function<void()> loop) : mLoop(std::move(loop)) {}
+
+    protected:
+        void run() override { mLoop(); }
+
+    private:
+        const std::function<void()> mLoop;
+    };
+}
+
+struct JobSystem::Batch {
+    const RangeFunction *function;
+    std::atomic<std::size_t> pending;
+};
+
+struct JobSystem::Job {
+    Batch *batch;
+    std::size_t begin;
+    std::size_t end;
+};
+
+struct JobSystem::Worker {
+    QMutex mutex;
+    std::deque<Job> jobs;
+    QThread *thread;
+};
+
+JobSystem::JobSystem(int workerCount) :
+        mWorkers(),
+        mSleepMutex(),
+        mWakeCondition(),
+        mDoneCondition(),
+        mQueued(0),
+        mSteals(0),
+        mStop(false) {
+    if (workerCount <= 0) {
+        workerCount = QThread::idealThreadCount();
+    }
+    workerCount = std::max(workerCount, 1);
+    for (int i = 0; i < workerCount; ++i) {
+        mWorkers.push_back(new Worker());
+        mWorkers.back()->thread = nullptr;
+    }
+    // Worker 0 is whichever thread calls parallelFor().
+    for (std::size_t i = 1; i < mWorkers.size(); ++i) {
+        mWorkers[i]->thread = new WorkerThread([this, i]() { workerLoop(i); });
+        mWorkers[i]->thread->setObjectName(QStringLiteral("JobSystem worker %1").arg(i));
+        mWorkers[i]->thread->start();
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        const QMutexLocker locker(&mSleepMutex);
+        mStop = true;
+        mWakeCondition.wakeAll();
+    }
+    for (Worker *worker : mWorkers) {
+        if (worker->thread != nullptr) {
+            worker->thread->wait();
+        }
+    }
+    for (Worker *worker : mWorkers) {
+        delete worker->thread;
+        delete worker;
+    }
+}
+
+void JobSystem::parallelFor(std::size_t count, std::size_t grain, const RangeFunction &function) {
+    if (count == 0) {
+        return;
+    }
+    grain = std::max<std::size_t>(grain, 1);
+    const std::size_t chunks = (count + grain - 1) / grain;
+    if (mWorkers.size() == 1 || chunks == 1) {
+        function(0, count);
+        return;
+    }
+
+    Batch batch {&function, {chunks}};
+    const std::size_t workers = std::min(mWorkers.size(), chunks);
+    for (std::size_t w = 0; w < workers; ++w) {
+        const std::size_t firstChunk = w * chunks / workers;
+        const std::size_t lastChunk = (w + 1) * chunks / workers;
+        Worker *worker = mWorkers[w];
+        const QMutexLocker locker(&worker->mutex);
+        // The owner pops from the back, so push in reverse to run its chunks in order.
+        for (std::size_t chunk = lastChunk; chunk-- > firstChunk;) {
+            worker->jobs.push_back(Job {&batch, chunk * grain, std::min((chunk + 1) * grain, count)});
+        }
+    }
+    {
+        const QMutexLocker locker(&mSleepMutex);
+        mQueued.fetch_add(static_cast<int>(chunks), std::memory_order_release);
+        mWakeCondition.wakeAll();
+    }
+
+    Job job {};
+    while (batch.pending.load(std::memory_order_acquire) != 0) {
+        if (takeJob(0, job)) {
+            run(job);
+            continue;
+        }
+        const QMutexLocker locker(&mSleepMutex);
+        while (batch.pending.load(std::memory_order_acquire) != 0) {
+            mDoneCondition.wait(&mSleepMutex);
+        }
+    }
+}
+
+bool JobSystem::takeJob(std::size_t index, Job &job) {
+    {
+        Worker *own = mWorkers[index];
+        const QMutexLocker locker(&own->mutex);
+        if (!own->jobs.empty()) {
+            job = own->jobs.back();
+            own->jobs.pop_back();
+            mQueued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    for (std::size_t offset = 1; offset < mWorkers.size(); ++offset) {
+        Worker *victim = mWorkers[(index + offset) % mWorkers.size()];
+        const QMutexLocker locker(&victim->mutex);
+        if (!victim->jobs.empty()) {
+            job = victim->jobs.front();
+            victim->jobs.pop_front();
+            mQueued.fetch_sub(1, std::memory_order_relaxed);
+            mSteals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::run(const Job &job) {
+    (*job.batch->function)(job.begin, job.end);
+    // The batch lives on the stack of parallelFor() and may be gone right after this decrement.
+    if (job.batch->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        const QMutexLocker locker(&mSleepMutex);
+        mDoneCondition.wakeAll();
+    }
+}
+
+void JobSystem::workerLoop(std::size_t index) {
+    Job job {};
+    for (;;) {
+        if (takeJob(index, job)) {
+            run(job);
+            continue;
+        }
+        const QMutexLocker locker(&mSleepMutex);
+        while (!mStop && mQueued.load(std::memory_order_acquire) <= 0) {
+            mWakeCondition.wait(&mSleepMutex);
+        }
+        if (mStop) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,49 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_JOBSYSTEM_H
+#define GLTUT2_JOBSYSTEM_H
+
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <QMutex>
+#include <QWaitCondition>
+
+// Fixed pool of workers with one deque each. parallelFor() splits a range into chunks, deals
+// contiguous runs of chunks to the deques and helps from the calling thread until all chunks
+// are done; idle workers steal from the front of other deques. Chunks never share output, so
+// results do not depend on which worker ran what.
+class JobSystem {
+public:
+    typedef std::function<void(std::size_t begin, std::size_t end)> RangeFunction;
+
+    explicit JobSystem(int workerCount = 0);
+    ~JobSystem();
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    int workerCount() const { return static_cast<int>(mWorkers.size()); }
+    void parallelFor(std::size_t count, std::size_t grain, const RangeFunction &function);
+    quint64 steals() const { return mSteals.load(std::memory_order_relaxed); }
+
+private:
+    struct Batch;
+    struct Job;
+    struct Worker;
+
+    bool takeJob(std::size_t index, Job &job);
+    void run(const Job &job);
+    void workerLoop(std::size_t index);
+
+    std::vector<Worker *> mWorkers;
+    QMutex mSleepMutex;
+    QWaitCondition mWakeCondition;
+    QWaitCondition mDoneCondition;
+    std::atomic<int> mQueued;
+    std::atomic<quint64> mSteals;
+    bool mStop;
+};
+
+#endif //GLTUT2_JOBSYSTEM_H
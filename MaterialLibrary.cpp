@@ -0,0 +1,101 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "MaterialLibrary.h"
+#include "GLStateCache.h"
+#include "TextureLoader.h"
+#include <algorithm>
+#include <cmath>
+#include <QDebug>
+#include <QOpenGLFunctions_4_5_Core>
+
+namespace {
+    GLsizei mipLevels(int width, int height) {
+        return static_cast<GLsizei>(std::floor(std::log2(std::max(std::max(width, height), 1)))) + 1;
+    }
+
+    // Zero-sized storage is not allowed, so empty tables still get one element.
+    GLuint createStorage(QOpenGLFunctions_4_5_Core *functions, const void *data, std::size_t count, GLsizeiptr stride) {
+        GLuint buffer = 0;
+        const auto elements = static_cast<GLsizeiptr>(std::max<std::size_t>(count, 1));
+        functions->glCreateBuffers(1, &buffer);
+        functions->glNamedBufferStorage(buffer, elements * stride, nullptr, GL_DYNAMIC_STORAGE_BIT);
+        if (count > 0) {
+            functions->glNamedBufferSubData(buffer, 0, static_cast<GLsizeiptr>(count) * stride, data);
+        }
+        return buffer;
+    }
+}
+
+MaterialLibrary::MaterialLibrary(QOpenGLFunctions_4_5_Core *functions, const QSize &layerSize, GLenum internalFormat,
+                                 GLsizei maxLayers) :
+        mFunctions(functions),
+        mLayerSize(layerSize),
+        mInternalFormat(internalFormat),
+        mMaxLayers(std::max(maxLayers, 1)),
+        mTexture(0),
+        mLayerCount(0),
+        mMaterialsBuffer(0),
+        mMaterialCount(0),
+        mObjectMaterialsBuffer(0),
+        mObjectCount(0) {
+}
+
+void MaterialLibrary::create() {
+    const GLsizei levels = mipLevels(mLayerSize.width(), mLayerSize.height());
+    mFunctions->glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &mTexture);
+    mFunctions->glTextureStorage3D(mTexture, levels, mInternalFormat, mLayerSize.width(), mLayerSize.height(), mMaxLayers);
+    mFunctions->glTextureParameteri(mTexture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    mFunctions->glTextureParameteri(mTexture, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    mFunctions->glTextureParameteri(mTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    mFunctions->glTextureParameteri(mTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    // Layers stay grey until the loader streams their image in. Compressed arrays cannot be
+    // cleared, their layers are undefined until then.
+    const GLubyte grey[] = {0x80, 0x80, 0x80, 0xff};
+    for (GLint level = 0; mInternalFormat == GL_RGBA8 && level < levels; ++level) {
+        mFunctions->glClearTexImage(mTexture, level, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    }
+    setMaterials({});
+    setObjectMaterials(nullptr, 0);
+}
+
+void MaterialLibrary::destroy() {
+    const GLuint buffers[] = {mMaterialsBuffer, mObjectMaterialsBuffer};
+    mFunctions->glDeleteBuffers(sizeof(buffers) / sizeof(buffers[0]), buffers);
+    mMaterialsBuffer = 0;
+    mObjectMaterialsBuffer = 0;
+    if (mTexture != 0) {
+        mFunctions->glDeleteTextures(1, &mTexture);
+        mTexture = 0;
+    }
+    mLayerCount = 0;
+}
+
+GLint MaterialLibrary::addLayer(TextureLoader &loader, const QString &fileName) {
+    if (Q_UNLIKELY(mLayerCount >= mMaxLayers)) {
+        qWarning() << "Material texture array is full, cannot add" << fileName;
+        return -1;
+    }
+    const GLint layer = mLayerCount++;
+    loader.loadLayer(fileName, mTexture, layer, mLayerSize);
+    return layer;
+}
+
+void MaterialLibrary::setMaterials(const std::vector<Material> &materials) {
+    mFunctions->glDeleteBuffers(1, &mMaterialsBuffer);
+    mMaterialCount = materials.size();
+    mMaterialsBuffer = createStorage(mFunctions, materials.data(), materials.size(), sizeof(Material));
+}
+
+void MaterialLibrary::setObjectMaterials(const GLuint *materials, std::size_t count) {
+    mFunctions->glDeleteBuffers(1, &mObjectMaterialsBuffer);
+    mObjectCount = count;
+    mObjectMaterialsBuffer = createStorage(mFunctions, materials, count, sizeof(GLuint));
+}
+
+void MaterialLibrary::bind(GLStateCache &state, GLuint textureUnit) const {
+    state.bindTextureUnit(textureUnit, mTexture);
+    state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, objectMaterialsBinding, mObjectMaterialsBuffer);
+    state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, materialsBinding, mMaterialsBuffer);
+}
@@ -0,0 +1,66 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_MATERIALLIBRARY_H
+#define GLTUT2_MATERIALLIBRARY_H
+
+#include <array>
+#include <vector>
+#include <QSize>
+#include <QString>
+#include <QtGui/qopengl.h>
+
+class GLStateCache;
+class QOpenGLFunctions_4_5_Core;
+class TextureLoader;
+
+// Packs every material texture into the layers of one GL_TEXTURE_2D_ARRAY and keeps material
+// parameters and the per-object material index in shader storage buffers. Objects with
+// different materials then share the program, the texture binding and the draw call; shaders
+// pick their layers through the object's material index.
+class MaterialLibrary {
+public:
+    // Matches the std430 layout of Material in fragment.glsl.
+    struct Material {
+        GLuint baseLayer;
+        GLuint detailLayer;
+        GLfloat detailMix;
+        GLfloat padding;
+        std::array<GLfloat, 4> tint;
+    };
+
+    static constexpr GLuint objectMaterialsBinding = 4;
+    static constexpr GLuint materialsBinding = 5;
+
+    explicit MaterialLibrary(QOpenGLFunctions_4_5_Core *functions, const QSize &layerSize = QSize(512, 512),
+                             GLenum internalFormat = GL_RGBA8, GLsizei maxLayers = 16);
+
+    void create();
+    void destroy();
+
+    GLint addLayer(TextureLoader &loader, const QString &fileName);
+    void setMaterials(const std::vector<Material> &materials);
+    void setObjectMaterials(const GLuint *materials, std::size_t count);
+    void bind(GLStateCache &state, GLuint textureUnit) const;
+
+    GLuint texture() const { return mTexture; }
+    GLenum internalFormat() const { return mInternalFormat; }
+    GLsizei layerCount() const { return mLayerCount; }
+    std::size_t materialCount() const { return mMaterialCount; }
+    std::size_t objectCount() const { return mObjectCount; }
+
+private:
+    QOpenGLFunctions_4_5_Core *mFunctions;
+    const QSize mLayerSize;
+    const GLenum mInternalFormat;
+    const GLsizei mMaxLayers;
+    GLuint mTexture;
+    GLsizei mLayerCount;
+    GLuint mMaterialsBuffer;
+    std::size_t mMaterialCount;
+    GLuint mObjectMaterialsBuffer;
+    std::size_t mObjectCount;
+};
+
+#endif //GLTUT2_MATERIALLIBRARY_H
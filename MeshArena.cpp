@@ -0,0 +1,206 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "MeshArena.h"
+#include <algorithm>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QOpenGLFunctions_4_5_Core>
+
+namespace {
+    GLsizeiptr indexSize(GLenum indexType) {
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    }
+}
+
+MeshArena::MeshArena(QOpenGLFunctions_4_5_Core *functions, GLsizei stride, GLsizeiptr vertexBytes,
+                     GLsizeiptr indexBytes) :
+        mFunctions(functions),
+        mStride(std::max(stride, 1)),
+        mVertices(static_cast<std::uint32_t>(vertexBytes / mStride)),
+        mIndices(static_cast<std::uint32_t>((indexBytes + indexUnit - 1) / indexUnit)),
+        mVertexBuffer(0),
+        mIndexBuffer(0),
+        mMeshes(),
+        mFreeHandles(),
+        mAttachments(),
+        mCompactions(0),
+        mCompactNs(0),
+        mFailedAllocations(0) {
+}
+
+void MeshArena::create() {
+    allocateStorage(mVertexBuffer, mIndexBuffer);
+}
+
+void MeshArena::destroy() {
+    if (mVertexBuffer != 0) {
+        const GLuint buffers[] = {mVertexBuffer, mIndexBuffer};
+        mFunctions->glDeleteBuffers(2, buffers);
+        mVertexBuffer = 0;
+        mIndexBuffer = 0;
+    }
+    mMeshes.clear();
+    mFreeHandles.clear();
+    mAttachments.clear();
+    mVertices.reset(mVertices.capacity());
+    mIndices.reset(mIndices.capacity());
+}
+
+std::uint32_t MeshArena::indexUnits(GLsizei indexCount, GLenum indexType) {
+    return static_cast<std::uint32_t>((indexCount * indexSize(indexType) + indexUnit - 1) / indexUnit);
+}
+
+void MeshArena::allocateStorage(GLuint &vertexBuffer, GLuint &indexBuffer) const {
+    GLuint buffers[2];
+    mFunctions->glCreateBuffers(2, buffers);
+    mFunctions->glNamedBufferStorage(buffers[0], static_cast<GLsizeiptr>(mVertices.capacity()) * mStride, nullptr,
+                                     GL_DYNAMIC_STORAGE_BIT);
+    mFunctions->glNamedBufferStorage(buffers[1], static_cast<GLsizeiptr>(mIndices.capacity()) * indexUnit, nullptr,
+                                     GL_DYNAMIC_STORAGE_BIT);
+    vertexBuffer = buffers[0];
+    indexBuffer = buffers[1];
+}
+
+MeshArena::Handle MeshArena::add(const void *vertices, GLsizei vertexCount, const void *indices, GLsizei indexCount,
+                                 GLenum indexType) {
+    const auto vertexUnits = static_cast<std::uint32_t>(vertexCount);
+    const std::uint32_t meshIndexUnits = indexUnits(indexCount, indexType);
+    OffsetAllocator::Allocation vertexAllocation = mVertices.allocate(vertexUnits);
+    OffsetAllocator::Allocation indexAllocation = mIndices.allocate(meshIndexUnits);
+    if (Q_UNLIKELY(vertexAllocation.node == OffsetAllocator::invalidNode
+                   || indexAllocation.node == OffsetAllocator::invalidNode)) {
+        mVertices.free(vertexAllocation.node);
+        mIndices.free(indexAllocation.node);
+        const OffsetAllocator::Statistics &vertexStatistics = mVertices.statistics();
+        const OffsetAllocator::Statistics &indexStatistics = mIndices.statistics();
+        if (vertexStatistics.capacity - vertexStatistics.used >= vertexUnits
+            && indexStatistics.capacity - indexStatistics.used >= meshIndexUnits) {
+            compact();
+            vertexAllocation = mVertices.allocate(vertexUnits);
+            indexAllocation = mIndices.allocate(meshIndexUnits);
+        }
+        if (vertexAllocation.node == OffsetAllocator::invalidNode || indexAllocation.node == OffsetAllocator::invalidNode) {
+            mVertices.free(vertexAllocation.node);
+            mIndices.free(indexAllocation.node);
+            ++mFailedAllocations;
+            qWarning() << "Mesh arena is out of space for" << vertexCount << "vertices and" << indexCount << "indices";
+            return invalidHandle;
+        }
+    }
+
+    const GLsizeiptr meshIndexSize = indexSize(indexType);
+    const Record record{
+            Mesh{static_cast<GLint>(vertexAllocation.offset), vertexCount,
+                 static_cast<GLintptr>(indexAllocation.offset) * indexUnit,
+                 static_cast<GLuint>(indexAllocation.offset * indexUnit / meshIndexSize), indexCount, indexType},
+            vertexAllocation.node, indexAllocation.node};
+    mFunctions->glNamedBufferSubData(mVertexBuffer, static_cast<GLintptr>(vertexAllocation.offset) * mStride,
+                                     static_cast<GLsizeiptr>(vertexCount) * mStride, vertices);
+    mFunctions->glNamedBufferSubData(mIndexBuffer, record.mesh.indexOffset, indexCount * meshIndexSize, indices);
+
+    if (!mFreeHandles.empty()) {
+        const Handle handle = mFreeHandles.back();
+        mFreeHandles.pop_back();
+        mMeshes[handle] = record;
+        return handle;
+    }
+    mMeshes.push_back(record);
+    return static_cast<Handle>(mMeshes.size() - 1);
+}
+
+void MeshArena::remove(Handle handle) {
+    if (Q_UNLIKELY(handle >= mMeshes.size() || mMeshes[handle].vertexNode == OffsetAllocator::invalidNode)) {
+        return;
+    }
+    Record &record = mMeshes[handle];
+    mVertices.free(record.vertexNode);
+    mIndices.free(record.indexNode);
+    record.vertexNode = OffsetAllocator::invalidNode;
+    record.indexNode = OffsetAllocator::invalidNode;
+    mFreeHandles.push_back(handle);
+}
+
+void MeshArena::compact() {
+    if (mVertexBuffer == 0) {
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    GLuint vertexBuffer;
+    GLuint indexBuffer;
+    allocateStorage(vertexBuffer, indexBuffer);
+    // A fresh allocator carves every request off the front of its single free block.
+    mVertices.reset(mVertices.capacity());
+    mIndices.reset(mIndices.capacity());
+    for (Record &record : mMeshes) {
+        if (record.vertexNode == OffsetAllocator::invalidNode) {
+            continue;
+        }
+        Mesh &mesh = record.mesh;
+        const GLsizeiptr meshIndexSize = indexSize(mesh.indexType);
+        const OffsetAllocator::Allocation &vertexAllocation = mVertices.allocate(static_cast<std::uint32_t>(mesh.vertexCount));
+        const OffsetAllocator::Allocation &indexAllocation = mIndices.allocate(indexUnits(mesh.indexCount, mesh.indexType));
+        const GLintptr indexOffset = static_cast<GLintptr>(indexAllocation.offset) * indexUnit;
+        mFunctions->glCopyNamedBufferSubData(mVertexBuffer, vertexBuffer,
+                                             static_cast<GLintptr>(mesh.baseVertex) * mStride,
+                                             static_cast<GLintptr>(vertexAllocation.offset) * mStride,
+                                             static_cast<GLsizeiptr>(mesh.vertexCount) * mStride);
+        mFunctions->glCopyNamedBufferSubData(mIndexBuffer, indexBuffer, mesh.indexOffset, indexOffset,
+                                             mesh.indexCount * meshIndexSize);
+        mesh.baseVertex = static_cast<GLint>(vertexAllocation.offset);
+        mesh.indexOffset = indexOffset;
+        mesh.firstIndex = static_cast<GLuint>(indexOffset / meshIndexSize);
+        record.vertexNode = vertexAllocation.node;
+        record.indexNode = indexAllocation.node;
+    }
+    // The driver keeps the old storage alive until queued draws that read it have finished.
+    const GLuint buffers[] = {mVertexBuffer, mIndexBuffer};
+    mFunctions->glDeleteBuffers(2, buffers);
+    mVertexBuffer = vertexBuffer;
+    mIndexBuffer = indexBuffer;
+    attachAll();
+    ++mCompactions;
+    mCompactNs += timer.nsecsElapsed();
+}
+
+void MeshArena::attach(GLuint vertexArray, GLuint binding) {
+    const auto attached = std::find_if(mAttachments.cbegin(), mAttachments.cend(), [vertexArray](const Attachment &a) {
+        return a.vertexArray == vertexArray;
+    });
+    if (attached == mAttachments.cend()) {
+        mAttachments.push_back(Attachment{vertexArray, binding});
+    }
+    mFunctions->glVertexArrayVertexBuffer(vertexArray, binding, mVertexBuffer, 0, mStride);
+    mFunctions->glVertexArrayElementBuffer(vertexArray, mIndexBuffer);
+}
+
+void MeshArena::attachAll() const {
+    for (const Attachment &attachment : mAttachments) {
+        mFunctions->glVertexArrayVertexBuffer(attachment.vertexArray, attachment.binding, mVertexBuffer, 0, mStride);
+        mFunctions->glVertexArrayElementBuffer(attachment.vertexArray, mIndexBuffer);
+    }
+}
+
+MeshArena::Statistics MeshArena::statistics() const {
+    return Statistics{
+            static_cast<int>(mMeshes.size() - mFreeHandles.size()),
+            mStride,
+            mVertices.statistics(),
+            mIndices.statistics(),
+            mCompactions,
+            mCompactNs,
+            mFailedAllocations
+    };
+}
+
+void MeshArena::logStatistics() const {
+    const Statistics &statistics = this->statistics();
+    qDebug() << "Mesh arena:" << statistics.meshes << "meshes,"
+             << statistics.vertices.used * static_cast<qint64>(mStride) / 1024 << "KiB of vertices and"
+             << statistics.indices.used * static_cast<qint64>(indexUnit) / 1024 << "KiB of indices,"
+             << statistics.vertices.occupancy() * 100.0f << "% and" << statistics.indices.occupancy() * 100.0f
+             << "% occupied," << statistics.vertices.fragmentation() * 100.0f << "% and"
+             << statistics.indices.fragmentation() * 100.0f << "% fragmented";
+}
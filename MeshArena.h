@@ -0,0 +1,98 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_MESHARENA_H
+#define GLTUT2_MESHARENA_H
+
+#include "OffsetAllocator.h"
+#include <vector>
+#include <QtGui/qopengl.h>
+
+class QOpenGLFunctions_4_5_Core;
+
+// Keeps every mesh of one vertex layout in a single immutable vertex buffer and a single
+// immutable index buffer, sub-allocated with OffsetAllocator. Meshes are drawn with a base
+// vertex and an index offset, so any number of them share one vertex array and switching
+// meshes never rebinds buffers. Vertices are allocated in whole vertices, indices in four
+// byte units, so 16 and 32 bit index meshes can live side by side.
+// compact() moves the live meshes to the front of fresh buffers and re-attaches every
+// vertex array handed to attach(); handles stay valid, offsets do not, so read them from
+// mesh() at draw time rather than caching them.
+class MeshArena {
+public:
+    typedef quint32 Handle;
+    static constexpr Handle invalidHandle = ~Handle(0);
+
+    struct Mesh {
+        GLint baseVertex;
+        GLsizei vertexCount;
+        GLintptr indexOffset;
+        GLuint firstIndex;
+        GLsizei indexCount;
+        GLenum indexType;
+    };
+
+    struct Statistics {
+        int meshes;
+        GLsizei stride;
+        OffsetAllocator::Statistics vertices;
+        OffsetAllocator::Statistics indices;
+        int compactions;
+        qint64 compactNs;
+        int failedAllocations;
+    };
+
+    MeshArena(QOpenGLFunctions_4_5_Core *functions, GLsizei stride, GLsizeiptr vertexBytes = 32 * 1024 * 1024,
+              GLsizeiptr indexBytes = 16 * 1024 * 1024);
+
+    void create();
+    void destroy();
+
+    // Copies the mesh into the arena, compacting first when only fragmentation stands in the way.
+    Handle add(const void *vertices, GLsizei vertexCount, const void *indices, GLsizei indexCount, GLenum indexType);
+    void remove(Handle handle);
+    const Mesh &mesh(Handle handle) const { return mMeshes[handle].mesh; }
+    void compact();
+
+    // Points binding of vertexArray at the vertex buffer and its element buffer at the index buffer.
+    void attach(GLuint vertexArray, GLuint binding);
+
+    GLuint vertexBuffer() const { return mVertexBuffer; }
+    GLuint indexBuffer() const { return mIndexBuffer; }
+    Statistics statistics() const;
+    void logStatistics() const;
+
+private:
+    static constexpr GLsizeiptr indexUnit = 4;
+
+    struct Record {
+        Mesh mesh;
+        OffsetAllocator::Node vertexNode;
+        OffsetAllocator::Node indexNode;
+    };
+
+    struct Attachment {
+        GLuint vertexArray;
+        GLuint binding;
+    };
+
+    static std::uint32_t indexUnits(GLsizei indexCount, GLenum indexType);
+    void allocateStorage(GLuint &vertexBuffer, GLuint &indexBuffer) const;
+    void attachAll() const;
+
+    QOpenGLFunctions_4_5_Core *mFunctions;
+    const GLsizei mStride;
+    OffsetAllocator mVertices;
+    OffsetAllocator mIndices;
+    GLuint mVertexBuffer;
+    GLuint mIndexBuffer;
+    std::vector<Record> mMeshes;
+    std::vector<Handle> mFreeHandles;
+    std::vector<Attachment> mAttachments;
+    int mCompactions;
+    qint64 mCompactNs;
+    int mFailedAllocations;
+};
+
+#endif //GLTUT2_MESHARENA_H
@@ -0,0 +1,187 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "MeshFile.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <QByteArray>
+#include <QDebug>
+#include <QSaveFile>
+
+namespace {
+    const std::array<char, 4> magic{'G', 'L', 'T', 'M'};
+    constexpr quint32 version = 2;
+    constexpr quint64 dataAlignment = 16;
+
+    struct Header {
+        std::array<char, 4> magic;
+        quint32 version;
+        quint32 layout;
+        quint32 levelCount;
+        float positionScale;
+        std::array<float, 3> boundsMin;
+        std::array<float, 3> boundsMax;
+        quint32 reserved;
+    };
+    static_assert(sizeof(Header) == 48, "Mesh header must be 48 bytes");
+
+    struct LevelHeader {
+        quint32 indexType;
+        quint32 vertexCount;
+        quint32 indexCount;
+        float error;
+        quint64 vertexOffset;
+        quint64 vertexSize;
+        quint64 indexOffset;
+        quint64 indexSize;
+    };
+    static_assert(sizeof(LevelHeader) == 48, "Mesh level header must be 48 bytes");
+
+    quint64 alignUp(quint64 value) {
+        return (value + dataAlignment - 1) & ~(dataAlignment - 1);
+    }
+
+    bool inFile(quint64 offset, quint64 size, quint64 fileSize) {
+        return offset <= fileSize && size <= fileSize - offset;
+    }
+
+    // The mapping gives no alignment guarantee for a corrupt file, so indices are copied out one by one.
+    template<typename Index>
+    quint32 maxIndex(const uchar *data, quint64 count) {
+        Index largest = 0;
+        for (quint64 i = 0; i < count; ++i) {
+            Index index;
+            std::memcpy(&index, data + i * sizeof(Index), sizeof(Index));
+            largest = std::max(largest, index);
+        }
+        return largest;
+    }
+}
+
+MeshFile::MeshFile() :
+        mFile(),
+        mData(nullptr),
+        mLayout(VertexLayout::Full),
+        mPositionScale(1.0f),
+        mBoundsMin(),
+        mBoundsMax(),
+        mLevels() {
+}
+
+MeshFile::~MeshFile() {
+    close();
+}
+
+bool MeshFile::open(const QString &fileName) {
+    close();
+    mFile.setFileName(fileName);
+    if (Q_UNLIKELY(!mFile.open(QIODevice::ReadOnly))) {
+        qWarning() << "Failed to open mesh" << fileName << mFile.errorString();
+        return false;
+    }
+    const auto fileSize = static_cast<quint64>(mFile.size());
+    Header header{};
+    if (Q_UNLIKELY(fileSize < sizeof(header))) {
+        qWarning() << "Mesh" << fileName << "is truncated";
+        close();
+        return false;
+    }
+    mData = mFile.map(0, mFile.size());
+    if (Q_UNLIKELY(mData == nullptr)) {
+        qWarning() << "Failed to map mesh" << fileName << mFile.errorString();
+        close();
+        return false;
+    }
+    std::memcpy(&header, mData, sizeof(header));
+
+    if (Q_UNLIKELY(header.magic != magic || header.version != version || header.layout > VertexLayout::Compact
+                   || header.levelCount == 0 || header.levelCount > maxLevels
+                   || fileSize < sizeof(header) + header.levelCount * sizeof(LevelHeader))) {
+        qWarning() << "Mesh" << fileName << "is not a supported mesh file";
+        close();
+        return false;
+    }
+    const VertexLayout layout(static_cast<VertexLayout::Preset>(header.layout));
+    for (quint32 i = 0; i < header.levelCount; ++i) {
+        LevelHeader level{};
+        std::memcpy(&level, mData + sizeof(header) + i * sizeof(level), sizeof(level));
+        const quint64 indexBytes = level.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+        if (Q_UNLIKELY((level.indexType != GL_UNSIGNED_SHORT && level.indexType != GL_UNSIGNED_INT)
+                       || level.vertexSize != static_cast<quint64>(level.vertexCount) * layout.stride()
+                       || level.indexSize != level.indexCount * indexBytes
+                       || !inFile(level.vertexOffset, level.vertexSize, fileSize)
+                       || !inFile(level.indexOffset, level.indexSize, fileSize))) {
+            qWarning() << "Mesh" << fileName << "is corrupt";
+            close();
+            return false;
+        }
+        // Draws read the indices unchecked, so one past the vertices would read outside the mesh.
+        const uchar *indexData = mData + level.indexOffset;
+        const quint32 largestIndex = level.indexType == GL_UNSIGNED_SHORT
+                ? maxIndex<GLushort>(indexData, level.indexCount) : maxIndex<GLuint>(indexData, level.indexCount);
+        if (Q_UNLIKELY(level.indexCount > 0 && largestIndex >= level.vertexCount)) {
+            qWarning() << "Mesh" << fileName << "level" << i << "indexes vertex" << largestIndex << "of"
+                       << level.vertexCount;
+            close();
+            return false;
+        }
+        mLevels.push_back(Level{level.indexType, static_cast<GLsizei>(level.vertexCount),
+                                static_cast<GLsizei>(level.indexCount), level.error, mData + level.vertexOffset,
+                                static_cast<GLsizeiptr>(level.vertexSize), mData + level.indexOffset,
+                                static_cast<GLsizeiptr>(level.indexSize)});
+    }
+
+    mLayout = layout.preset();
+    mPositionScale = header.positionScale;
+    mBoundsMin = QVector3D(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    mBoundsMax = QVector3D(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+    return true;
+}
+
+void MeshFile::close() {
+    mLevels.clear();
+    if (mData != nullptr) {
+        mFile.unmap(mData);
+        mData = nullptr;
+    }
+    mFile.close();
+}
+
+bool MeshFile::write(const QString &fileName, const VertexLayout &layout, const std::vector<LevelSource> &levels,
+                     const QVector3D &boundsMin, const QVector3D &boundsMax) {
+    const Header header{magic, version, static_cast<quint32>(layout.preset()), static_cast<quint32>(levels.size()),
+                        levels.front().mesh.positionScale,
+                        {boundsMin.x(), boundsMin.y(), boundsMin.z()}, {boundsMax.x(), boundsMax.y(), boundsMax.z()}, 0};
+    std::vector<LevelHeader> levelHeaders;
+    quint64 offset = alignUp(sizeof(Header) + levels.size() * sizeof(LevelHeader));
+    for (const auto &level : levels) {
+        const VertexLayout::PackedMesh &mesh = level.mesh;
+        const quint64 vertexOffset = offset;
+        const quint64 indexOffset = alignUp(vertexOffset + mesh.vertices.size());
+        offset = alignUp(indexOffset + mesh.indices.size());
+        levelHeaders.push_back(LevelHeader{mesh.indexType, static_cast<quint32>(level.vertexCount),
+                                           static_cast<quint32>(mesh.indexCount), level.error,
+                                           vertexOffset, mesh.vertices.size(), indexOffset, mesh.indices.size()});
+    }
+
+    QSaveFile file(fileName);
+    if (Q_UNLIKELY(!file.open(QIODevice::WriteOnly))) {
+        qWarning() << "Failed to create mesh" << fileName << file.errorString();
+        return false;
+    }
+    QByteArray data(static_cast<int>(offset), '\0');
+    std::memcpy(data.data(), &header, sizeof(header));
+    std::memcpy(data.data() + sizeof(header), levelHeaders.data(), levelHeaders.size() * sizeof(LevelHeader));
+    for (std::size_t i = 0; i < levels.size(); ++i) {
+        const VertexLayout::PackedMesh &mesh = levels[i].mesh;
+        std::memcpy(data.data() + levelHeaders[i].vertexOffset, mesh.vertices.data(), mesh.vertices.size());
+        std::memcpy(data.data() + levelHeaders[i].indexOffset, mesh.indices.data(), mesh.indices.size());
+    }
+    if (Q_UNLIKELY(file.write(data) != data.size() || !file.commit())) {
+        qWarning() << "Failed to write mesh" << fileName << file.errorString();
+        return false;
+    }
+    return true;
+}
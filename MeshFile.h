@@ -0,0 +1,71 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_MESHFILE_H
+#define GLTUT2_MESHFILE_H
+
+#include "VertexLayout.h"
+#include <vector>
+#include <QFile>
+#include <QString>
+#include <QVector3D>
+#include <QtGui/qopengl.h>
+
+// Flat binary mesh written by gltut2-meshconv: a fixed header and a table of levels of detail,
+// each with its own packed vertex buffer and index buffer aligned to 16 bytes, exactly as the
+// GPU consumes them. Level 0 is the source mesh; every further level is coarser, with the
+// geometric error of its simplification in mesh units. All levels share positionScale().
+// open() memory-maps the file, so level data can go straight into GPU buffers without an
+// intermediate copy.
+class MeshFile {
+public:
+    static constexpr int maxLevels = 8;
+
+    struct Level {
+        GLenum indexType;
+        GLsizei vertexCount;
+        GLsizei indexCount;
+        float error;
+        const uchar *vertexData;
+        GLsizeiptr vertexSize;
+        const uchar *indexData;
+        GLsizeiptr indexSize;
+    };
+
+    struct LevelSource {
+        VertexLayout::PackedMesh mesh;
+        std::size_t vertexCount;
+        float error;
+    };
+
+    MeshFile();
+    ~MeshFile();
+
+    bool open(const QString &fileName);
+    void close();
+
+    bool isOpen() const { return mData != nullptr; }
+    VertexLayout::Preset layout() const { return mLayout; }
+    GLfloat positionScale() const { return mPositionScale; }
+    const QVector3D &boundsMin() const { return mBoundsMin; }
+    const QVector3D &boundsMax() const { return mBoundsMax; }
+    int levelCount() const { return static_cast<int>(mLevels.size()); }
+    const Level &level(int level) const { return mLevels[level]; }
+
+    static bool write(const QString &fileName, const VertexLayout &layout, const std::vector<LevelSource> &levels,
+                      const QVector3D &boundsMin, const QVector3D &boundsMax);
+
+private:
+    Q_DISABLE_COPY(MeshFile)
+
+    QFile mFile;
+    uchar *mData;
+    VertexLayout::Preset mLayout;
+    GLfloat mPositionScale;
+    QVector3D mBoundsMin;
+    QVector3D mBoundsMax;
+    std::vector<Level> mLevels;
+};
+
+#endif //GLTUT2_MESHFILE_H
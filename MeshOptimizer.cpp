@@ -0,0 +1,131 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+    constexpr GLuint unused = std::numeric_limits<GLuint>::max();
+
+    struct Adjacency {
+        std::vector<GLuint> offsets;
+        std::vector<GLuint> triangles;
+    };
+
+    Adjacency buildAdjacency(const std::vector<GLuint> &indices, std::size_t vertexCount) {
+        Adjacency adjacency{std::vector<GLuint>(vertexCount + 1, 0), std::vector<GLuint>(indices.size())};
+        for (const GLuint index : indices) {
+            ++adjacency.offsets[index + 1];
+        }
+        for (std::size_t i = 1; i <= vertexCount; ++i) {
+            adjacency.offsets[i] += adjacency.offsets[i - 1];
+        }
+        std::vector<GLuint> cursor(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+        for (std::size_t i = 0; i < indices.size(); ++i) {
+            adjacency.triangles[cursor[indices[i]]++] = static_cast<GLuint>(i / 3);
+        }
+        return adjacency;
+    }
+}
+
+std::vector<GLuint> MeshOptimizer::optimizeVertexCache(const std::vector<GLuint> &indices, std::size_t vertexCount,
+                                                       int cacheSize) {
+    const Adjacency &adjacency = buildAdjacency(indices, vertexCount);
+    std::vector<int> liveTriangles(vertexCount);
+    for (std::size_t vertex = 0; vertex < vertexCount; ++vertex) {
+        liveTriangles[vertex] = static_cast<int>(adjacency.offsets[vertex + 1] - adjacency.offsets[vertex]);
+    }
+    std::vector<int> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(indices.size() / 3, false);
+    std::vector<GLuint> deadEnds;
+    std::vector<GLuint> candidates;
+    std::vector<GLuint> result;
+    result.reserve(indices.size());
+
+    int time = cacheSize + 1;
+    std::size_t cursor = 0;
+    GLuint fanning = vertexCount > 0 ? 0 : unused;
+    while (fanning != unused) {
+        candidates.clear();
+        for (GLuint i = adjacency.offsets[fanning]; i < adjacency.offsets[fanning + 1]; ++i) {
+            const GLuint triangle = adjacency.triangles[i];
+            if (emitted[triangle]) {
+                continue;
+            }
+            for (int corner = 0; corner < 3; ++corner) {
+                const GLuint vertex = indices[triangle * 3 + corner];
+                result.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                --liveTriangles[vertex];
+                if (time - cacheTime[vertex] > cacheSize) {
+                    cacheTime[vertex] = time++;
+                }
+            }
+            emitted[triangle] = true;
+        }
+
+        // Prefer the candidate that will still be cached after its remaining fan is emitted,
+        // the oldest such one first, since it is the closest to being evicted.
+        fanning = unused;
+        int best = -1;
+        for (const GLuint vertex : candidates) {
+            if (liveTriangles[vertex] <= 0) {
+                continue;
+            }
+            int priority = 0;
+            if (time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize) {
+                priority = time - cacheTime[vertex];
+            }
+            if (priority > best) {
+                best = priority;
+                fanning = vertex;
+            }
+        }
+        while (fanning == unused && !deadEnds.empty()) {
+            const GLuint vertex = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[vertex] > 0) {
+                fanning = vertex;
+            }
+        }
+        for (; fanning == unused && cursor < vertexCount; ++cursor) {
+            if (liveTriangles[cursor] > 0) {
+                fanning = static_cast<GLuint>(cursor);
+            }
+        }
+    }
+    return result;
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<MeshVertex> &vertices, std::vector<GLuint> &indices) {
+    std::vector<GLuint> remap(vertices.size(), unused);
+    std::vector<MeshVertex> reordered;
+    reordered.reserve(vertices.size());
+    for (GLuint &index : indices) {
+        if (remap[index] == unused) {
+            remap[index] = static_cast<GLuint>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(reordered);
+}
+
+double MeshOptimizer::acmr(const std::vector<GLuint> &indices, std::size_t vertexCount, int cacheSize) {
+    if (indices.empty()) {
+        return 0.0;
+    }
+    // A vertex is cached while fewer than cacheSize misses happened since it was last loaded.
+    std::vector<std::size_t> loadedAt(vertexCount, 0);
+    std::size_t misses = 0;
+    for (const GLuint index : indices) {
+        if (loadedAt[index] == 0 || misses - loadedAt[index] >= static_cast<std::size_t>(cacheSize)) {
+            ++misses;
+            loadedAt[index] = misses;
+        }
+    }
+    return static_cast<double>(misses) / (indices.size() / 3);
+}
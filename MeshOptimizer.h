@@ -0,0 +1,26 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_MESHOPTIMIZER_H
+#define GLTUT2_MESHOPTIMIZER_H
+
+#include "VertexLayout.h"
+#include <vector>
+#include <QtGui/qopengl.h>
+
+// Offline index and vertex reordering for mesh conversion.
+class MeshOptimizer {
+public:
+    // Tipsify (Sander, Nehab and Barczak, 2007): fans around the most recently cached vertex that
+    // still has triangles left, which keeps the post-transform cache warm in linear time and emits
+    // triangles in spatially coherent clusters.
+    static std::vector<GLuint> optimizeVertexCache(const std::vector<GLuint> &indices, std::size_t vertexCount,
+                                                   int cacheSize);
+    // Renumbers vertices in order of first use, so vertex fetch walks memory forwards.
+    static void optimizeVertexFetch(std::vector<MeshVertex> &vertices, std::vector<GLuint> &indices);
+    // Average cache miss ratio: vertex shader invocations per triangle with a FIFO cache.
+    static double acmr(const std::vector<GLuint> &indices, std::size_t vertexCount, int cacheSize);
+};
+
+#endif //GLTUT2_MESHOPTIMIZER_H
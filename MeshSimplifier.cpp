@@ -0,0 +1,246 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+namespace {
+    constexpr int maxPasses = 64;
+
+    // Sum of weighted squared distances to a set of planes, as the symmetric matrix A, vector b and
+    // scalar c of p'Ap + 2b'p + c.
+    struct Quadric {
+        double xx, xy, xz, yy, yz, zz;
+        double x, y, z;
+        double c;
+        double weight;
+
+        void addPlane(const QVector3D &normal, float distance, double planeWeight) {
+            const double a = normal.x();
+            const double b = normal.y();
+            const double n = normal.z();
+            const double d = distance;
+            xx += planeWeight * a * a;
+            xy += planeWeight * a * b;
+            xz += planeWeight * a * n;
+            yy += planeWeight * b * b;
+            yz += planeWeight * b * n;
+            zz += planeWeight * n * n;
+            x += planeWeight * a * d;
+            y += planeWeight * b * d;
+            z += planeWeight * n * d;
+            c += planeWeight * d * d;
+            weight += planeWeight;
+        }
+
+        void add(const Quadric &other) {
+            xx += other.xx;
+            xy += other.xy;
+            xz += other.xz;
+            yy += other.yy;
+            yz += other.yz;
+            zz += other.zz;
+            x += other.x;
+            y += other.y;
+            z += other.z;
+            c += other.c;
+            weight += other.weight;
+        }
+
+        // Weighted mean squared distance from point to the planes.
+        double error(const QVector3D &point) const {
+            const double px = point.x();
+            const double py = point.y();
+            const double pz = point.z();
+            const double value = xx * px * px + yy * py * py + zz * pz * pz
+                                 + 2.0 * (xy * px * py + xz * px * pz + yz * py * pz)
+                                 + 2.0 * (x * px + y * py + z * pz) + c;
+            return weight > 0.0 ? std::max(value, 0.0) / weight : 0.0;
+        }
+    };
+
+    struct Collapse {
+        GLuint from;
+        GLuint to;
+        double cost;
+    };
+
+    struct PositionHash {
+        std::size_t operator()(const std::array<quint32, 3> &bits) const {
+            return (static_cast<std::size_t>(bits[0]) * 73856093u) ^ (static_cast<std::size_t>(bits[1]) * 19349663u)
+                   ^ (static_cast<std::size_t>(bits[2]) * 83492791u);
+        }
+    };
+
+    std::array<quint32, 3> positionBits(const QVector3D &position) {
+        const float components[] = {position.x(), position.y(), position.z()};
+        std::array<quint32, 3> bits;
+        std::memcpy(bits.data(), components, sizeof(components));
+        return bits;
+    }
+
+    // Seam and border vertices; collapsing them would tear the texture mapping or shrink outlines.
+    std::vector<bool> lockedVertices(const std::vector<MeshVertex> &vertices, const std::vector<GLuint> &indices) {
+        std::vector<bool> locked(vertices.size(), false);
+        std::unordered_map<std::array<quint32, 3>, int, PositionHash> positions;
+        for (const auto &vertex : vertices) {
+            ++positions[positionBits(vertex.position)];
+        }
+        for (std::size_t i = 0; i < vertices.size(); ++i) {
+            locked[i] = positions[positionBits(vertices[i].position)] > 1;
+        }
+        std::unordered_map<quint64, int> edges;
+        for (std::size_t i = 0; i < indices.size(); i += 3) {
+            for (std::size_t corner = 0; corner < 3; ++corner) {
+                const GLuint a = indices[i + corner];
+                const GLuint b = indices[i + (corner + 1) % 3];
+                ++edges[(static_cast<quint64>(std::min(a, b)) << 32) | std::max(a, b)];
+            }
+        }
+        for (const auto &edge : edges) {
+            if (edge.second == 1) {
+                locked[edge.first >> 32] = true;
+                locked[edge.first & 0xffffffffu] = true;
+            }
+        }
+        return locked;
+    }
+
+    QVector3D faceNormal(const QVector3D &a, const QVector3D &b, const QVector3D &c) {
+        return QVector3D::crossProduct(b - a, c - a);
+    }
+}
+
+std::vector<GLuint> MeshSimplifier::simplify(const std::vector<MeshVertex> &vertices, const std::vector<GLuint> &indices,
+                                             std::size_t targetIndexCount, float *error) {
+    const std::size_t vertexCount = vertices.size();
+    std::vector<Quadric> quadrics(vertexCount, Quadric{});
+    for (std::size_t i = 0; i < indices.size(); i += 3) {
+        const QVector3D &a = vertices[indices[i]].position;
+        const QVector3D &cross = faceNormal(a, vertices[indices[i + 1]].position, vertices[indices[i + 2]].position);
+        const float length = cross.length();
+        if (length <= 0.0f) {
+            continue;
+        }
+        const QVector3D &normal = cross / length;
+        for (std::size_t corner = 0; corner < 3; ++corner) {
+            quadrics[indices[i + corner]].addPlane(normal, -QVector3D::dotProduct(normal, a), 0.5 * length);
+        }
+    }
+    const std::vector<bool> &locked = lockedVertices(vertices, indices);
+
+    std::vector<GLuint> result(indices);
+    std::vector<GLuint> adjacencyOffsets;
+    std::vector<GLuint> adjacency;
+    std::vector<Collapse> collapses;
+    std::vector<GLuint> remap(vertexCount);
+    std::vector<bool> touched;
+    double maxCost = 0.0;
+
+    // Would moving from onto to turn any surviving triangle around from over?
+    const auto flips = [&](GLuint from, GLuint to) {
+        for (GLuint i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1]; ++i) {
+            const GLuint *triangle = result.data() + adjacency[i] * 3;
+            if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+                continue;
+            }
+            QVector3D moved[3];
+            for (int corner = 0; corner < 3; ++corner) {
+                moved[corner] = vertices[triangle[corner] == from ? to : triangle[corner]].position;
+            }
+            const QVector3D &before = faceNormal(vertices[triangle[0]].position, vertices[triangle[1]].position,
+                                                 vertices[triangle[2]].position);
+            if (QVector3D::dotProduct(before, faceNormal(moved[0], moved[1], moved[2])) <= 0.0f) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    for (int pass = 0; pass < maxPasses && result.size() > targetIndexCount; ++pass) {
+        adjacencyOffsets.assign(vertexCount + 1, 0);
+        for (const GLuint index : result) {
+            ++adjacencyOffsets[index + 1];
+        }
+        std::partial_sum(adjacencyOffsets.cbegin(), adjacencyOffsets.cend(), adjacencyOffsets.begin());
+        adjacency.resize(result.size());
+        std::vector<GLuint> cursor(adjacencyOffsets.cbegin(), adjacencyOffsets.cend() - 1);
+        for (std::size_t i = 0; i < result.size(); ++i) {
+            adjacency[cursor[result[i]]++] = static_cast<GLuint>(i / 3);
+        }
+
+        collapses.clear();
+        for (std::size_t i = 0; i < result.size(); i += 3) {
+            for (std::size_t corner = 0; corner < 3; ++corner) {
+                const GLuint a = result[i + corner];
+                const GLuint b = result[i + (corner + 1) % 3];
+                Quadric merged = quadrics[a];
+                merged.add(quadrics[b]);
+                if (!locked[a]) {
+                    collapses.push_back(Collapse{a, b, merged.error(vertices[b].position)});
+                }
+                if (!locked[b]) {
+                    collapses.push_back(Collapse{b, a, merged.error(vertices[a].position)});
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &left, const Collapse &right) {
+            return left.cost < right.cost;
+        });
+
+        // Collapses within one pass must not share triangles, or their costs and flip tests go stale.
+        std::iota(remap.begin(), remap.end(), 0);
+        touched.assign(vertexCount, false);
+        const std::size_t trianglesToRemove = (result.size() - targetIndexCount + 2) / 3;
+        std::size_t removed = 0;
+        std::size_t collapsed = 0;
+        for (const Collapse &collapse : collapses) {
+            if (removed >= trianglesToRemove) {
+                break;
+            }
+            if (touched[collapse.from] || touched[collapse.to] || flips(collapse.from, collapse.to)) {
+                continue;
+            }
+            for (GLuint i = adjacencyOffsets[collapse.from]; i < adjacencyOffsets[collapse.from + 1]; ++i) {
+                const GLuint *triangle = result.data() + adjacency[i] * 3;
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                    ++removed;
+                }
+                for (int corner = 0; corner < 3; ++corner) {
+                    touched[triangle[corner]] = true;
+                }
+            }
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            maxCost = std::max(maxCost, collapse.cost);
+            ++collapsed;
+        }
+        if (collapsed == 0) {
+            break;
+        }
+
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < result.size(); i += 3) {
+            const GLuint a = remap[result[i]];
+            const GLuint b = remap[result[i + 1]];
+            const GLuint c = remap[result[i + 2]];
+            if (a == b || b == c || a == c) {
+                continue;
+            }
+            result[kept++] = a;
+            result[kept++] = b;
+            result[kept++] = c;
+        }
+        result.resize(kept);
+    }
+    if (error != nullptr) {
+        *error = static_cast<float>(std::sqrt(maxCost));
+    }
+    return result;
+}
@@ -0,0 +1,25 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_MESHSIMPLIFIER_H
+#define GLTUT2_MESHSIMPLIFIER_H
+
+#include "VertexLayout.h"
+#include <vector>
+#include <QtGui/qopengl.h>
+
+// Offline quadric error simplification (Garland and Heckbert, 1997) for level of detail chains.
+// Edges collapse one endpoint onto the other, so a level only drops vertices and never creates
+// new ones. Vertices on open borders and on attribute seams (a position shared by several
+// vertices) stay put, which keeps outlines and texture mapping intact.
+class MeshSimplifier {
+public:
+    // Collapses the cheapest edges in passes until at most targetIndexCount indices remain or no
+    // collapse is left that keeps every triangle facing the same way. error receives the largest
+    // collapse cost, as the root of the area-weighted mean squared distance to the source planes.
+    static std::vector<GLuint> simplify(const std::vector<MeshVertex> &vertices, const std::vector<GLuint> &indices,
+                                        std::size_t targetIndexCount, float *error);
+};
+
+#endif //GLTUT2_MESHSIMPLIFIER_H
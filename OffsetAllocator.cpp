@@ -0,0 +1,225 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "OffsetAllocator.h"
+#include <algorithm>
+#include <QtGlobal>
+
+namespace {
+    constexpr int linearSizes = 8;
+    constexpr int secondLevelShift = 3;
+
+    int highestBit(std::uint64_t value) {
+        return 63 - __builtin_clzll(value);
+    }
+
+    int lowestBit(std::uint32_t value) {
+        return __builtin_ctz(value);
+    }
+
+    // Bin holding blocks of size units; sizes below linearSizes get a bin each.
+    int floorBin(std::uint64_t size) {
+        if (size < linearSizes) {
+            return static_cast<int>(size);
+        }
+        const int bit = highestBit(size);
+        const int firstLevel = bit - secondLevelShift + 1;
+        const auto secondLevel = static_cast<int>((size >> (bit - secondLevelShift)) & (linearSizes - 1));
+        return firstLevel * linearSizes + secondLevel;
+    }
+
+    // First bin whose blocks are all at least size units.
+    int ceilBin(std::uint64_t size) {
+        if (size < linearSizes) {
+            return static_cast<int>(size);
+        }
+        const int bit = highestBit(size);
+        return floorBin(size + (std::uint64_t(1) << (bit - secondLevelShift)) - 1);
+    }
+}
+
+float OffsetAllocator::Statistics::occupancy() const {
+    return capacity == 0 ? 0.0f : static_cast<float>(used) / static_cast<float>(capacity);
+}
+
+float OffsetAllocator::Statistics::fragmentation() const {
+    const std::uint32_t free = capacity - used;
+    return free == 0 ? 0.0f : 1.0f - static_cast<float>(largestFree) / static_cast<float>(free);
+}
+
+OffsetAllocator::OffsetAllocator(std::uint32_t capacity) :
+        mCapacity(0),
+        mUsed(0),
+        mAllocations(0),
+        mFreeBlocks(0),
+        mNodes(),
+        mSpareNodes(),
+        mBins(),
+        mFirstLevelMask(0),
+        mSecondLevelMasks() {
+    reset(capacity);
+}
+
+void OffsetAllocator::reset(std::uint32_t capacity) {
+    mCapacity = capacity;
+    mUsed = 0;
+    mAllocations = 0;
+    mFreeBlocks = 0;
+    mNodes.clear();
+    mSpareNodes.clear();
+    mBins.fill(invalidNode);
+    mFirstLevelMask = 0;
+    mSecondLevelMasks.fill(0);
+    if (capacity > 0) {
+        insertFree(createNode(0, capacity));
+    }
+}
+
+OffsetAllocator::Allocation OffsetAllocator::allocate(std::uint32_t size) {
+    size = std::max<std::uint32_t>(size, 1);
+    const int bin = findBin(size);
+    if (Q_UNLIKELY(bin < 0)) {
+        return Allocation{0, invalidNode};
+    }
+    const Node node = mBins[bin];
+    removeFree(node);
+    const std::uint32_t remainder = mNodes[node].size - size;
+    if (remainder > 0) {
+        const Node rest = createNode(mNodes[node].offset + size, remainder);
+        Block &block = mNodes[node];
+        Block &restBlock = mNodes[rest];
+        restBlock.previousPhysical = node;
+        restBlock.nextPhysical = block.nextPhysical;
+        if (block.nextPhysical != invalidNode) {
+            mNodes[block.nextPhysical].previousPhysical = rest;
+        }
+        block.nextPhysical = rest;
+        block.size = size;
+        insertFree(rest);
+    }
+    Block &block = mNodes[node];
+    block.used = true;
+    mUsed += size;
+    ++mAllocations;
+    return Allocation{block.offset, node};
+}
+
+void OffsetAllocator::free(Node node) {
+    if (Q_UNLIKELY(node == invalidNode || !mNodes[node].used)) {
+        return;
+    }
+    mNodes[node].used = false;
+    mUsed -= mNodes[node].size;
+    --mAllocations;
+
+    const Node previous = mNodes[node].previousPhysical;
+    if (previous != invalidNode && !mNodes[previous].used) {
+        removeFree(previous);
+        Block &block = mNodes[node];
+        const Block &previousBlock = mNodes[previous];
+        block.offset = previousBlock.offset;
+        block.size += previousBlock.size;
+        block.previousPhysical = previousBlock.previousPhysical;
+        if (block.previousPhysical != invalidNode) {
+            mNodes[block.previousPhysical].nextPhysical = node;
+        }
+        releaseNode(previous);
+    }
+    const Node next = mNodes[node].nextPhysical;
+    if (next != invalidNode && !mNodes[next].used) {
+        removeFree(next);
+        Block &block = mNodes[node];
+        const Block &nextBlock = mNodes[next];
+        block.size += nextBlock.size;
+        block.nextPhysical = nextBlock.nextPhysical;
+        if (block.nextPhysical != invalidNode) {
+            mNodes[block.nextPhysical].previousPhysical = node;
+        }
+        releaseNode(next);
+    }
+    insertFree(node);
+}
+
+OffsetAllocator::Statistics OffsetAllocator::statistics() const {
+    std::uint32_t largestFree = 0;
+    if (mFirstLevelMask != 0) {
+        // Bins only bound their sizes from below, so the largest block may be anywhere in the top bin.
+        const int firstLevel = 31 - __builtin_clz(mFirstLevelMask);
+        const int secondLevel = 31 - __builtin_clz(mSecondLevelMasks[firstLevel]);
+        for (Node node = mBins[firstLevel * secondLevels + secondLevel]; node != invalidNode;
+             node = mNodes[node].nextFree) {
+            largestFree = std::max(largestFree, mNodes[node].size);
+        }
+    }
+    return Statistics{mCapacity, mUsed, mAllocations, mFreeBlocks, largestFree};
+}
+
+OffsetAllocator::Node OffsetAllocator::createNode(std::uint32_t offset, std::uint32_t size) {
+    const Block block{offset, size, invalidNode, invalidNode, invalidNode, invalidNode, false};
+    if (!mSpareNodes.empty()) {
+        const Node node = mSpareNodes.back();
+        mSpareNodes.pop_back();
+        mNodes[node] = block;
+        return node;
+    }
+    mNodes.push_back(block);
+    return static_cast<Node>(mNodes.size() - 1);
+}
+
+void OffsetAllocator::releaseNode(Node node) {
+    mSpareNodes.push_back(node);
+}
+
+void OffsetAllocator::insertFree(Node node) {
+    const int bin = floorBin(mNodes[node].size);
+    Block &block = mNodes[node];
+    block.previousFree = invalidNode;
+    block.nextFree = mBins[bin];
+    if (block.nextFree != invalidNode) {
+        mNodes[block.nextFree].previousFree = node;
+    }
+    mBins[bin] = node;
+    mSecondLevelMasks[bin / secondLevels] |= static_cast<std::uint8_t>(1u << (bin % secondLevels));
+    mFirstLevelMask |= 1u << (bin / secondLevels);
+    ++mFreeBlocks;
+}
+
+void OffsetAllocator::removeFree(Node node) {
+    const Block &block = mNodes[node];
+    const int bin = floorBin(block.size);
+    if (block.previousFree != invalidNode) {
+        mNodes[block.previousFree].nextFree = block.nextFree;
+    } else {
+        mBins[bin] = block.nextFree;
+    }
+    if (block.nextFree != invalidNode) {
+        mNodes[block.nextFree].previousFree = block.previousFree;
+    }
+    if (mBins[bin] == invalidNode) {
+        const int firstLevel = bin / secondLevels;
+        mSecondLevelMasks[firstLevel] &= static_cast<std::uint8_t>(~(1u << (bin % secondLevels)));
+        if (mSecondLevelMasks[firstLevel] == 0) {
+            mFirstLevelMask &= ~(1u << firstLevel);
+        }
+    }
+    --mFreeBlocks;
+}
+
+int OffsetAllocator::findBin(std::uint32_t size) const {
+    const int bin = ceilBin(size);
+    const int firstLevel = bin / secondLevels;
+    if (firstLevel >= firstLevels) {
+        return -1;
+    }
+    const std::uint32_t secondLevelMask = mSecondLevelMasks[firstLevel] & (~0u << (bin % secondLevels));
+    if (secondLevelMask != 0) {
+        return firstLevel * secondLevels + lowestBit(secondLevelMask);
+    }
+    const std::uint32_t firstLevelMask = firstLevel + 1 < firstLevels ? mFirstLevelMask & (~0u << (firstLevel + 1)) : 0;
+    if (firstLevelMask == 0) {
+        return -1;
+    }
+    const int nextLevel = lowestBit(firstLevelMask);
+    return nextLevel * secondLevels + lowestBit(mSecondLevelMasks[nextLevel]);
+}
@@ -0,0 +1,84 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_OFFSETALLOCATOR_H
+#define GLTUT2_OFFSETALLOCATOR_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Two-level segregated fit allocator over an abstract range of units; it hands out offsets and
+// never touches the memory itself. Free blocks are binned by size with eight linear bins per
+// power of two, and two bitmaps find the first bin whose blocks all fit in constant time.
+// Adjacent free blocks are merged when freed, so fragmentation only comes from the
+// allocation pattern, never from the bins.
+class OffsetAllocator {
+public:
+    typedef std::uint32_t Node;
+    static constexpr Node invalidNode = ~Node(0);
+
+    struct Allocation {
+        std::uint32_t offset;
+        Node node;
+    };
+
+    struct Statistics {
+        std::uint32_t capacity;
+        std::uint32_t used;
+        std::uint32_t allocations;
+        std::uint32_t freeBlocks;
+        std::uint32_t largestFree;
+
+        // Share of the capacity in use.
+        float occupancy() const;
+        // Share of the free space unusable by a single allocation of all of it, 0 when contiguous.
+        float fragmentation() const;
+    };
+
+    explicit OffsetAllocator(std::uint32_t capacity = 0);
+
+    void reset(std::uint32_t capacity);
+    // Returns invalidNode as the node when no free block holds size units.
+    Allocation allocate(std::uint32_t size);
+    void free(Node node);
+
+    std::uint32_t capacity() const { return mCapacity; }
+    std::uint32_t size(Node node) const { return mNodes[node].size; }
+    Statistics statistics() const;
+
+private:
+    static constexpr int secondLevelBits = 3;
+    static constexpr int secondLevels = 1 << secondLevelBits;
+    static constexpr int firstLevels = 32;
+    static constexpr int binCount = firstLevels * secondLevels;
+
+    struct Block {
+        std::uint32_t offset;
+        std::uint32_t size;
+        Node previousPhysical;
+        Node nextPhysical;
+        Node previousFree;
+        Node nextFree;
+        bool used;
+    };
+
+    Node createNode(std::uint32_t offset, std::uint32_t size);
+    void releaseNode(Node node);
+    void insertFree(Node node);
+    void removeFree(Node node);
+    int findBin(std::uint32_t size) const;
+
+    std::uint32_t mCapacity;
+    std::uint32_t mUsed;
+    std::uint32_t mAllocations;
+    std::uint32_t mFreeBlocks;
+    std::vector<Block> mNodes;
+    std::vector<Node> mSpareNodes;
+    std::array<Node, binCount> mBins;
+    std::uint32_t mFirstLevelMask;
+    std::array<std::uint8_t, firstLevels> mSecondLevelMasks;
+};
+
+#endif //GLTUT2_OFFSETALLOCATOR_H
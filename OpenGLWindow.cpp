@@ -4,83 +4,310 @@
 
 #include "OpenGLWindow.h"
 #include <QCoreApplication>
+#include <QDebug>
 #include <QOpenGLDebugLogger>
 #include <QOpenGLPaintDevice>
 #include <QPainter>
 #include <QOpenGLFunctions>
+#include <QOpenGLFunctions_4_5_Core>
+#include <QOpenGLFramebufferObject>
+#include <QOffscreenSurface>
+#include <QScreen>
+#include <QThread>
+#include <QTimer>
+#include <functional>
+
+namespace {
+    class RenderThread : public QThread {
+    public:
+        explicit RenderThread(std::function<void()> loop) : mLoop(std::move(loop)) {}
+
+    protected:
+        void run() override { mLoop(); }
+
+    private:
+        const std::function<void()> mLoop;
+    };
+}
 
 OpenGLWindow::OpenGLWindow(bool enableLogger, QWindow *parent) :
         QWindow(parent),
         mUpdatePending(false),
         mAnimating(false),
         mEnableLogger(enableLogger),
+        mThreaded(false),
+        mDeinitialized(false),
         mContext(nullptr),
         mDevice(nullptr),
-        mLogger(nullptr) {
+        mLogger(nullptr),
+        mOffscreenSurface(nullptr),
+        mFbo(nullptr),
+        mProfiler(),
+        mCapture(),
+        mScheduler(),
+        mExposedSize(),
+        mFrameSize(),
+        mRenderThread(nullptr),
+        mRenderMutex(),
+        mRenderCondition(),
+        mRenderExposed(false),
+        mRenderRequested(false),
+        mRenderStop(false) {
     setSurfaceType(QWindow::OpenGLSurface);
 }
 
 OpenGLWindow::~OpenGLWindow() {
+    stopRenderThread();
     delete mDevice;
+    delete mFbo;
+    delete mOffscreenSurface;
 }
 
 void OpenGLWindow::setAnimation(bool animating) {
-    mAnimating = animating;
+    {
+        const QMutexLocker locker(&mRenderMutex);
+        mAnimating = animating;
+    }
 
     if (animating) {
         renderLater();
     }
 }
 
+void OpenGLWindow::setVsync(bool vsync) {
+    QSurfaceFormat surfaceFormat = requestedFormat();
+    surfaceFormat.setSwapInterval(vsync ? 1 : 0);
+    setFormat(surfaceFormat);
+    mScheduler.setVsync(vsync, screen() == nullptr ? 0.0 : screen()->refreshRate());
+}
+
 void OpenGLWindow::renderLater() {
+    if (mRenderThread != nullptr) {
+        const QMutexLocker locker(&mRenderMutex);
+        mRenderRequested = true;
+        mRenderCondition.wakeOne();
+        return;
+    }
     if (Q_LIKELY(!mUpdatePending)) {
         mUpdatePending = true;
+        // A capped frame rate waits on a timer rather than in the scheduler, so the GUI thread never
+        // sleeps or spins; rounding up keeps the timer from firing before the slot.
+        const int delayMs = static_cast<int>((mScheduler.remainingNs() + 999999) / 1000000);
+        if (delayMs > 0) {
+            QTimer::singleShot(delayMs, Qt::PreciseTimer, this, [this] {
+                QCoreApplication::postEvent(this, new QEvent(QEvent::UpdateRequest));
+            });
+            return;
+        }
         QCoreApplication::postEvent(this, new QEvent(QEvent::UpdateRequest));
     }
 }
 
 void OpenGLWindow::renderNow() {
+    if (Q_UNLIKELY(mDeinitialized)) {
+        return;
+    }
+    if (mThreaded) {
+        startRenderThread();
+    }
+    if (mRenderThread != nullptr) {
+        synchronize();
+        const QMutexLocker locker(&mRenderMutex);
+        mRenderExposed = isExposed();
+        mExposedSize = size() * devicePixelRatio();
+        mRenderRequested = true;
+        mRenderCondition.wakeOne();
+        return;
+    }
+
     if (Q_UNLIKELY(!isExposed())) {
         return;
     }
 
+    synchronize();
+    mFrameSize = size() * devicePixelRatio();
     if (Q_UNLIKELY(mContext == nullptr)) {
-        mContext = new QOpenGLContext(this);
-        mContext->setFormat(requestedFormat());
-        mContext->create();
-        mContext->makeCurrent(this);
-
-        if (mEnableLogger) {
-            mLogger = new QOpenGLDebugLogger(this);
-            if (mLogger->initialize()) {
-                connect(mLogger, &QOpenGLDebugLogger::messageLogged, this, &OpenGLWindow::messageLogged);
-                mLogger->startLogging();
-                for (const auto &message : mLogger->loggedMessages()) {
-                    emit messageLogged(message);
-                }
-            }
+        if (Q_UNLIKELY(!createContext(this))) {
+            return;
         }
-
-        initialize();
     } else {
         mContext->makeCurrent(this);
     }
 
-    render();
-
-    mContext->swapBuffers(this);
+    renderFrame();
 
     if (Q_LIKELY(mAnimating)) {
         renderLater();
     }
 }
 
+void OpenGLWindow::renderFrame() {
+    mScheduler.beginFrame();
+    mProfiler.beginFrame();
+    {
+        const FrameProfiler::Scope scope(mProfiler, "render");
+        render();
+    }
+    if (Q_UNLIKELY(mCapture.isEnabled())) {
+        const FrameProfiler::Scope scope(mProfiler, "capture");
+        mCapture.capture(mContext->defaultFramebufferObject(), mFrameSize);
+    }
+    {
+        const FrameProfiler::Scope scope(mProfiler, "swapBuffers");
+        mContext->swapBuffers(this);
+    }
+    mProfiler.endFrame();
+}
+
+void OpenGLWindow::startRenderThread() {
+    if (Q_LIKELY(mRenderThread != nullptr) || Q_UNLIKELY(mDeinitialized)) {
+        return;
+    }
+    if (Q_UNLIKELY(!QOpenGLContext::supportsThreadedOpenGL())) {
+        qWarning() << "Threaded OpenGL is not supported, rendering on the GUI thread";
+        mThreaded = false;
+        return;
+    }
+    mRenderStop = false;
+    mRenderThread = new RenderThread([this] { renderThreadLoop(); });
+    mRenderThread->start(QThread::HighPriority);
+}
+
+void OpenGLWindow::stopRenderThread() {
+    if (mRenderThread == nullptr) {
+        return;
+    }
+    {
+        const QMutexLocker locker(&mRenderMutex);
+        mRenderStop = true;
+        mRenderCondition.wakeOne();
+    }
+    mRenderThread->wait();
+    delete mRenderThread;
+    mRenderThread = nullptr;
+}
+
+bool OpenGLWindow::waitForFrame() {
+    const QMutexLocker locker(&mRenderMutex);
+    while (!mRenderStop && !(mRenderExposed && (mAnimating || mRenderRequested))) {
+        mRenderCondition.wait(&mRenderMutex);
+    }
+    mRenderRequested = false;
+    mFrameSize = mExposedSize;
+    return !mRenderStop;
+}
+
+void OpenGLWindow::renderThreadLoop() {
+    if (Q_UNLIKELY(!createContext(this))) {
+        qWarning() << "Failed to create an OpenGL context on the render thread";
+        return;
+    }
+
+    while (waitForFrame()) {
+        mContext->makeCurrent(this);
+        mScheduler.waitForNextFrame();
+        renderFrame();
+    }
+
+    mContext->makeCurrent(this);
+    mProfiler.releaseGpu();
+    mCapture.releaseGpu();
+    deinitialize();
+    mContext->doneCurrent();
+    delete mContext;
+    mContext = nullptr;
+}
+
+bool OpenGLWindow::renderOffscreen() {
+    if (Q_UNLIKELY(mDeinitialized)) {
+        return false;
+    }
+    synchronize();
+    if (Q_UNLIKELY(mContext == nullptr)) {
+        mOffscreenSurface = new QOffscreenSurface(screen());
+        mOffscreenSurface->setFormat(requestedFormat());
+        mOffscreenSurface->create();
+        if (Q_UNLIKELY(!mOffscreenSurface->isValid() || !createContext(mOffscreenSurface))) {
+            return false;
+        }
+    } else if (Q_UNLIKELY(!mContext->makeCurrent(mOffscreenSurface))) {
+        return false;
+    }
+
+    const QSize &fboSize = size() * devicePixelRatio();
+    if (Q_UNLIKELY(mFbo == nullptr || mFbo->size() != fboSize)) {
+        delete mFbo;
+        QOpenGLFramebufferObjectFormat fboFormat;
+        fboFormat.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+        fboFormat.setSamples(requestedFormat().samples());
+        mFbo = new QOpenGLFramebufferObject(fboSize, fboFormat);
+    }
+
+    mScheduler.waitForNextFrame();
+    mScheduler.beginFrame();
+    mProfiler.beginFrame();
+    mFbo->bind();
+    {
+        const FrameProfiler::Scope scope(mProfiler, "render");
+        render();
+    }
+    if (Q_UNLIKELY(mCapture.isEnabled())) {
+        const FrameProfiler::Scope scope(mProfiler, "capture");
+        mCapture.capture(mFbo->handle(), fboSize);
+    }
+    {
+        const FrameProfiler::Scope scope(mProfiler, "finish");
+        mContext->functions()->glFinish();
+    }
+    mFbo->release();
+    mProfiler.endFrame();
+
+    return true;
+}
+
+bool OpenGLWindow::createContext(QSurface *surface) {
+    mContext = new QOpenGLContext(mRenderThread == nullptr ? this : nullptr);
+    mContext->setFormat(requestedFormat());
+    if (Q_UNLIKELY(!mContext->create() || !mContext->makeCurrent(surface))) {
+        delete mContext;
+        mContext = nullptr;
+        return false;
+    }
+
+    if (mEnableLogger) {
+        mLogger = new QOpenGLDebugLogger(mContext);
+        if (mLogger->initialize()) {
+            connect(mLogger, &QOpenGLDebugLogger::messageLogged, this, &OpenGLWindow::messageLogged);
+            mLogger->startLogging();
+            for (const auto &message : mLogger->loggedMessages()) {
+                emit messageLogged(message);
+            }
+        }
+    }
+
+    if (mProfiler.isEnabled() || mCapture.isEnabled()) {
+        auto *functions = mContext->versionFunctions<QOpenGLFunctions_4_5_Core>();
+        if (functions != nullptr && functions->initializeOpenGLFunctions()) {
+            if (mProfiler.isEnabled()) {
+                mProfiler.initializeGpu(functions);
+            }
+            mCapture.initializeGpu(functions);
+        }
+    }
+
+    initialize();
+    return true;
+}
+
 bool OpenGLWindow::event(QEvent *event) {
     switch (event->type()) {
         case QEvent::UpdateRequest:
             mUpdatePending = false;
             renderNow();
             return true;
+        case QEvent::Resize:
+            synchronize();
+            break;
         case QEvent::Close:
             deinitializeNow();
             break;
@@ -103,8 +330,24 @@ void OpenGLWindow::render() {
 }
 
 void OpenGLWindow::deinitializeNow() {
+    if (mDeinitialized) {
+        return;
+    }
+    mDeinitialized = true;
+    if (mRenderThread != nullptr) {
+        stopRenderThread();
+        return;
+    }
     if (mContext != nullptr) {
-        mContext->makeCurrent(this);
+        if (mOffscreenSurface != nullptr) {
+            mContext->makeCurrent(mOffscreenSurface);
+            delete mFbo;
+            mFbo = nullptr;
+        } else {
+            mContext->makeCurrent(this);
+        }
+        mProfiler.releaseGpu();
+        mCapture.releaseGpu();
         deinitialize();
     }
 }
@@ -5,12 +5,20 @@
 #ifndef GLTUT2_OPENGLWINDOW_H
 #define GLTUT2_OPENGLWINDOW_H
 
+#include "FrameCapture.h"
+#include "FrameProfiler.h"
+#include "FrameScheduler.h"
+#include <QMutex>
+#include <QWaitCondition>
 #include <QWindow>
 
 class QOpenGLPaintDevice;
 class QOpenGLDebugLogger;
 class QOpenGLDebugMessage;
 class QOpenGLFunctions;
+class QOffscreenSurface;
+class QOpenGLFramebufferObject;
+class QThread;
 
 class OpenGLWindow : public QWindow {
     Q_OBJECT
@@ -20,6 +28,20 @@ public:
     ~OpenGLWindow() override;
 
     void setAnimation(bool animating);
+    void setThreadedRendering(bool threaded) { mThreaded = threaded; }
+    // Sets the swap interval of the surface format; call before the window is shown.
+    void setVsync(bool vsync);
+    void setFrameRateCap(double framesPerSecond) { mScheduler.setFrameRateCap(framesPerSecond); }
+
+    bool renderOffscreen();
+    // Releases the GL state, stopping the render thread first; the window renders nothing afterwards.
+    void deinitializeNow();
+
+    FrameProfiler &profiler() { return mProfiler; }
+    const FrameProfiler &profiler() const { return mProfiler; }
+    FrameCapture &capture() { return mCapture; }
+    const FrameCapture &capture() const { return mCapture; }
+    const FrameScheduler &scheduler() const { return mScheduler; }
 
 public slots:
     void renderLater();
@@ -31,6 +53,8 @@ signals:
 protected:
     bool event(QEvent *event) override;
 
+    QOpenGLContext *context() const { return mContext; }
+
     void exposeEvent(QExposeEvent */*event*/) override { renderNow(); }
 
     virtual void render(const QPainter &/*painter*/) {}
@@ -39,16 +63,42 @@ protected:
     virtual void initialize() {}
     virtual void deinitialize() {}
 
+    // Called on the GUI thread whenever render() may observe new window or input state.
+    virtual void synchronize() {}
+
 private:
-    void deinitializeNow();
+    bool createContext(QSurface *surface);
+    void renderFrame();
+    void startRenderThread();
+    void stopRenderThread();
+    void renderThreadLoop();
+    bool waitForFrame();
 
     bool mUpdatePending;
     bool mAnimating;
     bool mEnableLogger;
+    bool mThreaded;
+    // Set by deinitializeNow(); no frame renders and no render thread starts after it.
+    bool mDeinitialized;
 
     QOpenGLContext *mContext;
     QOpenGLPaintDevice *mDevice;
     QOpenGLDebugLogger *mLogger;
+    QOffscreenSurface *mOffscreenSurface;
+    QOpenGLFramebufferObject *mFbo;
+    FrameProfiler mProfiler;
+    FrameCapture mCapture;
+    FrameScheduler mScheduler;
+    // Framebuffer size in pixels: set on the GUI thread under mRenderMutex, copied for the frame.
+    QSize mExposedSize;
+    QSize mFrameSize;
+
+    QThread *mRenderThread;
+    QMutex mRenderMutex;
+    QWaitCondition mRenderCondition;
+    bool mRenderExposed;
+    bool mRenderRequested;
+    bool mRenderStop;
 };
 
 #endif //GLTUT2_OPENGLWINDOW_H
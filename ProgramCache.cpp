@@ -0,0 +1,187 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "ProgramCache.h"
+#include <algorithm>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QOpenGLFunctions_4_5_Core>
+#include <QOpenGLShaderProgram>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace {
+    constexpr quint32 cacheMagic = 0x42504c47; // "GLPB"
+    constexpr quint32 cacheVersion = 1;
+
+    QByteArray glString(QOpenGLFunctions_4_5_Core *functions, GLenum name) {
+        return QByteArray(reinterpret_cast<const char *>(functions->glGetString(name)));
+    }
+}
+
+ProgramCache::ProgramCache(QOpenGLFunctions_4_5_Core *functions, const QString &directory) :
+        mFunctions(functions),
+        mDirectory(directory.isEmpty()
+                   ? QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/programs")
+                   : directory),
+        mDriver(glString(functions, GL_VENDOR) + '\n' + glString(functions, GL_RENDERER) + '\n'
+                + glString(functions, GL_VERSION)),
+        mEnabled(false),
+        mHits(0),
+        mMisses(0),
+        mSavedNs(0) {
+    GLint formats = 0;
+    mFunctions->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    mEnabled = formats > 0 && QDir().mkpath(mDirectory);
+}
+
+bool ProgramCache::build(QOpenGLShaderProgram *program, const ShaderFiles &files) {
+    ShaderSources sources;
+    sources.reserve(files.size());
+    for (const auto &file : files) {
+        QFile source(file.second);
+        if (Q_UNLIKELY(!source.open(QIODevice::ReadOnly))) {
+            qWarning() << "Failed to read shader" << file.second;
+            return false;
+        }
+        sources.emplace_back(file.first, source.readAll());
+    }
+    return build(program, sources);
+}
+
+bool ProgramCache::build(QOpenGLShaderProgram *program, const ShaderSources &sources) {
+    if (Q_UNLIKELY(!mEnabled)) {
+        return compile(program, sources);
+    }
+
+    const QString &fileName = binaryFileName(sources);
+    QElapsedTimer timer;
+    timer.start();
+    qint64 compileNs = 0;
+    if (load(program, fileName, &compileNs)) {
+        const qint64 loadNs = timer.nsecsElapsed();
+        ++mHits;
+        mSavedNs += std::max<qint64>(compileNs - loadNs, 0);
+        qDebug() << "Program cache hit:" << loadNs / 1000000.0 << "ms instead of" << compileNs / 1000000.0 << "ms";
+        return true;
+    }
+
+    ++mMisses;
+    timer.restart();
+    if (Q_UNLIKELY(!compile(program, sources))) {
+        return false;
+    }
+    compileNs = timer.nsecsElapsed();
+    qDebug() << "Program cache miss: compiled and linked in" << compileNs / 1000000.0 << "ms";
+    store(program, fileName, compileNs);
+    return true;
+}
+
+bool ProgramCache::loadBinary(QOpenGLShaderProgram *program, const ShaderSources &sources) {
+    if (Q_UNLIKELY(!mEnabled)) {
+        return false;
+    }
+    const QString &fileName = binaryFileName(sources);
+    QElapsedTimer timer;
+    timer.start();
+    qint64 compileNs = 0;
+    if (!load(program, fileName, &compileNs)) {
+        return false;
+    }
+    ++mHits;
+    mSavedNs += std::max<qint64>(compileNs - timer.nsecsElapsed(), 0);
+    return true;
+}
+
+void ProgramCache::storeBinary(QOpenGLShaderProgram *program, const ShaderSources &sources, qint64 compileNs) {
+    ++mMisses;
+    if (mEnabled) {
+        store(program, binaryFileName(sources), compileNs);
+    }
+}
+
+void ProgramCache::logStatistics() const {
+    const int requests = mHits + mMisses;
+    qDebug() << "Program cache:" << mHits << "hits of" << requests << "programs,"
+             << mSavedNs / 1000000.0 << "ms of compile and link time saved";
+}
+
+QString ProgramCache::binaryFileName(const ShaderSources &sources) const {
+    return QDir(mDirectory).filePath(QString::fromLatin1(key(sources).toHex()) + QStringLiteral(".bin"));
+}
+
+QByteArray ProgramCache::key(const ShaderSources &sources) const {
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(mDriver);
+    for (const auto &source : sources) {
+        hash.addData(QByteArray::number(static_cast<int>(source.first)));
+        hash.addData(source.second);
+    }
+    return hash.result();
+}
+
+bool ProgramCache::load(QOpenGLShaderProgram *program, const QString &fileName, qint64 *compileNs) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 format = 0;
+    QByteArray binary;
+    in >> magic >> version >> format >> *compileNs >> binary;
+    if (in.status() != QDataStream::Ok || magic != cacheMagic || version != cacheVersion || binary.isEmpty()) {
+        return false;
+    }
+
+    program->create();
+    mFunctions->glProgramBinary(program->programId(), format, binary.constData(), binary.size());
+    GLint linked = GL_FALSE;
+    mFunctions->glGetProgramiv(program->programId(), GL_LINK_STATUS, &linked);
+    if (linked == GL_FALSE || !program->link()) {
+        file.remove();
+        return false;
+    }
+    return true;
+}
+
+bool ProgramCache::compile(QOpenGLShaderProgram *program, const ShaderSources &sources) {
+    for (const auto &source : sources) {
+        if (Q_UNLIKELY(!program->addShaderFromSourceCode(source.first, source.second))) {
+            return false;
+        }
+    }
+    program->create();
+    if (mEnabled) {
+        mFunctions->glProgramParameteri(program->programId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    return program->link();
+}
+
+void ProgramCache::store(QOpenGLShaderProgram *program, const QString &fileName, qint64 compileNs) {
+    GLint length = 0;
+    mFunctions->glGetProgramiv(program->programId(), GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    QByteArray binary(length, Qt::Uninitialized);
+    GLenum format = 0;
+    mFunctions->glGetProgramBinary(program->programId(), length, &length, &format, binary.data());
+    binary.resize(length);
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    QDataStream out(&file);
+    out << cacheMagic << cacheVersion << static_cast<quint32>(format) << compileNs << binary;
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        qWarning() << "Failed to store program binary" << fileName;
+    }
+}
@@ -0,0 +1,53 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_PROGRAMCACHE_H
+#define GLTUT2_PROGRAMCACHE_H
+
+#include <utility>
+#include <vector>
+#include <QByteArray>
+#include <QOpenGLShader>
+#include <QString>
+
+class QOpenGLFunctions_4_5_Core;
+class QOpenGLShaderProgram;
+
+// Stores linked program binaries on disk, keyed by the shader sources and the driver identity.
+class ProgramCache {
+public:
+    typedef std::vector<std::pair<QOpenGLShader::ShaderType, QString>> ShaderFiles;
+    typedef std::vector<std::pair<QOpenGLShader::ShaderType, QByteArray>> ShaderSources;
+
+    explicit ProgramCache(QOpenGLFunctions_4_5_Core *functions, const QString &directory = QString());
+
+    bool build(QOpenGLShaderProgram *program, const ShaderFiles &files);
+    bool build(QOpenGLShaderProgram *program, const ShaderSources &sources);
+    // For programs the caller compiles and links itself, e.g. without waiting for the driver:
+    // loadBinary() links a cached binary if there is one, storeBinary() caches a freshly linked one.
+    bool loadBinary(QOpenGLShaderProgram *program, const ShaderSources &sources);
+    void storeBinary(QOpenGLShaderProgram *program, const ShaderSources &sources, qint64 compileNs);
+
+    int hits() const { return mHits; }
+    int misses() const { return mMisses; }
+    qint64 savedNs() const { return mSavedNs; }
+    void logStatistics() const;
+
+private:
+    QByteArray key(const ShaderSources &sources) const;
+    QString binaryFileName(const ShaderSources &sources) const;
+    bool load(QOpenGLShaderProgram *program, const QString &fileName, qint64 *compileNs);
+    bool compile(QOpenGLShaderProgram *program, const ShaderSources &sources);
+    void store(QOpenGLShaderProgram *program, const QString &fileName, qint64 compileNs);
+
+    QOpenGLFunctions_4_5_Core *mFunctions;
+    QString mDirectory;
+    QByteArray mDriver;
+    bool mEnabled;
+    int mHits;
+    int mMisses;
+    qint64 mSavedNs;
+};
+
+#endif //GLTUT2_PROGRAMCACHE_H
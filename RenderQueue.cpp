@@ -0,0 +1,118 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "RenderQueue.h"
+#include "GLStateCache.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <QOpenGLFunctions_4_5_Core>
+
+namespace {
+    constexpr std::size_t noTransform = ~std::size_t(0);
+    constexpr int transformSize = 16;
+    constexpr int radixBits = 8;
+    constexpr int radixBuckets = 1 << radixBits;
+    constexpr int radixPasses = 64 / radixBits;
+
+    quint32 depthBits(float depth) {
+        const float clamped = std::max(depth, 0.0f);
+        quint32 bits;
+        std::memcpy(&bits, &clamped, sizeof(bits));
+        return bits;
+    }
+}
+
+quint64 RenderQueue::makeKey(Pass pass, quint32 program, quint32 material, float depth) {
+    const quint32 depthKey = pass == Transparent ? ~depthBits(depth) : depthBits(depth);
+    return (static_cast<quint64>(pass & 0xf) << 60)
+           | (static_cast<quint64>(program & 0xfff) << 48)
+           | (static_cast<quint64>(material & 0xffff) << 32)
+           | depthKey;
+}
+
+RenderQueue::RenderQueue(QOpenGLFunctions_4_5_Core *functions) :
+        mFunctions(functions),
+        mEntries(),
+        mScratch(),
+        mPackets(),
+        mTransforms() {
+}
+
+void RenderQueue::clear() {
+    mEntries.clear();
+    mPackets.clear();
+    mTransforms.clear();
+}
+
+void RenderQueue::push(quint64 key, const DrawPacket &packet, const GLfloat *transform) {
+    std::size_t transformOffset = noTransform;
+    if (transform != nullptr) {
+        transformOffset = mTransforms.size();
+        mTransforms.insert(mTransforms.end(), transform, transform + transformSize);
+    }
+    mEntries.push_back(Entry{key, static_cast<quint32>(mPackets.size())});
+    mPackets.push_back(Packet{packet, transformOffset});
+}
+
+void RenderQueue::sort() {
+    const std::size_t count = mEntries.size();
+    if (count < 2) {
+        return;
+    }
+
+    std::array<std::array<std::size_t, radixBuckets>, radixPasses> histograms{};
+    for (const auto &entry : mEntries) {
+        for (int pass = 0; pass < radixPasses; ++pass) {
+            ++histograms[pass][(entry.key >> (pass * radixBits)) & (radixBuckets - 1)];
+        }
+    }
+
+    mScratch.resize(count);
+    Entry *source = mEntries.data();
+    Entry *destination = mScratch.data();
+    for (int pass = 0; pass < radixPasses; ++pass) {
+        auto &histogram = histograms[pass];
+        const int shift = pass * radixBits;
+        if (histogram[(source->key >> shift) & (radixBuckets - 1)] == count) {
+            continue;
+        }
+        std::size_t offset = 0;
+        for (auto &bucket : histogram) {
+            const std::size_t bucketSize = bucket;
+            bucket = offset;
+            offset += bucketSize;
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            const Entry &entry = source[i];
+            destination[histogram[(entry.key >> shift) & (radixBuckets - 1)]++] = entry;
+        }
+        std::swap(source, destination);
+    }
+    if (source != mEntries.data()) {
+        mEntries.swap(mScratch);
+    }
+}
+
+void RenderQueue::submit(GLStateCache &state) const {
+    for (const auto &entry : mEntries) {
+        const Packet &packet = mPackets[entry.packet];
+        const DrawPacket &draw = packet.draw;
+        state.useProgram(draw.program);
+        state.bindVertexArray(draw.vertexArray);
+        state.bindTextureUnit(0, draw.texture);
+        state.uniform(draw.materialLocation, draw.material);
+        if (packet.transform != noTransform) {
+            state.uniformMatrix4(draw.transformLocation, mTransforms.data() + packet.transform);
+        }
+        const auto *indices = reinterpret_cast<const void *>(draw.indexOffset);
+        if (draw.instanceCount > 0) {
+            mFunctions->glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, draw.indexCount, draw.indexType,
+                                                                      indices, draw.instanceCount, draw.baseVertex,
+                                                                      draw.baseInstance);
+        } else {
+            mFunctions->glDrawElementsBaseVertex(GL_TRIANGLES, draw.indexCount, draw.indexType, indices, draw.baseVertex);
+        }
+    }
+}
@@ -0,0 +1,67 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_RENDERQUEUE_H
+#define GLTUT2_RENDERQUEUE_H
+
+#include <vector>
+#include <QtGui/qopengl.h>
+
+class GLStateCache;
+class QOpenGLFunctions_4_5_Core;
+
+class RenderQueue {
+public:
+    enum Pass {
+        Opaque = 0,
+        Transparent = 1
+    };
+
+    struct DrawPacket {
+        GLuint program;
+        GLuint vertexArray;
+        GLuint texture;
+        GLint transformLocation;
+        GLint materialLocation;
+        GLint material;
+        GLenum indexType;
+        GLsizei indexCount;
+        GLintptr indexOffset;
+        GLint baseVertex;
+        GLsizei instanceCount;
+        GLuint baseInstance;
+    };
+
+    // 63..60 pass, 59..48 program, 47..32 material, 31..0 view depth
+    // (front to back for opaque, back to front for transparent packets).
+    static quint64 makeKey(Pass pass, quint32 program, quint32 material, float depth);
+
+    explicit RenderQueue(QOpenGLFunctions_4_5_Core *functions);
+
+    void clear();
+    void push(quint64 key, const DrawPacket &packet, const GLfloat *transform = nullptr);
+    void sort();
+    void submit(GLStateCache &state) const;
+
+    std::size_t size() const { return mEntries.size(); }
+
+private:
+    struct Entry {
+        quint64 key;
+        quint32 packet;
+    };
+
+    struct Packet {
+        DrawPacket draw;
+        std::size_t transform;
+    };
+
+    QOpenGLFunctions_4_5_Core *mFunctions;
+    std::vector<Entry> mEntries;
+    std::vector<Entry> mScratch;
+    std::vector<Packet> mPackets;
+    std::vector<GLfloat> mTransforms;
+};
+
+#endif //GLTUT2_RENDERQUEUE_H
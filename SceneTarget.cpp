@@ -0,0 +1,325 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "SceneTarget.h"
+#include "GLStateCache.h"
+#include "ProgramCache.h"
+#include <algorithm>
+#include <cmath>
+#include <QDebug>
+#include <QOpenGLFunctions_4_5_Core>
+#include <QOpenGLShaderProgram>
+
+namespace {
+    constexpr GLuint sceneUnit = 3;
+    constexpr float minScale = 0.5f;
+    constexpr float maxScaleStep = 0.1f;
+    // Scales snap to 1/32 so tiny corrections do not keep resizing the depth pyramid.
+    constexpr float scaleQuantum = 32.0f;
+    // The frame time may stray this far from the target before the scale moves.
+    constexpr double deadBand = 0.1;
+    // Frames to wait after a change, so the timings reflect the new scale before the next one.
+    constexpr int settleFrames = 15;
+    constexpr double smoothing = 0.1;
+
+    GLsizei requestedSamples(SceneTarget::Antialiasing antialiasing) {
+        switch (antialiasing) {
+            case SceneTarget::Msaa2:
+                return 2;
+            case SceneTarget::Msaa4:
+                return 4;
+            case SceneTarget::Msaa8:
+                return 8;
+            default:
+                return 0;
+        }
+    }
+
+    int scaled(int extent, float scale) {
+        return std::max(static_cast<int>(std::lround(static_cast<float>(extent) * scale)), 1);
+    }
+}
+
+SceneTarget::SceneTarget(QOpenGLFunctions_4_5_Core *functions, Antialiasing antialiasing) :
+        mFunctions(functions),
+        mAntialiasing(antialiasing),
+        mSamples(requestedSamples(antialiasing)),
+        mOutputSize(),
+        mRenderSize(),
+        mScale(1.0f),
+        mTargetFrameMs(0.0f),
+        mSmoothedMs(0.0),
+        mFramesSinceChange(0),
+        mSceneFramebuffer(0),
+        mSceneColor(0),
+        mSceneDepth(0),
+        mResolveFramebuffer(0),
+        mResolveColor(0),
+        mOutputFramebuffer(0),
+        mFxaaProgram(nullptr),
+        mTexelSizeLocation(-1),
+        mRegionSizeLocation(-1),
+        mEmptyVertexArray(0),
+        mTimers(),
+        mTimer(0),
+        mStatistics{0, 0, 0.0, 0.0, 1.0f, 0} {
+}
+
+const char *SceneTarget::antialiasingName(Antialiasing antialiasing) {
+    switch (antialiasing) {
+        case NoAntialiasing:
+            return "off";
+        case Msaa2:
+            return "msaa2";
+        case Msaa4:
+            return "msaa4";
+        case Msaa8:
+            return "msaa8";
+        case Fxaa:
+            return "fxaa";
+    }
+    return "unknown";
+}
+
+bool SceneTarget::fromName(const QString &name, Antialiasing &antialiasing) {
+    for (const Antialiasing candidate : {NoAntialiasing, Msaa2, Msaa4, Msaa8, Fxaa}) {
+        if (name == QLatin1String(antialiasingName(candidate))) {
+            antialiasing = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SceneTarget::create(ProgramCache *programCache, QObject *programParent) {
+    if (mSamples > 0) {
+        GLint maxSamples = 0;
+        mFunctions->glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+        if (Q_UNLIKELY(mSamples > maxSamples)) {
+            qWarning() << "Only" << maxSamples << "samples are supported, requested" << mSamples;
+            mSamples = maxSamples;
+        }
+    }
+    for (TimerQueries &queries : mTimers) {
+        mFunctions->glGenQueries(1, &queries.begin);
+        mFunctions->glGenQueries(1, &queries.end);
+        queries.pending = false;
+    }
+    mTimer = 0;
+    if (mAntialiasing != Fxaa) {
+        return true;
+    }
+    mFxaaProgram = new QOpenGLShaderProgram(programParent);
+    const bool built = programCache->build(mFxaaProgram, {
+            {QOpenGLShader::Vertex, QStringLiteral(":/shaders/fullscreen.vert")},
+            {QOpenGLShader::Fragment, QStringLiteral(":/shaders/fxaa.frag")}
+    });
+    if (Q_UNLIKELY(!built)) {
+        qWarning() << "Failed to build the FXAA program";
+        return false;
+    }
+    mTexelSizeLocation = mFxaaProgram->uniformLocation("texelSize");
+    mRegionSizeLocation = mFxaaProgram->uniformLocation("regionSize");
+    mFunctions->glProgramUniform1i(mFxaaProgram->programId(), mFxaaProgram->uniformLocation("scene"),
+                                   static_cast<GLint>(sceneUnit));
+    mFunctions->glCreateVertexArrays(1, &mEmptyVertexArray);
+    return true;
+}
+
+void SceneTarget::destroy() {
+    release();
+    for (TimerQueries &queries : mTimers) {
+        const GLuint ids[] = {queries.begin, queries.end};
+        mFunctions->glDeleteQueries(2, ids);
+        queries = TimerQueries{0, 0, false};
+    }
+    if (mEmptyVertexArray != 0) {
+        mFunctions->glDeleteVertexArrays(1, &mEmptyVertexArray);
+        mEmptyVertexArray = 0;
+    }
+    // The program belongs to its parent; only detach from it here.
+    if (mFxaaProgram != nullptr) {
+        mFxaaProgram->removeAllShaders();
+        mFxaaProgram = nullptr;
+    }
+    mOutputSize = QSize();
+    mRenderSize = QSize();
+}
+
+void SceneTarget::resize(const QSize &outputSize) {
+    if (outputSize == mOutputSize) {
+        return;
+    }
+    mOutputSize = outputSize;
+    mRenderSize = QSize(scaled(outputSize.width(), mScale), scaled(outputSize.height(), mScale));
+    release();
+    if (!outputSize.isEmpty()) {
+        allocate();
+    }
+}
+
+void SceneTarget::setScale(float scale) {
+    mScale = qBound(minScale, std::round(scale * scaleQuantum) / scaleQuantum, 1.0f);
+    if (!mOutputSize.isEmpty()) {
+        mRenderSize = QSize(scaled(mOutputSize.width(), mScale), scaled(mOutputSize.height(), mScale));
+    }
+}
+
+void SceneTarget::allocate() {
+    const int width = mOutputSize.width();
+    const int height = mOutputSize.height();
+    mFunctions->glCreateFramebuffers(1, &mSceneFramebuffer);
+    if (mSamples > 0) {
+        mFunctions->glCreateRenderbuffers(1, &mSceneColor);
+        mFunctions->glNamedRenderbufferStorageMultisample(mSceneColor, mSamples, GL_RGBA8, width, height);
+        mFunctions->glNamedFramebufferRenderbuffer(mSceneFramebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mSceneColor);
+
+        // A multisampled blit cannot scale, so a scaled region resolves here first.
+        mFunctions->glCreateTextures(GL_TEXTURE_2D, 1, &mResolveColor);
+        mFunctions->glTextureStorage2D(mResolveColor, 1, GL_RGBA8, width, height);
+        mFunctions->glCreateFramebuffers(1, &mResolveFramebuffer);
+        mFunctions->glNamedFramebufferTexture(mResolveFramebuffer, GL_COLOR_ATTACHMENT0, mResolveColor, 0);
+    } else {
+        mFunctions->glCreateTextures(GL_TEXTURE_2D, 1, &mSceneColor);
+        mFunctions->glTextureStorage2D(mSceneColor, 1, GL_RGBA8, width, height);
+        mFunctions->glTextureParameteri(mSceneColor, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        mFunctions->glTextureParameteri(mSceneColor, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        mFunctions->glTextureParameteri(mSceneColor, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        mFunctions->glTextureParameteri(mSceneColor, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        mFunctions->glNamedFramebufferTexture(mSceneFramebuffer, GL_COLOR_ATTACHMENT0, mSceneColor, 0);
+    }
+    mFunctions->glCreateRenderbuffers(1, &mSceneDepth);
+    mFunctions->glNamedRenderbufferStorageMultisample(mSceneDepth, mSamples, GL_DEPTH24_STENCIL8, width, height);
+    mFunctions->glNamedFramebufferRenderbuffer(mSceneFramebuffer, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
+                                               mSceneDepth);
+    if (Q_UNLIKELY(mFunctions->glCheckNamedFramebufferStatus(mSceneFramebuffer, GL_DRAW_FRAMEBUFFER)
+                   != GL_FRAMEBUFFER_COMPLETE)) {
+        qWarning() << "Scene framebuffer is incomplete:" << mOutputSize << mSamples << "samples";
+    }
+}
+
+void SceneTarget::release() {
+    const GLuint framebuffers[] = {mSceneFramebuffer, mResolveFramebuffer};
+    mFunctions->glDeleteFramebuffers(2, framebuffers);
+    if (mSamples > 0) {
+        const GLuint renderbuffers[] = {mSceneColor, mSceneDepth};
+        mFunctions->glDeleteRenderbuffers(2, renderbuffers);
+    } else {
+        mFunctions->glDeleteTextures(1, &mSceneColor);
+        mFunctions->glDeleteRenderbuffers(1, &mSceneDepth);
+    }
+    mFunctions->glDeleteTextures(1, &mResolveColor);
+    mSceneFramebuffer = 0;
+    mSceneColor = 0;
+    mSceneDepth = 0;
+    mResolveFramebuffer = 0;
+    mResolveColor = 0;
+}
+
+void SceneTarget::begin() {
+    // Until the first resize there is nothing to render into, so the scene goes to the output.
+    if (mSceneFramebuffer == 0) {
+        return;
+    }
+    mFunctions->glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &mOutputFramebuffer);
+    // Oldest first, so the controller sees the timings in frame order.
+    for (int i = 0; i < timerFrames; ++i) {
+        readTimer(mTimers[(mTimer + i) % timerFrames]);
+    }
+    if (!mTimers[mTimer].pending) {
+        mFunctions->glQueryCounter(mTimers[mTimer].begin, GL_TIMESTAMP);
+    }
+    ++mStatistics.frames;
+    mStatistics.scaleSum += mScale;
+    mStatistics.minScale = std::min(mStatistics.minScale, mScale);
+
+    mFunctions->glBindFramebuffer(GL_FRAMEBUFFER, mSceneFramebuffer);
+    mFunctions->glViewport(0, 0, mRenderSize.width(), mRenderSize.height());
+}
+
+void SceneTarget::end(GLStateCache &state) {
+    if (mSceneFramebuffer == 0) {
+        return;
+    }
+    const GLuint output = static_cast<GLuint>(mOutputFramebuffer);
+    const int renderWidth = mRenderSize.width();
+    const int renderHeight = mRenderSize.height();
+    const int outputWidth = mOutputSize.width();
+    const int outputHeight = mOutputSize.height();
+    const bool scaling = mRenderSize != mOutputSize;
+
+    GLuint source = mSceneFramebuffer;
+    if (mSamples > 0 && scaling) {
+        mFunctions->glBlitNamedFramebuffer(mSceneFramebuffer, mResolveFramebuffer, 0, 0, renderWidth, renderHeight,
+                                           0, 0, renderWidth, renderHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        source = mResolveFramebuffer;
+    }
+    mFunctions->glBindFramebuffer(GL_FRAMEBUFFER, output);
+    mFunctions->glViewport(0, 0, outputWidth, outputHeight);
+    if (mAntialiasing == Fxaa) {
+        state.useProgram(mFxaaProgram->programId());
+        state.bindVertexArray(mEmptyVertexArray);
+        state.bindTextureUnit(sceneUnit, mSceneColor);
+        const GLuint program = mFxaaProgram->programId();
+        mFunctions->glProgramUniform2f(program, mTexelSizeLocation, 1.0f / static_cast<float>(outputWidth),
+                                       1.0f / static_cast<float>(outputHeight));
+        mFunctions->glProgramUniform2f(program, mRegionSizeLocation,
+                                       static_cast<float>(renderWidth) / static_cast<float>(outputWidth),
+                                       static_cast<float>(renderHeight) / static_cast<float>(outputHeight));
+        mFunctions->glDisable(GL_DEPTH_TEST);
+        mFunctions->glDrawArrays(GL_TRIANGLES, 0, 3);
+        mFunctions->glEnable(GL_DEPTH_TEST);
+    } else {
+        mFunctions->glBlitNamedFramebuffer(source, output, 0, 0, renderWidth, renderHeight,
+                                           0, 0, outputWidth, outputHeight, GL_COLOR_BUFFER_BIT,
+                                           scaling ? GL_LINEAR : GL_NEAREST);
+    }
+
+    TimerQueries &queries = mTimers[mTimer];
+    if (!queries.pending) {
+        mFunctions->glQueryCounter(queries.end, GL_TIMESTAMP);
+        queries.pending = true;
+        mTimer = (mTimer + 1) % timerFrames;
+    }
+}
+
+void SceneTarget::readTimer(TimerQueries &queries) {
+    if (!queries.pending) {
+        return;
+    }
+    GLint available = 0;
+    mFunctions->glGetQueryObjectiv(queries.end, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available == 0) {
+        return;
+    }
+    GLuint64 begin = 0;
+    GLuint64 end = 0;
+    mFunctions->glGetQueryObjectui64v(queries.begin, GL_QUERY_RESULT, &begin);
+    mFunctions->glGetQueryObjectui64v(queries.end, GL_QUERY_RESULT, &end);
+    queries.pending = false;
+    const double gpuMs = static_cast<double>(end - begin) / 1000000.0;
+    ++mStatistics.timedFrames;
+    mStatistics.gpuMs += gpuMs;
+    adjustScale(gpuMs);
+}
+
+void SceneTarget::adjustScale(double gpuMs) {
+    mSmoothedMs = mStatistics.timedFrames == 1 ? gpuMs : mSmoothedMs + smoothing * (gpuMs - mSmoothedMs);
+    ++mFramesSinceChange;
+    if (mTargetFrameMs <= 0.0f || mFramesSinceChange < settleFrames || mSmoothedMs <= 0.0) {
+        return;
+    }
+    const double ratio = static_cast<double>(mTargetFrameMs) / mSmoothedMs;
+    if (std::abs(ratio - 1.0) <= deadBand) {
+        return;
+    }
+    // GPU time follows the pixel count, the square of the scale.
+    const auto wanted = static_cast<float>(mScale * std::sqrt(ratio));
+    const float previous = mScale;
+    setScale(qBound(previous - maxScaleStep, wanted, previous + maxScaleStep));
+    if (mScale != previous) {
+        ++mStatistics.scaleChanges;
+        mFramesSinceChange = 0;
+    }
+}
@@ -0,0 +1,110 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_SCENETARGET_H
+#define GLTUT2_SCENETARGET_H
+
+#include <array>
+#include <QSize>
+#include <QString>
+#include <QtGui/qopengl.h>
+
+class GLStateCache;
+class ProgramCache;
+class QObject;
+class QOpenGLFunctions_4_5_Core;
+class QOpenGLShaderProgram;
+
+// Offscreen framebuffer the scene renders into instead of the window, so anti-aliasing and
+// resolution are chosen by the application rather than fixed by the surface format. The
+// scene draws into the bottom-left scale() fraction of buffers sized for the output, so a
+// new scale only changes the viewport and never reallocates. end() resolves multisampling
+// and scales the region up into the framebuffer that was bound at begin(): with a blit, or
+// with the FXAA pass, which filters and scales in one draw.
+// With a target frame time, GPU timestamps around each frame drive the scale: a smoothed
+// frame time outside a dead band moves the pixel count by the ratio to the target, limited
+// per step and rested between steps so the scale settles instead of oscillating.
+class SceneTarget {
+public:
+    enum Antialiasing {
+        NoAntialiasing,
+        Msaa2,
+        Msaa4,
+        Msaa8,
+        Fxaa
+    };
+
+    struct Statistics {
+        int frames;
+        // Frames whose timestamps were read back, and their summed GPU time from begin() to end().
+        int timedFrames;
+        double gpuMs;
+        double scaleSum;
+        float minScale;
+        int scaleChanges;
+    };
+
+    explicit SceneTarget(QOpenGLFunctions_4_5_Core *functions, Antialiasing antialiasing = Msaa4);
+
+    static const char *antialiasingName(Antialiasing antialiasing);
+    static bool fromName(const QString &name, Antialiasing &antialiasing);
+
+    bool create(ProgramCache *programCache, QObject *programParent);
+    void destroy();
+    // Reallocates the buffers, which deletes textures behind GLStateCache's back.
+    void resize(const QSize &outputSize);
+
+    // A positive target lets the scale float between 0.5 and 1; otherwise it stays where set.
+    void setTargetFrameMs(float milliseconds) { mTargetFrameMs = milliseconds; }
+    void setScale(float scale);
+
+    void begin();
+    void end(GLStateCache &state);
+
+    Antialiasing antialiasing() const { return mAntialiasing; }
+    GLsizei samples() const { return mSamples; }
+    float scale() const { return mScale; }
+    const QSize &renderSize() const { return mRenderSize; }
+    const QSize &outputSize() const { return mOutputSize; }
+    const Statistics &statistics() const { return mStatistics; }
+
+private:
+    static constexpr int timerFrames = 4;
+
+    struct TimerQueries {
+        GLuint begin;
+        GLuint end;
+        bool pending;
+    };
+
+    void allocate();
+    void release();
+    void readTimer(TimerQueries &queries);
+    void adjustScale(double gpuMs);
+
+    QOpenGLFunctions_4_5_Core *mFunctions;
+    const Antialiasing mAntialiasing;
+    GLsizei mSamples;
+    QSize mOutputSize;
+    QSize mRenderSize;
+    float mScale;
+    float mTargetFrameMs;
+    double mSmoothedMs;
+    int mFramesSinceChange;
+    GLuint mSceneFramebuffer;
+    GLuint mSceneColor;
+    GLuint mSceneDepth;
+    GLuint mResolveFramebuffer;
+    GLuint mResolveColor;
+    GLint mOutputFramebuffer;
+    QOpenGLShaderProgram *mFxaaProgram;
+    GLint mTexelSizeLocation;
+    GLint mRegionSizeLocation;
+    GLuint mEmptyVertexArray;
+    std::array<TimerQueries, timerFrames> mTimers;
+    int mTimer;
+    Statistics mStatistics;
+};
+
+#endif //GLTUT2_SCENETARGET_H
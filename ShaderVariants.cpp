@@ -0,0 +1,280 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "ShaderVariants.h"
+#include <algorithm>
+#include <QDebug>
+#include <QFile>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_4_5_Core>
+#include <QOpenGLShaderProgram>
+
+namespace {
+    // GL_COMPLETION_STATUS_KHR, which the ARB extension shares; Qt's headers predate both.
+    constexpr GLenum completionStatus = 0x91B1;
+    // Lets the driver pick how many threads compile.
+    constexpr GLuint allCompilerThreads = 0xFFFFFFFF;
+    constexpr char featurePragma[] = "#pragma feature ";
+    constexpr std::size_t maxFeatures = 32;
+
+    typedef void (QOPENGLF_APIENTRYP MaxShaderCompilerThreads)(GLuint count);
+
+    GLenum shaderStage(QOpenGLShader::ShaderType type) {
+        switch (static_cast<int>(type)) {
+            case QOpenGLShader::Vertex:
+                return GL_VERTEX_SHADER;
+            case QOpenGLShader::Fragment:
+                return GL_FRAGMENT_SHADER;
+            case QOpenGLShader::Geometry:
+                return GL_GEOMETRY_SHADER;
+            case QOpenGLShader::TessellationControl:
+                return GL_TESS_CONTROL_SHADER;
+            case QOpenGLShader::TessellationEvaluation:
+                return GL_TESS_EVALUATION_SHADER;
+            default:
+                return GL_COMPUTE_SHADER;
+        }
+    }
+
+    QByteArray shaderLog(QOpenGLFunctions_4_5_Core *functions, GLuint shader) {
+        GLint length = 0;
+        functions->glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        QByteArray log(std::max(length, 1), '\0');
+        GLsizei written = 0;
+        functions->glGetShaderInfoLog(shader, log.size(), &written, log.data());
+        log.resize(written);
+        return log;
+    }
+
+    QByteArray programLog(QOpenGLFunctions_4_5_Core *functions, GLuint program) {
+        GLint length = 0;
+        functions->glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        QByteArray log(std::max(length, 1), '\0');
+        GLsizei written = 0;
+        functions->glGetProgramInfoLog(program, log.size(), &written, log.data());
+        log.resize(written);
+        return log;
+    }
+}
+
+ShaderVariants::ShaderVariants(QOpenGLFunctions_4_5_Core *functions) :
+        mFunctions(functions),
+        mProgramCache(nullptr),
+        mContext(nullptr),
+        mClock(),
+        mParallel(false),
+        mSources(),
+        mFeatures(),
+        mVariants(),
+        mStatistics{0, 0, 0, 0, 0} {
+    mClock.start();
+}
+
+bool ShaderVariants::create(ProgramCache *programCache, QOpenGLContext *context,
+                            const ProgramCache::ShaderFiles &files) {
+    mProgramCache = programCache;
+    mContext = context;
+    for (const auto &file : files) {
+        QFile source(file.second);
+        if (Q_UNLIKELY(!source.open(QIODevice::ReadOnly))) {
+            qWarning() << "Failed to read shader" << file.second;
+            return false;
+        }
+        const QByteArray &code = source.readAll();
+        for (const QByteArray &line : code.split('\n')) {
+            const QByteArray &directive = line.simplified();
+            if (!directive.startsWith(featurePragma)) {
+                continue;
+            }
+            const QByteArray &name = directive.mid(static_cast<int>(sizeof(featurePragma) - 1));
+            if (std::find(mFeatures.cbegin(), mFeatures.cend(), name) != mFeatures.cend()) {
+                continue;
+            }
+            if (Q_UNLIKELY(mFeatures.size() == maxFeatures)) {
+                qWarning() << "Shader" << file.second << "declares more than" << maxFeatures << "features";
+                return false;
+            }
+            mFeatures.push_back(name);
+        }
+        mSources.emplace_back(file.first, code);
+    }
+
+    const char *maxThreads = nullptr;
+    if (context->hasExtension(QByteArrayLiteral("GL_KHR_parallel_shader_compile"))) {
+        maxThreads = "glMaxShaderCompilerThreadsKHR";
+    } else if (context->hasExtension(QByteArrayLiteral("GL_ARB_parallel_shader_compile"))) {
+        maxThreads = "glMaxShaderCompilerThreadsARB";
+    }
+    mParallel = maxThreads != nullptr;
+    if (mParallel) {
+        const auto setMaxThreads = reinterpret_cast<MaxShaderCompilerThreads>(context->getProcAddress(maxThreads));
+        if (setMaxThreads != nullptr) {
+            setMaxThreads(allCompilerThreads);
+        }
+    }
+
+    compile(0);
+    finish();
+    return mVariants.front().state == Ready;
+}
+
+void ShaderVariants::destroy() {
+    // The programs belong to the context; only drop the shaders still compiling.
+    for (Variant &variant : mVariants) {
+        for (const GLuint shader : variant.shaders) {
+            mFunctions->glDeleteShader(shader);
+        }
+        variant.shaders.clear();
+    }
+}
+
+ShaderVariants::Features ShaderVariants::feature(const char *name) const {
+    const auto found = std::find(mFeatures.cbegin(), mFeatures.cend(), QByteArray(name));
+    return found == mFeatures.cend() ? 0 : Features(1) << (found - mFeatures.cbegin());
+}
+
+QByteArray ShaderVariants::name(Features features) const {
+    if (features == 0) {
+        return QByteArrayLiteral("generic");
+    }
+    QByteArray name;
+    for (std::size_t i = 0; i < mFeatures.size(); ++i) {
+        if ((features & (Features(1) << i)) != 0) {
+            name += (name.isEmpty() ? QByteArray() : QByteArrayLiteral("+")) + mFeatures[i];
+        }
+    }
+    return name;
+}
+
+ProgramCache::ShaderSources ShaderVariants::specialize(Features features) const {
+    if (features == 0) {
+        return mSources;
+    }
+    QByteArray defines;
+    for (std::size_t i = 0; i < mFeatures.size(); ++i) {
+        if ((features & (Features(1) << i)) != 0) {
+            defines += QByteArrayLiteral("#define ") + mFeatures[i] + QByteArrayLiteral(" 1\n");
+        }
+    }
+    // Defines must follow #version; #line keeps the compiler's line numbers matching the file.
+    defines += QByteArrayLiteral("#line 2\n");
+    ProgramCache::ShaderSources sources(mSources);
+    for (auto &source : sources) {
+        const int versionEnd = source.second.indexOf('\n', source.second.indexOf("#version"));
+        source.second.insert(versionEnd < 0 ? source.second.size() : versionEnd + 1, defines);
+    }
+    return sources;
+}
+
+void ShaderVariants::compile(Features features) {
+    const auto found = std::find_if(mVariants.cbegin(), mVariants.cend(),
+                                    [features](const Variant &variant) { return variant.features == features; });
+    if (found != mVariants.cend()) {
+        return;
+    }
+    mVariants.push_back(Variant{features, new QOpenGLShaderProgram(mContext), specialize(features), {}, Pending,
+                                mClock.nsecsElapsed()});
+    Variant &variant = mVariants.back();
+    ++mStatistics.variants;
+    if (mProgramCache != nullptr && mProgramCache->loadBinary(variant.program, variant.sources)) {
+        variant.state = Ready;
+        ++mStatistics.ready;
+        ++mStatistics.cached;
+        return;
+    }
+
+    // Nothing here asks for a status, so the driver is free to build the program in the background.
+    variant.program->create();
+    const GLuint program = variant.program->programId();
+    for (const auto &source : variant.sources) {
+        const GLuint shader = mFunctions->glCreateShader(shaderStage(source.first));
+        const char *code = source.second.constData();
+        const GLint length = source.second.size();
+        mFunctions->glShaderSource(shader, 1, &code, &length);
+        mFunctions->glCompileShader(shader);
+        mFunctions->glAttachShader(program, shader);
+        variant.shaders.push_back(shader);
+    }
+    mFunctions->glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    mFunctions->glLinkProgram(program);
+}
+
+void ShaderVariants::update() {
+    for (Variant &variant : mVariants) {
+        if (variant.state != Pending) {
+            continue;
+        }
+        if (mParallel) {
+            GLint completed = GL_FALSE;
+            mFunctions->glGetProgramiv(variant.program->programId(), completionStatus, &completed);
+            if (completed == GL_FALSE) {
+                continue;
+            }
+        }
+        complete(variant);
+    }
+}
+
+void ShaderVariants::finish() {
+    for (Variant &variant : mVariants) {
+        if (variant.state == Pending) {
+            complete(variant);
+        }
+    }
+}
+
+void ShaderVariants::complete(Variant &variant) {
+    const GLuint program = variant.program->programId();
+    GLint linked = GL_FALSE;
+    mFunctions->glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (Q_UNLIKELY(linked == GL_FALSE)) {
+        for (const GLuint shader : variant.shaders) {
+            GLint compiled = GL_FALSE;
+            mFunctions->glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+            if (compiled == GL_FALSE) {
+                qWarning() << "Failed to compile shader variant" << name(variant.features)
+                           << shaderLog(mFunctions, shader);
+            }
+        }
+        qWarning() << "Failed to link shader variant" << name(variant.features) << programLog(mFunctions, program);
+    }
+    for (const GLuint shader : variant.shaders) {
+        mFunctions->glDetachShader(program, shader);
+        mFunctions->glDeleteShader(shader);
+    }
+    variant.shaders.clear();
+    // With no shaders of its own, link() only adopts the program linked above.
+    if (Q_UNLIKELY(linked == GL_FALSE || !variant.program->link())) {
+        variant.state = Failed;
+        ++mStatistics.failed;
+        return;
+    }
+    const qint64 compileNs = mClock.nsecsElapsed() - variant.startNs;
+    variant.state = Ready;
+    ++mStatistics.ready;
+    mStatistics.compileNs += compileNs;
+    if (mProgramCache != nullptr) {
+        mProgramCache->storeBinary(variant.program, variant.sources, compileNs);
+    }
+}
+
+QOpenGLShaderProgram *ShaderVariants::program(Features features) const {
+    for (const Variant &variant : mVariants) {
+        if (variant.features == features) {
+            return variant.state == Ready ? variant.program : generic();
+        }
+    }
+    return generic();
+}
+
+QOpenGLShaderProgram *ShaderVariants::variantProgram(std::size_t index) const {
+    const Variant &variant = mVariants[index];
+    return variant.state == Ready ? variant.program : nullptr;
+}
+
+void ShaderVariants::logStatistics() const {
+    qDebug() << "Shader variants:" << mStatistics.ready << "of" << mStatistics.variants << "ready,"
+             << mStatistics.cached << "from the program cache," << mStatistics.failed << "failed,"
+             << mStatistics.compileNs / 1000000.0 << "ms compiling" << (mParallel ? "in parallel" : "serially");
+}
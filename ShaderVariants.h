@@ -0,0 +1,95 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_SHADERVARIANTS_H
+#define GLTUT2_SHADERVARIANTS_H
+
+#include "ProgramCache.h"
+#include <vector>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QtGui/qopengl.h>
+
+class QOpenGLContext;
+class QOpenGLFunctions_4_5_Core;
+class QOpenGLShaderProgram;
+
+// Permutations of one program. Its sources declare features with `#pragma feature NAME` lines,
+// which compilers ignore; a variant is compiled with `#define NAME 1` after the #version line for
+// each of its features, so a feature that is off costs nothing at run time instead of a branch.
+// compile() only submits a variant: with GL_KHR_parallel_shader_compile the driver builds it on
+// its own threads and update() adopts it once done, otherwise update() waits for it. Until then,
+// or if it fails, program() answers with the generic variant, which has no features.
+class ShaderVariants {
+public:
+    typedef quint32 Features;
+
+    struct Statistics {
+        int variants;
+        int ready;
+        int failed;
+        // Variants linked from the program cache instead of compiled.
+        int cached;
+        // From submission until the variant was adopted, summed over the compiled variants.
+        qint64 compileNs;
+    };
+
+    explicit ShaderVariants(QOpenGLFunctions_4_5_Core *functions);
+
+    // Builds the generic variant before returning; the cache may be null.
+    bool create(ProgramCache *programCache, QOpenGLContext *context, const ProgramCache::ShaderFiles &files);
+    void destroy();
+
+    // The bit of a declared feature, 0 for unknown names.
+    Features feature(const char *name) const;
+    QByteArray name(Features features) const;
+
+    void compile(Features features);
+    void update();
+    // Waits for every submitted variant.
+    void finish();
+
+    QOpenGLShaderProgram *program(Features features) const;
+    QOpenGLShaderProgram *generic() const { return mVariants.empty() ? nullptr : mVariants.front().program; }
+    bool parallel() const { return mParallel; }
+
+    // Variants in the order they were submitted, the generic one first; null until ready.
+    std::size_t variantCount() const { return mVariants.size(); }
+    Features variantFeatures(std::size_t index) const { return mVariants[index].features; }
+    QOpenGLShaderProgram *variantProgram(std::size_t index) const;
+
+    const Statistics &statistics() const { return mStatistics; }
+    void logStatistics() const;
+
+private:
+    enum State {
+        Pending,
+        Ready,
+        Failed
+    };
+
+    struct Variant {
+        Features features;
+        QOpenGLShaderProgram *program;
+        ProgramCache::ShaderSources sources;
+        std::vector<GLuint> shaders;
+        State state;
+        qint64 startNs;
+    };
+
+    ProgramCache::ShaderSources specialize(Features features) const;
+    void complete(Variant &variant);
+
+    QOpenGLFunctions_4_5_Core *mFunctions;
+    ProgramCache *mProgramCache;
+    QOpenGLContext *mContext;
+    QElapsedTimer mClock;
+    bool mParallel;
+    ProgramCache::ShaderSources mSources;
+    std::vector<QByteArray> mFeatures;
+    std::vector<Variant> mVariants;
+    Statistics mStatistics;
+};
+
+#endif //GLTUT2_SHADERVARIANTS_H
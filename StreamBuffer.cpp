@@ -0,0 +1,131 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "StreamBuffer.h"
+#include "FrameProfiler.h"
+#include "GLStateCache.h"
+#include <algorithm>
+#include <QDebug>
+#include <QOpenGLFunctions_4_5_Core>
+
+namespace {
+    constexpr GLbitfield storageFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    constexpr GLuint64 waitStepNs = 1000000;
+
+    GLsizeiptr alignUp(GLsizeiptr value, GLsizeiptr alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+StreamBuffer::StreamBuffer(QOpenGLFunctions_4_5_Core *functions, GLsizeiptr slotSize, int slotCount) :
+        mFunctions(functions),
+        mSlotSize(alignUp(slotSize, 256)),
+        mSlotCount(std::max(slotCount, 1)),
+        mBuffer(0),
+        mData(nullptr),
+        mFences(static_cast<std::size_t>(mSlotCount), nullptr),
+        mSlot(0),
+        mHead(0),
+        mUniformAlignment(256),
+        mStorageAlignment(256),
+        mStatistics{0, 0, 0, 0} {
+}
+
+void StreamBuffer::create() {
+    GLint alignment = 0;
+    mFunctions->glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    mUniformAlignment = std::max<GLsizeiptr>(alignment, 16);
+    mFunctions->glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    mStorageAlignment = std::max<GLsizeiptr>(alignment, 16);
+    createStorage();
+}
+
+void StreamBuffer::destroy() {
+    releaseStorage();
+}
+
+void StreamBuffer::createStorage() {
+    const GLsizeiptr size = mSlotSize * mSlotCount;
+    mFunctions->glCreateBuffers(1, &mBuffer);
+    mFunctions->glNamedBufferStorage(mBuffer, size, nullptr, storageFlags);
+    mData = static_cast<uchar *>(mFunctions->glMapNamedBufferRange(mBuffer, 0, size, storageFlags));
+    mSlot = 0;
+    mHead = 0;
+}
+
+void StreamBuffer::releaseStorage() {
+    for (GLsync &fence : mFences) {
+        if (fence != nullptr) {
+            mFunctions->glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    if (mBuffer != 0) {
+        mFunctions->glUnmapNamedBuffer(mBuffer);
+        mFunctions->glDeleteBuffers(1, &mBuffer);
+        mBuffer = 0;
+        mData = nullptr;
+    }
+}
+
+void StreamBuffer::beginFrame(FrameProfiler &profiler, GLsizeiptr requiredSize) {
+    ++mStatistics.frames;
+    if (Q_UNLIKELY(requiredSize > mSlotSize)) {
+        // Every slot may still be read by the GPU, so drain them all before replacing the buffer.
+        for (int slot = 0; slot < mSlotCount; ++slot) {
+            waitForSlot(slot, profiler);
+        }
+        releaseStorage();
+        while (mSlotSize < requiredSize) {
+            mSlotSize *= 2;
+        }
+        createStorage();
+        ++mStatistics.reallocations;
+        return;
+    }
+    waitForSlot(mSlot, profiler);
+    mHead = 0;
+}
+
+void StreamBuffer::endFrame() {
+    if (mBuffer == 0) {
+        return;
+    }
+    mFences[mSlot] = mFunctions->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    mSlot = (mSlot + 1) % mSlotCount;
+}
+
+void StreamBuffer::waitForSlot(int slot, FrameProfiler &profiler) {
+    GLsync &fence = mFences[slot];
+    if (fence == nullptr) {
+        return;
+    }
+    GLenum status = mFunctions->glClientWaitSync(fence, 0, 0);
+    if (Q_UNLIKELY(status == GL_TIMEOUT_EXPIRED)) {
+        const FrameProfiler::Scope scope(profiler, "stream.wait");
+        const qint64 startNs = profiler.nowNs();
+        do {
+            status = mFunctions->glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, waitStepNs);
+        } while (status == GL_TIMEOUT_EXPIRED);
+        ++mStatistics.stalledFrames;
+        mStatistics.waitNs += profiler.nowNs() - startNs;
+    }
+    mFunctions->glDeleteSync(fence);
+    fence = nullptr;
+}
+
+StreamBuffer::Range StreamBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment) {
+    const GLsizeiptr offset = alignUp(mHead, alignment);
+    if (Q_UNLIKELY(mData == nullptr || offset + size > mSlotSize)) {
+        qWarning() << "Stream buffer slot of" << mSlotSize << "bytes cannot fit" << size << "more bytes";
+        return Range{0, 0, 0, nullptr};
+    }
+    mHead = offset + size;
+    const GLintptr bufferOffset = mSlot * mSlotSize + offset;
+    return Range{mBuffer, bufferOffset, size, mData + bufferOffset};
+}
+
+void StreamBuffer::bindRange(GLStateCache &state, GLenum target, GLuint index, const Range &range) const {
+    state.bindBufferRange(target, index, range.buffer, range.offset, range.size);
+}
@@ -0,0 +1,71 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_STREAMBUFFER_H
+#define GLTUT2_STREAMBUFFER_H
+
+#include <vector>
+#include <QtGui/qopengl.h>
+
+class FrameProfiler;
+class GLStateCache;
+class QOpenGLFunctions_4_5_Core;
+
+// Persistently mapped ring of per-frame slots for data the CPU rewrites every frame. Each slot
+// is fenced when its frame is submitted, and beginFrame() waits for the slot it is about to
+// reuse, so writes never race the GPU and the driver never has to orphan or stall. The slot
+// size only grows, between frames, when a frame asks for more than fits.
+class StreamBuffer {
+public:
+    struct Range {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+        void *data;
+    };
+
+    struct Statistics {
+        int frames;
+        int stalledFrames;
+        qint64 waitNs;
+        int reallocations;
+    };
+
+    explicit StreamBuffer(QOpenGLFunctions_4_5_Core *functions, GLsizeiptr slotSize = 4 * 1024 * 1024,
+                          int slotCount = 3);
+
+    void create();
+    void destroy();
+
+    void beginFrame(FrameProfiler &profiler, GLsizeiptr requiredSize = 0);
+    void endFrame();
+    Range allocate(GLsizeiptr size, GLsizeiptr alignment = 16);
+    Range allocateUniform(GLsizeiptr size) { return allocate(size, mUniformAlignment); }
+    Range allocateStorage(GLsizeiptr size) { return allocate(size, mStorageAlignment); }
+
+    void bindRange(GLStateCache &state, GLenum target, GLuint index, const Range &range) const;
+
+    GLuint buffer() const { return mBuffer; }
+    GLsizeiptr slotSize() const { return mSlotSize; }
+    const Statistics &statistics() const { return mStatistics; }
+
+private:
+    void createStorage();
+    void releaseStorage();
+    void waitForSlot(int slot, FrameProfiler &profiler);
+
+    QOpenGLFunctions_4_5_Core *mFunctions;
+    GLsizeiptr mSlotSize;
+    const int mSlotCount;
+    GLuint mBuffer;
+    uchar *mData;
+    std::vector<GLsync> mFences;
+    int mSlot;
+    GLsizeiptr mHead;
+    GLsizeiptr mUniformAlignment;
+    GLsizeiptr mStorageAlignment;
+    Statistics mStatistics;
+};
+
+#endif //GLTUT2_STREAMBUFFER_H
@@ -0,0 +1,213 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "TextureFile.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <QDebug>
+#include <QSaveFile>
+
+namespace {
+    const std::array<uchar, 12> identifier{0xab, 0x4b, 0x54, 0x58, 0x20, 0x32, 0x30, 0xbb, 0x0d, 0x0a, 0x1a, 0x0a};
+
+    // Vulkan format numbers used in the header.
+    constexpr quint32 vkFormatRgba8 = 37;
+    constexpr quint32 vkFormatBc1 = 131;
+    constexpr quint32 vkFormatBc3 = 137;
+
+    constexpr qint64 levelAlignment = 16;
+
+    struct Header {
+        std::array<uchar, 12> identifier;
+        quint32 vkFormat;
+        quint32 typeSize;
+        quint32 pixelWidth;
+        quint32 pixelHeight;
+        quint32 pixelDepth;
+        quint32 layerCount;
+        quint32 faceCount;
+        quint32 levelCount;
+        quint32 supercompressionScheme;
+        quint32 dfdByteOffset;
+        quint32 dfdByteLength;
+        quint32 kvdByteOffset;
+        quint32 kvdByteLength;
+        quint64 sgdByteOffset;
+        quint64 sgdByteLength;
+    };
+    static_assert(sizeof(Header) == 80, "KTX2 header must be 80 bytes");
+
+    struct LevelIndex {
+        quint64 byteOffset;
+        quint64 byteLength;
+        quint64 uncompressedByteLength;
+    };
+
+    quint32 vkFormat(TextureFile::Format format) {
+        switch (format) {
+            case TextureFile::Bc1:
+                return vkFormatBc1;
+            case TextureFile::Bc3:
+                return vkFormatBc3;
+            case TextureFile::Rgba8:
+                break;
+        }
+        return vkFormatRgba8;
+    }
+
+    bool fromVkFormat(quint32 vkFormat, TextureFile::Format &format) {
+        switch (vkFormat) {
+            case vkFormatRgba8:
+                format = TextureFile::Rgba8;
+                return true;
+            case vkFormatBc1:
+                format = TextureFile::Bc1;
+                return true;
+            case vkFormatBc3:
+                format = TextureFile::Bc3;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    qint64 alignUp(qint64 value) {
+        return (value + levelAlignment - 1) & ~(levelAlignment - 1);
+    }
+}
+
+TextureFile::TextureFile() :
+        mFile(),
+        mData(nullptr),
+        mFormat(Rgba8),
+        mSize(),
+        mLevels() {
+}
+
+TextureFile::~TextureFile() {
+    close();
+}
+
+GLenum TextureFile::internalFormat(Format format) {
+    switch (format) {
+        case Bc1:
+            return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case Bc3:
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case Rgba8:
+            break;
+    }
+    return GL_RGBA8;
+}
+
+qint64 TextureFile::levelSize(Format format, int width, int height) {
+    const qint64 blocks = static_cast<qint64>((width + 3) / 4) * ((height + 3) / 4);
+    switch (format) {
+        case Bc1:
+            return blocks * 8;
+        case Bc3:
+            return blocks * 16;
+        case Rgba8:
+            break;
+    }
+    return static_cast<qint64>(width) * height * 4;
+}
+
+bool TextureFile::open(const QString &fileName) {
+    close();
+    mFile.setFileName(fileName);
+    if (Q_UNLIKELY(!mFile.open(QIODevice::ReadOnly))) {
+        qWarning() << "Failed to open texture" << fileName << mFile.errorString();
+        return false;
+    }
+    const qint64 fileSize = mFile.size();
+    Header header{};
+    if (Q_UNLIKELY(fileSize < static_cast<qint64>(sizeof(header)))) {
+        qWarning() << "Texture" << fileName << "is truncated";
+        close();
+        return false;
+    }
+    mData = mFile.map(0, fileSize);
+    if (Q_UNLIKELY(mData == nullptr)) {
+        qWarning() << "Failed to map texture" << fileName << mFile.errorString();
+        close();
+        return false;
+    }
+    std::memcpy(&header, mData, sizeof(header));
+    if (Q_UNLIKELY(header.identifier != identifier || !fromVkFormat(header.vkFormat, mFormat)
+                   || header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth != 0
+                   || header.layerCount != 0 || header.faceCount != 1 || header.levelCount == 0
+                   || header.supercompressionScheme != 0)) {
+        qWarning() << "Texture" << fileName << "is not a supported KTX2 file";
+        close();
+        return false;
+    }
+    const qint64 indexEnd = static_cast<qint64>(sizeof(header) + header.levelCount * sizeof(LevelIndex));
+    if (Q_UNLIKELY(header.levelCount > 32 || indexEnd > fileSize)) {
+        qWarning() << "Texture" << fileName << "is truncated";
+        close();
+        return false;
+    }
+
+    mSize = QSize(static_cast<int>(header.pixelWidth), static_cast<int>(header.pixelHeight));
+    mLevels.reserve(header.levelCount);
+    for (quint32 i = 0; i < header.levelCount; ++i) {
+        LevelIndex index{};
+        std::memcpy(&index, mData + sizeof(header) + i * sizeof(index), sizeof(index));
+        const int width = std::max(mSize.width() >> i, 1);
+        const int height = std::max(mSize.height() >> i, 1);
+        const qint64 size = levelSize(mFormat, width, height);
+        if (Q_UNLIKELY(index.byteLength != static_cast<quint64>(size) || index.byteOffset > static_cast<quint64>(fileSize)
+                       || index.byteLength > static_cast<quint64>(fileSize) - index.byteOffset)) {
+            qWarning() << "Texture" << fileName << "has a corrupt level" << i;
+            close();
+            return false;
+        }
+        mLevels.push_back(Level{width, height, mData + index.byteOffset, size});
+    }
+    return true;
+}
+
+void TextureFile::close() {
+    mLevels.clear();
+    if (mData != nullptr) {
+        mFile.unmap(mData);
+        mData = nullptr;
+    }
+    mFile.close();
+}
+
+bool TextureFile::write(const QString &fileName, Format format, const QSize &size, const std::vector<QByteArray> &levels) {
+    const auto levelCount = static_cast<quint32>(levels.size());
+    Header header{identifier, vkFormat(format), 1,
+                  static_cast<quint32>(size.width()), static_cast<quint32>(size.height()), 0, 0, 1, levelCount, 0,
+                  0, 0, 0, 0, 0, 0};
+
+    // Levels are laid out smallest first, as KTX2 requires, while the index lists them largest first.
+    std::vector<LevelIndex> indices(levels.size());
+    qint64 offset = alignUp(static_cast<qint64>(sizeof(header) + levels.size() * sizeof(LevelIndex)));
+    for (auto i = static_cast<int>(levels.size()) - 1; i >= 0; --i) {
+        const auto length = static_cast<quint64>(levels[i].size());
+        indices[i] = LevelIndex{static_cast<quint64>(offset), length, length};
+        offset = alignUp(offset + levels[i].size());
+    }
+
+    QSaveFile file(fileName);
+    if (Q_UNLIKELY(!file.open(QIODevice::WriteOnly))) {
+        qWarning() << "Failed to create texture" << fileName << file.errorString();
+        return false;
+    }
+    QByteArray data(static_cast<int>(offset), '\0');
+    std::memcpy(data.data(), &header, sizeof(header));
+    std::memcpy(data.data() + sizeof(header), indices.data(), indices.size() * sizeof(LevelIndex));
+    for (std::size_t i = 0; i < levels.size(); ++i) {
+        std::memcpy(data.data() + indices[i].byteOffset, levels[i].constData(), static_cast<std::size_t>(levels[i].size()));
+    }
+    if (Q_UNLIKELY(file.write(data) != data.size() || !file.commit())) {
+        qWarning() << "Failed to write texture" << fileName << file.errorString();
+        return false;
+    }
+    return true;
+}
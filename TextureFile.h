@@ -0,0 +1,63 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_TEXTUREFILE_H
+#define GLTUT2_TEXTUREFILE_H
+
+#include <vector>
+#include <QByteArray>
+#include <QFile>
+#include <QSize>
+#include <QString>
+#include <QtGui/qopengl.h>
+
+// KTX2-style texture container: the KTX2 identifier, header and level index followed by the
+// mip levels, smallest first, each aligned to 16 bytes. There is no data format descriptor or
+// supercompression; the format is identified by its Vulkan format number alone.
+// open() memory-maps the file and level() points straight into the mapping, so uploads read
+// the file pages directly without an intermediate copy.
+class TextureFile {
+public:
+    enum Format {
+        Rgba8,
+        Bc1,
+        Bc3
+    };
+
+    struct Level {
+        int width;
+        int height;
+        const uchar *data;
+        qint64 size;
+    };
+
+    TextureFile();
+    ~TextureFile();
+
+    bool open(const QString &fileName);
+    void close();
+
+    bool isOpen() const { return mData != nullptr; }
+    Format format() const { return mFormat; }
+    QSize size() const { return mSize; }
+    int levelCount() const { return static_cast<int>(mLevels.size()); }
+    const Level &level(int level) const { return mLevels[level]; }
+    bool isCompressed() const { return mFormat != Rgba8; }
+    GLenum internalFormat() const { return internalFormat(mFormat); }
+
+    static GLenum internalFormat(Format format);
+    static qint64 levelSize(Format format, int width, int height);
+    static bool write(const QString &fileName, Format format, const QSize &size, const std::vector<QByteArray> &levels);
+
+private:
+    Q_DISABLE_COPY(TextureFile)
+
+    QFile mFile;
+    uchar *mData;
+    Format mFormat;
+    QSize mSize;
+    std::vector<Level> mLevels;
+};
+
+#endif //GLTUT2_TEXTUREFILE_H
@@ -0,0 +1,329 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "TextureLoader.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <QDebug>
+#include <QOpenGLFunctions_4_5_Core>
+#include <QRunnable>
+
+namespace {
+    constexpr GLsizeiptr stagingAlignment = 64;
+    constexpr GLbitfield stagingFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    class DecodeJob : public QRunnable {
+    public:
+        explicit DecodeJob(std::function<void()> job) : mJob(std::move(job)) {}
+        void run() override { mJob(); }
+
+    private:
+        const std::function<void()> mJob;
+    };
+
+    GLsizeiptr alignUp(GLsizeiptr value) {
+        return (value + stagingAlignment - 1) & ~(stagingAlignment - 1);
+    }
+
+    GLsizei mipLevels(int width, int height) {
+        return static_cast<GLsizei>(std::floor(std::log2(std::max(std::max(width, height), 1)))) + 1;
+    }
+}
+
+TextureLoader::TextureLoader(QOpenGLFunctions_4_5_Core *functions, GLsizeiptr stagingSize) :
+        mFunctions(functions),
+        mPool(),
+        mClock(),
+        mTextures(),
+        mPlaceholder(0),
+        mDecodedMutex(),
+        mDecoded(),
+        mReady(),
+        mStagingBuffer(0),
+        mStagingData(nullptr),
+        mStagingSize(stagingSize),
+        mStagingHead(0),
+        mStagingTail(0),
+        mStagingFences(),
+        mPending(0),
+        mFirstFrameNs(-1),
+        mAllResidentNs(-1),
+        mResidentBytes(0) {
+    mClock.start();
+
+    const std::array<uchar, 4> grey{0x80, 0x80, 0x80, 0xff};
+    mFunctions->glCreateTextures(GL_TEXTURE_2D, 1, &mPlaceholder);
+    mFunctions->glTextureStorage2D(mPlaceholder, 1, GL_RGBA8, 1, 1);
+    mFunctions->glTextureSubImage2D(mPlaceholder, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, grey.data());
+
+    mFunctions->glCreateBuffers(1, &mStagingBuffer);
+    mFunctions->glNamedBufferStorage(mStagingBuffer, mStagingSize, nullptr, stagingFlags);
+    mStagingData = static_cast<uchar *>(mFunctions->glMapNamedBufferRange(mStagingBuffer, 0, mStagingSize, stagingFlags));
+}
+
+TextureLoader::~TextureLoader() {
+    mPool.clear();
+    mPool.waitForDone();
+}
+
+TextureLoader::Handle TextureLoader::load(const QString &fileName) {
+    return enqueue(fileName, 0, -1, QSize());
+}
+
+TextureLoader::Handle TextureLoader::loadLayer(const QString &fileName, GLuint arrayTexture, GLint layer,
+                                               const QSize &layerSize) {
+    return enqueue(fileName, arrayTexture, layer, layerSize);
+}
+
+TextureLoader::Handle TextureLoader::enqueue(const QString &fileName, GLuint arrayTexture, GLint layer,
+                                             const QSize &layerSize) {
+    const auto handle = static_cast<Handle>(mTextures.size());
+    mTextures.push_back(Texture{fileName, arrayTexture, layer, false});
+    ++mPending;
+    auto *job = new DecodeJob([this, handle, fileName, layerSize] {
+        if (fileName.endsWith(QStringLiteral(".ktx2"))) {
+            auto file = std::make_shared<TextureFile>();
+            if (!file->open(fileName)) {
+                file.reset();
+            }
+            enqueueDecoded(handle, QImage(), std::move(file));
+            return;
+        }
+        QImage image(fileName);
+        if (!image.isNull() && layerSize.isValid() && image.size() != layerSize) {
+            image = image.scaled(layerSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        }
+        enqueueDecoded(handle, image.mirrored().convertToFormat(QImage::Format_RGBA8888), nullptr);
+    });
+    mPool.start(job);
+    return handle;
+}
+
+void TextureLoader::enqueueDecoded(Handle handle, QImage image, std::shared_ptr<const TextureFile> file) {
+    const QMutexLocker locker(&mDecodedMutex);
+    mDecoded.push_back(Decoded{handle, std::move(image), std::move(file)});
+}
+
+void TextureLoader::update() {
+    if (Q_LIKELY(mPending == 0)) {
+        return;
+    }
+
+    retireStaging();
+    {
+        const QMutexLocker locker(&mDecodedMutex);
+        std::move(mDecoded.begin(), mDecoded.end(), std::back_inserter(mReady));
+        mDecoded.clear();
+    }
+    while (!mReady.empty() && upload(mReady.front())) {
+        mReady.pop_front();
+    }
+    reportIfDone();
+}
+
+bool TextureLoader::upload(const Decoded &decoded) {
+    Texture &texture = mTextures[decoded.handle];
+    if (decoded.file != nullptr) {
+        uploadFile(texture, *decoded.file);
+        texture.resident = true;
+        --mPending;
+        return true;
+    }
+
+    const QImage &image = decoded.image;
+    if (Q_UNLIKELY(image.isNull())) {
+        qWarning() << "Failed to decode texture" << texture.fileName;
+        texture.resident = true;
+        if (texture.layer < 0) {
+            texture.id = mPlaceholder;
+        }
+        --mPending;
+        return true;
+    }
+
+    const auto size = static_cast<GLsizeiptr>(image.sizeInBytes());
+    GLsizeiptr offset = -1;
+    if (Q_LIKELY(mStagingData != nullptr && alignUp(size) <= mStagingSize)) {
+        offset = allocateStaging(size);
+        if (offset < 0) {
+            return false;
+        }
+    }
+
+    if (texture.layer < 0) {
+        mFunctions->glCreateTextures(GL_TEXTURE_2D, 1, &texture.id);
+        mFunctions->glTextureStorage2D(texture.id, mipLevels(image.width(), image.height()), GL_RGBA8,
+                                       image.width(), image.height());
+        mFunctions->glTextureParameteri(texture.id, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        mFunctions->glTextureParameteri(texture.id, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        mFunctions->glTextureParameteri(texture.id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        mFunctions->glTextureParameteri(texture.id, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    }
+    mFunctions->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    const void *pixels = image.constBits();
+    if (offset >= 0) {
+        std::memcpy(mStagingData + offset, image.constBits(), static_cast<std::size_t>(size));
+        mFunctions->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mStagingBuffer);
+        pixels = reinterpret_cast<const void *>(offset);
+    }
+    if (texture.layer < 0) {
+        mFunctions->glTextureSubImage2D(texture.id, 0, 0, 0, image.width(), image.height(), GL_RGBA, GL_UNSIGNED_BYTE,
+                                        pixels);
+    } else {
+        mFunctions->glTextureSubImage3D(texture.id, 0, 0, 0, texture.layer, image.width(), image.height(), 1, GL_RGBA,
+                                        GL_UNSIGNED_BYTE, pixels);
+    }
+    if (offset >= 0) {
+        mFunctions->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        mStagingFences.push_back(StagingFence{mFunctions->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), mStagingHead});
+    }
+    // Regenerates the mips of every layer of an array, which is cheap next to a frame.
+    mFunctions->glGenerateTextureMipmap(texture.id);
+
+    for (GLsizei level = 0; level < mipLevels(image.width(), image.height()); ++level) {
+        mResidentBytes += static_cast<qint64>(std::max(image.width() >> level, 1)) * std::max(image.height() >> level, 1) * 4;
+    }
+    texture.resident = true;
+    --mPending;
+    return true;
+}
+
+void TextureLoader::uploadFile(Texture &texture, const TextureFile &file) {
+    const GLenum format = file.internalFormat();
+    GLint levels = file.levelCount();
+    if (texture.layer < 0) {
+        mFunctions->glCreateTextures(GL_TEXTURE_2D, 1, &texture.id);
+        mFunctions->glTextureStorage2D(texture.id, levels, format, file.size().width(), file.size().height());
+        mFunctions->glTextureParameteri(texture.id, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        mFunctions->glTextureParameteri(texture.id, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        mFunctions->glTextureParameteri(texture.id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        mFunctions->glTextureParameteri(texture.id, GL_TEXTURE_MIN_FILTER,
+                                        levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    } else {
+        GLint arrayFormat = 0;
+        GLint width = 0;
+        GLint height = 0;
+        GLint arrayLevels = 0;
+        mFunctions->glGetTextureLevelParameteriv(texture.id, 0, GL_TEXTURE_INTERNAL_FORMAT, &arrayFormat);
+        mFunctions->glGetTextureLevelParameteriv(texture.id, 0, GL_TEXTURE_WIDTH, &width);
+        mFunctions->glGetTextureLevelParameteriv(texture.id, 0, GL_TEXTURE_HEIGHT, &height);
+        mFunctions->glGetTextureParameteriv(texture.id, GL_TEXTURE_IMMUTABLE_LEVELS, &arrayLevels);
+        if (Q_UNLIKELY(static_cast<GLenum>(arrayFormat) != format || QSize(width, height) != file.size())) {
+            qWarning() << "Texture" << texture.fileName << "does not match its texture array layer";
+            return;
+        }
+        levels = std::min(levels, arrayLevels);
+    }
+
+    // Level data is read from the mapping while the call runs, so no unpack buffer may be bound.
+    mFunctions->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (GLint i = 0; i < levels; ++i) {
+        const TextureFile::Level &level = file.level(i);
+        const auto size = static_cast<GLsizei>(level.size);
+        if (texture.layer < 0 && file.isCompressed()) {
+            mFunctions->glCompressedTextureSubImage2D(texture.id, i, 0, 0, level.width, level.height, format, size,
+                                                      level.data);
+        } else if (texture.layer < 0) {
+            mFunctions->glTextureSubImage2D(texture.id, i, 0, 0, level.width, level.height, GL_RGBA, GL_UNSIGNED_BYTE,
+                                            level.data);
+        } else if (file.isCompressed()) {
+            mFunctions->glCompressedTextureSubImage3D(texture.id, i, 0, 0, texture.layer, level.width, level.height, 1,
+                                                      format, size, level.data);
+        } else {
+            mFunctions->glTextureSubImage3D(texture.id, i, 0, 0, texture.layer, level.width, level.height, 1, GL_RGBA,
+                                            GL_UNSIGNED_BYTE, level.data);
+        }
+        mResidentBytes += level.size;
+    }
+    if (levels < mipLevels(file.size().width(), file.size().height()) && texture.layer >= 0 && !file.isCompressed()) {
+        mFunctions->glGenerateTextureMipmap(texture.id);
+    }
+}
+
+GLsizeiptr TextureLoader::allocateStaging(GLsizeiptr size) {
+    if (mStagingFences.empty()) {
+        mStagingHead = 0;
+        mStagingTail = 0;
+    }
+    const GLsizeiptr alignedSize = alignUp(size);
+    GLsizeiptr offset = -1;
+    if (mStagingHead >= mStagingTail) {
+        if (mStagingSize - mStagingHead >= alignedSize) {
+            offset = mStagingHead;
+        } else if (alignedSize < mStagingTail) {
+            offset = 0;
+        }
+    } else if (mStagingHead + alignedSize < mStagingTail) {
+        offset = mStagingHead;
+    }
+    if (offset >= 0) {
+        mStagingHead = offset + alignedSize;
+    }
+    return offset;
+}
+
+void TextureLoader::retireStaging() {
+    while (!mStagingFences.empty()) {
+        const StagingFence &front = mStagingFences.front();
+        if (mFunctions->glClientWaitSync(front.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            break;
+        }
+        mFunctions->glDeleteSync(front.fence);
+        mStagingTail = front.end;
+        mStagingFences.pop_front();
+    }
+}
+
+void TextureLoader::frameRendered() {
+    if (Q_UNLIKELY(mFirstFrameNs < 0)) {
+        mFirstFrameNs = mClock.nsecsElapsed();
+        reportIfDone();
+    }
+}
+
+void TextureLoader::reportIfDone() {
+    if (mPending != 0 || mAllResidentNs >= 0 || mFirstFrameNs < 0) {
+        return;
+    }
+    mAllResidentNs = mClock.nsecsElapsed();
+    qDebug() << "Textures: first frame after" << mFirstFrameNs / 1000000.0 << "ms," << mTextures.size()
+             << "textures resident after" << mAllResidentNs / 1000000.0 << "ms," << mResidentBytes / 1024 << "KiB";
+}
+
+GLuint TextureLoader::texture(Handle handle) const {
+    const Texture &texture = mTextures[handle];
+    return Q_LIKELY(texture.resident) ? texture.id : mPlaceholder;
+}
+
+void TextureLoader::destroy() {
+    mPool.clear();
+    mPool.waitForDone();
+    for (const auto &fence : mStagingFences) {
+        mFunctions->glDeleteSync(fence.fence);
+    }
+    mStagingFences.clear();
+    for (auto &texture : mTextures) {
+        // Array layers belong to the array's owner.
+        if (texture.id != 0 && texture.id != mPlaceholder && texture.layer < 0) {
+            mFunctions->glDeleteTextures(1, &texture.id);
+        }
+        texture.id = 0;
+        texture.resident = false;
+    }
+    if (mStagingBuffer != 0) {
+        mFunctions->glUnmapNamedBuffer(mStagingBuffer);
+        mFunctions->glDeleteBuffers(1, &mStagingBuffer);
+        mStagingBuffer = 0;
+        mStagingData = nullptr;
+    }
+    if (mPlaceholder != 0) {
+        mFunctions->glDeleteTextures(1, &mPlaceholder);
+        mPlaceholder = 0;
+    }
+}
@@ -0,0 +1,98 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_TEXTURELOADER_H
+#define GLTUT2_TEXTURELOADER_H
+
+#include "TextureFile.h"
+#include <deque>
+#include <memory>
+#include <vector>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QMutex>
+#include <QSize>
+#include <QString>
+#include <QThreadPool>
+#include <QtGui/qopengl.h>
+
+class QOpenGLFunctions_4_5_Core;
+
+// Decodes images on a worker pool and streams them into immutable textures through a
+// persistently mapped pixel unpack buffer. Until a texture is resident, texture() returns
+// a placeholder so draws never wait for I/O or decoding. loadLayer() streams into one layer of
+// an existing texture array instead, scaling the image to the layer size while decoding.
+// .ktx2 files skip decoding: they are memory-mapped on the pool and their precomputed mips are
+// uploaded straight from the mapping.
+class TextureLoader {
+public:
+    typedef int Handle;
+
+    explicit TextureLoader(QOpenGLFunctions_4_5_Core *functions, GLsizeiptr stagingSize = 16 * 1024 * 1024);
+    ~TextureLoader();
+
+    Handle load(const QString &fileName);
+    Handle loadLayer(const QString &fileName, GLuint arrayTexture, GLint layer, const QSize &layerSize);
+    void update();
+    void frameRendered();
+    void destroy();
+
+    GLuint texture(Handle handle) const;
+    bool isResident(Handle handle) const { return mTextures[handle].resident; }
+    int pendingCount() const { return mPending; }
+    qint64 firstFrameNs() const { return mFirstFrameNs; }
+    qint64 allResidentNs() const { return mAllResidentNs; }
+    qint64 residentBytes() const { return mResidentBytes; }
+
+private:
+    struct Texture {
+        QString fileName;
+        GLuint id;
+        GLint layer;
+        bool resident;
+    };
+
+    struct Decoded {
+        Handle handle;
+        QImage image;
+        std::shared_ptr<const TextureFile> file;
+    };
+
+    struct StagingFence {
+        GLsync fence;
+        GLsizeiptr end;
+    };
+
+    Handle enqueue(const QString &fileName, GLuint arrayTexture, GLint layer, const QSize &layerSize);
+    void enqueueDecoded(Handle handle, QImage image, std::shared_ptr<const TextureFile> file);
+    bool upload(const Decoded &decoded);
+    void uploadFile(Texture &texture, const TextureFile &file);
+    GLsizeiptr allocateStaging(GLsizeiptr size);
+    void retireStaging();
+    void reportIfDone();
+
+    QOpenGLFunctions_4_5_Core *mFunctions;
+    QThreadPool mPool;
+    QElapsedTimer mClock;
+    std::vector<Texture> mTextures;
+    GLuint mPlaceholder;
+
+    QMutex mDecodedMutex;
+    std::vector<Decoded> mDecoded;
+    std::deque<Decoded> mReady;
+
+    GLuint mStagingBuffer;
+    uchar *mStagingData;
+    GLsizeiptr mStagingSize;
+    GLsizeiptr mStagingHead;
+    GLsizeiptr mStagingTail;
+    std::deque<StagingFence> mStagingFences;
+
+    int mPending;
+    qint64 mFirstFrameNs;
+    qint64 mAllResidentNs;
+    qint64 mResidentBytes;
+};
+
+#endif //GLTUT2_TEXTURELOADER_H
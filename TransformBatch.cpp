@@ -0,0 +1,405 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "TransformBatch.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GLTUT2_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace {
+    constexpr std::size_t blockSize = 256;
+    constexpr float degreesToTurns = 1.0f / 360.0f;
+    constexpr float degreesToRadians = 3.14159265358979323846f / 180.0f;
+    constexpr float twoOverPi = 0.636619772367581343076f;
+    constexpr float halfPi1 = 1.5703125f;
+    constexpr float halfPi2 = 4.837512969970703125e-4f;
+    constexpr float halfPi3 = 7.54978995489188216e-8f;
+    constexpr float sin1 = -1.6666654611e-1f;
+    constexpr float sin2 = 8.3321608736e-3f;
+    constexpr float sin3 = -1.9515295891e-4f;
+    constexpr float cos1 = 4.166664568298827e-2f;
+    constexpr float cos2 = -1.388731625493765e-3f;
+    constexpr float cos3 = 2.443315711809948e-5f;
+
+    // Column j of a result matrix is base[j] + u * first[j] + v * second[j] + w * third[j],
+    // where (u, v, w) is (cos, sin, 0) for the rotation columns and (x, y, z) for the translation column.
+    struct Coefficients {
+        float base[4][4];
+        float first[4][4];
+        float second[4][4];
+        float third[4][4];
+    };
+
+    struct Arrays {
+        const float *x;
+        const float *y;
+        const float *z;
+        const float *angles;
+        float *models;
+        float *mvps;
+    };
+
+    typedef void (*Kernel)(const Coefficients &model, const Coefficients &mvp, const Arrays &arrays, std::size_t count);
+
+    void scalarSinCos(const float *degrees, std::size_t count, float *sines, float *cosines) {
+        for (std::size_t i = 0; i < count; ++i) {
+            const float turns = static_cast<float>(static_cast<int>(std::nearbyint(degrees[i] * degreesToTurns)));
+            const float radians = (degrees[i] - turns * 360.0f) * degreesToRadians;
+            const auto quadrant = static_cast<int>(std::nearbyint(radians * twoOverPi));
+            const auto q = static_cast<float>(quadrant);
+            const float y = ((radians - q * halfPi1) - q * halfPi2) - q * halfPi3;
+            const float z = y * y;
+            const float sinY = y + y * z * (sin1 + z * (sin2 + z * sin3));
+            const float cosY = 1.0f - 0.5f * z + z * z * (cos1 + z * (cos2 + z * cos3));
+            const bool swap = (quadrant & 1) != 0;
+            const float sine = swap ? cosY : sinY;
+            const float cosine = swap ? sinY : cosY;
+            sines[i] = (quadrant & 2) != 0 ? -sine : sine;
+            cosines[i] = ((quadrant + 1) & 2) != 0 ? -cosine : cosine;
+        }
+    }
+
+    void scalarAssemble(const Coefficients &k, const float u[4], const float v[4], const float w[4], float *out) {
+        for (int column = 0; column < 4; ++column) {
+            for (int row = 0; row < 4; ++row) {
+                out[column * 4 + row] = k.base[column][row] + u[column] * k.first[column][row]
+                                        + v[column] * k.second[column][row] + w[column] * k.third[column][row];
+            }
+        }
+    }
+
+    void scalarKernel(const Coefficients &model, const Coefficients &mvp, const Arrays &arrays, std::size_t count) {
+        std::array<float, blockSize> sines;
+        std::array<float, blockSize> cosines;
+        for (std::size_t start = 0; start < count; start += blockSize) {
+            const std::size_t blockCount = std::min(blockSize, count - start);
+            scalarSinCos(arrays.angles + start, blockCount, sines.data(), cosines.data());
+            for (std::size_t j = 0; j < blockCount; ++j) {
+                const std::size_t i = start + j;
+                const float u[4] = {cosines[j], cosines[j], cosines[j], arrays.x[i]};
+                const float v[4] = {sines[j], sines[j], sines[j], arrays.y[i]};
+                const float w[4] = {0.0f, 0.0f, 0.0f, arrays.z[i]};
+                if (arrays.models != nullptr) {
+                    scalarAssemble(model, u, v, w, arrays.models + i * 16);
+                }
+                if (arrays.mvps != nullptr) {
+                    scalarAssemble(mvp, u, v, w, arrays.mvps + i * 16);
+                }
+            }
+        }
+    }
+
+#ifdef GLTUT2_X86_KERNELS
+    void sse2SinCos(const float *degrees, std::size_t count, float *sines, float *cosines) {
+        const __m128i one = _mm_set1_epi32(1);
+        const __m128i two = _mm_set1_epi32(2);
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const __m128 angle = _mm_loadu_ps(degrees + i);
+            const __m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(angle, _mm_set1_ps(degreesToTurns))));
+            const __m128 radians = _mm_mul_ps(_mm_sub_ps(angle, _mm_mul_ps(turns, _mm_set1_ps(360.0f))),
+                                              _mm_set1_ps(degreesToRadians));
+            const __m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(radians, _mm_set1_ps(twoOverPi)));
+            const __m128 q = _mm_cvtepi32_ps(quadrant);
+            __m128 y = _mm_sub_ps(radians, _mm_mul_ps(q, _mm_set1_ps(halfPi1)));
+            y = _mm_sub_ps(y, _mm_mul_ps(q, _mm_set1_ps(halfPi2)));
+            y = _mm_sub_ps(y, _mm_mul_ps(q, _mm_set1_ps(halfPi3)));
+            const __m128 z = _mm_mul_ps(y, y);
+            __m128 sinPoly = _mm_add_ps(_mm_set1_ps(sin2), _mm_mul_ps(z, _mm_set1_ps(sin3)));
+            sinPoly = _mm_add_ps(_mm_set1_ps(sin1), _mm_mul_ps(z, sinPoly));
+            const __m128 sinY = _mm_add_ps(y, _mm_mul_ps(_mm_mul_ps(y, z), sinPoly));
+            __m128 cosPoly = _mm_add_ps(_mm_set1_ps(cos2), _mm_mul_ps(z, _mm_set1_ps(cos3)));
+            cosPoly = _mm_add_ps(_mm_set1_ps(cos1), _mm_mul_ps(z, cosPoly));
+            const __m128 cosY = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), z)),
+                                           _mm_mul_ps(_mm_mul_ps(z, z), cosPoly));
+            const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+            const __m128 sine = _mm_or_ps(_mm_and_ps(swap, cosY), _mm_andnot_ps(swap, sinY));
+            const __m128 cosine = _mm_or_ps(_mm_and_ps(swap, sinY), _mm_andnot_ps(swap, cosY));
+            const __m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, two), 30));
+            const __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, one), two), 30));
+            _mm_storeu_ps(sines + i, _mm_xor_ps(sine, sinSign));
+            _mm_storeu_ps(cosines + i, _mm_xor_ps(cosine, cosSign));
+        }
+        scalarSinCos(degrees + i, count - i, sines + i, cosines + i);
+    }
+
+    void sse2Assemble(const Coefficients &k, float c, float s, float x, float y, float z, float *out) {
+        const __m128 cosine = _mm_set1_ps(c);
+        const __m128 sine = _mm_set1_ps(s);
+        for (int column = 0; column < 3; ++column) {
+            const __m128 value = _mm_add_ps(_mm_loadu_ps(k.base[column]),
+                                            _mm_add_ps(_mm_mul_ps(cosine, _mm_loadu_ps(k.first[column])),
+                                                       _mm_mul_ps(sine, _mm_loadu_ps(k.second[column]))));
+            _mm_storeu_ps(out + column * 4, value);
+        }
+        __m128 translation = _mm_add_ps(_mm_loadu_ps(k.base[3]), _mm_mul_ps(_mm_set1_ps(x), _mm_loadu_ps(k.first[3])));
+        translation = _mm_add_ps(translation, _mm_mul_ps(_mm_set1_ps(y), _mm_loadu_ps(k.second[3])));
+        translation = _mm_add_ps(translation, _mm_mul_ps(_mm_set1_ps(z), _mm_loadu_ps(k.third[3])));
+        _mm_storeu_ps(out + 12, translation);
+    }
+
+    void sse2Kernel(const Coefficients &model, const Coefficients &mvp, const Arrays &arrays, std::size_t count) {
+        alignas(16) std::array<float, blockSize> sines;
+        alignas(16) std::array<float, blockSize> cosines;
+        for (std::size_t start = 0; start < count; start += blockSize) {
+            const std::size_t blockCount = std::min(blockSize, count - start);
+            sse2SinCos(arrays.angles + start, blockCount, sines.data(), cosines.data());
+            for (std::size_t j = 0; j < blockCount; ++j) {
+                const std::size_t i = start + j;
+                if (arrays.models != nullptr) {
+                    sse2Assemble(model, cosines[j], sines[j], arrays.x[i], arrays.y[i], arrays.z[i], arrays.models + i * 16);
+                }
+                if (arrays.mvps != nullptr) {
+                    sse2Assemble(mvp, cosines[j], sines[j], arrays.x[i], arrays.y[i], arrays.z[i], arrays.mvps + i * 16);
+                }
+            }
+        }
+    }
+
+    __attribute__((target("avx2,fma")))
+    void avx2SinCos(const float *degrees, std::size_t count, float *sines, float *cosines) {
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256i two = _mm256_set1_epi32(2);
+        std::size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m256 angle = _mm256_loadu_ps(degrees + i);
+            const __m256 turns = _mm256_round_ps(_mm256_mul_ps(angle, _mm256_set1_ps(degreesToTurns)),
+                                                 _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            const __m256 radians = _mm256_mul_ps(_mm256_fnmadd_ps(turns, _mm256_set1_ps(360.0f), angle),
+                                                 _mm256_set1_ps(degreesToRadians));
+            const __m256i quadrant = _mm256_cvtps_epi32(_mm256_mul_ps(radians, _mm256_set1_ps(twoOverPi)));
+            const __m256 q = _mm256_cvtepi32_ps(quadrant);
+            __m256 y = _mm256_fnmadd_ps(q, _mm256_set1_ps(halfPi1), radians);
+            y = _mm256_fnmadd_ps(q, _mm256_set1_ps(halfPi2), y);
+            y = _mm256_fnmadd_ps(q, _mm256_set1_ps(halfPi3), y);
+            const __m256 z = _mm256_mul_ps(y, y);
+            __m256 sinPoly = _mm256_fmadd_ps(z, _mm256_set1_ps(sin3), _mm256_set1_ps(sin2));
+            sinPoly = _mm256_fmadd_ps(z, sinPoly, _mm256_set1_ps(sin1));
+            const __m256 sinY = _mm256_fmadd_ps(_mm256_mul_ps(y, z), sinPoly, y);
+            __m256 cosPoly = _mm256_fmadd_ps(z, _mm256_set1_ps(cos3), _mm256_set1_ps(cos2));
+            cosPoly = _mm256_fmadd_ps(z, cosPoly, _mm256_set1_ps(cos1));
+            const __m256 cosY = _mm256_fmadd_ps(_mm256_mul_ps(z, z), cosPoly,
+                                                _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z, _mm256_set1_ps(1.0f)));
+            const __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, one), one));
+            const __m256 sine = _mm256_blendv_ps(sinY, cosY, swap);
+            const __m256 cosine = _mm256_blendv_ps(cosY, sinY, swap);
+            const __m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, two), 30));
+            const __m256 cosSign = _mm256_castsi256_ps(
+                    _mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, one), two), 30));
+            _mm256_storeu_ps(sines + i, _mm256_xor_ps(sine, sinSign));
+            _mm256_storeu_ps(cosines + i, _mm256_xor_ps(cosine, cosSign));
+        }
+        scalarSinCos(degrees + i, count - i, sines + i, cosines + i);
+    }
+
+    struct Avx2Coefficients {
+        __m256 base[2];
+        __m256 first[2];
+        __m256 second[2];
+        __m256 third;
+    };
+
+    __attribute__((target("avx2,fma")))
+    __m256 pair(const float *low, const float *high) {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(low)), _mm_loadu_ps(high), 1);
+    }
+
+    __attribute__((target("avx2,fma")))
+    Avx2Coefficients avx2Coefficients(const Coefficients &k) {
+        Avx2Coefficients result;
+        for (int half = 0; half < 2; ++half) {
+            result.base[half] = pair(k.base[half * 2], k.base[half * 2 + 1]);
+            result.first[half] = pair(k.first[half * 2], k.first[half * 2 + 1]);
+            result.second[half] = pair(k.second[half * 2], k.second[half * 2 + 1]);
+        }
+        result.third = pair(k.third[2], k.third[3]);
+        return result;
+    }
+
+    __attribute__((target("avx2,fma")))
+    void avx2Assemble(const Avx2Coefficients &k, __m256 cosine, __m256 sine, __m256 cosX, __m256 sinY, __m256 z,
+                      float *out) {
+        __m256 low = _mm256_fmadd_ps(cosine, k.first[0], k.base[0]);
+        low = _mm256_fmadd_ps(sine, k.second[0], low);
+        __m256 high = _mm256_fmadd_ps(cosX, k.first[1], k.base[1]);
+        high = _mm256_fmadd_ps(sinY, k.second[1], high);
+        high = _mm256_fmadd_ps(z, k.third, high);
+        _mm256_storeu_ps(out, low);
+        _mm256_storeu_ps(out + 8, high);
+    }
+
+    __attribute__((target("avx2,fma")))
+    void avx2Kernel(const Coefficients &model, const Coefficients &mvp, const Arrays &arrays, std::size_t count) {
+        alignas(32) std::array<float, blockSize> sines;
+        alignas(32) std::array<float, blockSize> cosines;
+        const Avx2Coefficients &modelK = avx2Coefficients(model);
+        const Avx2Coefficients &mvpK = avx2Coefficients(mvp);
+        for (std::size_t start = 0; start < count; start += blockSize) {
+            const std::size_t blockCount = std::min(blockSize, count - start);
+            avx2SinCos(arrays.angles + start, blockCount, sines.data(), cosines.data());
+            for (std::size_t j = 0; j < blockCount; ++j) {
+                const std::size_t i = start + j;
+                const __m128 c = _mm_set1_ps(cosines[j]);
+                const __m128 s = _mm_set1_ps(sines[j]);
+                const __m256 cosine = _mm256_set1_ps(cosines[j]);
+                const __m256 sine = _mm256_set1_ps(sines[j]);
+                const __m256 cosX = _mm256_insertf128_ps(_mm256_castps128_ps256(c), _mm_set1_ps(arrays.x[i]), 1);
+                const __m256 sinY = _mm256_insertf128_ps(_mm256_castps128_ps256(s), _mm_set1_ps(arrays.y[i]), 1);
+                const __m256 z = _mm256_insertf128_ps(_mm256_setzero_ps(), _mm_set1_ps(arrays.z[i]), 1);
+                if (arrays.models != nullptr) {
+                    avx2Assemble(modelK, cosine, sine, cosX, sinY, z, arrays.models + i * 16);
+                }
+                if (arrays.mvps != nullptr) {
+                    avx2Assemble(mvpK, cosine, sine, cosX, sinY, z, arrays.mvps + i * 16);
+                }
+            }
+        }
+    }
+#endif
+
+    Kernel kernel(TransformBatch::Isa isa) {
+        switch (isa) {
+#ifdef GLTUT2_X86_KERNELS
+            case TransformBatch::Avx2:
+                return avx2Kernel;
+            case TransformBatch::Sse2:
+                return sse2Kernel;
+#endif
+            default:
+                return scalarKernel;
+        }
+    }
+
+    Coefficients modelCoefficients(const QVector3D &axis) {
+        const float x = axis.x();
+        const float y = axis.y();
+        const float z = axis.z();
+        const Coefficients result {
+                {{x * x, x * y, x * z, 0.0f}, {x * y, y * y, y * z, 0.0f}, {x * z, y * z, z * z, 0.0f}, {0.0f, 0.0f, 0.0f, 1.0f}},
+                {{1.0f - x * x, -x * y, -x * z, 0.0f}, {-x * y, 1.0f - y * y, -y * z, 0.0f}, {-x * z, -y * z, 1.0f - z * z, 0.0f}, {1.0f, 0.0f, 0.0f, 0.0f}},
+                {{0.0f, z, -y, 0.0f}, {-z, 0.0f, x, 0.0f}, {y, -x, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}},
+                {{0.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f}}
+        };
+        return result;
+    }
+
+    void transform(const float *matrix, const float (&in)[4][4], float (&out)[4][4]) {
+        for (int column = 0; column < 4; ++column) {
+            for (int row = 0; row < 4; ++row) {
+                out[column][row] = matrix[row] * in[column][0] + matrix[4 + row] * in[column][1]
+                                   + matrix[8 + row] * in[column][2] + matrix[12 + row] * in[column][3];
+            }
+        }
+    }
+
+    Coefficients transformed(const QMatrix4x4 &matrix, const Coefficients &k) {
+        Coefficients result;
+        transform(matrix.constData(), k.base, result.base);
+        transform(matrix.constData(), k.first, result.first);
+        transform(matrix.constData(), k.second, result.second);
+        transform(matrix.constData(), k.third, result.third);
+        return result;
+    }
+}
+
+TransformBatch::TransformBatch() :
+        mX(),
+        mY(),
+        mZ(),
+        mAngles(),
+        mAxis(0.0f, 0.0f, 1.0f),
+        mIsa(bestIsa()) {
+}
+
+void TransformBatch::resize(std::size_t count) {
+    mX.resize(count);
+    mY.resize(count);
+    mZ.resize(count);
+    mAngles.resize(count);
+}
+
+void TransformBatch::setPosition(std::size_t index, const QVector3D &position) {
+    mX[index] = position.x();
+    mY[index] = position.y();
+    mZ[index] = position.z();
+}
+
+TransformBatch::Isa TransformBatch::bestIsa() {
+#ifdef GLTUT2_X86_KERNELS
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return Avx2;
+    }
+    return Sse2;
+#else
+    return Scalar;
+#endif
+}
+
+const char *TransformBatch::isaName(Isa isa) {
+    switch (isa) {
+        case Avx2:
+            return "avx2";
+        case Sse2:
+            return "sse2";
+        default:
+            return "scalar";
+    }
+}
+
+void TransformBatch::compute(const QMatrix4x4 &projView, float *models, float *mvps, std::size_t first,
+                             std::size_t count) const {
+    if (count == 0 || (models == nullptr && mvps == nullptr)) {
+        return;
+    }
+    const Coefficients &model = modelCoefficients(mAxis);
+    const Coefficients &mvp = transformed(projView, model);
+    const Arrays arrays {
+            mX.data() + first,
+            mY.data() + first,
+            mZ.data() + first,
+            mAngles.data() + first,
+            models == nullptr ? nullptr : models + first * 16,
+            mvps == nullptr ? nullptr : mvps + first * 16
+    };
+    kernel(mIsa)(model, mvp, arrays, count);
+}
+
+void TransformBatch::computeIndexed(const QMatrix4x4 &projView, const std::uint32_t *indices, std::size_t count,
+                                    float *models, float *mvps) const {
+    if (count == 0 || (models == nullptr && mvps == nullptr)) {
+        return;
+    }
+    const Coefficients &model = modelCoefficients(mAxis);
+    const Coefficients &mvp = transformed(projView, model);
+    const Kernel compute = kernel(mIsa);
+    alignas(32) std::array<float, blockSize> x;
+    alignas(32) std::array<float, blockSize> y;
+    alignas(32) std::array<float, blockSize> z;
+    alignas(32) std::array<float, blockSize> angles;
+    for (std::size_t start = 0; start < count; start += blockSize) {
+        const std::size_t blockCount = std::min(blockSize, count - start);
+        for (std::size_t j = 0; j < blockCount; ++j) {
+            const std::uint32_t index = indices[start + j];
+            x[j] = mX[index];
+            y[j] = mY[index];
+            z[j] = mZ[index];
+            angles[j] = mAngles[index];
+        }
+        const Arrays arrays {
+                x.data(),
+                y.data(),
+                z.data(),
+                angles.data(),
+                models == nullptr ? nullptr : models + start * 16,
+                mvps == nullptr ? nullptr : mvps + start * 16
+        };
+        compute(model, mvp, arrays, blockCount);
+    }
+}
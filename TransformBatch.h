@@ -0,0 +1,57 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_TRANSFORMBATCH_H
+#define GLTUT2_TRANSFORMBATCH_H
+
+#include <cstdint>
+#include <vector>
+#include <QMatrix4x4>
+#include <QVector3D>
+
+// Structure-of-arrays store for objects transformed as translate(position) * rotate(angle, axis)
+// with one rotation axis shared by the whole batch. compute() writes column-major model and/or
+// projection * view * model matrices, 16 floats per object, using the best kernel for this CPU.
+class TransformBatch {
+public:
+    enum Isa {
+        Scalar,
+        Sse2,
+        Avx2
+    };
+
+    TransformBatch();
+
+    void resize(std::size_t count);
+    std::size_t size() const { return mX.size(); }
+
+    void setPosition(std::size_t index, const QVector3D &position);
+    QVector3D position(std::size_t index) const { return QVector3D(mX[index], mY[index], mZ[index]); }
+    float *angles() { return mAngles.data(); }
+    const float *angles() const { return mAngles.data(); }
+    void setAxis(const QVector3D &axis) { mAxis = axis.normalized(); }
+
+    void setIsa(Isa isa) { mIsa = isa; }
+    Isa isa() const { return mIsa; }
+    static Isa bestIsa();
+    static const char *isaName(Isa isa);
+
+    void compute(const QMatrix4x4 &projView, float *models, float *mvps) const {
+        compute(projView, models, mvps, 0, size());
+    }
+    void compute(const QMatrix4x4 &projView, float *models, float *mvps, std::size_t first, std::size_t count) const;
+    // Writes the matrices of objects indices[0..count) packed one after another.
+    void computeIndexed(const QMatrix4x4 &projView, const std::uint32_t *indices, std::size_t count,
+                        float *models, float *mvps) const;
+
+private:
+    std::vector<float> mX;
+    std::vector<float> mY;
+    std::vector<float> mZ;
+    std::vector<float> mAngles;
+    QVector3D mAxis;
+    Isa mIsa;
+};
+
+#endif //GLTUT2_TRANSFORMBATCH_H
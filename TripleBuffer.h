@@ -0,0 +1,43 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_TRIPLEBUFFER_H
+#define GLTUT2_TRIPLEBUFFER_H
+
+#include <array>
+#include <atomic>
+
+// Single producer, single consumer. The producer fills back() and publishes it,
+// the consumer takes the newest published value without ever blocking the producer.
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : mSlots(), mBack(0), mMiddle(1), mFront(2) {}
+
+    T &back() { return mSlots[mBack]; }
+
+    void publish() {
+        const int previous = mMiddle.exchange(mBack | dirtyBit, std::memory_order_acq_rel);
+        mBack = previous & indexMask;
+    }
+
+    const T &consume() {
+        if (mMiddle.load(std::memory_order_relaxed) & dirtyBit) {
+            const int previous = mMiddle.exchange(mFront, std::memory_order_acq_rel);
+            mFront = previous & indexMask;
+        }
+        return mSlots[mFront];
+    }
+
+private:
+    static constexpr int dirtyBit = 0x4;
+    static constexpr int indexMask = 0x3;
+
+    std::array<T, 3> mSlots;
+    int mBack;
+    std::atomic<int> mMiddle;
+    int mFront;
+};
+
+#endif //GLTUT2_TRIPLEBUFFER_H
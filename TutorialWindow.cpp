@@ -3,30 +3,28 @@
 //
 
 #include "TutorialWindow.h"
+#include <algorithm>
 #include <cmath>
 #include <functional>
+#include <numeric>
+#include <random>
 #include <QOpenGLBuffer>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLVertexArrayObject>
-#include <QOpenGLTexture>
 #include <QWheelEvent>
-#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QCoreApplication>
 #include <QtMath>
 #include <QApplication>
 #include <QDesktopWidget>
 
 namespace {
-    struct VertexAttributes {
-        QVector3D position;
-        QVector2D texCoord;
-    };
-
-    constexpr std::array<VertexAttributes, 4> planeVertices { // NOLINT
-            VertexAttributes { QVector3D(0.5f, 0.5f, 0.0f), QVector2D(1.0f, 1.0f) },
-            VertexAttributes { QVector3D(0.5f, -0.5f, 0.0f), QVector2D(1.0f, 0.0f) },
-            VertexAttributes { QVector3D(-0.5f, -0.5f, 0.0f), QVector2D(0.0f, 0.0f) },
-            VertexAttributes { QVector3D(-0.5f, 0.5f, 0.0f), QVector2D(0.0f, 1.0f) }
+    constexpr std::array<MeshVertex, 4> planeVertices { // NOLINT
+            MeshVertex { QVector3D(0.5f, 0.5f, 0.0f), QVector2D(1.0f, 1.0f), QVector3D(0.0f, 0.0f, 1.0f) },
+            MeshVertex { QVector3D(0.5f, -0.5f, 0.0f), QVector2D(1.0f, 0.0f), QVector3D(0.0f, 0.0f, 1.0f) },
+            MeshVertex { QVector3D(-0.5f, -0.5f, 0.0f), QVector2D(0.0f, 0.0f), QVector3D(0.0f, 0.0f, 1.0f) },
+            MeshVertex { QVector3D(-0.5f, 0.5f, 0.0f), QVector2D(0.0f, 1.0f), QVector3D(0.0f, 0.0f, 1.0f) }
     };
     constexpr std::array<unsigned int, 6> planeIndices {
             3, 2, 1,
@@ -52,7 +50,7 @@ namespace {
 
     private:
         static const size_t mPlanesCount = 6;
-        std::array<VertexAttributes, mPlanesCount * planeVertices.size()> mVertices;
+        std::array<MeshVertex, mPlanesCount * planeVertices.size()> mVertices;
         std::array<unsigned int, mPlanesCount * planeIndices.size()> mIndices;
     };
 
@@ -64,6 +62,7 @@ namespace {
             for (const auto &planeVertex : planeVertices) {
                 verticesIt->position = transform * planeVertex.position;
                 verticesIt->texCoord = planeVertex.texCoord;
+                verticesIt->normal = transform.mapVector(planeVertex.normal);
                 ++verticesIt;
             }
         };
@@ -111,37 +110,208 @@ namespace {
             QVector3D( 1.5f,  0.2f, -1.5f),
             QVector3D(-1.3f,  1.0f, -1.5f)
     };
+
+    constexpr GLuint meshBinding = 0;
+    constexpr int instanceModelLocation = 2;
+    constexpr GLuint objectIndexLocation = 6;
+    constexpr int matrixSize = 16;
+    constexpr int instanceStride = matrixSize * sizeof(GLfloat);
+    constexpr GLsizeiptr streamSlack = 64 * 1024;
+    // The objects' arena holds the meshes it starts with and a quarter more, for meshes added later.
+    constexpr GLsizeiptr arenaHeadroom = 4;
+    constexpr float lodMinDistance = 0.1f;
+    // A coarser level is only taken once its error is this fraction of the threshold.
+    constexpr float lodHysteresis = 0.75f;
+    constexpr std::size_t defaultInstanceCount = cubePositions.size();
+    constexpr std::size_t objectsPerJob = 1024;
+    // Half the diagonal of the unit cube bounds it under any rotation.
+    constexpr float cubeRadius = 0.8660254f;
+    // Matches the binding of materialTextures in the fragment shader.
+    constexpr GLuint materialTextureUnit = 0;
+    // A mixBalance location not yet looked up in its variant.
+    constexpr GLint unknownLocation = -2;
+    constexpr float farPlane = 100.0f;
+    // How far digVoxel() reaches, in blocks.
+    constexpr float digDistance = 64.0f;
+    constexpr float cameraSpeed = 2.5f;
+    // A frame runs at most this many ticks; a longer stall is dropped rather than caught up on.
+    constexpr int maxTicksPerFrame = 8;
+
+    // Layers in the order initialize() adds them. The first material is the original look,
+    // the rest vary the same two layers so a large scene mixes many materials in one draw.
+    constexpr GLuint containerLayer = 0;
+    constexpr GLuint awesomeLayer = 1;
+    const std::array<MaterialLibrary::Material, 8> materials {{ // NOLINT
+            {containerLayer, awesomeLayer, 0.5f, 0.0f, {1.0f, 1.0f, 1.0f, 1.0f}},
+            {containerLayer, awesomeLayer, 0.0f, 0.0f, {1.0f, 1.0f, 1.0f, 1.0f}},
+            {awesomeLayer, containerLayer, 0.3f, 0.0f, {1.0f, 1.0f, 1.0f, 1.0f}},
+            {containerLayer, awesomeLayer, 0.3f, 0.0f, {1.0f, 0.55f, 0.5f, 1.0f}},
+            {containerLayer, awesomeLayer, 0.7f, 0.0f, {0.55f, 0.7f, 1.0f, 1.0f}},
+            {awesomeLayer, awesomeLayer, 0.0f, 0.0f, {0.6f, 1.0f, 0.6f, 1.0f}},
+            {containerLayer, containerLayer, 0.0f, 0.0f, {1.0f, 0.85f, 0.4f, 1.0f}},
+            {awesomeLayer, containerLayer, 0.6f, 0.0f, {0.8f, 0.6f, 1.0f, 1.0f}}
+    }};
+
+    struct MaterialSources {
+        std::vector<QString> files;
+        QSize layerSize;
+        GLenum internalFormat;
+    };
+
+    // Prefers the textures converted by gltut2-texconv next to the executable and falls back to the
+    // images compiled into the resources unless every layer has one in the same format and size.
+    MaterialSources materialSources(const QOpenGLContext *context, bool allowConverted) {
+        const MaterialSources fallback{
+                {QStringLiteral(":/textures/container.jpg"), QStringLiteral(":/textures/awesomeface.png")},
+                QSize(512, 512), GL_RGBA8};
+        if (!allowConverted) {
+            return fallback;
+        }
+        const QString &directory = QCoreApplication::applicationDirPath() + QStringLiteral("/textures/");
+        MaterialSources converted{{directory + QStringLiteral("container.ktx2"),
+                                   directory + QStringLiteral("awesomeface.ktx2")}, QSize(), GL_NONE};
+        for (const auto &fileName : converted.files) {
+            TextureFile file;
+            if (!QFile::exists(fileName) || !file.open(fileName)) {
+                return fallback;
+            }
+            if (converted.internalFormat == GL_NONE) {
+                converted.layerSize = file.size();
+                converted.internalFormat = file.internalFormat();
+            } else if (file.size() != converted.layerSize || file.internalFormat() != converted.internalFormat) {
+                qWarning() << "Converted textures differ in format or size, using the built-in images";
+                return fallback;
+            }
+        }
+        if (converted.internalFormat != GL_RGBA8 && !context->hasExtension(QByteArrayLiteral("GL_EXT_texture_compression_s3tc"))) {
+            return fallback;
+        }
+        return converted;
+    }
+
+    // Material of each voxel block type: grass, dirt and stone.
+    constexpr std::array<GLuint, VoxelWorld::blockTypes> voxelMaterials {{5, 6, 1}};
+
+    GLuint objectMaterial(std::size_t object) {
+        return object < cubePositions.size() ? 0 : static_cast<GLuint>(object % materials.size());
+    }
+
+    void placeObjects(TransformBatch &objects, std::size_t count) {
+        objects.resize(count);
+        const std::size_t fixedCount = std::min(count, cubePositions.size());
+        for (std::size_t i = 0; i < fixedCount; ++i) {
+            objects.setPosition(i, cubePositions[i]);
+        }
+        std::mt19937 generator(0x67746c32u);
+        std::uniform_real_distribution<float> spread(-50.0f, 50.0f);
+        std::uniform_real_distribution<float> depth(-100.0f, 0.0f);
+        for (std::size_t i = fixedCount; i < count; ++i) {
+            const float x = spread(generator);
+            const float y = spread(generator);
+            const float z = depth(generator);
+            objects.setPosition(i, QVector3D(x, y, z));
+        }
+    }
+
+    void updateAngles(TransformBatch &objects, float currentTime, const std::uint32_t *indices, std::size_t count) {
+        float *angles = objects.angles();
+        for (std::size_t i = 0; i < count; ++i) {
+            const std::uint32_t index = indices[i];
+            angles[index] = 20.0f * index + currentTime * 50.0f;
+        }
+    }
 }
 
 TutorialWindow::TutorialWindow(bool enableLogger, QWindow *parent) :
         OpenGLWindow(enableLogger, parent),
+        mState(nullptr),
+        mRenderQueue(nullptr),
+        mProgramCache(nullptr),
+        mShaderVariants(nullptr),
         mProgram(nullptr),
-        mVbo(nullptr),
-        mLeftTriangleEbo(nullptr),
+        mVariantMixBalance(-1.0f),
+        mMaterialFeatures(),
+        mSceneFeatures(0),
+        mMaterialPrograms(),
+        mSceneProgram(0),
+        mMixBalanceLocations(),
+        mVariantUniforms{-1.0f, false, false, 1.0f},
+        mVariantUniformsSet(),
+        mPositionScale(1.0f),
+        mMeshArena(nullptr),
+        mLodMeshes(),
+        mLodErrors(),
         mLeftTriangleVao(nullptr),
+        mInstanceVbo(nullptr),
+        mStream(nullptr),
+        mGpuVao(nullptr),
+        mGpuCuller(nullptr),
         mPrevSize(),
-        mContainerTexture(nullptr),
-        mAwesomeTexture(nullptr),
-        mMixBalance(0.5f),
-        mMixBalanceLocation(-1),
-        mStartTime(QDateTime::currentMSecsSinceEpoch()),
+        mFramebufferSize(),
+        mPrevDevicePixelRatio(1.0),
+        mTextureLoader(nullptr),
+        mMaterials(nullptr),
+        mConvertedTextures(true),
+        mVertexLayout(),
+        mMesh(nullptr),
+        mObjectRadius(cubeRadius),
+        mMeshLoadNs(0),
+        mMaterialLocation(-1),
         mTransformLocation(-1),
         mScreenRatio(1.0f),
         mViewMat(),
         mProjMat(),
         mProjViewMat(),
-        mCameraPos(),
+        mCameraPos(0.0f, 0.0f, 3.0f),
         mCameraFront(),
-        mCameraUp(),
-        mDirections(),
-        mDeltaTime(0.0f),
-        mLastFrame(0.0f),
+        mCameraUp(0.0f, 1.0f, 0.0f),
+        mCameraGeneration(0),
+        mTickRate(60),
+        mSimulationStarted(false),
+        mSimulationOrigin(0.0),
+        mTick(0),
+        mTickCameraPos(mCameraPos),
+        mPreviousTickCameraPos(mCameraPos),
+        mTickInput{0, QVector3D()},
+        mSimulationStatistics{0, 0, 0, 0},
+        mRecorder(),
+        mPendingDigs(),
+        mReplayFinished(false),
         mMouseGrabbed(false),
         mWindowCenter(QApplication::desktop()->geometry().center()),
         mPitch(0.0f),
-        mYaw(-90.0f) {
+        mYaw(-90.0f),
+        mInstanced(false),
+        mInstancedLocation(-1),
+        mObjects(),
+        mObjectMaterials(),
+        mMatrixData(),
+        mWorkerCount(0),
+        mJobs(nullptr),
+        mBvh(),
+        mVisible(),
+        mSortedVisible(),
+        mObjectLevels(),
+        mLevelOffsets(),
+        mLodThreshold(1.0f),
+        mLodStatistics{0, 0, 0, 0},
+        mCulling(true),
+        mGpuDriven(false),
+        mOcclusionCulling(true),
+        mGpuDrivenLocation(-1),
+        mPositionScaleLocation(-1),
+        mVoxelRadius(0),
+        mVoxelWorld(nullptr),
+        mVoxelVao(nullptr),
+        mVoxelDraws(),
+        mDigGeneration(0),
+        mAntialiasing(SceneTarget::Msaa4),
+        mRenderScale(1.0f),
+        mTargetFrameMs(0.0f),
+        mSceneTarget(nullptr),
+        mInput(),
+        mInputBuffer() {
     QSurfaceFormat surfaceFormat(QSurfaceFormat::DebugContext);
-    surfaceFormat.setSamples(16);
     surfaceFormat.setMajorVersion(4);
     surfaceFormat.setMinorVersion(5);
     surfaceFormat.setProfile(QSurfaceFormat::CoreProfile);
@@ -154,10 +324,95 @@ TutorialWindow::TutorialWindow(bool enableLogger, QWindow *parent) :
     surfaceFormat.setGreenBufferSize(8);
     surfaceFormat.setBlueBufferSize(8);
     setFormat(surfaceFormat);
+    mInput.cameraPos = mCameraPos;
+    updateCameraFront();
+    mObjects.setAxis(QVector3D(1.0f, 0.3f, 0.5f));
+    setObjectCount(defaultInstanceCount);
+}
+
+void TutorialWindow::setInstanceCount(int instanceCount) {
+    setObjectCount(static_cast<std::size_t>(std::max(instanceCount, 0)));
+}
+
+void TutorialWindow::setObjectCount(std::size_t count) {
+    placeObjects(mObjects, count);
+    const QVector3D extent(mObjectRadius, mObjectRadius, mObjectRadius);
+    mBvh.resize(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        const QVector3D &position = mObjects.position(i);
+        mBvh.setBounds(i, position - extent, position + extent);
+    }
+    mBvh.build();
+    mObjectMaterials.resize(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        mObjectMaterials[i] = objectMaterial(i);
+    }
+    mObjectLevels.assign(count, 0);
+}
+
+bool TutorialWindow::setMesh(const QString &fileName) {
+    QElapsedTimer timer;
+    timer.start();
+    if (mMesh == nullptr) {
+        mMesh = new MeshFile();
+    }
+    if (!mMesh->open(fileName)) {
+        return false;
+    }
+    // The bounding sphere is centered on the mesh origin, so it must reach the farthest corner.
+    const QVector3D &low = mMesh->boundsMin();
+    const QVector3D &high = mMesh->boundsMax();
+    mObjectRadius = QVector3D(std::max(std::abs(low.x()), std::abs(high.x())),
+                              std::max(std::abs(low.y()), std::abs(high.y())),
+                              std::max(std::abs(low.z()), std::abs(high.z()))).length();
+    mMeshLoadNs = timer.nsecsElapsed();
+    setObjectCount(mObjects.size());
+    return true;
+}
+
+void TutorialWindow::setFixedTime(float seconds) {
+    mInput.useFixedTime = true;
+    mInput.fixedTime = seconds;
+    publishInput();
+}
+
+void TutorialWindow::setCamera(const QVector3D &position, float yaw, float pitch) {
+    mInput.cameraPos = position;
+    ++mInput.cameraGeneration;
+    mYaw = yaw;
+    mPitch = clamp(-89.0f, pitch, 89.0f);
+    updateCameraFront();
+}
+
+void TutorialWindow::recordInput(const QString &fileName) {
+    mRecorder.startRecording(fileName, mTickRate);
+}
+
+bool TutorialWindow::replayInput(const QString &fileName) {
+    if (!mRecorder.startReplay(fileName)) {
+        return false;
+    }
+    mTickRate = mRecorder.tickRate();
+    // Frames before the first tick already look the recorded way.
+    mTickInput = mRecorder.replay(0);
+    mInput.cameraPos = mRecorder.startPosition();
+    ++mInput.cameraGeneration;
+    publishInput();
+    return true;
+}
+
+void TutorialWindow::digVoxel() {
+    ++mInput.digGeneration;
+    publishInput();
 }
 
 void TutorialWindow::initialize() {
     initializeOpenGLFunctions();
+    if (mVoxelRadius > 0) {
+        // Chunks draw one by one with the material uniform.
+        mInstanced = false;
+        mGpuDriven = false;
+    }
     qDebug() << format();
     qDebug() << requestedFormat();
 
@@ -170,134 +425,518 @@ void TutorialWindow::initialize() {
 
     glEnable(GL_DEPTH_TEST);
 
-    updateSize(size());
-
-    mVbo = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
-    mVbo->create();
-    mLeftTriangleEbo = new QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
-    mLeftTriangleEbo->create();
-    mLeftTriangleVao = new QOpenGLVertexArrayObject(this);
+    mLeftTriangleVao = new QOpenGLVertexArrayObject(context());
     mLeftTriangleVao->create();
+    mInstanceVbo = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+    mInstanceVbo->create();
+    mGpuVao = new QOpenGLVertexArrayObject(context());
+    mGpuVao->create();
+
+    mJobs = new JobSystem(mWorkerCount);
+    mState = new GLStateCache(this);
+    mRenderQueue = new RenderQueue(this);
+    mProgramCache = new ProgramCache(this);
+    mShaderVariants = new ShaderVariants(this);
+    mShaderVariants->create(mProgramCache, context(), {
+            {QOpenGLShader::Vertex, QStringLiteral(":/shaders/vertex.glsl")},
+            {QOpenGLShader::Fragment, QStringLiteral(":/shaders/fragment.glsl")}
+    });
+    mProgram = mShaderVariants->generic();
+    mGpuCuller = new GpuCuller(this);
+    if (mGpuDriven && !mGpuCuller->initialize(mProgramCache, context())) {
+        mGpuDriven = false;
+    }
+    mGpuCuller->setOcclusionCulling(mOcclusionCulling);
+    mSceneTarget = new SceneTarget(this, mAntialiasing);
+    if (!mSceneTarget->create(mProgramCache, context())) {
+        mSceneTarget->destroy();
+        delete mSceneTarget;
+        mSceneTarget = new SceneTarget(this, SceneTarget::NoAntialiasing);
+        mSceneTarget->create(mProgramCache, context());
+    }
+    mSceneTarget->setScale(mRenderScale);
+    mSceneTarget->setTargetFrameMs(mTargetFrameMs);
+    mProgramCache->logStatistics();
+
+    mLodMeshes.clear();
+    mLodErrors.clear();
+    if (mVoxelRadius > 0) {
+        // The voxel scene draws only its own chunks, so the objects' arena is never created.
+        mVoxelWorld = new VoxelWorld(this, mVoxelRadius);
+        mVoxelWorld->create();
+        mVoxelVao = new QOpenGLVertexArrayObject(context());
+        mVoxelVao->create();
+        mVoxelWorld->layout().apply(this, mVoxelVao->objectId(), meshBinding);
+        mVoxelWorld->attach(mVoxelVao->objectId(), meshBinding);
+        mPositionScale = 1.0f;
+    } else {
+        const bool meshLoaded = mMesh != nullptr && mMesh->isOpen();
+        VertexLayout::PackedMesh packedCube{};
+        GLsizeiptr arenaVertexBytes = 0;
+        GLsizeiptr arenaIndexBytes = 0;
+        if (meshLoaded) {
+            mVertexLayout = VertexLayout(mMesh->layout());
+            for (int level = 0; level < mMesh->levelCount(); ++level) {
+                arenaVertexBytes += mMesh->level(level).vertexSize;
+                arenaIndexBytes += mMesh->level(level).indexSize + sizeof(GLuint);
+            }
+        } else {
+            packedCube = mVertexLayout.pack(cube.vertices().data(), cube.vertices().size(), cube.indices().data(),
+                                            cube.indices().size());
+            arenaVertexBytes = static_cast<GLsizeiptr>(packedCube.vertices.size());
+            arenaIndexBytes = static_cast<GLsizeiptr>(packedCube.indices.size()) + sizeof(GLuint);
+        }
+        mMeshArena = new MeshArena(this, mVertexLayout.stride(), arenaVertexBytes + arenaVertexBytes / arenaHeadroom,
+                                   arenaIndexBytes + arenaIndexBytes / arenaHeadroom);
+        mMeshArena->create();
+        if (meshLoaded) {
+            QElapsedTimer timer;
+            timer.start();
+            for (int level = 0; level < mMesh->levelCount(); ++level) {
+                const MeshFile::Level &data = mMesh->level(level);
+                mLodMeshes.push_back(mMeshArena->add(data.vertexData, data.vertexCount, data.indexData, data.indexCount,
+                                                     data.indexType));
+                mLodErrors.push_back(data.error);
+            }
+            mPositionScale = mMesh->positionScale();
+            mMeshLoadNs += timer.nsecsElapsed();
+            qDebug() << "Mesh:" << mMesh->level(0).indexCount / 3 << "triangles in" << mMesh->levelCount()
+                     << "levels of detail loaded in" << mMeshLoadNs / 1000000.0 << "ms";
+        } else {
+            mLodMeshes.push_back(mMeshArena->add(packedCube.vertices.data(),
+                                                 static_cast<GLsizei>(cube.vertices().size()),
+                                                 packedCube.indices.data(), packedCube.indexCount,
+                                                 packedCube.indexType));
+            mLodErrors.push_back(0.0f);
+            mPositionScale = packedCube.positionScale;
+        }
+        mMeshArena->logStatistics();
+    }
 
-    mProgram = new QOpenGLShaderProgram(this);
-    mProgram->addShaderFromSourceFile(QOpenGLShader::Vertex, QStringLiteral(":/shaders/vertex.glsl"));
-    mProgram->addShaderFromSourceFile(QOpenGLShader::Fragment, QStringLiteral(":/shaders/fragment.glsl"));
-    mProgram->link();
-    mProgram->bind();
-
-    mVbo->bind();
-    mVbo->setUsagePattern(QOpenGLBuffer::StaticDraw);
-    mVbo->allocate(cube.vertices().data(), sizeof(cube.vertices()));
-
-    mLeftTriangleEbo->bind();
-    mLeftTriangleEbo->setUsagePattern(QOpenGLBuffer::StaticDraw);
-    mLeftTriangleEbo->allocate(cube.indices().data(), sizeof(cube.indices()));
-
-    mContainerTexture = new QOpenGLTexture(QImage(QStringLiteral(":/textures/container.jpg")).mirrored());
-    mContainerTexture->setWrapMode(QOpenGLTexture::Repeat);
-    mContainerTexture->setMagnificationFilter(QOpenGLTexture::Linear);
-    mContainerTexture->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
-    mProgram->setUniformValue("texture1", 0);
-
-    mAwesomeTexture = new QOpenGLTexture(QImage(QStringLiteral(":/textures/awesomeface.png")).mirrored());
-    mAwesomeTexture->setWrapMode(QOpenGLTexture::Repeat);
-    mAwesomeTexture->setMagnificationFilter(QOpenGLTexture::Linear);
-    mAwesomeTexture->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
-    mProgram->setUniformValue("texture2", 1);
-
-    mMixBalanceLocation = mProgram->uniformLocation("mixBalance");
+    mTextureLoader = new TextureLoader(this);
+    const MaterialSources &sources = materialSources(context(), mConvertedTextures);
+    mMaterials = new MaterialLibrary(this, sources.layerSize, sources.internalFormat);
+    mMaterials->create();
+    for (const auto &fileName : sources.files) {
+        mMaterials->addLayer(*mTextureLoader, fileName);
+    }
+    mMaterials->setMaterials(std::vector<MaterialLibrary::Material>(materials.cbegin(), materials.cend()));
+
+    mMaterialLocation = mProgram->uniformLocation("material");
     mTransformLocation = mProgram->uniformLocation("transform");
+    mInstancedLocation = mProgram->uniformLocation("instanced");
+    mGpuDrivenLocation = mProgram->uniformLocation("gpuDriven");
+    mPositionScaleLocation = mProgram->uniformLocation("positionScale");
 
-    mCameraPos = QVector3D(0.0f, 0.0f, 3.0f);
-    mCameraUp = QVector3D(0.0f, 1.0f, 0.0f);
-    updateCameraFront();
+    // A single identity instance keeps the model attribute valid for non-instanced draws.
+    mInstanceVbo->bind();
+    mInstanceVbo->setUsagePattern(QOpenGLBuffer::StaticDraw);
+    mInstanceVbo->allocate(QMatrix4x4().constData(), instanceStride);
+    mStream = new StreamBuffer(this);
+    mStream->create();
 
+    // The per-instance object index of mGpuVao is attached by GpuCuller::draw().
+    for (const GLuint vertexArray : {mLeftTriangleVao->objectId(), mGpuVao->objectId()}) {
+        mVertexLayout.apply(this, vertexArray, meshBinding);
+        if (mMeshArena != nullptr) {
+            mMeshArena->attach(vertexArray, meshBinding);
+        }
+    }
     {
-        const QOpenGLVertexArrayObject::Binder vao_binder(mLeftTriangleVao);
+        // All four model columns read from one per-instance binding, pointed at the stream buffer every frame.
+        const GLuint vertexArray = mLeftTriangleVao->objectId();
+        for (GLuint column = 0; column < 4; ++column) {
+            const GLuint location = instanceModelLocation + column;
+            glVertexArrayAttribFormat(vertexArray, location, 4, GL_FLOAT, GL_FALSE, column * 4 * sizeof(GLfloat));
+            glVertexArrayAttribBinding(vertexArray, location, instanceModelLocation);
+            glEnableVertexArrayAttrib(vertexArray, location);
+        }
+        glVertexArrayBindingDivisor(vertexArray, instanceModelLocation, 1);
+        glVertexArrayVertexBuffer(vertexArray, instanceModelLocation, mInstanceVbo->bufferId(), 0, instanceStride);
 
-        mVbo->bind();
-        mLeftTriangleEbo->bind();
-        mProgram->setAttributeBuffer(0, GL_FLOAT, static_cast<int>(offsetof(VertexAttributes, position)), 3, sizeof(VertexAttributes));
-        mProgram->enableAttributeArray(0);
-        mProgram->setAttributeBuffer(1, GL_FLOAT, static_cast<int>(offsetof(VertexAttributes, texCoord)), 2, sizeof(VertexAttributes));
-        mProgram->enableAttributeArray(1);
+        // Instanced draws look materials up by object index, also streamed per frame.
+        glVertexArrayAttribIFormat(vertexArray, objectIndexLocation, 1, GL_UNSIGNED_INT, 0);
+        glVertexArrayAttribBinding(vertexArray, objectIndexLocation, objectIndexLocation);
+        glEnableVertexArrayAttrib(vertexArray, objectIndexLocation);
+        glVertexArrayBindingDivisor(vertexArray, objectIndexLocation, 1);
+        glVertexArrayVertexBuffer(vertexArray, objectIndexLocation, mInstanceVbo->bufferId(), 0, sizeof(GLuint));
     }
+    mState->invalidate();
 }
 
 void TutorialWindow::render() {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    const QSize &newSize = size();
-    if (Q_UNLIKELY(newSize != mPrevSize)) {
-        updateSize(newSize);
-    }
-
-    mProgram->bind();
-    mContainerTexture->bind(0);
-    mAwesomeTexture->bind(1);
-    mProgram->setUniformValue(mMixBalanceLocation, mMixBalance);
-
-    const float currentTime = static_cast<float>(QDateTime::currentMSecsSinceEpoch() - mStartTime) / 1000.0f;
-    mDeltaTime = currentTime - mLastFrame;
-    mLastFrame = currentTime;
-
-    updateViewMat();
-
-    int i = 0;
-    for(const auto &cubePosition : cubePositions) {
-        QMatrix4x4 model;
-        model.translate(cubePosition);
-        const float angle = 20.0f * i + currentTime * 50.0f;
-        model.rotate(angle, 1.0f, 0.3f, 0.5f);
-        mProgram->setUniformValue(mTransformLocation, mProjViewMat * model);
-        {
-            const QOpenGLVertexArrayObject::Binder vao_binder(mLeftTriangleVao);
-            glDrawElements(GL_TRIANGLES, cube.indices().size(), GL_UNSIGNED_INT, nullptr);
+    FrameProfiler &frameProfiler = profiler();
+    const SceneInput &input = mInputBuffer.consume();
+    if (Q_UNLIKELY(input.size != mPrevSize || input.devicePixelRatio != mPrevDevicePixelRatio)) {
+        updateSize(input.size, input.devicePixelRatio);
+    }
+    {
+        const FrameProfiler::Scope scope(frameProfiler, "scene.clear");
+        mSceneTarget->begin();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    float currentTime;
+    {
+        const FrameProfiler::Scope scope(frameProfiler, "scene.setup");
+        mState->beginFrame();
+        mStream->beginFrame(frameProfiler,
+                            static_cast<GLsizeiptr>(mObjects.size()) * (instanceStride + sizeof(GLuint)) + streamSlack);
+        mTextureLoader->update();
+        if (Q_UNLIKELY(mMaterials->objectCount() != mObjectMaterials.size())) {
+            mMaterials->setObjectMaterials(mObjectMaterials.data(), mObjectMaterials.size());
         }
-        ++i;
+        mMaterials->bind(*mState, materialTextureUnit);
+
+        if (Q_UNLIKELY(input.cameraGeneration != mCameraGeneration)) {
+            mCameraGeneration = input.cameraGeneration;
+            mTickCameraPos = input.cameraPos;
+            mPreviousTickCameraPos = input.cameraPos;
+        }
+        const double clock = input.useFixedTime ? input.fixedTime : scheduler().frameTime();
+        const float alpha = advanceSimulation(input, clock);
+        // Draw the state between the last two ticks, so the picture trails the clock by one tick.
+        currentTime = static_cast<float>(std::max(static_cast<double>(mTick - 1) + alpha, 0.0) / mTickRate);
+        mCameraPos = mPreviousTickCameraPos + alpha * (mTickCameraPos - mPreviousTickCameraPos);
+        // Looking around follows the mouse every frame, unless the recording steers.
+        mCameraFront = mRecorder.mode() == InputRecorder::Replaying ? mTickInput.cameraFront : input.cameraFront;
+        updateViewMat();
+        updateVariants(input.mixBalance);
+    }
+
+    if (mVoxelWorld != nullptr) {
+        renderVoxels();
+    } else if (mGpuDriven) {
+        renderGpuDriven(currentTime);
+    } else {
+        cullObjects();
+        selectLevels();
+        if (mInstanced) {
+            renderInstanced(currentTime);
+        } else {
+            renderPerObject(currentTime);
+        }
+    }
+    {
+        const FrameProfiler::Scope scope(frameProfiler, "scene.post");
+        mSceneTarget->end(*mState);
     }
+    mStream->endFrame();
+    mTextureLoader->frameRendered();
+}
+
+RenderQueue::DrawPacket TutorialWindow::meshPacket(GLuint program, std::size_t level, GLuint baseInstance,
+                                                   GLsizei instanceCount) const {
+    const MeshArena::Mesh &mesh = mMeshArena->mesh(mLodMeshes[level]);
+    return RenderQueue::DrawPacket {
+            program,
+            mLeftTriangleVao->objectId(),
+            mMaterials->texture(),
+            mTransformLocation,
+            mMaterialLocation,
+            -1,
+            mesh.indexType,
+            mesh.indexCount,
+            mesh.indexOffset,
+            mesh.baseVertex,
+            instanceCount,
+            baseInstance
+    };
+}
+
+void TutorialWindow::submitQueue() {
+    FrameProfiler &frameProfiler = profiler();
+    {
+        const FrameProfiler::Scope scope(frameProfiler, "queue.sort");
+        mRenderQueue->sort();
+    }
+    const FrameProfiler::Scope scope(frameProfiler, "scene.draw");
+    mRenderQueue->submit(*mState);
+}
+
+void TutorialWindow::renderInstanced(float currentTime) {
+    FrameProfiler &frameProfiler = profiler();
+    const std::size_t instanceCount = mVisible.size();
+    const StreamBuffer::Range &instances = mStream->allocate(static_cast<GLsizeiptr>(instanceCount) * instanceStride);
+    const StreamBuffer::Range &objects = mStream->allocate(static_cast<GLsizeiptr>(instanceCount) * sizeof(GLuint));
+    if (Q_UNLIKELY(instances.data == nullptr || objects.data == nullptr)) {
+        return;
+    }
+    std::copy(mVisible.cbegin(), mVisible.cend(), static_cast<GLuint *>(objects.data));
+    {
+        const FrameProfiler::Scope scope(frameProfiler, "scene.update");
+        updateObjects(currentTime, static_cast<GLfloat *>(instances.data), nullptr);
+    }
+    glVertexArrayVertexBuffer(mLeftTriangleVao->objectId(), instanceModelLocation, instances.buffer, instances.offset,
+                              instanceStride);
+    glVertexArrayVertexBuffer(mLeftTriangleVao->objectId(), objectIndexLocation, objects.buffer, objects.offset,
+                              sizeof(GLuint));
+
+    // selectLevels() grouped the visible objects by level, so each level is one instanced draw.
+    mRenderQueue->clear();
+    for (std::size_t level = 0; level < mLodMeshes.size(); ++level) {
+        const std::uint32_t first = mLevelOffsets[level];
+        const std::uint32_t count = mLevelOffsets[level + 1] - first;
+        if (count > 0) {
+            mRenderQueue->push(RenderQueue::makeKey(RenderQueue::Opaque, mSceneProgram, 0, 0.0f),
+                               meshPacket(mSceneProgram, level, first, static_cast<GLsizei>(count)),
+                               mProjViewMat.constData());
+        }
+    }
+    submitQueue();
+}
+
+void TutorialWindow::renderPerObject(float currentTime) {
+    glVertexArrayVertexBuffer(mLeftTriangleVao->objectId(), instanceModelLocation, mInstanceVbo->bufferId(), 0,
+                              instanceStride);
+    // The object index is unused here, the material uniform wins, but the attribute still needs a buffer.
+    glVertexArrayVertexBuffer(mLeftTriangleVao->objectId(), objectIndexLocation, mInstanceVbo->bufferId(), 0,
+                              sizeof(GLuint));
+    {
+        const FrameProfiler::Scope scope(profiler(), "scene.update");
+        mRenderQueue->clear();
+        mMatrixData.resize(mVisible.size() * matrixSize);
+        updateObjects(currentTime, nullptr, mMatrixData.data());
+        for (std::size_t i = 0; i < mVisible.size(); ++i) {
+            const std::uint32_t object = mVisible[i];
+            const float depth = -mViewMat.map(mObjects.position(object)).z();
+            const GLuint material = mObjectMaterials[object];
+            RenderQueue::DrawPacket packet = meshPacket(mMaterialPrograms[material], mObjectLevels[object], 0, 0);
+            packet.material = static_cast<GLint>(material);
+            mRenderQueue->push(RenderQueue::makeKey(RenderQueue::Opaque, packet.program, material, depth),
+                               packet, mMatrixData.data() + i * matrixSize);
+        }
+    }
+    submitQueue();
+}
+
+void TutorialWindow::renderGpuDriven(float currentTime) {
+    FrameProfiler &frameProfiler = profiler();
+    if (Q_UNLIKELY(mGpuCuller->objectCount() != mObjects.size())) {
+        std::vector<GLfloat> spheres;
+        spheres.reserve(mObjects.size() * 4);
+        for (std::size_t i = 0; i < mObjects.size(); ++i) {
+            const QVector3D &position = mObjects.position(i);
+            spheres.insert(spheres.end(), {position.x(), position.y(), position.z(), mObjectRadius});
+        }
+        mGpuCuller->setObjects(spheres.data(), mObjects.size());
+    }
+    const StreamBuffer::Range &models = mStream->allocateStorage(static_cast<GLsizeiptr>(mObjects.size()) * instanceStride);
+    if (Q_UNLIKELY(models.data == nullptr)) {
+        return;
+    }
+    {
+        const FrameProfiler::Scope scope(frameProfiler, "scene.update");
+        selectAllObjects();
+        updateObjects(currentTime, static_cast<GLfloat *>(models.data), nullptr);
+    }
+    {
+        const FrameProfiler::Scope scope(frameProfiler, "gpu.cull");
+        mGpuCuller->cull(*mState, mProjViewMat, mMeshArena->mesh(mLodMeshes.front()));
+    }
+    {
+        const FrameProfiler::Scope scope(frameProfiler, "scene.draw");
+        mState->useProgram(mSceneProgram);
+        mState->uniformMatrix4(mTransformLocation, mProjViewMat.constData());
+        mGpuCuller->draw(*mState, mGpuVao->objectId(), objectIndexLocation,
+                         mMeshArena->mesh(mLodMeshes.front()).indexType, models);
+    }
+    const FrameProfiler::Scope scope(frameProfiler, "gpu.hiz");
+    mGpuCuller->updateHiZ(*mState, mSceneTarget->renderSize(), mProjViewMat);
+}
+
+void TutorialWindow::renderVoxels() {
+    FrameProfiler &frameProfiler = profiler();
+    {
+        const FrameProfiler::Scope scope(frameProfiler, "voxel.update");
+        mVoxelWorld->update();
+    }
+    {
+        const FrameProfiler::Scope scope(frameProfiler, "scene.cull");
+        mRenderQueue->clear();
+        mVoxelDraws.clear();
+        mVoxelWorld->collect(mProjViewMat, mVoxelDraws);
+        const float halfChunk = 0.5f * static_cast<float>(VoxelWorld::chunkSize);
+        for (const VoxelWorld::Draw &draw : mVoxelDraws) {
+            const MeshArena::Mesh &mesh = mVoxelWorld->mesh(draw.mesh);
+            const GLuint material = voxelMaterials[draw.block - 1];
+            const RenderQueue::DrawPacket packet {
+                    mMaterialPrograms[material],
+                    mVoxelVao->objectId(),
+                    mMaterials->texture(),
+                    mTransformLocation,
+                    mMaterialLocation,
+                    static_cast<GLint>(material),
+                    mesh.indexType,
+                    mesh.indexCount,
+                    mesh.indexOffset,
+                    mesh.baseVertex,
+                    0,
+                    0
+            };
+            QMatrix4x4 transform = mProjViewMat;
+            transform.translate(draw.origin);
+            const float depth = -mViewMat.map(draw.origin + QVector3D(halfChunk, halfChunk, halfChunk)).z();
+            mRenderQueue->push(RenderQueue::makeKey(RenderQueue::Opaque, packet.program, material, depth), packet,
+                               transform.constData());
+        }
+    }
+    submitQueue();
+}
+
+void TutorialWindow::cullObjects() {
+    const FrameProfiler::Scope scope(profiler(), "scene.cull");
+    if (mCulling) {
+        mBvh.cull(mProjViewMat, mVisible);
+        return;
+    }
+    selectAllObjects();
+}
+
+// Picks the coarsest level whose error, projected to the framebuffer at the object's nearest
+// distance, stays within the threshold. A coarser level must fit with some margin before an
+// object switches down, so objects near a boundary do not flip between levels every frame.
+// The visible list is then grouped by level, keeping the cull order within each group.
+void TutorialWindow::selectLevels() {
+    const FrameProfiler::Scope scope(profiler(), "scene.lod");
+    const std::size_t levelCount = mLodMeshes.size();
+    mLevelOffsets.assign(levelCount + 1, 0);
+    // Pixels covered by one unit at unit distance: the projection's vertical focal length.
+    const float pixelsPerUnit = mProjMat(1, 1) * 0.5f * static_cast<float>(mFramebufferSize.height());
+    const auto fullTriangles = static_cast<qint64>(mMeshArena->mesh(mLodMeshes.front()).indexCount / 3);
+    qint64 drawnTriangles = 0;
+    for (const std::uint32_t object : mVisible) {
+        std::size_t level = mObjectLevels[object];
+        if (levelCount > 1) {
+            const float distance = std::max((mObjects.position(object) - mCameraPos).length() - mObjectRadius,
+                                            lodMinDistance);
+            const float scale = pixelsPerUnit / distance;
+            const std::size_t previous = level;
+            while (level > 0 && mLodErrors[level] * scale > mLodThreshold) {
+                --level;
+            }
+            while (level + 1 < levelCount && mLodErrors[level + 1] * scale <= mLodThreshold * lodHysteresis) {
+                ++level;
+            }
+            if (level != previous) {
+                mObjectLevels[object] = static_cast<quint8>(level);
+                ++mLodStatistics.switches;
+            }
+        }
+        ++mLevelOffsets[level + 1];
+        drawnTriangles += mMeshArena->mesh(mLodMeshes[level]).indexCount / 3;
+    }
+    ++mLodStatistics.frames;
+    mLodStatistics.fullTriangles += fullTriangles * static_cast<qint64>(mVisible.size());
+    mLodStatistics.drawnTriangles += drawnTriangles;
+
+    std::partial_sum(mLevelOffsets.cbegin(), mLevelOffsets.cend(), mLevelOffsets.begin());
+    if (levelCount == 1) {
+        return;
+    }
+    mSortedVisible.resize(mVisible.size());
+    std::array<std::uint32_t, MeshFile::maxLevels> cursor{};
+    std::copy(mLevelOffsets.cbegin(), mLevelOffsets.cend() - 1, cursor.begin());
+    for (const std::uint32_t object : mVisible) {
+        mSortedVisible[cursor[mObjectLevels[object]]++] = object;
+    }
+    mVisible.swap(mSortedVisible);
+}
+
+void TutorialWindow::selectAllObjects() {
+    mVisible.resize(mObjects.size());
+    for (std::size_t i = 0; i < mVisible.size(); ++i) {
+        mVisible[i] = static_cast<std::uint32_t>(i);
+    }
+}
+
+void TutorialWindow::updateObjects(float currentTime, float *models, float *mvps) {
+    const auto update = [this, currentTime, models, mvps](std::size_t begin, std::size_t end) {
+        const std::uint32_t *indices = mVisible.data() + begin;
+        updateAngles(mObjects, currentTime, indices, end - begin);
+        mObjects.computeIndexed(mProjViewMat, indices, end - begin,
+                                models == nullptr ? nullptr : models + begin * matrixSize,
+                                mvps == nullptr ? nullptr : mvps + begin * matrixSize);
+    };
+    mJobs->parallelFor(mVisible.size(), objectsPerJob, update);
 }
 
 void TutorialWindow::deinitialize() {
     if (mLeftTriangleVao != nullptr) {
         mLeftTriangleVao->destroy();
     }
-    if (mVbo != nullptr) {
-        mVbo->destroy();
+    if (mMeshArena != nullptr) {
+        mMeshArena->destroy();
+    }
+    if (mInstanceVbo != nullptr) {
+        mInstanceVbo->destroy();
+    }
+    if (mStream != nullptr) {
+        mStream->destroy();
+    }
+    if (mGpuVao != nullptr) {
+        mGpuVao->destroy();
     }
-    if (mLeftTriangleEbo != nullptr) {
-        mLeftTriangleEbo->destroy();
+    if (mVoxelVao != nullptr) {
+        mVoxelVao->destroy();
     }
-    if (mProgram != nullptr) {
-        mProgram->removeAllShaders();
+    if (mVoxelWorld != nullptr) {
+        mVoxelWorld->logStatistics();
+        mVoxelWorld->destroy();
     }
-    if (mContainerTexture != nullptr) {
-        mContainerTexture->destroy();
+    if (mGpuCuller != nullptr) {
+        mGpuCuller->destroy();
     }
-    if (mAwesomeTexture != nullptr) {
-        mAwesomeTexture->destroy();
+    if (mSceneTarget != nullptr) {
+        mSceneTarget->destroy();
     }
+    if (mShaderVariants != nullptr) {
+        mShaderVariants->logStatistics();
+        mShaderVariants->destroy();
+    }
+    if (mTextureLoader != nullptr) {
+        mTextureLoader->destroy();
+    }
+    if (mMaterials != nullptr) {
+        mMaterials->destroy();
+    }
+    mRecorder.finish();
 }
 
 TutorialWindow::~TutorialWindow() {
-    delete mContainerTexture;
-    delete mAwesomeTexture;
-    delete mVbo;
-    delete mLeftTriangleEbo;
+    // The render thread must be gone, and deinitialize() still ours, before its objects are deleted.
+    deinitializeNow();
+    delete mJobs;
+    delete mTextureLoader;
+    delete mMaterials;
+    delete mMesh;
+    delete mGpuCuller;
+    delete mSceneTarget;
+    delete mShaderVariants;
+    delete mProgramCache;
+    delete mRenderQueue;
+    delete mState;
+    delete mMeshArena;
+    delete mVoxelWorld;
+    delete mInstanceVbo;
+    delete mStream;
 }
 
-void TutorialWindow::updateSize(const QSize &newSize) {
-    const double dpr = devicePixelRatio();
+void TutorialWindow::updateSize(const QSize &newSize, qreal devicePixelRatio) {
+    const double dpr = devicePixelRatio;
     const int width = newSize.width();
     const int height = newSize.height();
-    glViewport(0, 0,
-               static_cast<GLsizei>(std::lround(width * dpr)),
-               static_cast<GLsizei>(std::lround(height * dpr))
-    );
+    mFramebufferSize = QSize(static_cast<int>(std::lround(width * dpr)), static_cast<int>(std::lround(height * dpr)));
+    mSceneTarget->resize(mFramebufferSize);
+    mState->invalidate();
     mPrevSize = newSize;
+    mPrevDevicePixelRatio = devicePixelRatio;
     mScreenRatio = height == 0 ? 1.0f : static_cast<float>(width) / static_cast<float>(height);
     mProjMat.setToIdentity();
-    mProjMat.perspective(45.0f, mScreenRatio, 0.1f, 100.0f);
+    // The voxel world streams chunks out to a chunk past its radius; draw them all rather than
+    // building and uploading chunks the far plane clips.
+    const float far = mVoxelRadius > 0 ? static_cast<float>((mVoxelRadius + 1) * VoxelWorld::chunkSize) : farPlane;
+    mProjMat.perspective(45.0f, mScreenRatio, 0.1f, far);
     updateProjViewMat();
 }
 
@@ -315,36 +954,198 @@ void TutorialWindow::wheelEvent(QWheelEvent *event) {
 }
 
 void TutorialWindow::updateMixBalance(float delta) {
-    mMixBalance = clamp(0.0f, mMixBalance + delta, 1.0f);
+    mInput.mixBalance = clamp(0.0f, mInput.mixBalance + delta, 1.0f);
+    publishInput();
+}
+
+void TutorialWindow::synchronize() {
+    mInput.size = size();
+    mInput.devicePixelRatio = devicePixelRatio();
+    publishInput();
+}
+
+void TutorialWindow::publishInput() {
+    mInputBuffer.back() = mInput;
+    mInputBuffer.publish();
+}
+
+// Picks each material's variant from the mix it ends up with: one that samples only the base or
+// only the detail layer when the other would not contribute. Instanced and GPU-driven draws mix
+// materials, so they get a specialized variant only if every material agrees on it.
+void TutorialWindow::selectVariants(float mixBalance) {
+    mVariantMixBalance = mixBalance;
+    const ShaderVariants::Features baseOnly = mShaderVariants->feature("BASE_ONLY");
+    const ShaderVariants::Features detailOnly = mShaderVariants->feature("DETAIL_ONLY");
+    mMaterialFeatures.resize(materials.size());
+    for (std::size_t i = 0; i < materials.size(); ++i) {
+        const MaterialLibrary::Material &material = materials[i];
+        const float mix = clamp(0.0f, material.detailMix + mixBalance - 0.5f, 1.0f);
+        ShaderVariants::Features features = 0;
+        if (material.baseLayer == material.detailLayer || mix <= 0.0f) {
+            features = baseOnly;
+        } else if (mix >= 1.0f) {
+            features = detailOnly;
+        }
+        mMaterialFeatures[i] = features;
+        mShaderVariants->compile(features);
+    }
+    const ShaderVariants::Features first = mMaterialFeatures.front();
+    const bool shared = std::all_of(mMaterialFeatures.cbegin(), mMaterialFeatures.cend(),
+                                    [first](ShaderVariants::Features features) { return features == first; });
+    mSceneFeatures = shared ? first : 0;
+}
+
+// Adopts the variants that finished compiling and sets the shared uniforms on each one that just
+// became ready, or on all of them once an input behind those uniforms changes, then resolves the
+// program each material draws with. Leaves the scene's program in use.
+void TutorialWindow::updateVariants(float mixBalance) {
+    mShaderVariants->update();
+    if (Q_UNLIKELY(mixBalance != mVariantMixBalance)) {
+        selectVariants(mixBalance);
+    }
+    if (Q_UNLIKELY(mixBalance != mVariantUniforms.mixBalance || mInstanced != mVariantUniforms.instanced
+                   || mGpuDriven != mVariantUniforms.gpuDriven
+                   || mPositionScale != mVariantUniforms.positionScale)) {
+        mVariantUniforms = VariantUniforms{mixBalance, mInstanced, mGpuDriven, mPositionScale};
+        mVariantUniformsSet.assign(mVariantUniformsSet.size(), false);
+    }
+    mMixBalanceLocations.resize(mShaderVariants->variantCount(), unknownLocation);
+    mVariantUniformsSet.resize(mShaderVariants->variantCount(), false);
+    for (std::size_t i = 0; i < mShaderVariants->variantCount(); ++i) {
+        QOpenGLShaderProgram *program = mShaderVariants->variantProgram(i);
+        if (Q_LIKELY(mVariantUniformsSet[i]) || program == nullptr) {
+            continue;
+        }
+        mVariantUniformsSet[i] = true;
+        if (Q_UNLIKELY(mMixBalanceLocations[i] == unknownLocation)) {
+            // Variants that sample a single layer have no mixBalance.
+            mMixBalanceLocations[i] = program->uniformLocation("mixBalance");
+        }
+        mState->useProgram(program->programId());
+        mState->uniform(mMixBalanceLocations[i], mixBalance);
+        mState->uniform(mMaterialLocation, -1);
+        mState->uniform(mInstancedLocation, static_cast<GLint>(mInstanced));
+        mState->uniform(mGpuDrivenLocation, static_cast<GLint>(mGpuDriven));
+        mState->uniform(mPositionScaleLocation, mPositionScale);
+    }
+    mMaterialPrograms.resize(mMaterialFeatures.size());
+    for (std::size_t i = 0; i < mMaterialFeatures.size(); ++i) {
+        mMaterialPrograms[i] = mShaderVariants->program(mMaterialFeatures[i])->programId();
+    }
+    mSceneProgram = mShaderVariants->program(mSceneFeatures)->programId();
+    mState->useProgram(mSceneProgram);
 }
 
 void TutorialWindow::updateProjViewMat() {
     mProjViewMat = mProjMat * mViewMat;
 }
 
-void TutorialWindow::updateViewMat() {
-    if (!mDirections) {
-        return;
+// Runs every tick due by clock, feeding each the live input, the recorded input when replaying,
+// and recording what it consumed. Returns how far the clock is past the last tick, in ticks.
+float TutorialWindow::advanceSimulation(const SceneInput &input, double clock) {
+    if (Q_UNLIKELY(!mSimulationStarted)) {
+        mSimulationStarted = true;
+        mSimulationOrigin = clock;
+        if (mRecorder.mode() == InputRecorder::Recording) {
+            mRecorder.setStartPosition(mTickCameraPos);
+        }
+    }
+    const double elapsedTicks = (clock - mSimulationOrigin) * mTickRate;
+    QElapsedTimer timer;
+    timer.start();
+    int ticks = 0;
+    // A dig request is consumed by the next tick; a replay digs what the recording says instead.
+    bool dig = input.digGeneration != mDigGeneration;
+    while (static_cast<double>(mTick + 1) <= elapsedTicks) {
+        if (Q_UNLIKELY(ticks == maxTicksPerFrame)) {
+            const auto behind = static_cast<qint64>(elapsedTicks) - mTick;
+            mSimulationStatistics.droppedTicks += behind;
+            mSimulationOrigin += static_cast<double>(behind) / mTickRate;
+            break;
+        }
+        if (Q_UNLIKELY(mRecorder.replayFinished(mTick))) {
+            qDebug() << "Replay finished after" << mTick << "ticks";
+            mRecorder.finish();
+            mReplayFinished = true;
+            // The rest of the frame is live input; end it here so the last replayed frame is all recording.
+            break;
+        }
+        InputRecorder::Input tickInput{static_cast<int>(input.directions), input.cameraFront};
+        if (mRecorder.mode() == InputRecorder::Replaying) {
+            tickInput = mRecorder.replay(mTick);
+            InputRecorder::Dig recorded{};
+            while (mRecorder.nextDig(mTick, recorded)) {
+                if (mVoxelWorld != nullptr) {
+                    mPendingDigs.push_back(recorded);
+                }
+            }
+            dig = false;
+        } else if (mRecorder.mode() == InputRecorder::Recording) {
+            mRecorder.record(mTick, tickInput);
+        }
+        mDigGeneration = input.digGeneration;
+        simulateTick(tickInput, dig);
+        dig = false;
+        ++mTick;
+        ++ticks;
     }
-    const bool forward = mDirections.testFlag(Direction::Forward);
-    const bool backward = mDirections.testFlag(Direction::Backward);
+    mSimulationStatistics.ticks += ticks;
+    mSimulationStatistics.maxTicksPerFrame = std::max(mSimulationStatistics.maxTicksPerFrame, ticks);
+    mSimulationStatistics.tickNs += ticks > 0 ? timer.nsecsElapsed() : 0;
+    const double elapsed = (clock - mSimulationOrigin) * mTickRate - static_cast<double>(mTick);
+    return static_cast<float>(qBound(0.0, elapsed, 1.0));
+}
+
+void TutorialWindow::simulateTick(const InputRecorder::Input &tickInput, bool dig) {
+    mTickInput = tickInput;
+    mPreviousTickCameraPos = mTickCameraPos;
+    const Directions directions(QFlag(tickInput.directions));
+    const bool forward = directions.testFlag(Direction::Forward);
+    const bool backward = directions.testFlag(Direction::Backward);
     const bool frontMove = forward != backward;
-    const bool left = mDirections.testFlag(Direction::Left);
-    const bool right = mDirections.testFlag(Direction::Right);
+    const bool left = directions.testFlag(Direction::Left);
+    const bool right = directions.testFlag(Direction::Right);
     const bool strafeMove = left != right;
-    if (!frontMove && !strafeMove) {
-        return;
-    }
-    const float cameraSpeed = 2.5f * mDeltaTime;
+    const float step = cameraSpeed / static_cast<float>(mTickRate);
     if (frontMove) {
-        const float frontSpeed = forward ? cameraSpeed : -cameraSpeed;
-        mCameraPos += frontSpeed * mCameraFront;
+        const float frontSpeed = forward ? step : -step;
+        mTickCameraPos += frontSpeed * tickInput.cameraFront;
     }
     if (strafeMove) {
-        const float strafeSpeed = right ? cameraSpeed : -cameraSpeed;
-        mCameraPos += strafeSpeed * QVector3D::crossProduct(mCameraFront, mCameraUp);
+        const float strafeSpeed = right ? step : -step;
+        mTickCameraPos += strafeSpeed * QVector3D::crossProduct(tickInput.cameraFront, mCameraUp);
+    }
+    VoxelWorld::Coord hit{};
+    if (Q_UNLIKELY(dig) && mVoxelWorld != nullptr
+        && mVoxelWorld->raycast(mTickCameraPos, tickInput.cameraFront, digDistance, hit)
+        && mVoxelWorld->setBlock(hit.x, hit.y, hit.z, VoxelWorld::air)
+        && mRecorder.mode() == InputRecorder::Recording) {
+        mRecorder.recordDig(InputRecorder::Dig{mTick, hit.x, hit.y, hit.z});
+    }
+    if (Q_UNLIKELY(!mPendingDigs.empty())) {
+        applyPendingDigs();
     }
+}
+
+// Digs in recorded order, holding back every dig from the first whose chunk is still loading, so
+// edits to the same block land in the same order as when they were recorded.
+void TutorialWindow::applyPendingDigs() {
+    std::size_t applied = 0;
+    while (applied < mPendingDigs.size()) {
+        const InputRecorder::Dig &dig = mPendingDigs[applied];
+        if (!mVoxelWorld->setBlock(dig.x, dig.y, dig.z, VoxelWorld::air)) {
+            break;
+        }
+        ++applied;
+    }
+    mPendingDigs.erase(mPendingDigs.begin(), mPendingDigs.begin() + static_cast<std::ptrdiff_t>(applied));
+}
+
+void TutorialWindow::updateViewMat() {
     explicitUpdateViewMat();
+    if (mVoxelWorld != nullptr) {
+        mVoxelWorld->setFocus(mCameraPos);
+    }
 }
 
 void TutorialWindow::explicitUpdateViewMat() {
@@ -367,6 +1168,9 @@ void TutorialWindow::keyPressEvent(QKeyEvent *event) {
         case Qt::Key_BracketRight:
             updateMixBalance(0.05f);
             break;
+        case Qt::Key_E:
+            digVoxel();
+            break;
         default:
             OpenGLWindow::keyPressEvent(event);
             break;
@@ -383,23 +1187,24 @@ bool TutorialWindow::keyEvent(QKeyEvent *event, bool isKeyPressed) {
     switch (event->key()) {
         case Qt::Key_W:
         case Qt::Key_Up:
-            mDirections.setFlag(Direction::Forward, isKeyPressed);
+            mInput.directions.setFlag(Direction::Forward, isKeyPressed);
             break;
         case Qt::Key_S:
         case Qt::Key_Down:
-            mDirections.setFlag(Direction::Backward, isKeyPressed);
+            mInput.directions.setFlag(Direction::Backward, isKeyPressed);
             break;
         case Qt::Key_A:
         case Qt::Key_Left:
-            mDirections.setFlag(Direction::Left, isKeyPressed);
+            mInput.directions.setFlag(Direction::Left, isKeyPressed);
             break;
         case Qt::Key_D:
         case Qt::Key_Right:
-            mDirections.setFlag(Direction::Right, isKeyPressed);
+            mInput.directions.setFlag(Direction::Right, isKeyPressed);
             break;
         default:
             return false;
     }
+    publishInput();
     return true;
 }
 
@@ -441,6 +1246,6 @@ void TutorialWindow::updateCameraFront() {
     const auto cosYaw = static_cast<float>(qFastCos(yawRad));
     const auto sinPitch = static_cast<float>(qFastSin(pitchRad));
     const auto cosPitch = static_cast<float>(qFastCos(pitchRad));
-    mCameraFront = QVector3D(cosYaw * cosPitch, -sinPitch, sinYaw * cosPitch).normalized();
-    explicitUpdateViewMat();
+    mInput.cameraFront = QVector3D(cosYaw * cosPitch, -sinPitch, sinYaw * cosPitch).normalized();
+    publishInput();
 }
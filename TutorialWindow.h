@@ -5,14 +5,33 @@
 #ifndef GLTUT2_TUTORIALWINDOW_H
 #define GLTUT2_TUTORIALWINDOW_H
 
+#include "Bvh.h"
+#include "GLStateCache.h"
+#include "GpuCuller.h"
+#include "InputRecorder.h"
+#include "JobSystem.h"
+#include "MeshArena.h"
+#include "MeshFile.h"
+#include "MaterialLibrary.h"
 #include "OpenGLWindow.h"
+#include "ProgramCache.h"
+#include "RenderQueue.h"
+#include "SceneTarget.h"
+#include "ShaderVariants.h"
+#include "StreamBuffer.h"
+#include "TextureLoader.h"
+#include "TransformBatch.h"
+#include "TripleBuffer.h"
+#include "VertexLayout.h"
+#include "VoxelWorld.h"
 #include <QOpenGLFunctions_4_5_Core>
 #include <QMatrix4x4>
+#include <algorithm>
+#include <vector>
 
 class QOpenGLShaderProgram;
 class QOpenGLBuffer;
 class QOpenGLVertexArrayObject;
-class QOpenGLTexture;
 
 class TutorialWindow : public OpenGLWindow, protected QOpenGLFunctions_4_5_Core {
     Q_OBJECT
@@ -26,9 +45,90 @@ public:
     };
     Q_DECLARE_FLAGS(Directions, Direction)
 
+    // Everything render() needs from the GUI thread, published once per change.
+    struct SceneInput {
+        QSize size;
+        qreal devicePixelRatio = 1.0;
+        float mixBalance = 0.5f;
+        QVector3D cameraPos;
+        quint64 cameraGeneration = 0;
+        QVector3D cameraFront;
+        Directions directions;
+        bool useFixedTime = false;
+        float fixedTime = 0.0f;
+        quint64 digGeneration = 0;
+    };
+
+    struct LodStatistics {
+        int frames;
+        // Triangles of the visible objects at full detail and at the levels actually drawn.
+        qint64 fullTriangles;
+        qint64 drawnTriangles;
+        qint64 switches;
+    };
+
+    struct SimulationStatistics {
+        qint64 ticks;
+        // Ticks skipped because a frame fell more than maxTicksPerFrame behind.
+        qint64 droppedTicks;
+        int maxTicksPerFrame;
+        qint64 tickNs;
+    };
+
     explicit TutorialWindow(bool enableLogger = false, QWindow *parent = nullptr);
     ~TutorialWindow() override;
 
+    void setInstanced(bool instanced) { mInstanced = instanced; }
+    void setInstanceCount(int instanceCount);
+    // 0 for one worker per core; the pool starts in initialize().
+    void setWorkerCount(int workerCount) { mWorkerCount = workerCount; }
+    void setCulling(bool culling) { mCulling = culling; }
+    void setGpuDriven(bool gpuDriven) { mGpuDriven = gpuDriven; }
+    void setOcclusionCulling(bool occlusionCulling) { mOcclusionCulling = occlusionCulling; }
+    void setConvertedTextures(bool convertedTextures) { mConvertedTextures = convertedTextures; }
+    void setVertexLayout(VertexLayout::Preset preset) { mVertexLayout = VertexLayout(preset); }
+    // Replaces the built-in cube with a mesh written by gltut2-meshconv; call before the first frame.
+    bool setMesh(const QString &fileName);
+    // Largest geometric error, in pixels, a level of detail may show before a finer one is drawn.
+    void setLodThreshold(float pixels) { mLodThreshold = pixels; }
+    // Replaces the objects with a voxel world streamed this many chunks around the camera, 0 for
+    // the objects; the far plane moves out to the streamed distance. Call before the first frame.
+    void setVoxelRadius(int chunks) { mVoxelRadius = chunks; }
+    // Removes the first block the camera looks at, up to a few chunks away.
+    void digVoxel();
+    // The scene renders offscreen with this anti-aliasing at scale times the window resolution;
+    // a positive target frame time lets the scale adapt to the GPU time. Call before the first frame.
+    void setAntialiasing(SceneTarget::Antialiasing antialiasing) { mAntialiasing = antialiasing; }
+    void setRenderScale(float scale) { mRenderScale = scale; }
+    void setTargetFrameMs(float milliseconds) { mTargetFrameMs = milliseconds; }
+    // Camera movement, object rotation and digging advance in ticks of 1/ticksPerSecond seconds;
+    // frames draw between the last two ticks. Call before the first frame.
+    void setTickRate(int ticksPerSecond) { mTickRate = std::max(ticksPerSecond, 1); }
+    // Writes the input every tick consumed to fileName when the window is deinitialized.
+    void recordInput(const QString &fileName);
+    // Drives the simulation from a recording instead of the keyboard and mouse, at its tick rate.
+    // Once every recorded tick has run, the simulation goes back to live input.
+    bool replayInput(const QString &fileName);
+    bool replayFinished() const { return mReplayFinished; }
+    void setFixedTime(float seconds);
+    void setCamera(const QVector3D &position, float yaw, float pitch);
+
+    const TextureLoader *textureLoader() const { return mTextureLoader; }
+    const MaterialLibrary *materialLibrary() const { return mMaterials; }
+    const GLStateCache *stateCache() const { return mState; }
+    const JobSystem *jobSystem() const { return mJobs; }
+    const Bvh &bvh() const { return mBvh; }
+    const GpuCuller *gpuCuller() const { return mGpuCuller; }
+    const StreamBuffer *streamBuffer() const { return mStream; }
+    // Null in voxel mode.
+    const MeshArena *meshArena() const { return mMeshArena; }
+    qint64 meshLoadNs() const { return mMeshLoadNs; }
+    const LodStatistics &lodStatistics() const { return mLodStatistics; }
+    const VoxelWorld *voxelWorld() const { return mVoxelWorld; }
+    const SceneTarget *sceneTarget() const { return mSceneTarget; }
+    const ShaderVariants *shaderVariants() const { return mShaderVariants; }
+    const SimulationStatistics &simulationStatistics() const { return mSimulationStatistics; }
+
 protected:
     void initialize() override;
     void render() override;
@@ -38,26 +138,78 @@ protected:
     void keyReleaseEvent(QKeyEvent *event) override;
     void mousePressEvent(QMouseEvent *event) override;
     void mouseMoveEvent(QMouseEvent *event) override;
+    void synchronize() override;
 
 private:
-    void updateSize(const QSize &newSize);
+    // The inputs behind the uniforms every shader variant shares.
+    struct VariantUniforms {
+        float mixBalance;
+        bool instanced;
+        bool gpuDriven;
+        float positionScale;
+    };
+
+    void publishInput();
+    void updateSize(const QSize &newSize, qreal devicePixelRatio);
     void updateMixBalance(float delta);
     void updateProjViewMat();
     void updateViewMat();
+    float advanceSimulation(const SceneInput &input, double clock);
+    void simulateTick(const InputRecorder::Input &tickInput, bool dig);
+    void applyPendingDigs();
     bool keyEvent(QKeyEvent *event, bool isKeyPressed);
     void explicitUpdateViewMat();
+    void selectVariants(float mixBalance);
+    void updateVariants(float mixBalance);
     void updateCameraFront();
+    RenderQueue::DrawPacket meshPacket(GLuint program, std::size_t level, GLuint baseInstance,
+                                       GLsizei instanceCount) const;
+    void submitQueue();
+    void setObjectCount(std::size_t count);
+    void cullObjects();
+    void selectLevels();
+    void selectAllObjects();
+    void updateObjects(float currentTime, float *models, float *mvps);
+    void renderInstanced(float currentTime);
+    void renderPerObject(float currentTime);
+    void renderGpuDriven(float currentTime);
+    void renderVoxels();
 
+    GLStateCache *mState;
+    RenderQueue *mRenderQueue;
+    ProgramCache *mProgramCache;
+    ShaderVariants *mShaderVariants;
+    // The generic variant, whose uniform locations every variant shares except mixBalance's.
     QOpenGLShaderProgram *mProgram;
-    QOpenGLBuffer *mVbo;
-    QOpenGLBuffer *mLeftTriangleEbo;
+    float mVariantMixBalance;
+    std::vector<ShaderVariants::Features> mMaterialFeatures;
+    ShaderVariants::Features mSceneFeatures;
+    std::vector<GLuint> mMaterialPrograms;
+    GLuint mSceneProgram;
+    std::vector<GLint> mMixBalanceLocations;
+    // What the ready variants' uniforms were last set from, and which variants have them.
+    VariantUniforms mVariantUniforms;
+    std::vector<bool> mVariantUniformsSet;
+    float mPositionScale;
+    MeshArena *mMeshArena;
+    std::vector<MeshArena::Handle> mLodMeshes;
+    std::vector<float> mLodErrors;
     QOpenGLVertexArrayObject *mLeftTriangleVao;
+    QOpenGLBuffer *mInstanceVbo;
+    StreamBuffer *mStream;
+    QOpenGLVertexArrayObject *mGpuVao;
+    GpuCuller *mGpuCuller;
     QSize mPrevSize;
-    QOpenGLTexture *mContainerTexture;
-    QOpenGLTexture *mAwesomeTexture;
-    float mMixBalance;
-    int mMixBalanceLocation;
-    const qint64 mStartTime;
+    QSize mFramebufferSize;
+    qreal mPrevDevicePixelRatio;
+    TextureLoader *mTextureLoader;
+    MaterialLibrary *mMaterials;
+    bool mConvertedTextures;
+    VertexLayout mVertexLayout;
+    MeshFile *mMesh;
+    float mObjectRadius;
+    qint64 mMeshLoadNs;
+    int mMaterialLocation;
     int mTransformLocation;
     float mScreenRatio;
     QMatrix4x4 mViewMat;
@@ -66,13 +218,53 @@ private:
     QVector3D mCameraPos;
     QVector3D mCameraFront;
     QVector3D mCameraUp;
-    Directions mDirections;
-    float mDeltaTime;
-    float mLastFrame;
+    quint64 mCameraGeneration;
+    int mTickRate;
+    bool mSimulationStarted;
+    double mSimulationOrigin;
+    qint64 mTick;
+    QVector3D mTickCameraPos;
+    QVector3D mPreviousTickCameraPos;
+    InputRecorder::Input mTickInput;
+    SimulationStatistics mSimulationStatistics;
+    InputRecorder mRecorder;
+    // Replayed digs whose chunk has not loaded yet.
+    std::vector<InputRecorder::Dig> mPendingDigs;
+    bool mReplayFinished;
     bool mMouseGrabbed;
     QPoint mWindowCenter;
     float mPitch;
     float mYaw;
+    bool mInstanced;
+    int mInstancedLocation;
+    TransformBatch mObjects;
+    std::vector<GLuint> mObjectMaterials;
+    std::vector<GLfloat> mMatrixData;
+    int mWorkerCount;
+    JobSystem *mJobs;
+    Bvh mBvh;
+    std::vector<std::uint32_t> mVisible;
+    std::vector<std::uint32_t> mSortedVisible;
+    std::vector<quint8> mObjectLevels;
+    std::vector<std::uint32_t> mLevelOffsets;
+    float mLodThreshold;
+    LodStatistics mLodStatistics;
+    bool mCulling;
+    bool mGpuDriven;
+    bool mOcclusionCulling;
+    int mGpuDrivenLocation;
+    int mPositionScaleLocation;
+    int mVoxelRadius;
+    VoxelWorld *mVoxelWorld;
+    QOpenGLVertexArrayObject *mVoxelVao;
+    std::vector<VoxelWorld::Draw> mVoxelDraws;
+    quint64 mDigGeneration;
+    SceneTarget::Antialiasing mAntialiasing;
+    float mRenderScale;
+    float mTargetFrameMs;
+    SceneTarget *mSceneTarget;
+    SceneInput mInput;
+    TripleBuffer<SceneInput> mInputBuffer;
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(TutorialWindow::Directions)
@@ -0,0 +1,163 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "VertexLayout.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <QOpenGLFunctions_4_5_Core>
+#include <QtCore/qfloat16.h>
+
+namespace {
+    constexpr std::size_t shortIndexLimit = std::numeric_limits<GLushort>::max() + std::size_t(1);
+
+    GLshort snorm16(float value) {
+        return static_cast<GLshort>(std::lround(std::max(-1.0f, std::min(value, 1.0f)) * 32767.0f));
+    }
+
+    GLushort unorm16(float value) {
+        return static_cast<GLushort>(std::lround(std::max(0.0f, std::min(value, 1.0f)) * 65535.0f));
+    }
+
+    float signNotZero(float value) {
+        return value >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    // Projects the unit normal onto the octahedron |x| + |y| + |z| = 1 and folds the lower half
+    // over the upper one, which keeps the error of two snorm16 components well under a degree.
+    QVector2D encodeOctahedral(const QVector3D &normal) {
+        const float length = std::abs(normal.x()) + std::abs(normal.y()) + std::abs(normal.z());
+        if (Q_UNLIKELY(length == 0.0f)) {
+            return QVector2D(0.0f, 0.0f);
+        }
+        const float x = normal.x() / length;
+        const float y = normal.y() / length;
+        if (normal.z() >= 0.0f) {
+            return QVector2D(x, y);
+        }
+        return QVector2D((1.0f - std::abs(y)) * signNotZero(x), (1.0f - std::abs(x)) * signNotZero(y));
+    }
+
+    template <typename T>
+    void store(uchar *target, const T *values, std::size_t count) {
+        std::memcpy(target, values, count * sizeof(T));
+    }
+}
+
+VertexLayout::VertexLayout(Preset preset) :
+        mPreset(preset),
+        mStride(0),
+        mAttributes() {
+    switch (mPreset) {
+        case Full:
+            mAttributes = {
+                    {positionLocation, 3, GL_FLOAT, GL_FALSE, 0},
+                    {texCoordLocation, 2, GL_FLOAT, GL_FALSE, 12},
+                    {normalLocation, 3, GL_FLOAT, GL_FALSE, 20}
+            };
+            mStride = 32;
+            break;
+        case Half:
+            mAttributes = {
+                    {positionLocation, 4, GL_HALF_FLOAT, GL_FALSE, 0},
+                    {texCoordLocation, 2, GL_UNSIGNED_SHORT, GL_TRUE, 8},
+                    {normalLocation, 2, GL_SHORT, GL_TRUE, 12}
+            };
+            mStride = 16;
+            break;
+        case Compact:
+            mAttributes = {
+                    {positionLocation, 4, GL_SHORT, GL_TRUE, 0},
+                    {texCoordLocation, 2, GL_UNSIGNED_SHORT, GL_TRUE, 8},
+                    {normalLocation, 2, GL_SHORT, GL_TRUE, 12}
+            };
+            mStride = 16;
+            break;
+    }
+}
+
+const char *VertexLayout::presetName(Preset preset) {
+    switch (preset) {
+        case Full:
+            return "full";
+        case Half:
+            return "half";
+        case Compact:
+            return "compact";
+    }
+    return "unknown";
+}
+
+bool VertexLayout::fromName(const QString &name, Preset &preset) {
+    for (const Preset candidate : {Full, Half, Compact}) {
+        if (name == QLatin1String(presetName(candidate))) {
+            preset = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void VertexLayout::apply(QOpenGLFunctions_4_5_Core *functions, GLuint vertexArray, GLuint binding) const {
+    for (const auto &attribute : mAttributes) {
+        functions->glVertexArrayAttribFormat(vertexArray, attribute.location, attribute.size, attribute.type,
+                                             attribute.normalized, attribute.offset);
+        functions->glVertexArrayAttribBinding(vertexArray, attribute.location, binding);
+        functions->glEnableVertexArrayAttrib(vertexArray, attribute.location);
+    }
+}
+
+VertexLayout::PackedMesh VertexLayout::pack(const MeshVertex *vertices, std::size_t vertexCount, const GLuint *indices,
+                                            std::size_t indexCount, bool shortIndices, GLfloat positionScale) const {
+    PackedMesh mesh{std::vector<uchar>(vertexCount * mStride), {}, GL_UNSIGNED_INT, static_cast<GLsizei>(indexCount), 1.0f};
+
+    if (mPreset == Compact && positionScale > 0.0f) {
+        mesh.positionScale = positionScale;
+    } else if (mPreset == Compact) {
+        float extent = 0.0f;
+        for (std::size_t i = 0; i < vertexCount; ++i) {
+            const QVector3D &position = vertices[i].position;
+            extent = std::max({extent, std::abs(position.x()), std::abs(position.y()), std::abs(position.z())});
+        }
+        mesh.positionScale = extent > 0.0f ? extent : 1.0f;
+    }
+
+    for (std::size_t i = 0; i < vertexCount; ++i) {
+        const MeshVertex &vertex = vertices[i];
+        uchar *target = mesh.vertices.data() + i * mStride;
+        if (mPreset == Full) {
+            const float data[] = {vertex.position.x(), vertex.position.y(), vertex.position.z(),
+                                  vertex.texCoord.x(), vertex.texCoord.y(),
+                                  vertex.normal.x(), vertex.normal.y(), vertex.normal.z()};
+            store(target, data, 8);
+            continue;
+        }
+        if (mPreset == Half) {
+            const qfloat16 position[] = {qfloat16(vertex.position.x()), qfloat16(vertex.position.y()),
+                                         qfloat16(vertex.position.z()), qfloat16(1.0f)};
+            store(target, position, 4);
+        } else {
+            const QVector3D &position = vertex.position / mesh.positionScale;
+            const GLshort data[] = {snorm16(position.x()), snorm16(position.y()), snorm16(position.z()), 0};
+            store(target, data, 4);
+        }
+        const GLushort texCoord[] = {unorm16(vertex.texCoord.x()), unorm16(vertex.texCoord.y())};
+        store(target + 8, texCoord, 2);
+        const QVector2D &octahedral = encodeOctahedral(vertex.normal);
+        const GLshort normal[] = {snorm16(octahedral.x()), snorm16(octahedral.y())};
+        store(target + 12, normal, 2);
+    }
+
+    if (shortIndices && vertexCount <= shortIndexLimit) {
+        mesh.indexType = GL_UNSIGNED_SHORT;
+        mesh.indices.resize(indexCount * sizeof(GLushort));
+        auto *target = reinterpret_cast<GLushort *>(mesh.indices.data());
+        std::transform(indices, indices + indexCount, target, [](GLuint index) { return static_cast<GLushort>(index); });
+    } else {
+        mesh.indices.resize(indexCount * sizeof(GLuint));
+        store(mesh.indices.data(), indices, indexCount);
+    }
+    return mesh;
+}
@@ -0,0 +1,80 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_VERTEXLAYOUT_H
+#define GLTUT2_VERTEXLAYOUT_H
+
+#include <vector>
+#include <QString>
+#include <QVector2D>
+#include <QVector3D>
+#include <QtGui/qopengl.h>
+
+class QOpenGLFunctions_4_5_Core;
+
+struct MeshVertex {
+    QVector3D position;
+    QVector2D texCoord;
+    QVector3D normal;
+};
+
+// Describes how mesh vertices are interleaved in one vertex buffer and generates the matching
+// DSA attribute formats, so the same mesh can be stored at full precision or packed:
+// Full   - float positions, texcoords and normals, 32 bytes;
+// Half   - half-float positions, unorm16 texcoords, octahedral snorm16 normals, 16 bytes;
+// Compact - snorm16 positions scaled by the mesh extent, otherwise as Half, 16 bytes.
+// Texcoords must lie in [0, 1] for the unorm16 layouts. pack() also narrows indices to
+// 16 bits whenever the mesh has at most 65536 vertices.
+class VertexLayout {
+public:
+    enum Preset {
+        Full,
+        Half,
+        Compact
+    };
+
+    struct Attribute {
+        GLuint location;
+        GLint size;
+        GLenum type;
+        GLboolean normalized;
+        GLuint offset;
+    };
+
+    struct PackedMesh {
+        std::vector<uchar> vertices;
+        std::vector<uchar> indices;
+        GLenum indexType;
+        GLsizei indexCount;
+        // Shaders multiply decoded positions by this to undo the snorm16 normalisation.
+        GLfloat positionScale;
+    };
+
+    static constexpr GLuint positionLocation = 0;
+    static constexpr GLuint texCoordLocation = 1;
+    static constexpr GLuint normalLocation = 7;
+
+    explicit VertexLayout(Preset preset = Compact);
+
+    static const char *presetName(Preset preset);
+    static bool fromName(const QString &name, Preset &preset);
+
+    Preset preset() const { return mPreset; }
+    GLsizei stride() const { return mStride; }
+    const std::vector<Attribute> &attributes() const { return mAttributes; }
+    bool octahedralNormals() const { return mPreset != Full; }
+
+    void apply(QOpenGLFunctions_4_5_Core *functions, GLuint vertexArray, GLuint binding) const;
+    // A positionScale of 0 fits the Compact range to the mesh; pass the scale of another mesh
+    // to quantize several meshes, such as levels of detail, for one shader uniform.
+    PackedMesh pack(const MeshVertex *vertices, std::size_t vertexCount, const GLuint *indices, std::size_t indexCount,
+                    bool shortIndices = true, GLfloat positionScale = 0.0f) const;
+
+private:
+    Preset mPreset;
+    GLsizei mStride;
+    std::vector<Attribute> mAttributes;
+};
+
+#endif //GLTUT2_VERTEXLAYOUT_H
@@ -0,0 +1,620 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "VoxelWorld.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <QDebug>
+#include <QOpenGLFunctions_4_5_Core>
+#include <QRunnable>
+
+namespace {
+    constexpr int chunkSize = VoxelWorld::chunkSize;
+    constexpr int paddedSize = chunkSize + 2;
+    // The world is two chunks deep, its surface well below the default camera height.
+    constexpr int lowestChunk = -2;
+    constexpr int highestChunk = -1;
+    constexpr int dirtDepth = 3;
+
+    class BuildJob : public QRunnable {
+    public:
+        explicit BuildJob(std::function<void()> job) : mJob(std::move(job)) {}
+        void run() override { mJob(); }
+
+    private:
+        const std::function<void()> mJob;
+    };
+
+    int floorDiv(int value) {
+        return value >= 0 ? value / chunkSize : (value + 1) / chunkSize - 1;
+    }
+
+    int blockIndex(int x, int y, int z) {
+        return (y * chunkSize + z) * chunkSize + x;
+    }
+
+    // Rolling hills from a few octaves of sines; cheap, deterministic and the same on every thread.
+    int terrainHeight(int x, int z) {
+        const float fx = static_cast<float>(x);
+        const float fz = static_cast<float>(z);
+        const float height = -14.0f + 5.0f * std::sin(fx * 0.061f) * std::cos(fz * 0.047f)
+                             + 3.0f * std::sin((fx - fz) * 0.113f) + 1.5f * std::cos(fx * 0.21f + fz * 0.17f);
+        return static_cast<int>(std::floor(height));
+    }
+
+    VoxelWorld::Block terrainBlock(int y, int height) {
+        if (y > height) {
+            return VoxelWorld::air;
+        }
+        if (y == height) {
+            return VoxelWorld::grass;
+        }
+        return y >= height - dirtDepth ? VoxelWorld::dirt : VoxelWorld::stone;
+    }
+
+    // Chunk blocks plus a one block border on each face, taken from the neighbors where they are
+    // loaded and from the generator where they are not. Edges and corners stay air, no face needs them.
+    class Padded {
+    public:
+        Padded() : mBlocks(paddedSize * paddedSize * paddedSize, VoxelWorld::air) {}
+
+        VoxelWorld::Block at(int x, int y, int z) const { return mBlocks[index(x, y, z)]; }
+        void set(int x, int y, int z, VoxelWorld::Block block) { mBlocks[index(x, y, z)] = block; }
+
+    private:
+        static int index(int x, int y, int z) { return ((y + 1) * paddedSize + z + 1) * paddedSize + x + 1; }
+
+        std::vector<VoxelWorld::Block> mBlocks;
+    };
+
+    struct Plane {
+        QVector3D normal;
+        float distance;
+    };
+}
+
+double VoxelWorld::Statistics::trianglesPerChunk() const {
+    return meshedChunks == 0 ? 0.0 : static_cast<double>(triangles) / meshedChunks;
+}
+
+double VoxelWorld::Statistics::averagePending() const {
+    return updates == 0 ? 0.0 : static_cast<double>(pendingSum) / updates;
+}
+
+std::size_t VoxelWorld::CoordHash::operator()(const Coord &coord) const {
+    return (static_cast<std::size_t>(static_cast<unsigned>(coord.x)) * 73856093u)
+           ^ (static_cast<std::size_t>(static_cast<unsigned>(coord.y)) * 19349663u)
+           ^ (static_cast<std::size_t>(static_cast<unsigned>(coord.z)) * 83492791u);
+}
+
+VoxelWorld::VoxelWorld(QOpenGLFunctions_4_5_Core *functions, int viewRadius, int uploadsPerFrame) :
+        mLayout(VertexLayout::Full),
+        mArena(functions, mLayout.stride()),
+        mPool(),
+        mClock(),
+        mChunks(),
+        mDirty(),
+        mFocus{0, 0, 0},
+        mFocused(false),
+        mViewRadius(std::max(viewRadius, 1)),
+        mUploadsPerFrame(std::max(uploadsPerFrame, 1)),
+        mCounter(0),
+        mBuiltMutex(),
+        mBuilt(),
+        mReady(),
+        mPending(0),
+        mMaxPending(0),
+        mPendingSum(0),
+        mUpdates(0),
+        mBuilds(0),
+        mRemeshes(0),
+        mDropped(0),
+        mBuildNs(0),
+        mLatencyNs(0),
+        mMaxLatencyNs(0),
+        mUploads(0) {
+    mClock.start();
+}
+
+VoxelWorld::~VoxelWorld() {
+    mPool.clear();
+    mPool.waitForDone();
+}
+
+void VoxelWorld::create() {
+    mArena.create();
+}
+
+void VoxelWorld::destroy() {
+    mPool.clear();
+    mPool.waitForDone();
+    mArena.destroy();
+    mChunks.clear();
+    mDirty.clear();
+    mBuilt.clear();
+    mReady.clear();
+    mPending = 0;
+    mFocused = false;
+}
+
+void VoxelWorld::setFocus(const QVector3D &position) {
+    const Coord focus{floorDiv(static_cast<int>(std::floor(position.x()))), 0,
+                      floorDiv(static_cast<int>(std::floor(position.z())))};
+    if (Q_LIKELY(mFocused && focus == mFocus)) {
+        return;
+    }
+    mFocus = focus;
+    mFocused = true;
+    stream();
+}
+
+void VoxelWorld::setViewRadius(int viewRadius) {
+    mViewRadius = std::max(viewRadius, 1);
+    if (mFocused) {
+        stream();
+    }
+}
+
+void VoxelWorld::stream() {
+    const int unloadRadius = mViewRadius + 1;
+    for (auto it = mChunks.begin(); it != mChunks.end();) {
+        const int dx = it->first.x - mFocus.x;
+        const int dz = it->first.z - mFocus.z;
+        if (dx * dx + dz * dz > unloadRadius * unloadRadius) {
+            release(it->second);
+            it = mChunks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // Nearest columns first; the pool also runs queued builds by priority, so a camera that keeps
+    // moving sees the chunks in front of it before the ones it requested a while ago.
+    std::vector<std::pair<int, Coord>> requests;
+    for (int dz = -mViewRadius; dz <= mViewRadius; ++dz) {
+        for (int dx = -mViewRadius; dx <= mViewRadius; ++dx) {
+            const int distance = dx * dx + dz * dz;
+            if (distance > mViewRadius * mViewRadius) {
+                continue;
+            }
+            for (int y = lowestChunk; y <= highestChunk; ++y) {
+                const Coord coord{mFocus.x + dx, y, mFocus.z + dz};
+                if (mChunks.find(coord) == mChunks.end()) {
+                    requests.emplace_back(distance, coord);
+                }
+            }
+        }
+    }
+    std::stable_sort(requests.begin(), requests.end(), [](const auto &left, const auto &right) {
+        return left.first < right.first;
+    });
+    for (const auto &request : requests) {
+        Chunk &chunk = mChunks[request.second];
+        chunk.meshes.fill(MeshArena::invalidHandle);
+        chunk.triangles = 0;
+        chunk.version = ++mCounter;
+        chunk.job = 0;
+        chunk.dirty = false;
+        chunk.requestedNs = mClock.nsecsElapsed();
+        submit(request.second, chunk);
+    }
+}
+
+void VoxelWorld::submit(const Coord &coord, Chunk &chunk) {
+    static const std::array<Coord, 6> offsets{{{-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}}};
+    std::array<std::shared_ptr<const Blocks>, 6> neighbors;
+    for (std::size_t i = 0; i < offsets.size(); ++i) {
+        const auto neighbor = mChunks.find(Coord{coord.x + offsets[i].x, coord.y + offsets[i].y, coord.z + offsets[i].z});
+        if (neighbor != mChunks.end()) {
+            neighbors[i] = neighbor->second.blocks;
+        }
+    }
+    if (chunk.blocks != nullptr) {
+        ++mRemeshes;
+    }
+    chunk.job = ++mCounter;
+    chunk.dirty = false;
+    const quint64 job = chunk.job;
+    const quint64 version = chunk.version;
+    const std::shared_ptr<const Blocks> blocks = chunk.blocks;
+    auto *runnable = new BuildJob([this, coord, job, version, blocks, neighbors] {
+        Built built = build(coord, blocks, neighbors, mLayout);
+        built.job = job;
+        built.version = version;
+        const QMutexLocker locker(&mBuiltMutex);
+        mBuilt.push_back(std::move(built));
+    });
+    const int dx = coord.x - mFocus.x;
+    const int dz = coord.z - mFocus.z;
+    mPool.start(runnable, -(dx * dx + dz * dz));
+    ++mBuilds;
+    ++mPending;
+    mMaxPending = std::max(mMaxPending, mPending);
+}
+
+VoxelWorld::Built VoxelWorld::build(const Coord &coord, std::shared_ptr<const Blocks> blocks,
+                                    const std::array<std::shared_ptr<const Blocks>, 6> &neighbors,
+                                    const VertexLayout &layout) {
+    QElapsedTimer timer;
+    timer.start();
+    const int originX = coord.x * chunkSize;
+    const int originY = coord.y * chunkSize;
+    const int originZ = coord.z * chunkSize;
+    Built built{coord, 0, 0, nullptr, {}, {}, 0};
+    if (blocks == nullptr) {
+        auto generated = std::make_shared<Blocks>(chunkSize * chunkSize * chunkSize, air);
+        for (int z = 0; z < chunkSize; ++z) {
+            for (int x = 0; x < chunkSize; ++x) {
+                const int height = terrainHeight(originX + x, originZ + z);
+                for (int y = 0; y < chunkSize; ++y) {
+                    (*generated)[blockIndex(x, y, z)] = terrainBlock(originY + y, height);
+                }
+            }
+        }
+        blocks = generated;
+        built.blocks = blocks;
+    }
+
+    Padded volume;
+    for (int y = 0; y < chunkSize; ++y) {
+        for (int z = 0; z < chunkSize; ++z) {
+            for (int x = 0; x < chunkSize; ++x) {
+                volume.set(x, y, z, (*blocks)[blockIndex(x, y, z)]);
+            }
+        }
+    }
+    // Border cell (i, j) of each face, read from the neighbor's opposite face or generated.
+    for (int axis = 0; axis < 3; ++axis) {
+        for (int side = 0; side < 2; ++side) {
+            const Blocks *neighbor = neighbors[axis * 2 + side].get();
+            const int outside = side == 0 ? -1 : chunkSize;
+            const int inside = side == 0 ? chunkSize - 1 : 0;
+            for (int j = 0; j < chunkSize; ++j) {
+                for (int i = 0; i < chunkSize; ++i) {
+                    int cell[3];
+                    cell[axis] = outside;
+                    cell[(axis + 1) % 3] = i;
+                    cell[(axis + 2) % 3] = j;
+                    Block block;
+                    if (neighbor != nullptr) {
+                        int source[3] = {cell[0], cell[1], cell[2]};
+                        source[axis] = inside;
+                        block = (*neighbor)[blockIndex(source[0], source[1], source[2])];
+                    } else {
+                        block = terrainBlock(originY + cell[1], terrainHeight(originX + cell[0], originZ + cell[2]));
+                    }
+                    volume.set(cell[0], cell[1], cell[2], block);
+                }
+            }
+        }
+    }
+
+    // Greedy meshing (Lysenko, 2012): per axis, direction and slice, mask the faces between a
+    // solid block and air, then grow rectangles of one block type along u and then v.
+    std::array<std::vector<MeshVertex>, blockTypes> vertices;
+    std::array<std::vector<GLuint>, blockTypes> indices;
+    std::array<Block, chunkSize * chunkSize> mask;
+    for (int axis = 0; axis < 3; ++axis) {
+        const int u = (axis + 1) % 3;
+        const int v = (axis + 2) % 3;
+        for (int side = -1; side <= 1; side += 2) {
+            QVector3D normal;
+            normal[axis] = static_cast<float>(side);
+            for (int slice = 0; slice < chunkSize; ++slice) {
+                for (int j = 0; j < chunkSize; ++j) {
+                    for (int i = 0; i < chunkSize; ++i) {
+                        int cell[3];
+                        cell[axis] = slice;
+                        cell[u] = i;
+                        cell[v] = j;
+                        const Block block = volume.at(cell[0], cell[1], cell[2]);
+                        cell[axis] += side;
+                        mask[j * chunkSize + i] = block != air && volume.at(cell[0], cell[1], cell[2]) == air ? block : air;
+                    }
+                }
+                const float plane = static_cast<float>(side > 0 ? slice + 1 : slice);
+                for (int j = 0; j < chunkSize; ++j) {
+                    for (int i = 0; i < chunkSize;) {
+                        const Block block = mask[j * chunkSize + i];
+                        if (block == air) {
+                            ++i;
+                            continue;
+                        }
+                        int width = 1;
+                        while (i + width < chunkSize && mask[j * chunkSize + i + width] == block) {
+                            ++width;
+                        }
+                        int height = 1;
+                        for (; j + height < chunkSize; ++height) {
+                            const Block *row = mask.data() + (j + height) * chunkSize + i;
+                            if (std::any_of(row, row + width, [block](Block other) { return other != block; })) {
+                                break;
+                            }
+                        }
+                        for (int row = j; row < j + height; ++row) {
+                            std::fill_n(mask.data() + row * chunkSize + i, width, air);
+                        }
+
+                        std::vector<MeshVertex> &target = vertices[block - 1];
+                        const auto first = static_cast<GLuint>(target.size());
+                        const int corners[4][2] = {{i, j}, {i + width, j}, {i + width, j + height}, {i, j + height}};
+                        for (const auto &corner : corners) {
+                            QVector3D position;
+                            position[axis] = plane;
+                            position[u] = static_cast<float>(corner[0]);
+                            position[v] = static_cast<float>(corner[1]);
+                            // Side faces keep the texture upright; every face repeats it once per block.
+                            const QVector2D texCoord = axis == 0 ? QVector2D(position.z(), position.y())
+                                                       : axis == 1 ? QVector2D(position.x(), position.z())
+                                                       : QVector2D(position.x(), position.y());
+                            target.push_back(MeshVertex{position, texCoord, normal});
+                        }
+                        // u x v points along +axis, so the corners run counterclockwise seen from that side.
+                        if (side > 0) {
+                            indices[block - 1].insert(indices[block - 1].end(),
+                                                      {first, first + 1, first + 2, first, first + 2, first + 3});
+                        } else {
+                            indices[block - 1].insert(indices[block - 1].end(),
+                                                      {first, first + 2, first + 1, first, first + 3, first + 2});
+                        }
+                        i += width;
+                    }
+                }
+            }
+        }
+    }
+
+    for (int type = 0; type < blockTypes; ++type) {
+        built.vertexCounts[type] = static_cast<GLsizei>(vertices[type].size());
+        if (!indices[type].empty()) {
+            built.meshes[type] = layout.pack(vertices[type].data(), vertices[type].size(), indices[type].data(),
+                                             indices[type].size());
+        }
+    }
+    built.buildNs = timer.nsecsElapsed();
+    return built;
+}
+
+void VoxelWorld::update() {
+    {
+        const QMutexLocker locker(&mBuiltMutex);
+        std::move(mBuilt.begin(), mBuilt.end(), std::back_inserter(mReady));
+        mBuilt.clear();
+    }
+    for (int uploads = 0; uploads < mUploadsPerFrame && !mReady.empty();) {
+        if (upload(mReady.front())) {
+            ++uploads;
+        }
+        mReady.pop_front();
+        --mPending;
+    }
+
+    std::vector<Coord> dirty;
+    dirty.swap(mDirty);
+    for (const Coord &coord : dirty) {
+        const auto it = mChunks.find(coord);
+        if (it == mChunks.end() || !it->second.dirty) {
+            continue;
+        }
+        // One build per chunk at a time; the dirty flag survives until the current one lands.
+        if (it->second.job != 0) {
+            mDirty.push_back(coord);
+            continue;
+        }
+        submit(coord, it->second);
+    }
+    mPendingSum += mPending;
+    ++mUpdates;
+}
+
+bool VoxelWorld::upload(Built &built) {
+    mBuildNs += built.buildNs;
+    const auto it = mChunks.find(built.coord);
+    if (it == mChunks.end() || it->second.job != built.job) {
+        ++mDropped;
+        return false;
+    }
+    Chunk &chunk = it->second;
+    chunk.job = 0;
+    if (built.blocks != nullptr) {
+        chunk.blocks = built.blocks;
+    }
+    if (built.version != chunk.version) {
+        ++mDropped;
+        return false;
+    }
+    release(chunk);
+    for (int type = 0; type < blockTypes; ++type) {
+        const VertexLayout::PackedMesh &mesh = built.meshes[type];
+        if (mesh.indexCount > 0) {
+            chunk.meshes[type] = mArena.add(mesh.vertices.data(), built.vertexCounts[type], mesh.indices.data(),
+                                            mesh.indexCount, mesh.indexType);
+            if (chunk.meshes[type] != MeshArena::invalidHandle) {
+                chunk.triangles += mesh.indexCount / 3;
+            }
+        }
+    }
+    const qint64 latencyNs = mClock.nsecsElapsed() - chunk.requestedNs;
+    mLatencyNs += latencyNs;
+    mMaxLatencyNs = std::max(mMaxLatencyNs, latencyNs);
+    ++mUploads;
+    chunk.requestedNs = -1;
+    return true;
+}
+
+void VoxelWorld::release(Chunk &chunk) {
+    for (MeshArena::Handle &mesh : chunk.meshes) {
+        if (mesh != MeshArena::invalidHandle) {
+            mArena.remove(mesh);
+            mesh = MeshArena::invalidHandle;
+        }
+    }
+    chunk.triangles = 0;
+}
+
+void VoxelWorld::markDirty(const Coord &coord) {
+    const auto it = mChunks.find(coord);
+    if (it == mChunks.end()) {
+        return;
+    }
+    Chunk &chunk = it->second;
+    chunk.version = ++mCounter;
+    if (chunk.requestedNs < 0) {
+        chunk.requestedNs = mClock.nsecsElapsed();
+    }
+    if (!chunk.dirty) {
+        chunk.dirty = true;
+        mDirty.push_back(coord);
+    }
+}
+
+VoxelWorld::Block VoxelWorld::block(int x, int y, int z) const {
+    const Coord coord{floorDiv(x), floorDiv(y), floorDiv(z)};
+    const auto it = mChunks.find(coord);
+    if (it == mChunks.end() || it->second.blocks == nullptr) {
+        return air;
+    }
+    return (*it->second.blocks)[blockIndex(x - coord.x * chunkSize, y - coord.y * chunkSize, z - coord.z * chunkSize)];
+}
+
+bool VoxelWorld::setBlock(int x, int y, int z, Block block) {
+    const Coord coord{floorDiv(x), floorDiv(y), floorDiv(z)};
+    const auto it = mChunks.find(coord);
+    if (Q_UNLIKELY(it == mChunks.end() || it->second.blocks == nullptr)) {
+        return false;
+    }
+    const int localX = x - coord.x * chunkSize;
+    const int localY = y - coord.y * chunkSize;
+    const int localZ = z - coord.z * chunkSize;
+    const int index = blockIndex(localX, localY, localZ);
+    if ((*it->second.blocks)[index] == block) {
+        return true;
+    }
+    // Builds in flight hold the old blocks, so edits copy rather than write under them.
+    auto blocks = std::make_shared<Blocks>(*it->second.blocks);
+    (*blocks)[index] = block;
+    it->second.blocks = blocks;
+    markDirty(coord);
+
+    const int local[3] = {localX, localY, localZ};
+    for (int axis = 0; axis < 3; ++axis) {
+        if (local[axis] == 0 || local[axis] == chunkSize - 1) {
+            int neighbor[3] = {coord.x, coord.y, coord.z};
+            neighbor[axis] += local[axis] == 0 ? -1 : 1;
+            markDirty(Coord{neighbor[0], neighbor[1], neighbor[2]});
+        }
+    }
+    return true;
+}
+
+// Amanatides and Woo (1987): advance to whichever block boundary along the ray is nearest.
+bool VoxelWorld::raycast(const QVector3D &origin, const QVector3D &direction, float distance, Coord &hit) const {
+    int cell[3];
+    int step[3];
+    float next[3];
+    float delta[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        cell[axis] = static_cast<int>(std::floor(origin[axis]));
+        const float component = direction[axis];
+        if (component > 0.0f) {
+            step[axis] = 1;
+            delta[axis] = 1.0f / component;
+            next[axis] = (static_cast<float>(cell[axis] + 1) - origin[axis]) * delta[axis];
+        } else if (component < 0.0f) {
+            step[axis] = -1;
+            delta[axis] = -1.0f / component;
+            next[axis] = (origin[axis] - static_cast<float>(cell[axis])) * delta[axis];
+        } else {
+            // Never the nearest boundary; finite because -ffast-math assumes there is no infinity.
+            step[axis] = 0;
+            delta[axis] = std::numeric_limits<float>::max();
+            next[axis] = std::numeric_limits<float>::max();
+        }
+    }
+    for (float travelled = 0.0f; travelled <= distance;) {
+        if (block(cell[0], cell[1], cell[2]) != air) {
+            hit = Coord{cell[0], cell[1], cell[2]};
+            return true;
+        }
+        const int axis = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2) : (next[1] < next[2] ? 1 : 2);
+        cell[axis] += step[axis];
+        travelled = next[axis];
+        next[axis] += delta[axis];
+    }
+    return false;
+}
+
+void VoxelWorld::collect(const QMatrix4x4 &projView, std::vector<Draw> &draws) const {
+    // Gribb-Hartmann: each clip plane is the last row of the matrix plus or minus another row.
+    std::array<Plane, 6> planes;
+    for (int i = 0; i < 6; ++i) {
+        const int row = i / 2;
+        const float sign = i % 2 == 0 ? 1.0f : -1.0f;
+        planes[i].normal = QVector3D(projView(3, 0) + sign * projView(row, 0), projView(3, 1) + sign * projView(row, 1),
+                                     projView(3, 2) + sign * projView(row, 2));
+        planes[i].distance = projView(3, 3) + sign * projView(row, 3);
+    }
+    const float size = static_cast<float>(chunkSize);
+    for (const auto &entry : mChunks) {
+        const Chunk &chunk = entry.second;
+        if (chunk.triangles == 0) {
+            continue;
+        }
+        const QVector3D origin(entry.first.x * size, entry.first.y * size, entry.first.z * size);
+        const bool outside = std::any_of(planes.cbegin(), planes.cend(), [&origin, size](const Plane &plane) {
+            // The corner farthest along the plane normal is the last to leave the frustum.
+            const QVector3D corner(origin.x() + (plane.normal.x() >= 0.0f ? size : 0.0f),
+                                   origin.y() + (plane.normal.y() >= 0.0f ? size : 0.0f),
+                                   origin.z() + (plane.normal.z() >= 0.0f ? size : 0.0f));
+            return QVector3D::dotProduct(plane.normal, corner) + plane.distance < 0.0f;
+        });
+        if (outside) {
+            continue;
+        }
+        for (int type = 0; type < blockTypes; ++type) {
+            if (chunk.meshes[type] != MeshArena::invalidHandle) {
+                draws.push_back(Draw{origin, static_cast<Block>(type + 1), chunk.meshes[type]});
+            }
+        }
+    }
+}
+
+VoxelWorld::Statistics VoxelWorld::statistics() const {
+    int meshedChunks = 0;
+    qint64 triangles = 0;
+    for (const auto &entry : mChunks) {
+        if (entry.second.triangles > 0) {
+            ++meshedChunks;
+            triangles += entry.second.triangles;
+        }
+    }
+    return Statistics{
+            static_cast<int>(mChunks.size()),
+            meshedChunks,
+            mPending,
+            mMaxPending,
+            mPendingSum,
+            mUpdates,
+            mBuilds,
+            mRemeshes,
+            mDropped,
+            mBuildNs,
+            mLatencyNs,
+            mMaxLatencyNs,
+            mUploads,
+            triangles
+    };
+}
+
+void VoxelWorld::logStatistics() const {
+    const Statistics &statistics = this->statistics();
+    qDebug() << "Voxel world:" << statistics.loadedChunks << "chunks," << statistics.meshedChunks << "with faces,"
+             << statistics.trianglesPerChunk() << "triangles per chunk," << statistics.pending << "builds pending,"
+             << static_cast<double>(statistics.latencyNs) / std::max<qint64>(statistics.uploads, 1) / 1e6
+             << "ms average latency";
+    mArena.logStatistics();
+}
@@ -0,0 +1,175 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#ifndef GLTUT2_VOXELWORLD_H
+#define GLTUT2_VOXELWORLD_H
+
+#include "MeshArena.h"
+#include "VertexLayout.h"
+#include <array>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <QElapsedTimer>
+#include <QMatrix4x4>
+#include <QMutex>
+#include <QThreadPool>
+#include <QVector3D>
+#include <QtGui/qopengl.h>
+
+class QOpenGLFunctions_4_5_Core;
+
+// Block world split into chunks of chunkSize^3 blocks that stream in and out around a focus
+// point. Chunks are generated and greedy meshed on a worker pool: the visible faces of each
+// slice are merged into the largest rectangles of one block type, with texture coordinates in
+// blocks so the repeating material textures tile once per block, like the faces of the cube.
+// A chunk is only meshed again once setBlock() marks it dirty, and a result that an edit
+// overtook is dropped. update() uploads a few finished meshes per frame into a MeshArena, one
+// mesh per block type, so each draws with its own material.
+class VoxelWorld {
+public:
+    typedef quint8 Block;
+    static constexpr int chunkSize = 32;
+    static constexpr Block air = 0;
+    static constexpr Block grass = 1;
+    static constexpr Block dirt = 2;
+    static constexpr Block stone = 3;
+    static constexpr int blockTypes = 3;
+
+    struct Coord {
+        int x;
+        int y;
+        int z;
+
+        bool operator==(const Coord &other) const { return x == other.x && y == other.y && z == other.z; }
+        bool operator!=(const Coord &other) const { return !(*this == other); }
+    };
+
+    struct Draw {
+        QVector3D origin;
+        Block block;
+        MeshArena::Handle mesh;
+    };
+
+    struct Statistics {
+        int loadedChunks;
+        int meshedChunks;
+        // Builds submitted to the pool and not yet uploaded or dropped.
+        int pending;
+        int maxPending;
+        // Sum of pending over every update(), for the average queue depth.
+        qint64 pendingSum;
+        int updates;
+        qint64 builds;
+        qint64 remeshes;
+        qint64 dropped;
+        qint64 buildNs;
+        // From the chunk coming into range, or its first edit, to its mesh being uploaded.
+        qint64 latencyNs;
+        qint64 maxLatencyNs;
+        qint64 uploads;
+        qint64 triangles;
+
+        double trianglesPerChunk() const;
+        double averagePending() const;
+    };
+
+    explicit VoxelWorld(QOpenGLFunctions_4_5_Core *functions, int viewRadius = 4, int uploadsPerFrame = 8);
+    ~VoxelWorld();
+    VoxelWorld(const VoxelWorld &) = delete;
+    VoxelWorld &operator=(const VoxelWorld &) = delete;
+
+    void create();
+    void destroy();
+
+    // Chunks within viewRadius chunks of the focus, horizontally, are requested nearest first;
+    // chunks more than one chunk beyond it are unloaded. Cheap while the focus stays in one chunk.
+    void setFocus(const QVector3D &position);
+    void setViewRadius(int viewRadius);
+    // Uploads finished meshes and submits dirty chunks; call once per frame.
+    void update();
+
+    Block block(int x, int y, int z) const;
+    // Returns false when the chunk holding the block is not loaded yet.
+    bool setBlock(int x, int y, int z, Block block);
+    // Steps through the blocks along a normalized direction and returns the first solid one.
+    bool raycast(const QVector3D &origin, const QVector3D &direction, float distance, Coord &hit) const;
+
+    // Appends one draw per block type of every chunk whose bounds intersect the frustum.
+    void collect(const QMatrix4x4 &projView, std::vector<Draw> &draws) const;
+    const MeshArena::Mesh &mesh(MeshArena::Handle handle) const { return mArena.mesh(handle); }
+    void attach(GLuint vertexArray, GLuint binding) { mArena.attach(vertexArray, binding); }
+    const VertexLayout &layout() const { return mLayout; }
+
+    Statistics statistics() const;
+    void logStatistics() const;
+
+private:
+    typedef std::vector<Block> Blocks;
+
+    struct CoordHash {
+        std::size_t operator()(const Coord &coord) const;
+    };
+
+    struct Chunk {
+        std::shared_ptr<const Blocks> blocks;
+        std::array<MeshArena::Handle, blockTypes> meshes;
+        qint64 triangles;
+        // Bumped by every edit of this chunk or a neighbor's boundary; results must match it.
+        quint64 version;
+        // Build in flight for this chunk, 0 when none.
+        quint64 job;
+        bool dirty;
+        qint64 requestedNs;
+    };
+
+    struct Built {
+        Coord coord;
+        quint64 job;
+        quint64 version;
+        std::shared_ptr<const Blocks> blocks;
+        std::array<VertexLayout::PackedMesh, blockTypes> meshes;
+        std::array<GLsizei, blockTypes> vertexCounts;
+        qint64 buildNs;
+    };
+
+    void stream();
+    void submit(const Coord &coord, Chunk &chunk);
+    void markDirty(const Coord &coord);
+    bool upload(Built &built);
+    void release(Chunk &chunk);
+    static Built build(const Coord &coord, std::shared_ptr<const Blocks> blocks,
+                       const std::array<std::shared_ptr<const Blocks>, 6> &neighbors, const VertexLayout &layout);
+
+    const VertexLayout mLayout;
+    MeshArena mArena;
+    QThreadPool mPool;
+    QElapsedTimer mClock;
+    std::unordered_map<Coord, Chunk, CoordHash> mChunks;
+    std::vector<Coord> mDirty;
+    Coord mFocus;
+    bool mFocused;
+    int mViewRadius;
+    const int mUploadsPerFrame;
+    quint64 mCounter;
+
+    QMutex mBuiltMutex;
+    std::vector<Built> mBuilt;
+    std::deque<Built> mReady;
+
+    int mPending;
+    int mMaxPending;
+    qint64 mPendingSum;
+    int mUpdates;
+    qint64 mBuilds;
+    qint64 mRemeshes;
+    qint64 mDropped;
+    qint64 mBuildNs;
+    qint64 mLatencyNs;
+    qint64 mMaxLatencyNs;
+    qint64 mUploads;
+};
+
+#endif //GLTUT2_VOXELWORLD_H
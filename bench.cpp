@@ -0,0 +1,798 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "JobSystem.h"
+#include "OffsetAllocator.h"
+#include "ShaderVariants.h"
+#include "TransformBatch.h"
+#include "TutorialWindow.h"
+#include "VertexLayout.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <vector>
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_4_5_Core>
+#include <QOpenGLShaderProgram>
+#include <QThread>
+#include <QTextStream>
+#include <QtMath>
+
+namespace {
+    constexpr float frameStep = 1.0f / 60.0f;
+
+    double percentile(const std::vector<double> &sorted, double fraction) {
+        const auto rank = static_cast<std::size_t>(std::ceil(fraction * sorted.size()));
+        return sorted[std::max<std::size_t>(rank, 1) - 1];
+    }
+
+    void moveCamera(TutorialWindow &window, int frame) {
+        const float time = frame * frameStep;
+        const float angle = time * 0.5f;
+        const float radius = 8.0f + 2.0f * std::sin(time * 0.25f);
+        const QVector3D position(radius * std::cos(angle), 1.5f * std::sin(time * 0.75f), radius * std::sin(angle) - 5.0f);
+        const float yaw = qRadiansToDegrees(angle) + 180.0f;
+        window.setFixedTime(time);
+        window.setCamera(position, yaw, 0.0f);
+    }
+
+    // Flies across the voxel world looking down at the ground, about a chunk every two seconds.
+    void moveVoxelCamera(TutorialWindow &window, int frame) {
+        const float time = frame * frameStep;
+        const QVector3D position(16.0f * time, 0.0f, 8.0f * std::sin(time * 0.5f));
+        window.setFixedTime(time);
+        window.setCamera(position, 0.0f, 30.0f);
+    }
+
+    void fillBatch(TransformBatch &batch, std::size_t count) {
+        batch.resize(count);
+        batch.setAxis(QVector3D(1.0f, 0.3f, 0.5f));
+        for (std::size_t i = 0; i < count; ++i) {
+            batch.setPosition(i, QVector3D(i % 97 - 48.0f, i % 89 - 44.0f, -static_cast<float>(i % 101)));
+            batch.angles()[i] = 20.0f * i;
+        }
+    }
+
+    QMatrix4x4 benchProjView() {
+        QMatrix4x4 projView;
+        projView.perspective(45.0f, 4.0f / 3.0f, 0.1f, 100.0f);
+        projView.translate(0.0f, 0.0f, -3.0f);
+        return projView;
+    }
+
+    void benchmarkTransforms(std::size_t count, int iterations, QTextStream &out) {
+        TransformBatch batch;
+        fillBatch(batch, count);
+        const QMatrix4x4 &projView = benchProjView();
+        std::vector<float> models(count * 16);
+        std::vector<float> mvps(count * 16);
+        QElapsedTimer timer;
+
+        const auto report = [&out, count, iterations](const char *name, qint64 elapsedNs) {
+            out << "transform_" << name << "_ns_per_object: "
+                << static_cast<double>(elapsedNs) / (static_cast<double>(count) * iterations) << "\n";
+        };
+
+        timer.start();
+        for (int iteration = 0; iteration < iterations; ++iteration) {
+            for (std::size_t i = 0; i < count; ++i) {
+                QMatrix4x4 model;
+                model.translate(batch.position(i));
+                model.rotate(batch.angles()[i], 1.0f, 0.3f, 0.5f);
+                const QMatrix4x4 &mvp = projView * model;
+                std::copy_n(model.constData(), 16, models.begin() + i * 16);
+                std::copy_n(mvp.constData(), 16, mvps.begin() + i * 16);
+            }
+        }
+        report("qmatrix", timer.nsecsElapsed());
+
+        for (int isa = TransformBatch::Scalar; isa <= TransformBatch::bestIsa(); ++isa) {
+            batch.setIsa(static_cast<TransformBatch::Isa>(isa));
+            timer.start();
+            for (int iteration = 0; iteration < iterations; ++iteration) {
+                batch.compute(projView, models.data(), mvps.data());
+            }
+            report(TransformBatch::isaName(batch.isa()), timer.nsecsElapsed());
+        }
+    }
+
+    // Runs the same update as TutorialWindow on 1..maxWorkers workers and checks that every
+    // worker count produces bit-identical matrices.
+    void benchmarkScaling(std::size_t count, int iterations, int maxWorkers, QTextStream &out) {
+        TransformBatch batch;
+        fillBatch(batch, count);
+        const QMatrix4x4 &projView = benchProjView();
+        std::vector<float> reference;
+        std::vector<float> models(count * 16);
+        std::vector<float> mvps(count * 16);
+        double singleWorkerMs = 0.0;
+        QElapsedTimer timer;
+        for (int workers = 1; workers <= maxWorkers; ++workers) {
+            JobSystem jobs(workers);
+            const quint64 stealsBefore = jobs.steals();
+            timer.start();
+            for (int iteration = 0; iteration < iterations; ++iteration) {
+                const float time = iteration * frameStep;
+                const auto update = [&batch, &projView, &models, &mvps, time](std::size_t begin, std::size_t end) {
+                    float *angles = batch.angles();
+                    for (std::size_t i = begin; i < end; ++i) {
+                        angles[i] = 20.0f * i + time * 50.0f;
+                    }
+                    batch.compute(projView, models.data(), mvps.data(), begin, end - begin);
+                };
+                jobs.parallelFor(count, 1024, update);
+            }
+            const double elapsedMs = static_cast<double>(timer.nsecsElapsed()) / 1e6 / iterations;
+            if (workers == 1) {
+                singleWorkerMs = elapsedMs;
+                reference = mvps;
+            }
+            const bool identical = std::memcmp(reference.data(), mvps.data(), mvps.size() * sizeof(float)) == 0;
+            out << "workers: " << workers
+                << " update_ms: " << elapsedMs
+                << " speedup: " << singleWorkerMs / elapsedMs
+                << " steals_per_frame: " << static_cast<double>(jobs.steals() - stealsBefore) / iterations
+                << " deterministic: " << (identical ? "yes" : "no") << "\n";
+        }
+    }
+
+    // UV sphere with (rings + 1) * (segments + 1) vertices, dense enough to be vertex bound.
+    void makeSphere(int rings, int segments, std::vector<MeshVertex> &vertices, std::vector<GLuint> &indices) {
+        vertices.clear();
+        indices.clear();
+        for (int ring = 0; ring <= rings; ++ring) {
+            const float v = static_cast<float>(ring) / rings;
+            const float theta = v * static_cast<float>(M_PI);
+            for (int segment = 0; segment <= segments; ++segment) {
+                const float u = static_cast<float>(segment) / segments;
+                const float phi = u * 2.0f * static_cast<float>(M_PI);
+                const QVector3D normal(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+                vertices.push_back(MeshVertex{normal * 0.9f, QVector2D(u, v), normal});
+            }
+        }
+        const auto row = static_cast<GLuint>(segments + 1);
+        for (GLuint ring = 0; ring < static_cast<GLuint>(rings); ++ring) {
+            for (GLuint segment = 0; segment < static_cast<GLuint>(segments); ++segment) {
+                const GLuint first = ring * row + segment;
+                indices.insert(indices.end(), {first, first + row, first + 1, first + 1, first + row, first + row + 1});
+            }
+        }
+    }
+
+    // Draws dense spheres in every vertex layout into a small framebuffer and times them with
+    // GPU queries, so the numbers reflect vertex fetch rather than fill rate.
+    bool benchmarkVertexFetch(int iterations, QTextStream &out) {
+        QSurfaceFormat format;
+        format.setMajorVersion(4);
+        format.setMinorVersion(5);
+        format.setProfile(QSurfaceFormat::CoreProfile);
+        QOpenGLContext context;
+        context.setFormat(format);
+        QOffscreenSurface surface;
+        surface.setFormat(format);
+        surface.create();
+        if (!context.create() || !surface.isValid() || !context.makeCurrent(&surface)) {
+            return false;
+        }
+        auto *functions = context.versionFunctions<QOpenGLFunctions_4_5_Core>();
+        if (functions == nullptr || !functions->initializeOpenGLFunctions()) {
+            return false;
+        }
+
+        QOpenGLShaderProgram program;
+        program.addShaderFromSourceFile(QOpenGLShader::Vertex, QStringLiteral(":/shaders/meshbench.vert"));
+        program.addShaderFromSourceFile(QOpenGLShader::Fragment, QStringLiteral(":/shaders/meshbench.frag"));
+        if (!program.link()) {
+            return false;
+        }
+        program.bind();
+        QMatrix4x4 transform;
+        transform.perspective(45.0f, 1.0f, 0.1f, 10.0f);
+        transform.translate(0.0f, 0.0f, -3.0f);
+        program.setUniformValue("transform", transform);
+
+        constexpr GLsizei framebufferSize = 256;
+        GLuint framebuffer = 0;
+        std::array<GLuint, 2> renderbuffers{};
+        functions->glCreateFramebuffers(1, &framebuffer);
+        functions->glCreateRenderbuffers(static_cast<GLsizei>(renderbuffers.size()), renderbuffers.data());
+        functions->glNamedRenderbufferStorage(renderbuffers[0], GL_RGBA8, framebufferSize, framebufferSize);
+        functions->glNamedRenderbufferStorage(renderbuffers[1], GL_DEPTH_COMPONENT24, framebufferSize, framebufferSize);
+        functions->glNamedFramebufferRenderbuffer(framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        functions->glNamedFramebufferRenderbuffer(framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        functions->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        functions->glViewport(0, 0, framebufferSize, framebufferSize);
+        functions->glEnable(GL_DEPTH_TEST);
+        functions->glEnable(GL_CULL_FACE);
+        GLuint query = 0;
+        functions->glCreateQueries(GL_TIME_ELAPSED, 1, &query);
+
+        struct Case {
+            int rings;
+            bool shortIndices;
+        };
+        // 255 x 255 segments is exactly 65536 vertices, the largest mesh 16-bit indices can address.
+        const std::array<Case, 3> cases{{{255, true}, {255, false}, {511, true}}};
+        std::vector<MeshVertex> vertices;
+        std::vector<GLuint> indices;
+        for (const Case &meshCase : cases) {
+            makeSphere(meshCase.rings, meshCase.rings, vertices, indices);
+            for (const VertexLayout::Preset preset : {VertexLayout::Full, VertexLayout::Half, VertexLayout::Compact}) {
+                const VertexLayout layout(preset);
+                const VertexLayout::PackedMesh &mesh = layout.pack(vertices.data(), vertices.size(), indices.data(),
+                                                                   indices.size(), meshCase.shortIndices);
+                GLuint vertexArray = 0;
+                std::array<GLuint, 2> buffers{};
+                functions->glCreateVertexArrays(1, &vertexArray);
+                functions->glCreateBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+                functions->glNamedBufferStorage(buffers[0], static_cast<GLsizeiptr>(mesh.vertices.size()), mesh.vertices.data(), 0);
+                functions->glNamedBufferStorage(buffers[1], static_cast<GLsizeiptr>(mesh.indices.size()), mesh.indices.data(), 0);
+                layout.apply(functions, vertexArray, 0);
+                functions->glVertexArrayVertexBuffer(vertexArray, 0, buffers[0], 0, layout.stride());
+                functions->glVertexArrayElementBuffer(vertexArray, buffers[1]);
+                functions->glBindVertexArray(vertexArray);
+                program.setUniformValue("positionScale", mesh.positionScale);
+                program.setUniformValue("octahedralNormals", layout.octahedralNormals());
+
+                functions->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                functions->glDrawElements(GL_TRIANGLES, mesh.indexCount, mesh.indexType, nullptr);
+                functions->glFinish();
+                functions->glBeginQuery(GL_TIME_ELAPSED, query);
+                for (int iteration = 0; iteration < iterations; ++iteration) {
+                    functions->glClear(GL_DEPTH_BUFFER_BIT);
+                    functions->glDrawElements(GL_TRIANGLES, mesh.indexCount, mesh.indexType, nullptr);
+                }
+                functions->glEndQuery(GL_TIME_ELAPSED);
+                GLuint64 elapsedNs = 0;
+                functions->glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsedNs);
+                const double drawMs = static_cast<double>(elapsedNs) / 1e6 / iterations;
+
+                out << "vertex_layout: " << VertexLayout::presetName(preset)
+                    << " vertices: " << static_cast<qulonglong>(vertices.size())
+                    << " index_bits: " << (mesh.indexType == GL_UNSIGNED_SHORT ? 16 : 32)
+                    << " vertex_kib: " << static_cast<double>(mesh.vertices.size()) / 1024.0
+                    << " index_kib: " << static_cast<double>(mesh.indices.size()) / 1024.0
+                    << " gpu_ms_per_draw: " << drawMs
+                    << " mindices_per_s: " << mesh.indexCount / drawMs / 1e3 << "\n";
+
+                functions->glBindVertexArray(0);
+                functions->glDeleteVertexArrays(1, &vertexArray);
+                functions->glDeleteBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+            }
+        }
+
+        functions->glDeleteQueries(1, &query);
+        functions->glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        functions->glDeleteFramebuffers(1, &framebuffer);
+        functions->glDeleteRenderbuffers(static_cast<GLsizei>(renderbuffers.size()), renderbuffers.data());
+        program.removeAllShaders();
+        context.doneCurrent();
+        return true;
+    }
+
+    // Fills a 1080p framebuffer with one material through every variant of the scene's fragment
+    // shader and times them with GPU queries, so the difference is the fragment cost of the variant.
+    bool benchmarkVariants(int iterations, QTextStream &out) {
+        QSurfaceFormat format;
+        format.setMajorVersion(4);
+        format.setMinorVersion(5);
+        format.setProfile(QSurfaceFormat::CoreProfile);
+        QOpenGLContext context;
+        context.setFormat(format);
+        QOffscreenSurface surface;
+        surface.setFormat(format);
+        surface.create();
+        if (!context.create() || !surface.isValid() || !context.makeCurrent(&surface)) {
+            return false;
+        }
+        auto *functions = context.versionFunctions<QOpenGLFunctions_4_5_Core>();
+        if (functions == nullptr || !functions->initializeOpenGLFunctions()) {
+            return false;
+        }
+
+        // No program cache, so every variant is really compiled.
+        ShaderVariants variants(functions);
+        if (!variants.create(nullptr, &context, {
+                {QOpenGLShader::Vertex, QStringLiteral(":/shaders/variantbench.vert")},
+                {QOpenGLShader::Fragment, QStringLiteral(":/shaders/fragment.glsl")}
+        })) {
+            return false;
+        }
+        QElapsedTimer timer;
+        timer.start();
+        for (const char *feature : {"BASE_ONLY", "DETAIL_ONLY"}) {
+            variants.compile(variants.feature(feature));
+        }
+        variants.finish();
+        const qint64 compileNs = timer.nsecsElapsed();
+
+        constexpr GLsizei width = 1920;
+        constexpr GLsizei height = 1080;
+        constexpr GLsizei layerSize = 512;
+        GLuint framebuffer = 0;
+        GLuint renderbuffer = 0;
+        functions->glCreateFramebuffers(1, &framebuffer);
+        functions->glCreateRenderbuffers(1, &renderbuffer);
+        functions->glNamedRenderbufferStorage(renderbuffer, GL_RGBA8, width, height);
+        functions->glNamedFramebufferRenderbuffer(framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+        functions->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        functions->glViewport(0, 0, width, height);
+
+        // Two layers of noise, so neither fetch is served by a trivially compressible pattern.
+        std::vector<quint32> texels(static_cast<std::size_t>(layerSize) * layerSize * 2);
+        std::mt19937 generator(0x67746c32u);
+        std::generate(texels.begin(), texels.end(), [&generator]() { return static_cast<quint32>(generator()); });
+        GLuint texture = 0;
+        functions->glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture);
+        functions->glTextureStorage3D(texture, 1, GL_RGBA8, layerSize, layerSize, 2);
+        functions->glTextureSubImage3D(texture, 0, 0, 0, 0, layerSize, layerSize, 2, GL_RGBA, GL_UNSIGNED_BYTE,
+                                       texels.data());
+        functions->glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        functions->glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        functions->glBindTextureUnit(0, texture);
+        const MaterialLibrary::Material material{0, 1, 0.5f, 0.0f, {1.0f, 1.0f, 1.0f, 1.0f}};
+        GLuint materialBuffer = 0;
+        functions->glCreateBuffers(1, &materialBuffer);
+        functions->glNamedBufferStorage(materialBuffer, sizeof(material), &material, 0);
+        functions->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, materialBuffer);
+        GLuint vertexArray = 0;
+        functions->glCreateVertexArrays(1, &vertexArray);
+        functions->glBindVertexArray(vertexArray);
+        GLuint query = 0;
+        functions->glCreateQueries(GL_TIME_ELAPSED, 1, &query);
+
+        out << "shader_variants_parallel: " << (variants.parallel() ? "yes" : "no") << "\n"
+            << "shader_variants_compile_ms: " << static_cast<double>(compileNs) / 1e6 << "\n";
+        for (std::size_t i = 0; i < variants.variantCount(); ++i) {
+            QOpenGLShaderProgram *program = variants.variantProgram(i);
+            if (program == nullptr) {
+                continue;
+            }
+            functions->glUseProgram(program->programId());
+            functions->glProgramUniform1f(program->programId(), program->uniformLocation("mixBalance"), 0.5f);
+            functions->glDrawArrays(GL_TRIANGLES, 0, 3);
+            functions->glFinish();
+            functions->glBeginQuery(GL_TIME_ELAPSED, query);
+            for (int iteration = 0; iteration < iterations; ++iteration) {
+                functions->glDrawArrays(GL_TRIANGLES, 0, 3);
+            }
+            functions->glEndQuery(GL_TIME_ELAPSED);
+            GLuint64 elapsedNs = 0;
+            functions->glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsedNs);
+            const double drawMs = static_cast<double>(elapsedNs) / 1e6 / iterations;
+
+            out << "shader_variant: " << variants.name(variants.variantFeatures(i))
+                << " gpu_ms_per_draw: " << drawMs
+                << " gpixels_per_s: " << static_cast<double>(width) * height / drawMs / 1e6 << "\n";
+        }
+
+        functions->glDeleteQueries(1, &query);
+        functions->glBindVertexArray(0);
+        functions->glDeleteVertexArrays(1, &vertexArray);
+        functions->glDeleteBuffers(1, &materialBuffer);
+        functions->glDeleteTextures(1, &texture);
+        functions->glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        functions->glDeleteFramebuffers(1, &framebuffer);
+        functions->glDeleteRenderbuffers(1, &renderbuffer);
+        variants.destroy();
+        context.doneCurrent();
+        return true;
+    }
+
+    // Churns a mesh arena sized vertex range with meshes from a few dozen to 64k vertices: every
+    // iteration frees a tenth of the live meshes and refills the range, like streaming levels of detail.
+    void benchmarkArena(int iterations, QTextStream &out) {
+        constexpr std::uint32_t capacity = 1u << 24;
+        OffsetAllocator allocator(capacity);
+        std::mt19937 generator(0x67746c32u);
+        std::uniform_real_distribution<float> logSize(std::log2(24.0f), std::log2(65536.0f));
+        std::vector<OffsetAllocator::Node> live;
+        qint64 allocateNs = 0;
+        qint64 freeNs = 0;
+        qint64 allocations = 0;
+        qint64 frees = 0;
+        int failed = 0;
+        int fragmentedFailures = 0;
+        QElapsedTimer timer;
+        const auto fill = [&]() {
+            for (;;) {
+                const auto size = static_cast<std::uint32_t>(std::exp2(logSize(generator)));
+                timer.start();
+                const OffsetAllocator::Allocation &allocation = allocator.allocate(size);
+                allocateNs += timer.nsecsElapsed();
+                if (allocation.node == OffsetAllocator::invalidNode) {
+                    ++failed;
+                    const OffsetAllocator::Statistics &statistics = allocator.statistics();
+                    fragmentedFailures += statistics.capacity - statistics.used >= size ? 1 : 0;
+                    return;
+                }
+                ++allocations;
+                live.push_back(allocation.node);
+            }
+        };
+        fill();
+        for (int iteration = 0; iteration < iterations; ++iteration) {
+            std::shuffle(live.begin(), live.end(), generator);
+            const std::size_t keep = live.size() - live.size() / 10;
+            timer.start();
+            for (std::size_t i = keep; i < live.size(); ++i) {
+                allocator.free(live[i]);
+            }
+            freeNs += timer.nsecsElapsed();
+            frees += static_cast<qint64>(live.size() - keep);
+            live.resize(keep);
+            fill();
+        }
+        const OffsetAllocator::Statistics &statistics = allocator.statistics();
+        out << "arena_meshes: " << statistics.allocations << "\n"
+            << "arena_allocate_ns: " << static_cast<double>(allocateNs) / std::max<qint64>(allocations + failed, 1) << "\n"
+            << "arena_free_ns: " << static_cast<double>(freeNs) / std::max<qint64>(frees, 1) << "\n"
+            << "arena_occupancy: " << statistics.occupancy() << "\n"
+            << "arena_fragmentation: " << statistics.fragmentation() << "\n"
+            << "arena_free_blocks: " << statistics.freeBlocks << "\n"
+            << "arena_failures_fixed_by_compaction: " << fragmentedFailures << " of " << failed << "\n";
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const QApplication application(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("gltut2-bench"));
+    QCoreApplication::setApplicationVersion(QStringLiteral("1.0"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral(
+            "Renders a fixed number of frames offscreen along a deterministic camera path "
+            "and reports frame times. Run with -platform offscreen on machines without a display."));
+    parser.addHelpOption();
+    parser.addVersionOption();
+    const QCommandLineOption framesOption(QStringLiteral("frames"), QStringLiteral("Number of measured frames."),
+                                          QStringLiteral("count"), QStringLiteral("600"));
+    parser.addOption(framesOption);
+    const QCommandLineOption warmupOption(QStringLiteral("warmup"), QStringLiteral("Number of unmeasured frames."),
+                                          QStringLiteral("count"), QStringLiteral("30"));
+    parser.addOption(warmupOption);
+    const QCommandLineOption widthOption(QStringLiteral("width"), QStringLiteral("Framebuffer width."),
+                                         QStringLiteral("pixels"), QStringLiteral("800"));
+    parser.addOption(widthOption);
+    const QCommandLineOption heightOption(QStringLiteral("height"), QStringLiteral("Framebuffer height."),
+                                          QStringLiteral("pixels"), QStringLiteral("600"));
+    parser.addOption(heightOption);
+    const QCommandLineOption instancedOption(QStringLiteral("instanced"),
+                                             QStringLiteral("Draw all objects with a single instanced call."));
+    parser.addOption(instancedOption);
+    const QCommandLineOption instancesOption(QStringLiteral("instances"),
+                                             QStringLiteral("Number of objects in the scene."),
+                                             QStringLiteral("count"), QStringLiteral("10"));
+    parser.addOption(instancesOption);
+    const QCommandLineOption profileOption(QStringLiteral("profile"),
+                                           QStringLiteral("Record frame phases and write them as CSV or Chrome trace JSON."),
+                                           QStringLiteral("file"));
+    parser.addOption(profileOption);
+    const QCommandLineOption transformOption(QStringLiteral("transform-bench"),
+                                             QStringLiteral("Time the CPU transform kernels without rendering."));
+    parser.addOption(transformOption);
+    const QCommandLineOption workersOption(QStringLiteral("workers"),
+                                           QStringLiteral("Number of scene update workers, 0 for one per core."),
+                                           QStringLiteral("count"), QStringLiteral("0"));
+    parser.addOption(workersOption);
+    const QCommandLineOption noCullingOption(QStringLiteral("no-culling"),
+                                             QStringLiteral("Draw every object instead of frustum culling them."));
+    parser.addOption(noCullingOption);
+    const QCommandLineOption gpuDrivenOption(QStringLiteral("gpu-driven"),
+                                             QStringLiteral("Cull on the GPU and draw the scene with one indirect call."));
+    parser.addOption(gpuDrivenOption);
+    const QCommandLineOption noOcclusionOption(QStringLiteral("no-occlusion"),
+                                               QStringLiteral("Skip Hi-Z occlusion culling in GPU-driven mode."));
+    parser.addOption(noOcclusionOption);
+    const QCommandLineOption scalingOption(QStringLiteral("scaling-bench"),
+                                           QStringLiteral("Time the scene update on 1 to --workers workers without rendering."));
+    parser.addOption(scalingOption);
+    const QCommandLineOption vertexBenchOption(QStringLiteral("vertex-bench"),
+                                               QStringLiteral("Time vertex fetch of dense meshes in every vertex layout."));
+    parser.addOption(vertexBenchOption);
+    const QCommandLineOption variantBenchOption(QStringLiteral("variant-bench"),
+                                                QStringLiteral("Time the fragment cost of every shader variant at 1080p."));
+    parser.addOption(variantBenchOption);
+    const QCommandLineOption arenaBenchOption(QStringLiteral("arena-bench"),
+                                              QStringLiteral("Time mesh arena allocation under churn and report its fragmentation."));
+    parser.addOption(arenaBenchOption);
+    const QCommandLineOption vertexLayoutOption(QStringLiteral("vertex-layout"),
+                                                QStringLiteral("Mesh vertex layout: full, half or compact."),
+                                                QStringLiteral("layout"), QStringLiteral("compact"));
+    parser.addOption(vertexLayoutOption);
+    const QCommandLineOption meshOption(QStringLiteral("mesh"),
+                                        QStringLiteral("Draw a mesh converted by gltut2-meshconv instead of the cube."),
+                                        QStringLiteral("file"));
+    parser.addOption(meshOption);
+    const QCommandLineOption lodThresholdOption(QStringLiteral("lod-threshold"),
+                                                QStringLiteral("Largest screen-space error of a level of detail, in pixels."),
+                                                QStringLiteral("pixels"), QStringLiteral("1.0"));
+    parser.addOption(lodThresholdOption);
+    const QCommandLineOption builtinTexturesOption(QStringLiteral("builtin-textures"),
+                                                   QStringLiteral("Decode the images in the resources instead of loading converted textures."));
+    parser.addOption(builtinTexturesOption);
+    const QCommandLineOption voxelsOption(QStringLiteral("voxels"),
+                                          QStringLiteral("Fly through a streamed voxel world instead of drawing the objects."));
+    parser.addOption(voxelsOption);
+    const QCommandLineOption voxelRadiusOption(QStringLiteral("voxel-radius"),
+                                               QStringLiteral("Chunks loaded around the camera in the voxel world."),
+                                               QStringLiteral("chunks"), QStringLiteral("4"));
+    parser.addOption(voxelRadiusOption);
+    const QCommandLineOption voxelDigOption(QStringLiteral("voxel-dig-interval"),
+                                            QStringLiteral("Dig the block under the crosshair every this many frames, 0 never."),
+                                            QStringLiteral("frames"), QStringLiteral("0"));
+    parser.addOption(voxelDigOption);
+    const QCommandLineOption captureOption(QStringLiteral("capture"),
+                                           QStringLiteral("Record frames without stalling: a .y4m file, or a directory of PNG files."),
+                                           QStringLiteral("path"));
+    parser.addOption(captureOption);
+    const QCommandLineOption antialiasingOption(QStringLiteral("aa"),
+                                                QStringLiteral("Scene anti-aliasing: off, msaa2, msaa4, msaa8 or fxaa."),
+                                                QStringLiteral("mode"), QStringLiteral("msaa4"));
+    parser.addOption(antialiasingOption);
+    const QCommandLineOption renderScaleOption(QStringLiteral("render-scale"),
+                                               QStringLiteral("Scene resolution relative to the window, 0.5 to 1."),
+                                               QStringLiteral("scale"), QStringLiteral("1.0"));
+    parser.addOption(renderScaleOption);
+    const QCommandLineOption targetFrameOption(QStringLiteral("target-frame-ms"),
+                                               QStringLiteral("Adapt the render scale to this GPU frame time, 0 to keep it fixed."),
+                                               QStringLiteral("ms"), QStringLiteral("0"));
+    parser.addOption(targetFrameOption);
+    const QCommandLineOption fpsCapOption(QStringLiteral("fps-cap"),
+                                          QStringLiteral("Cap the frame rate, sleeping between frames; 0 for no cap."),
+                                          QStringLiteral("fps"), QStringLiteral("0"));
+    parser.addOption(fpsCapOption);
+    const QCommandLineOption tickRateOption(QStringLiteral("tick-rate"),
+                                            QStringLiteral("Simulation ticks per second; frames interpolate between ticks."),
+                                            QStringLiteral("ticks"), QStringLiteral("60"));
+    parser.addOption(tickRateOption);
+    const QCommandLineOption replayOption(QStringLiteral("replay"),
+                                          QStringLiteral("Drive the camera from input recorded with --record, "
+                                                         "for as many frames as its ticks take."),
+                                          QStringLiteral("file"));
+    parser.addOption(replayOption);
+    parser.process(application);
+
+    const int frames = std::max(parser.value(framesOption).toInt(), 1);
+    const int warmup = std::max(parser.value(warmupOption).toInt(), 0);
+    const int workers = parser.value(workersOption).toInt();
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    if (parser.isSet(transformOption)) {
+        out.setRealNumberNotation(QTextStream::FixedNotation);
+        out.setRealNumberPrecision(3);
+        benchmarkTransforms(static_cast<std::size_t>(std::max(parser.value(instancesOption).toInt(), 1)), frames, out);
+        return 0;
+    }
+    if (parser.isSet(scalingOption)) {
+        out.setRealNumberNotation(QTextStream::FixedNotation);
+        out.setRealNumberPrecision(3);
+        benchmarkScaling(static_cast<std::size_t>(std::max(parser.value(instancesOption).toInt(), 1)), frames,
+                         workers > 0 ? workers : QThread::idealThreadCount(), out);
+        return 0;
+    }
+    if (parser.isSet(vertexBenchOption)) {
+        out.setRealNumberNotation(QTextStream::FixedNotation);
+        out.setRealNumberPrecision(3);
+        if (!benchmarkVertexFetch(frames, out)) {
+            err << "Failed to create an OpenGL 4.5 context\n";
+            return 1;
+        }
+        return 0;
+    }
+    if (parser.isSet(variantBenchOption)) {
+        out.setRealNumberNotation(QTextStream::FixedNotation);
+        out.setRealNumberPrecision(3);
+        if (!benchmarkVariants(frames, out)) {
+            err << "Failed to create an OpenGL 4.5 context\n";
+            return 1;
+        }
+        return 0;
+    }
+    if (parser.isSet(arenaBenchOption)) {
+        out.setRealNumberNotation(QTextStream::FixedNotation);
+        out.setRealNumberPrecision(3);
+        benchmarkArena(frames, out);
+        return 0;
+    }
+    VertexLayout::Preset vertexLayout = VertexLayout::Compact;
+    if (!VertexLayout::fromName(parser.value(vertexLayoutOption), vertexLayout)) {
+        err << "Unknown vertex layout " << parser.value(vertexLayoutOption) << '\n';
+        return 1;
+    }
+    SceneTarget::Antialiasing antialiasing = SceneTarget::Msaa4;
+    if (!SceneTarget::fromName(parser.value(antialiasingOption), antialiasing)) {
+        err << "Unknown anti-aliasing " << parser.value(antialiasingOption) << '\n';
+        return 1;
+    }
+
+    TutorialWindow window;
+    window.resize(parser.value(widthOption).toInt(), parser.value(heightOption).toInt());
+    // Offscreen frames never wait for a refresh, so only a cap sets deadlines.
+    window.setVsync(false);
+    window.setFrameRateCap(parser.value(fpsCapOption).toDouble());
+    window.setInstanced(parser.isSet(instancedOption));
+    window.setInstanceCount(parser.value(instancesOption).toInt());
+    window.setWorkerCount(workers);
+    window.setCulling(!parser.isSet(noCullingOption));
+    window.setGpuDriven(parser.isSet(gpuDrivenOption));
+    window.setOcclusionCulling(!parser.isSet(noOcclusionOption));
+    window.setConvertedTextures(!parser.isSet(builtinTexturesOption));
+    window.setVertexLayout(vertexLayout);
+    window.setLodThreshold(parser.value(lodThresholdOption).toFloat());
+    window.setAntialiasing(antialiasing);
+    window.setRenderScale(parser.value(renderScaleOption).toFloat());
+    window.setTargetFrameMs(parser.value(targetFrameOption).toFloat());
+    const bool voxels = parser.isSet(voxelsOption);
+    const int digInterval = std::max(parser.value(voxelDigOption).toInt(), 0);
+    if (voxels) {
+        window.setVoxelRadius(std::max(parser.value(voxelRadiusOption).toInt(), 1));
+    }
+    if (parser.isSet(meshOption) && !window.setMesh(parser.value(meshOption))) {
+        err << "Failed to load mesh " << parser.value(meshOption) << '\n';
+        return 1;
+    }
+    window.setTickRate(parser.value(tickRateOption).toInt());
+    const bool replay = parser.isSet(replayOption);
+    if (replay && !window.replayInput(parser.value(replayOption))) {
+        err << "Failed to replay " << parser.value(replayOption) << '\n';
+        return 1;
+    }
+    window.profiler().setEnabled(parser.isSet(profileOption));
+    if (parser.isSet(captureOption)) {
+        window.capture().setOutput(parser.value(captureOption));
+    }
+
+    std::vector<double> frameTimes;
+    frameTimes.reserve(static_cast<std::size_t>(frames));
+    QElapsedTimer timer;
+    // A replay runs exactly the recorded ticks, however many frames that takes.
+    for (int frame = 0; replay ? !window.replayFinished() : frame < warmup + frames; ++frame) {
+        if (replay) {
+            // The recording moves the camera; the fixed clock keeps the ticks per frame constant.
+            window.setFixedTime(frame * frameStep);
+        } else if (voxels) {
+            moveVoxelCamera(window, frame);
+            if (digInterval > 0 && frame % digInterval == 0) {
+                window.digVoxel();
+            }
+        } else {
+            moveCamera(window, frame);
+        }
+        timer.start();
+        if (Q_UNLIKELY(!window.renderOffscreen())) {
+            err << "Failed to create an offscreen OpenGL context\n";
+            return 1;
+        }
+        const double elapsedMs = static_cast<double>(timer.nsecsElapsed()) / 1e6;
+        if (frame >= warmup) {
+            frameTimes.push_back(elapsedMs);
+        }
+    }
+    if (Q_UNLIKELY(frameTimes.empty())) {
+        err << "The replay ended during the " << warmup << " warmup frames\n";
+        return 1;
+    }
+    const TextureLoader *textureLoader = window.textureLoader();
+    const qint64 firstFrameNs = textureLoader->firstFrameNs();
+    const qint64 allResidentNs = textureLoader->allResidentNs();
+    const qint64 textureBytes = textureLoader->residentBytes();
+    const GLStateCache *stateCache = window.stateCache();
+    const double stateFrames = std::max(stateCache->frames(), 1);
+    const double issuedPerFrame = stateCache->total().issued / stateFrames;
+    const double skippedPerFrame = stateCache->total().skipped / stateFrames;
+    const Bvh &bvh = window.bvh();
+    const double cullFrames = std::max(bvh.frames(), 1);
+    const GpuCuller *gpuCuller = window.gpuCuller();
+    const double gpuVisiblePerFrame = gpuCuller == nullptr
+            ? 0.0 : static_cast<double>(gpuCuller->visibleTotal()) / std::max(gpuCuller->resolvedFrames(), 1);
+    const StreamBuffer::Statistics streamStatistics = window.streamBuffer()->statistics();
+    const qint64 meshLoadNs = window.meshLoadNs();
+    const MeshArena::Statistics arenaStatistics = window.meshArena() == nullptr
+            ? MeshArena::Statistics{} : window.meshArena()->statistics();
+    const TutorialWindow::LodStatistics lodStatistics = window.lodStatistics();
+    const double lodFrames = std::max(lodStatistics.frames, 1);
+    const VoxelWorld::Statistics voxelStatistics = window.voxelWorld() == nullptr
+            ? VoxelWorld::Statistics{} : window.voxelWorld()->statistics();
+    const double voxelUploads = std::max<qint64>(voxelStatistics.uploads, 1);
+    const SceneTarget::Statistics sceneStatistics = window.sceneTarget()->statistics();
+    const double sceneFrames = std::max(sceneStatistics.frames, 1);
+    const char *sceneAntialiasing = SceneTarget::antialiasingName(window.sceneTarget()->antialiasing());
+    const FrameScheduler::Statistics pacingStatistics = window.scheduler().statistics();
+    const TutorialWindow::SimulationStatistics simulationStatistics = window.simulationStatistics();
+    const ShaderVariants::Statistics variantStatistics = window.shaderVariants()->statistics();
+    const MaterialLibrary *materials = window.materialLibrary();
+    const auto materialCount = materials->materialCount();
+    const GLsizei materialLayers = materials->layerCount();
+    window.deinitializeNow();
+
+    if (parser.isSet(profileOption) && !window.profiler().write(parser.value(profileOption))) {
+        err << "Failed to write profile to " << parser.value(profileOption) << '\n';
+    }
+
+    const FrameCapture::Statistics captureStatistics = window.capture().statistics();
+    const double captureFrames = std::max<qint64>(captureStatistics.frames, 1);
+
+    std::vector<double> sorted(frameTimes);
+    std::sort(sorted.begin(), sorted.end());
+    const double average = std::accumulate(sorted.cbegin(), sorted.cend(), 0.0) / sorted.size();
+
+    out.setRealNumberNotation(QTextStream::FixedNotation);
+    out.setRealNumberPrecision(3);
+    out << "frames: " << static_cast<qulonglong>(frameTimes.size()) << "\n"
+        << "min_ms: " << sorted.front() << "\n"
+        << "avg_ms: " << average << "\n"
+        << "p50_ms: " << percentile(sorted, 0.50) << "\n"
+        << "p95_ms: " << percentile(sorted, 0.95) << "\n"
+        << "p99_ms: " << percentile(sorted, 0.99) << "\n"
+        << "max_ms: " << sorted.back() << "\n"
+        << "first_frame_ms: " << static_cast<double>(firstFrameNs) / 1e6 << "\n"
+        << "textures_resident_ms: " << static_cast<double>(allResidentNs) / 1e6 << "\n"
+        << "texture_kib: " << static_cast<double>(textureBytes) / 1024.0 << "\n"
+        << "mesh_load_ms: " << static_cast<double>(meshLoadNs) / 1e6 << "\n"
+        << "mesh_arena_meshes: " << arenaStatistics.meshes << "\n"
+        << "mesh_arena_vertex_kib: " << static_cast<double>(arenaStatistics.vertices.used) * arenaStatistics.stride / 1024.0 << "\n"
+        << "mesh_arena_occupancy: " << arenaStatistics.vertices.occupancy() << "\n"
+        << "mesh_arena_fragmentation: " << arenaStatistics.vertices.fragmentation() << "\n"
+        << "gl_calls_issued_per_frame: " << issuedPerFrame << "\n"
+        << "gl_calls_skipped_per_frame: " << skippedPerFrame << "\n"
+        << "visible_per_frame: " << bvh.total().visible / cullFrames << "\n"
+        << "culled_per_frame: " << bvh.total().culled / cullFrames << "\n"
+        << "bvh_nodes_per_frame: " << bvh.total().nodesVisited / cullFrames << "\n"
+        << "bvh_box_tests_per_frame: " << bvh.total().boxTests / cullFrames << "\n"
+        << "triangles_full_per_frame: " << lodStatistics.fullTriangles / lodFrames << "\n"
+        << "triangles_drawn_per_frame: " << lodStatistics.drawnTriangles / lodFrames << "\n"
+        << "lod_switches_per_frame: " << lodStatistics.switches / lodFrames << "\n"
+        << "voxel_chunks: " << voxelStatistics.loadedChunks << "\n"
+        << "voxel_builds: " << voxelStatistics.builds << "\n"
+        << "voxel_remeshes: " << voxelStatistics.remeshes << "\n"
+        << "voxel_dropped_builds: " << voxelStatistics.dropped << "\n"
+        << "voxel_build_ms: " << static_cast<double>(voxelStatistics.buildNs) / std::max<qint64>(voxelStatistics.builds - voxelStatistics.pending, 1) / 1e6 << "\n"
+        << "voxel_latency_ms: " << static_cast<double>(voxelStatistics.latencyNs) / voxelUploads / 1e6 << "\n"
+        << "voxel_latency_max_ms: " << static_cast<double>(voxelStatistics.maxLatencyNs) / 1e6 << "\n"
+        << "voxel_pending_avg: " << voxelStatistics.averagePending() << "\n"
+        << "voxel_pending_max: " << voxelStatistics.maxPending << "\n"
+        << "voxel_triangles_per_chunk: " << voxelStatistics.trianglesPerChunk() << "\n"
+        << "aa: " << sceneAntialiasing << "\n"
+        << "render_scale_avg: " << sceneStatistics.scaleSum / sceneFrames << "\n"
+        << "render_scale_min: " << sceneStatistics.minScale << "\n"
+        << "render_scale_changes: " << sceneStatistics.scaleChanges << "\n"
+        << "scene_gpu_ms: " << sceneStatistics.gpuMs / std::max(sceneStatistics.timedFrames, 1) << "\n"
+        << "gpu_visible_per_frame: " << gpuVisiblePerFrame << "\n"
+        << "stream_stalled_frames: " << streamStatistics.stalledFrames << "\n"
+        << "stream_wait_ms: " << static_cast<double>(streamStatistics.waitNs) / 1e6 << "\n"
+        << "stream_reallocations: " << streamStatistics.reallocations << "\n"
+        << "capture_frames: " << captureStatistics.encoded << " of " << captureStatistics.frames << "\n"
+        << "capture_skipped: " << captureStatistics.skipped << "\n"
+        << "capture_ms_per_frame: " << static_cast<double>(captureStatistics.captureNs) / captureFrames / 1e6 << "\n"
+        << "capture_encode_ms_per_frame: "
+        << static_cast<double>(captureStatistics.encodeNs) / std::max<qint64>(captureStatistics.encoded, 1) / 1e6 << "\n"
+        << "capture_mib: " << static_cast<double>(captureStatistics.bytes) / (1024.0 * 1024.0) << "\n"
+        << "sim_ticks: " << simulationStatistics.ticks << "\n"
+        << "sim_ticks_dropped: " << simulationStatistics.droppedTicks << "\n"
+        << "sim_ticks_per_frame_max: " << simulationStatistics.maxTicksPerFrame << "\n"
+        << "sim_tick_us: " << static_cast<double>(simulationStatistics.tickNs) / std::max<qint64>(simulationStatistics.ticks, 1) / 1e3 << "\n"
+        << "pacing_interval_ms: " << pacingStatistics.averageIntervalMs() << "\n"
+        << "pacing_jitter_ms: " << pacingStatistics.jitterMs() << "\n"
+        << "pacing_max_interval_ms: " << static_cast<double>(pacingStatistics.maxIntervalNs) / 1e6 << "\n"
+        << "pacing_missed_frames: " << pacingStatistics.missed << "\n"
+        << "pacing_sleep_ms: " << static_cast<double>(pacingStatistics.sleepNs) / 1e6 << "\n"
+        << "pacing_spin_ms: " << static_cast<double>(pacingStatistics.spinNs) / 1e6 << "\n"
+        << "shader_variants_ready: " << variantStatistics.ready << " of " << variantStatistics.variants << "\n"
+        << "shader_variants_cached: " << variantStatistics.cached << "\n"
+        << "shader_variant_compile_ms: "
+        << static_cast<double>(variantStatistics.compileNs) / std::max(variantStatistics.ready - variantStatistics.cached, 1) / 1e6 << "\n"
+        << "materials: " << materialCount << "\n"
+        << "material_layers: " << materialLayers << "\n";
+
+    return 0;
+}
@@ -1,6 +1,8 @@
 #include "TutorialWindow.h"
+#include <algorithm>
 #include <QOpenGLDebugMessage>
 #include <QApplication>
+#include <QCommandLineParser>
 
 int main(int argc, char *argv[]) {
     const QApplication application(argc, argv);
@@ -9,13 +11,148 @@ int main(int argc, char *argv[]) {
     QCoreApplication::setApplicationName(applicationName);
     QCoreApplication::setApplicationVersion(QStringLiteral("1.0"));
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addVersionOption();
+    const QCommandLineOption instancedOption(QStringLiteral("instanced"),
+                                             QStringLiteral("Draw all objects with a single instanced call."));
+    parser.addOption(instancedOption);
+    const QCommandLineOption instancesOption(QStringLiteral("instances"),
+                                             QStringLiteral("Number of objects in the scene."),
+                                             QStringLiteral("count"), QStringLiteral("10"));
+    parser.addOption(instancesOption);
+    const QCommandLineOption workersOption(QStringLiteral("workers"),
+                                           QStringLiteral("Number of scene update workers, 0 for one per core."),
+                                           QStringLiteral("count"), QStringLiteral("0"));
+    parser.addOption(workersOption);
+    const QCommandLineOption noCullingOption(QStringLiteral("no-culling"),
+                                             QStringLiteral("Draw every object instead of frustum culling them."));
+    parser.addOption(noCullingOption);
+    const QCommandLineOption gpuDrivenOption(QStringLiteral("gpu-driven"),
+                                             QStringLiteral("Cull on the GPU and draw the scene with one indirect call."));
+    parser.addOption(gpuDrivenOption);
+    const QCommandLineOption noOcclusionOption(QStringLiteral("no-occlusion"),
+                                               QStringLiteral("Skip Hi-Z occlusion culling in GPU-driven mode."));
+    parser.addOption(noOcclusionOption);
+    const QCommandLineOption threadedOption(QStringLiteral("threaded"),
+                                            QStringLiteral("Render on a dedicated thread instead of the GUI thread."));
+    parser.addOption(threadedOption);
+    const QCommandLineOption profileOption(QStringLiteral("profile"),
+                                           QStringLiteral("Record frame phases and write them as CSV or Chrome trace JSON."),
+                                           QStringLiteral("file"));
+    parser.addOption(profileOption);
+    const QCommandLineOption vertexLayoutOption(QStringLiteral("vertex-layout"),
+                                                QStringLiteral("Mesh vertex layout: full, half or compact."),
+                                                QStringLiteral("layout"), QStringLiteral("compact"));
+    parser.addOption(vertexLayoutOption);
+    const QCommandLineOption meshOption(QStringLiteral("mesh"),
+                                        QStringLiteral("Draw a mesh converted by gltut2-meshconv instead of the cube."),
+                                        QStringLiteral("file"));
+    parser.addOption(meshOption);
+    const QCommandLineOption lodThresholdOption(QStringLiteral("lod-threshold"),
+                                                QStringLiteral("Largest screen-space error of a level of detail, in pixels."),
+                                                QStringLiteral("pixels"), QStringLiteral("1.0"));
+    parser.addOption(lodThresholdOption);
+    const QCommandLineOption voxelsOption(QStringLiteral("voxels"),
+                                          QStringLiteral("Walk through a streamed voxel world instead of the objects; E digs."));
+    parser.addOption(voxelsOption);
+    const QCommandLineOption voxelRadiusOption(QStringLiteral("voxel-radius"),
+                                               QStringLiteral("Chunks loaded around the camera in the voxel world."),
+                                               QStringLiteral("chunks"), QStringLiteral("4"));
+    parser.addOption(voxelRadiusOption);
+    const QCommandLineOption captureOption(QStringLiteral("capture"),
+                                           QStringLiteral("Record frames without stalling: a .y4m file, or a directory of PNG files."),
+                                           QStringLiteral("path"));
+    parser.addOption(captureOption);
+    const QCommandLineOption antialiasingOption(QStringLiteral("aa"),
+                                                QStringLiteral("Scene anti-aliasing: off, msaa2, msaa4, msaa8 or fxaa."),
+                                                QStringLiteral("mode"), QStringLiteral("msaa4"));
+    parser.addOption(antialiasingOption);
+    const QCommandLineOption renderScaleOption(QStringLiteral("render-scale"),
+                                               QStringLiteral("Scene resolution relative to the window, 0.5 to 1."),
+                                               QStringLiteral("scale"), QStringLiteral("1.0"));
+    parser.addOption(renderScaleOption);
+    const QCommandLineOption targetFrameOption(QStringLiteral("target-frame-ms"),
+                                               QStringLiteral("Adapt the render scale to this GPU frame time, 0 to keep it fixed."),
+                                               QStringLiteral("ms"), QStringLiteral("0"));
+    parser.addOption(targetFrameOption);
+    const QCommandLineOption fpsCapOption(QStringLiteral("fps-cap"),
+                                          QStringLiteral("Cap the frame rate, sleeping between frames; 0 for no cap."),
+                                          QStringLiteral("fps"), QStringLiteral("0"));
+    parser.addOption(fpsCapOption);
+    const QCommandLineOption noVsyncOption(QStringLiteral("no-vsync"),
+                                           QStringLiteral("Present without waiting for the vertical refresh."));
+    parser.addOption(noVsyncOption);
+    const QCommandLineOption tickRateOption(QStringLiteral("tick-rate"),
+                                            QStringLiteral("Simulation ticks per second; frames interpolate between ticks."),
+                                            QStringLiteral("ticks"), QStringLiteral("60"));
+    parser.addOption(tickRateOption);
+    const QCommandLineOption recordOption(QStringLiteral("record"),
+                                          QStringLiteral("Record the simulation input to a file for --replay."),
+                                          QStringLiteral("file"));
+    parser.addOption(recordOption);
+    const QCommandLineOption replayOption(QStringLiteral("replay"),
+                                          QStringLiteral("Drive the camera from input recorded with --record."),
+                                          QStringLiteral("file"));
+    parser.addOption(replayOption);
+    parser.process(application);
+    if (parser.isSet(recordOption) && parser.isSet(replayOption)) {
+        qWarning() << "--record and --replay cannot be combined";
+        return 1;
+    }
+
+    VertexLayout::Preset vertexLayout = VertexLayout::Compact;
+    if (!VertexLayout::fromName(parser.value(vertexLayoutOption), vertexLayout)) {
+        qWarning() << "Unknown vertex layout" << parser.value(vertexLayoutOption);
+    }
+    SceneTarget::Antialiasing antialiasing = SceneTarget::Msaa4;
+    if (!SceneTarget::fromName(parser.value(antialiasingOption), antialiasing)) {
+        qWarning() << "Unknown anti-aliasing" << parser.value(antialiasingOption);
+    }
+
     TutorialWindow window(true);
     window.setTitle(applicationName);
+    window.setThreadedRendering(parser.isSet(threadedOption));
+    window.setVsync(!parser.isSet(noVsyncOption));
+    window.setFrameRateCap(parser.value(fpsCapOption).toDouble());
+    window.setInstanced(parser.isSet(instancedOption));
+    window.setInstanceCount(parser.value(instancesOption).toInt());
+    window.setWorkerCount(parser.value(workersOption).toInt());
+    window.setCulling(!parser.isSet(noCullingOption));
+    window.setGpuDriven(parser.isSet(gpuDrivenOption));
+    window.setOcclusionCulling(!parser.isSet(noOcclusionOption));
+    window.setVertexLayout(vertexLayout);
+    window.setLodThreshold(parser.value(lodThresholdOption).toFloat());
+    window.setAntialiasing(antialiasing);
+    window.setRenderScale(parser.value(renderScaleOption).toFloat());
+    window.setTargetFrameMs(parser.value(targetFrameOption).toFloat());
+    if (parser.isSet(voxelsOption)) {
+        window.setVoxelRadius(std::max(parser.value(voxelRadiusOption).toInt(), 1));
+    }
+    if (parser.isSet(meshOption) && !window.setMesh(parser.value(meshOption))) {
+        qWarning() << "Failed to load mesh" << parser.value(meshOption) << "- drawing the cube instead";
+    }
+    window.setTickRate(parser.value(tickRateOption).toInt());
+    if (parser.isSet(replayOption) && !window.replayInput(parser.value(replayOption))) {
+        qWarning() << "Failed to replay" << parser.value(replayOption) << "- using live input instead";
+    }
+    if (parser.isSet(recordOption)) {
+        window.recordInput(parser.value(recordOption));
+    }
+    window.profiler().setEnabled(parser.isSet(profileOption));
+    if (parser.isSet(captureOption)) {
+        window.capture().setOutput(parser.value(captureOption));
+    }
     QObject::connect(&window, &OpenGLWindow::messageLogged, [](const auto &message){ qDebug() << message; });
     window.resize(800, 600);
     window.show();
 
     window.setAnimation(true);
 
-    return QApplication::exec();
+    const int result = QApplication::exec();
+    window.scheduler().logStatistics();
+    if (parser.isSet(profileOption) && !window.profiler().write(parser.value(profileOption))) {
+        qWarning() << "Failed to write profile to" << parser.value(profileOption);
+    }
+    return result;
 }
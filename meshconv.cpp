@@ -0,0 +1,293 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "MeshFile.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <unordered_map>
+#include <vector>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+
+namespace {
+    typedef std::array<int, 3> Corner;
+
+    struct CornerHash {
+        std::size_t operator()(const Corner &corner) const {
+            return (static_cast<std::size_t>(corner[0]) * 73856093u) ^ (static_cast<std::size_t>(corner[1]) * 19349663u)
+                   ^ (static_cast<std::size_t>(corner[2]) * 83492791u);
+        }
+    };
+
+    struct ObjMesh {
+        std::vector<MeshVertex> vertices;
+        std::vector<GLuint> indices;
+        bool hasNormals;
+    };
+
+    // Resolves a 1-based or negative (relative) OBJ index into a 0-based one, -1 when absent or invalid.
+    int resolveIndex(const char *text, std::size_t count) {
+        if (*text == '\0' || *text == '/') {
+            return -1;
+        }
+        const long index = std::strtol(text, nullptr, 10);
+        const long resolved = index < 0 ? static_cast<long>(count) + index : index - 1;
+        return resolved >= 0 && resolved < static_cast<long>(count) ? static_cast<int>(resolved) : -1;
+    }
+
+    float readFloat(const QList<QByteArray> &fields, int field) {
+        return field < fields.size() ? std::strtof(fields[field].constData(), nullptr) : 0.0f;
+    }
+
+    // Positions, texcoords, normals and polygonal faces (fan triangulated); everything else is ignored.
+    bool parseObj(const QByteArray &data, ObjMesh &mesh, QTextStream &err) {
+        std::vector<QVector3D> positions;
+        std::vector<QVector2D> texCoords;
+        std::vector<QVector3D> normals;
+        std::unordered_map<Corner, GLuint, CornerHash> corners;
+        std::vector<int> positionOfVertex;
+        mesh.hasNormals = true;
+
+        for (const QByteArray &rawLine : data.split('\n')) {
+            const QList<QByteArray> &fields = rawLine.simplified().split(' ');
+            const QByteArray &keyword = fields.first();
+            if (keyword == "v") {
+                positions.emplace_back(readFloat(fields, 1), readFloat(fields, 2), readFloat(fields, 3));
+            } else if (keyword == "vt") {
+                texCoords.emplace_back(readFloat(fields, 1), readFloat(fields, 2));
+            } else if (keyword == "vn") {
+                normals.emplace_back(readFloat(fields, 1), readFloat(fields, 2), readFloat(fields, 3));
+            } else if (keyword == "f") {
+                std::vector<GLuint> face;
+                for (int field = 1; field < fields.size(); ++field) {
+                    const QList<QByteArray> &parts = fields[field].split('/');
+                    const Corner corner{resolveIndex(parts.value(0).constData(), positions.size()),
+                                        resolveIndex(parts.value(1).constData(), texCoords.size()),
+                                        resolveIndex(parts.value(2).constData(), normals.size())};
+                    if (corner[0] < 0) {
+                        err << "Invalid face corner " << fields[field] << '\n';
+                        return false;
+                    }
+                    mesh.hasNormals = mesh.hasNormals && corner[2] >= 0;
+                    const auto inserted = corners.emplace(corner, static_cast<GLuint>(mesh.vertices.size()));
+                    if (inserted.second) {
+                        mesh.vertices.push_back(MeshVertex{
+                                positions[corner[0]],
+                                corner[1] >= 0 ? texCoords[corner[1]] : QVector2D(),
+                                corner[2] >= 0 ? normals[corner[2]] : QVector3D()});
+                        positionOfVertex.push_back(corner[0]);
+                    }
+                    face.push_back(inserted.first->second);
+                }
+                for (std::size_t i = 2; i < face.size(); ++i) {
+                    mesh.indices.insert(mesh.indices.end(), {face[0], face[i - 1], face[i]});
+                }
+            }
+        }
+        if (mesh.indices.empty()) {
+            err << "No faces found\n";
+            return false;
+        }
+
+        if (!mesh.hasNormals) {
+            // Area-weighted face normals, shared by every vertex at the same position.
+            std::vector<QVector3D> accumulated(positions.size());
+            for (std::size_t i = 0; i < mesh.indices.size(); i += 3) {
+                const QVector3D &a = mesh.vertices[mesh.indices[i]].position;
+                const QVector3D &b = mesh.vertices[mesh.indices[i + 1]].position;
+                const QVector3D &c = mesh.vertices[mesh.indices[i + 2]].position;
+                const QVector3D &normal = QVector3D::crossProduct(b - a, c - a);
+                for (std::size_t corner = 0; corner < 3; ++corner) {
+                    accumulated[positionOfVertex[mesh.indices[i + corner]]] += normal;
+                }
+            }
+            for (std::size_t i = 0; i < mesh.vertices.size(); ++i) {
+                mesh.vertices[i].normal = accumulated[positionOfVertex[i]].normalized();
+            }
+        }
+        return true;
+    }
+
+    // Centers the mesh and scales its largest extent to 1, the size of the built-in cube.
+    void normalizeScale(std::vector<MeshVertex> &vertices) {
+        QVector3D low = vertices.front().position;
+        QVector3D high = low;
+        for (const auto &vertex : vertices) {
+            for (int axis = 0; axis < 3; ++axis) {
+                low[axis] = std::min(low[axis], vertex.position[axis]);
+                high[axis] = std::max(high[axis], vertex.position[axis]);
+            }
+        }
+        const QVector3D &center = (low + high) * 0.5f;
+        const QVector3D &extent = high - low;
+        const float size = std::max({extent.x(), extent.y(), extent.z()});
+        const float scale = size > 0.0f ? 1.0f / size : 1.0f;
+        for (auto &vertex : vertices) {
+            vertex.position = (vertex.position - center) * scale;
+        }
+    }
+
+    bool texCoordsInUnitRange(const std::vector<MeshVertex> &vertices) {
+        return std::all_of(vertices.cbegin(), vertices.cend(), [](const MeshVertex &vertex) {
+            return vertex.texCoord.x() >= 0.0f && vertex.texCoord.x() <= 1.0f
+                   && vertex.texCoord.y() >= 0.0f && vertex.texCoord.y() <= 1.0f;
+        });
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const QCoreApplication application(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("gltut2-meshconv"));
+    QCoreApplication::setApplicationVersion(QStringLiteral("1.0"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral(
+            "Converts a Wavefront OBJ file into a binary mesh with a chain of simplified levels of detail, "
+            "reordered for the post-transform vertex cache and for vertex fetch, and reports the ACMR "
+            "before and after."));
+    parser.addHelpOption();
+    parser.addVersionOption();
+    const QCommandLineOption layoutOption(QStringLiteral("vertex-layout"),
+                                          QStringLiteral("Vertex layout: full, half or compact."),
+                                          QStringLiteral("layout"), QStringLiteral("compact"));
+    parser.addOption(layoutOption);
+    const QCommandLineOption cacheSizeOption(QStringLiteral("cache-size"),
+                                             QStringLiteral("Post-transform cache entries to optimize and measure for."),
+                                             QStringLiteral("entries"), QStringLiteral("16"));
+    parser.addOption(cacheSizeOption);
+    const QCommandLineOption noOptimizeOption(QStringLiteral("no-optimize"),
+                                              QStringLiteral("Keep the triangle and vertex order of the source."));
+    parser.addOption(noOptimizeOption);
+    const QCommandLineOption keepScaleOption(QStringLiteral("keep-scale"),
+                                             QStringLiteral("Keep source units instead of fitting the mesh into a unit cube."));
+    parser.addOption(keepScaleOption);
+    const QCommandLineOption lodsOption(QStringLiteral("lods"),
+                                        QStringLiteral("Levels of detail to generate, including the source mesh."),
+                                        QStringLiteral("count"), QStringLiteral("5"));
+    parser.addOption(lodsOption);
+    const QCommandLineOption lodRatioOption(QStringLiteral("lod-ratio"),
+                                            QStringLiteral("Triangles kept by each level relative to the previous one."),
+                                            QStringLiteral("ratio"), QStringLiteral("0.5"));
+    parser.addOption(lodRatioOption);
+    parser.addPositionalArgument(QStringLiteral("input"), QStringLiteral("Source OBJ file."));
+    parser.addPositionalArgument(QStringLiteral("output"), QStringLiteral("Mesh file to write."));
+    parser.process(application);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    const QStringList &arguments = parser.positionalArguments();
+    if (arguments.size() != 2) {
+        parser.showHelp(1);
+    }
+    VertexLayout::Preset preset = VertexLayout::Compact;
+    if (!VertexLayout::fromName(parser.value(layoutOption), preset)) {
+        err << "Unknown vertex layout " << parser.value(layoutOption) << '\n';
+        return 1;
+    }
+    const int cacheSize = std::max(parser.value(cacheSizeOption).toInt(), 3);
+    const int maxLevels = MeshFile::maxLevels;
+    const auto lodCount = static_cast<std::size_t>(qBound(1, parser.value(lodsOption).toInt(), maxLevels));
+    const double lodRatio = qBound(0.05, parser.value(lodRatioOption).toDouble(), 0.95);
+
+    QElapsedTimer timer;
+    timer.start();
+    QFile input(arguments[0]);
+    if (!input.open(QIODevice::ReadOnly)) {
+        err << "Failed to open " << arguments[0] << ": " << input.errorString() << '\n';
+        return 1;
+    }
+    ObjMesh mesh;
+    if (!parseObj(input.readAll(), mesh, err)) {
+        return 1;
+    }
+    const qint64 parseNs = timer.nsecsElapsed();
+    if (!parser.isSet(keepScaleOption)) {
+        normalizeScale(mesh.vertices);
+    }
+    if (preset != VertexLayout::Full && !texCoordsInUnitRange(mesh.vertices)) {
+        err << "Texture coordinates leave [0, 1], using the full vertex layout\n";
+        preset = VertexLayout::Full;
+    }
+
+    QVector3D low = mesh.vertices.front().position;
+    QVector3D high = low;
+    for (const auto &vertex : mesh.vertices) {
+        for (int axis = 0; axis < 3; ++axis) {
+            low[axis] = std::min(low[axis], vertex.position[axis]);
+            high[axis] = std::max(high[axis], vertex.position[axis]);
+        }
+    }
+
+    // Every level is simplified from the one before, so its error adds to theirs. The chain stops
+    // early once seams and borders leave too little to collapse.
+    timer.start();
+    std::vector<std::vector<GLuint>> levelIndices{mesh.indices};
+    std::vector<float> levelErrors{0.0f};
+    while (levelIndices.size() < lodCount) {
+        const std::vector<GLuint> &previous = levelIndices.back();
+        const std::size_t target = static_cast<std::size_t>(previous.size() / 3 * lodRatio) * 3;
+        float error = 0.0f;
+        std::vector<GLuint> simplified = MeshSimplifier::simplify(mesh.vertices, previous, target, &error);
+        if (simplified.empty() || simplified.size() > previous.size() * 9 / 10) {
+            break;
+        }
+        levelErrors.push_back(levelErrors.back() + error);
+        levelIndices.push_back(std::move(simplified));
+    }
+    const qint64 simplifyNs = timer.nsecsElapsed();
+
+    const VertexLayout layout(preset);
+    const double acmrBefore = MeshOptimizer::acmr(mesh.indices, mesh.vertices.size(), cacheSize);
+    double acmrAfter = acmrBefore;
+    qint64 optimizeNs = 0;
+    std::vector<MeshFile::LevelSource> levels;
+    for (std::size_t level = 0; level < levelIndices.size(); ++level) {
+        // Coarser levels drop vertices, so they are always renumbered into a compact vertex buffer.
+        std::vector<MeshVertex> vertices(mesh.vertices);
+        std::vector<GLuint> &indices = levelIndices[level];
+        timer.start();
+        if (!parser.isSet(noOptimizeOption)) {
+            indices = MeshOptimizer::optimizeVertexCache(indices, vertices.size(), cacheSize);
+        }
+        if (!parser.isSet(noOptimizeOption) || level > 0) {
+            MeshOptimizer::optimizeVertexFetch(vertices, indices);
+        }
+        optimizeNs += timer.nsecsElapsed();
+        if (level == 0) {
+            acmrAfter = MeshOptimizer::acmr(indices, vertices.size(), cacheSize);
+        }
+        const GLfloat positionScale = levels.empty() ? 0.0f : levels.front().mesh.positionScale;
+        levels.push_back(MeshFile::LevelSource{
+                layout.pack(vertices.data(), vertices.size(), indices.data(), indices.size(), true, positionScale),
+                vertices.size(), levelErrors[level]});
+    }
+    if (!MeshFile::write(arguments[1], layout, levels, low, high)) {
+        return 1;
+    }
+
+    out.setRealNumberNotation(QTextStream::FixedNotation);
+    out.setRealNumberPrecision(3);
+    out << "vertices: " << static_cast<qulonglong>(levels.front().vertexCount) << "\n"
+        << "triangles: " << static_cast<qulonglong>(mesh.indices.size() / 3) << "\n"
+        << "vertex_layout: " << VertexLayout::presetName(preset) << "\n"
+        << "index_bits: " << (levels.front().mesh.indexType == GL_UNSIGNED_SHORT ? 16 : 32) << "\n"
+        << "parse_ms: " << static_cast<double>(parseNs) / 1e6 << "\n"
+        << "simplify_ms: " << static_cast<double>(simplifyNs) / 1e6 << "\n"
+        << "optimize_ms: " << static_cast<double>(optimizeNs) / 1e6 << "\n"
+        << "acmr_before: " << acmrBefore << "\n"
+        << "acmr_after: " << acmrAfter << "\n"
+        << "lod_levels: " << static_cast<qulonglong>(levels.size()) << "\n";
+    out.setRealNumberPrecision(5);
+    for (std::size_t level = 1; level < levels.size(); ++level) {
+        out << "lod_" << static_cast<qulonglong>(level) << "_triangles: " << levels[level].mesh.indexCount / 3
+            << " error: " << levels[level].error << "\n";
+    }
+    return 0;
+}
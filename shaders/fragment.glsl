@@ -1,12 +1,37 @@
 #version 450 core
+// ShaderVariants compiles a variant for each requested set of the features below, with their names defined.
+// Only sample the base layer, for materials whose mix resolves to 0.
+#pragma feature BASE_ONLY
+// Only sample the detail layer, for materials whose mix resolves to 1.
+#pragma feature DETAIL_ONLY
 out vec4 FragColor;
 
 in vec2 texCoord;
+flat in uint materialIndex;
 
-uniform sampler2D texture1;
-uniform sampler2D texture2;
+struct Material {
+    uint baseLayer;
+    uint detailLayer;
+    float detailMix;
+    float padding;
+    vec4 tint;
+};
+
+layout (std430, binding = 5) readonly buffer Materials { Material materials[]; };
+
+layout (binding = 0) uniform sampler2DArray materialTextures;
+// Shifts every material's detail mix; 0.5 keeps them as authored.
 uniform float mixBalance;
 
 void main() {
-    FragColor = mix(texture(texture1, texCoord), texture(texture2, texCoord), mixBalance);
+    Material m = materials[materialIndex];
+#if defined(BASE_ONLY)
+    FragColor = m.tint * texture(materialTextures, vec3(texCoord, m.baseLayer));
+#elif defined(DETAIL_ONLY)
+    FragColor = m.tint * texture(materialTextures, vec3(texCoord, m.detailLayer));
+#else
+    vec4 base = texture(materialTextures, vec3(texCoord, m.baseLayer));
+    vec4 detail = texture(materialTextures, vec3(texCoord, m.detailLayer));
+    FragColor = m.tint * mix(base, detail, clamp(m.detailMix + mixBalance - 0.5, 0.0, 1.0));
+#endif
 }
@@ -0,0 +1,8 @@
+#version 450 core
+// One triangle covering the viewport, positions and texture coordinates from gl_VertexID.
+out vec2 texCoord;
+
+void main() {
+    texCoord = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(texCoord * 2.0f - 1.0f, 0.0f, 1.0f);
+}
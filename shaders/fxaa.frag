@@ -0,0 +1,44 @@
+#version 450 core
+// FXAA (Lottes, 2009), the single pass variant without end-of-edge search: estimate the edge
+// direction from the luma of four diagonal neighbors and blur along it, falling back to the
+// narrower blur when the wide one picks up luma from across the edge. Reads the scene with
+// bilinear filtering, so it also scales the rendered region up to the output.
+out vec4 FragColor;
+
+in vec2 texCoord;
+
+uniform sampler2D scene;
+// Size of one scene texel and the corner of the rendered region, both in texture coordinates.
+uniform vec2 texelSize;
+uniform vec2 regionSize;
+
+const float spanMax = 8.0f;
+const float reduceMul = 1.0f / 8.0f;
+const float reduceMin = 1.0f / 128.0f;
+const vec3 lumaWeights = vec3(0.299f, 0.587f, 0.114f);
+
+vec3 fetch(vec2 uv) {
+    return texture(scene, clamp(uv, 0.5f * texelSize, regionSize - 0.5f * texelSize)).rgb;
+}
+
+void main() {
+    vec2 uv = texCoord * regionSize;
+    float lumaNW = dot(fetch(uv + vec2(-1.0f, -1.0f) * texelSize), lumaWeights);
+    float lumaNE = dot(fetch(uv + vec2(1.0f, -1.0f) * texelSize), lumaWeights);
+    float lumaSW = dot(fetch(uv + vec2(-1.0f, 1.0f) * texelSize), lumaWeights);
+    float lumaSE = dot(fetch(uv + vec2(1.0f, 1.0f) * texelSize), lumaWeights);
+    vec3 center = fetch(uv);
+    float lumaM = dot(center, lumaWeights);
+    float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+    float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+    vec2 direction = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), (lumaNW + lumaSW) - (lumaNE + lumaSE));
+    float reduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25f * reduceMul, reduceMin);
+    float scale = 1.0f / (min(abs(direction.x), abs(direction.y)) + reduce);
+    direction = clamp(direction * scale, vec2(-spanMax), vec2(spanMax)) * texelSize;
+
+    vec3 narrow = 0.5f * (fetch(uv + direction * (1.0f / 3.0f - 0.5f)) + fetch(uv + direction * (2.0f / 3.0f - 0.5f)));
+    vec3 wide = 0.5f * narrow + 0.25f * (fetch(uv - direction * 0.5f) + fetch(uv + direction * 0.5f));
+    float lumaWide = dot(wide, lumaWeights);
+    FragColor = vec4(lumaWide < lumaMin || lumaWide > lumaMax ? narrow : wide, 1.0f);
+}
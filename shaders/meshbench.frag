@@ -0,0 +1,9 @@
+#version 450 core
+out vec4 FragColor;
+
+in vec2 texCoord;
+in vec3 normal;
+
+void main() {
+    FragColor = vec4(normal * 0.5 + 0.5, texCoord.x);
+}
@@ -0,0 +1,25 @@
+#version 450 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 7) in vec3 aNormal;
+
+out vec2 texCoord;
+out vec3 normal;
+
+uniform mat4 transform;
+uniform float positionScale;
+uniform bool octahedralNormals;
+
+vec3 decodeOctahedral(vec2 encoded) {
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+void main() {
+    gl_Position = transform * vec4(aPos * positionScale, 1.0f);
+    texCoord = aTexCoord;
+    normal = octahedralNormals ? decodeOctahedral(aNormal.xy) : aNormal;
+}
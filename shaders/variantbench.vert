@@ -0,0 +1,11 @@
+#version 450 core
+// One triangle covering the viewport that tiles the material four times, for timing fragment variants.
+out vec2 texCoord;
+flat out uint materialIndex;
+
+void main() {
+    const vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    texCoord = corner * 4.0f;
+    materialIndex = 0u;
+    gl_Position = vec4(corner * 2.0f - 1.0f, 0.0f, 1.0f);
+}
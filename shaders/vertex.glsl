@@ -1,12 +1,31 @@
 #version 450 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in mat4 aModel;
+layout (location = 6) in uint aObject;
+
+layout (std430, binding = 0) readonly buffer ObjectModels { mat4 objectModels[]; };
+layout (std430, binding = 4) readonly buffer ObjectMaterials { uint objectMaterials[]; };
 
 out vec2 texCoord;
+flat out uint materialIndex;
 
-uniform mat4 transform;
+// Fixed locations keep the uniforms in the same place in every variant of the fragment shader.
+layout (location = 0) uniform mat4 transform;
+// Undoes the snorm16 normalisation of compact positions, 1 for the other layouts.
+layout (location = 1) uniform float positionScale;
+layout (location = 2) uniform bool instanced;
+layout (location = 3) uniform bool gpuDriven;
+// Per-object draws set the material directly, otherwise it is looked up by object index.
+layout (location = 4) uniform int material;
 
 void main() {
-    gl_Position = transform * vec4(aPos, 1.0f);
+    vec4 position = vec4(aPos * positionScale, 1.0f);
+    if (gpuDriven) {
+        gl_Position = transform * (objectModels[aObject] * position);
+    } else {
+        gl_Position = instanced ? transform * (aModel * position) : transform * position;
+    }
     texCoord = aTexCoord;
+    materialIndex = material >= 0 ? uint(material) : objectMaterials[aObject];
 }
@@ -0,0 +1,252 @@
+//
+// Created by maratik on 17.10.26.
+//
+
+#include "TextureFile.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QImage>
+#include <QTextStream>
+
+namespace {
+    typedef std::array<uchar, 4> Texel;
+    typedef std::array<Texel, 16> Block;
+
+    // Averages 2x2 texels; odd edges repeat their last row or column.
+    QImage downsample(const QImage &source) {
+        const int width = std::max(source.width() / 2, 1);
+        const int height = std::max(source.height() / 2, 1);
+        QImage result(width, height, QImage::Format_RGBA8888);
+        for (int y = 0; y < height; ++y) {
+            const uchar *row0 = source.constScanLine(std::min(2 * y, source.height() - 1));
+            const uchar *row1 = source.constScanLine(std::min(2 * y + 1, source.height() - 1));
+            uchar *target = result.scanLine(y);
+            for (int x = 0; x < width; ++x) {
+                const int x0 = std::min(2 * x, source.width() - 1) * 4;
+                const int x1 = std::min(2 * x + 1, source.width() - 1) * 4;
+                for (int channel = 0; channel < 4; ++channel) {
+                    const int sum = row0[x0 + channel] + row0[x1 + channel] + row1[x0 + channel] + row1[x1 + channel];
+                    target[x * 4 + channel] = static_cast<uchar>((sum + 2) / 4);
+                }
+            }
+        }
+        return result;
+    }
+
+    Block fetchBlock(const QImage &image, int blockX, int blockY) {
+        Block block{};
+        for (int y = 0; y < 4; ++y) {
+            const uchar *row = image.constScanLine(std::min(blockY * 4 + y, image.height() - 1));
+            for (int x = 0; x < 4; ++x) {
+                const uchar *texel = row + std::min(blockX * 4 + x, image.width() - 1) * 4;
+                std::copy_n(texel, 4, block[y * 4 + x].begin());
+            }
+        }
+        return block;
+    }
+
+    quint16 packRgb565(int r, int g, int b) {
+        return static_cast<quint16>(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+    }
+
+    Texel unpackRgb565(quint16 color) {
+        const int r = color >> 11 & 0x1f;
+        const int g = color >> 5 & 0x3f;
+        const int b = color & 0x1f;
+        return Texel{static_cast<uchar>(r << 3 | r >> 2), static_cast<uchar>(g << 2 | g >> 4),
+                     static_cast<uchar>(b << 3 | b >> 2), 0xff};
+    }
+
+    void putLittleEndian(uchar *target, quint64 value, int bytes) {
+        for (int i = 0; i < bytes; ++i) {
+            target[i] = static_cast<uchar>(value >> (8 * i));
+        }
+    }
+
+    // Four-color BC1 block from the color bounding box, inset by 1/16 to cut the error at the ends.
+    void encodeColor(const Block &block, uchar *target) {
+        std::array<int, 3> low{255, 255, 255};
+        std::array<int, 3> high{0, 0, 0};
+        for (const auto &texel : block) {
+            for (int channel = 0; channel < 3; ++channel) {
+                low[channel] = std::min<int>(low[channel], texel[channel]);
+                high[channel] = std::max<int>(high[channel], texel[channel]);
+            }
+        }
+        for (int channel = 0; channel < 3; ++channel) {
+            const int inset = (high[channel] - low[channel]) / 16;
+            low[channel] += inset;
+            high[channel] -= inset;
+        }
+        quint16 color0 = packRgb565(high[0], high[1], high[2]);
+        quint16 color1 = packRgb565(low[0], low[1], low[2]);
+        if (color0 < color1) {
+            std::swap(color0, color1);
+        }
+        putLittleEndian(target, color0, 2);
+        putLittleEndian(target + 2, color1, 2);
+        if (color0 == color1) {
+            putLittleEndian(target + 4, 0, 4);
+            return;
+        }
+
+        std::array<Texel, 4> palette{unpackRgb565(color0), unpackRgb565(color1), Texel{}, Texel{}};
+        for (int channel = 0; channel < 3; ++channel) {
+            palette[2][channel] = static_cast<uchar>((2 * palette[0][channel] + palette[1][channel] + 1) / 3);
+            palette[3][channel] = static_cast<uchar>((palette[0][channel] + 2 * palette[1][channel] + 1) / 3);
+        }
+        quint32 indices = 0;
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            int bestError = std::numeric_limits<int>::max();
+            for (int entry = 0; entry < 4; ++entry) {
+                int error = 0;
+                for (int channel = 0; channel < 3; ++channel) {
+                    const int delta = block[i][channel] - palette[entry][channel];
+                    error += delta * delta;
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    best = entry;
+                }
+            }
+            indices |= static_cast<quint32>(best) << (2 * i);
+        }
+        putLittleEndian(target + 4, indices, 4);
+    }
+
+    // Eight-value BC3 alpha block between the block's alpha extremes.
+    void encodeAlpha(const Block &block, uchar *target) {
+        int alpha0 = 0;
+        int alpha1 = 255;
+        for (const auto &texel : block) {
+            alpha0 = std::max<int>(alpha0, texel[3]);
+            alpha1 = std::min<int>(alpha1, texel[3]);
+        }
+        target[0] = static_cast<uchar>(alpha0);
+        target[1] = static_cast<uchar>(alpha1);
+        if (alpha0 == alpha1) {
+            putLittleEndian(target + 2, 0, 6);
+            return;
+        }
+        std::array<int, 8> palette{alpha0, alpha1};
+        for (int entry = 2; entry < 8; ++entry) {
+            palette[entry] = ((8 - entry) * alpha0 + (entry - 1) * alpha1 + 3) / 7;
+        }
+        quint64 indices = 0;
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            for (int entry = 1; entry < 8; ++entry) {
+                if (std::abs(block[i][3] - palette[entry]) < std::abs(block[i][3] - palette[best])) {
+                    best = entry;
+                }
+            }
+            indices |= static_cast<quint64>(best) << (3 * i);
+        }
+        putLittleEndian(target + 2, indices, 6);
+    }
+
+    QByteArray encodeLevel(const QImage &image, TextureFile::Format format) {
+        QByteArray data(static_cast<int>(TextureFile::levelSize(format, image.width(), image.height())), '\0');
+        auto *target = reinterpret_cast<uchar *>(data.data());
+        if (format == TextureFile::Rgba8) {
+            for (int y = 0; y < image.height(); ++y) {
+                std::memcpy(target + y * image.width() * 4, image.constScanLine(y), static_cast<std::size_t>(image.width()) * 4);
+            }
+            return data;
+        }
+        const int blockBytes = format == TextureFile::Bc1 ? 8 : 16;
+        for (int blockY = 0; blockY < (image.height() + 3) / 4; ++blockY) {
+            for (int blockX = 0; blockX < (image.width() + 3) / 4; ++blockX) {
+                const Block &block = fetchBlock(image, blockX, blockY);
+                if (format == TextureFile::Bc3) {
+                    encodeAlpha(block, target);
+                }
+                encodeColor(block, target + blockBytes - 8);
+                target += blockBytes;
+            }
+        }
+        return data;
+    }
+
+    bool parseFormat(const QString &name, TextureFile::Format &format) {
+        if (name == QStringLiteral("rgba8")) {
+            format = TextureFile::Rgba8;
+        } else if (name == QStringLiteral("bc1")) {
+            format = TextureFile::Bc1;
+        } else if (name == QStringLiteral("bc3")) {
+            format = TextureFile::Bc3;
+        } else {
+            return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const QCoreApplication application(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("gltut2-texconv"));
+    QCoreApplication::setApplicationVersion(QStringLiteral("1.0"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral(
+            "Converts an image into a KTX2-style texture with a full, precomputed mip chain, "
+            "flipped to OpenGL's bottom-up row order."));
+    parser.addHelpOption();
+    parser.addVersionOption();
+    const QCommandLineOption formatOption(QStringLiteral("format"),
+                                          QStringLiteral("rgba8, bc1 or bc3; bc3 for images with alpha, bc1 otherwise by default."),
+                                          QStringLiteral("format"));
+    parser.addOption(formatOption);
+    const QCommandLineOption sizeOption(QStringLiteral("size"), QStringLiteral("Resize to WIDTHxHEIGHT first."),
+                                        QStringLiteral("size"));
+    parser.addOption(sizeOption);
+    parser.addPositionalArgument(QStringLiteral("input"), QStringLiteral("Source image."));
+    parser.addPositionalArgument(QStringLiteral("output"), QStringLiteral("Texture file to write."));
+    parser.process(application);
+
+    QTextStream err(stderr);
+    const QStringList &arguments = parser.positionalArguments();
+    if (arguments.size() != 2) {
+        parser.showHelp(1);
+    }
+
+    QImage image(arguments[0]);
+    if (Q_UNLIKELY(image.isNull())) {
+        err << "Failed to read " << arguments[0] << '\n';
+        return 1;
+    }
+    TextureFile::Format format = image.hasAlphaChannel() ? TextureFile::Bc3 : TextureFile::Bc1;
+    if (parser.isSet(formatOption) && !parseFormat(parser.value(formatOption), format)) {
+        err << "Unknown format " << parser.value(formatOption) << '\n';
+        return 1;
+    }
+    if (parser.isSet(sizeOption)) {
+        const QStringList &size = parser.value(sizeOption).split(QLatin1Char('x'));
+        const int width = size.value(0).toInt();
+        const int height = size.value(1).toInt();
+        if (Q_UNLIKELY(size.size() != 2 || width <= 0 || height <= 0)) {
+            err << "Invalid size " << parser.value(sizeOption) << '\n';
+            return 1;
+        }
+        image = image.scaled(QSize(width, height), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    image = image.mirrored().convertToFormat(QImage::Format_RGBA8888);
+
+    const QSize size = image.size();
+    std::vector<QByteArray> levels;
+    while (true) {
+        levels.push_back(encodeLevel(image, format));
+        if (image.width() == 1 && image.height() == 1) {
+            break;
+        }
+        image = downsample(image);
+    }
+    return TextureFile::write(arguments[1], format, size, levels) ? 0 : 1;
+}